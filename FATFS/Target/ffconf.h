@@ -34,7 +34,7 @@
 /* This option switches f_mkfs() function. (0:Disable or 1:Enable) */
 
 
-#define FF_USE_FASTSEEK	0
+#define FF_USE_FASTSEEK	1
 /* This option switches fast seek function. (0:Disable or 1:Enable) */
 
 
@@ -113,7 +113,7 @@
 */
 
 
-#define FF_USE_LFN		1
+#define FF_USE_LFN		2	/* Stack buffer, the static one cannot be used with FF_FS_REENTRANT */
 #define FF_MAX_LFN		255
 /* The FF_USE_LFN switches the support for LFN (long file name).
 /
@@ -276,9 +276,16 @@
 
 
 /* #include <somertos.h>	// O/S definitions */
+#if !defined(OVERRIDE_MY_MACHINE) && !defined(__DRIVER_H__)
+#include "my_machine.h"	/* for ETHERNET_ENABLE and ETHERNET_RX_IRQ */
+#endif
+#if ETHERNET_ENABLE && ETHERNET_RX_IRQ
+#define FF_FS_REENTRANT	1	/* The network file services call FatFs from PendSV, see ffsystem.c */
+#else
 #define FF_FS_REENTRANT	0
+#endif
 #define FF_FS_TIMEOUT	1000
-#define FF_SYNC_t		HANDLE
+#define FF_SYNC_t		int
 /* The option FF_FS_REENTRANT switches the re-entrancy (thread safe) of the FatFs
 /  module itself. Note that regardless of this option, file access to different
 /  volume is always re-entrant and volume control functions, f_mount(), f_mkfs()
@@ -22,6 +22,9 @@
 
 /* USER CODE BEGIN firstSection */
 /* can be used to modify / undefine following code or add new definitions */
+
+#include "driver.h"
+
 /* USER CODE END firstSection*/
 
 /* Includes ------------------------------------------------------------------*/
@@ -76,7 +79,7 @@
 /* Private variables ---------------------------------------------------------*/
 #if defined(ENABLE_SCRATCH_BUFFER)
 /* Scratch buffer is 32-Byte aligned for cache maintenance */
-ALIGN_32BYTES(static uint8_t scratch[BLOCKSIZE]);
+ALIGN_32BYTES(static uint8_t scratch[SD_SCRATCH_BLOCKS * BLOCKSIZE]);
 #endif
 /* Disk status */
 static volatile DSTATUS Stat = STA_NOINIT;
@@ -105,6 +108,24 @@ const Diskio_drvTypeDef  SD_Driver =
 
 /* USER CODE BEGIN beforeFunctionSection */
 /* can be used to modify / undefine following code or add new code */
+
+#if SDCARD_READAHEAD
+static bool ra_wait(void);
+static bool ra_active(void);
+static void ra_reset(void);
+#endif
+
+#if SDCARD_WRITEBEHIND
+extern SD_HandleTypeDef hsd1;
+
+static void wb_wait(void);
+static bool wb_active(void);
+static void wb_flush(BYTE lun);
+static bool wb_sync(void);
+static bool wb_read_check(DWORD sector, UINT count);
+static bool wb_write(const BYTE *buff, DWORD sector, UINT count, DRESULT *res);
+#endif
+
 /* USER CODE END beforeFunctionSection */
 
 /* Private functions ---------------------------------------------------------*/
@@ -128,7 +149,14 @@ static DSTATUS SD_CheckStatus(BYTE lun)
 {
   Stat = STA_NOINIT;
 
+#if SDCARD_WRITEBEHIND
+  /* The card may still be programming sectors written in the background */
+  HAL_SD_CardStateTypeDef state = HAL_SD_GetCardState(&hsd1);
+
+  if(state == HAL_SD_CARD_TRANSFER || state == HAL_SD_CARD_PROGRAMMING)
+#else
   if(BSP_SD_GetCardState() == MSD_OK)
+#endif
   {
     Stat &= ~STA_NOINIT;
   }
@@ -144,6 +172,14 @@ static DSTATUS SD_CheckStatus(BYTE lun)
 DSTATUS SD_initialize(BYTE lun)
 {
 
+#if SDCARD_READAHEAD
+  ra_wait();
+#endif
+
+#if SDCARD_WRITEBEHIND
+  wb_flush(lun);
+#endif
+
 #if !defined(DISABLE_SD_INIT)
 
   if(BSP_SD_Init() == MSD_OK)
@@ -155,6 +191,10 @@ DSTATUS SD_initialize(BYTE lun)
   Stat = SD_CheckStatus(lun);
 #endif
 
+#if SDCARD_READAHEAD
+  ra_reset();
+#endif
+
   return Stat;
 }
 
@@ -165,11 +205,242 @@ DSTATUS SD_initialize(BYTE lun)
   */
 DSTATUS SD_status(BYTE lun)
 {
+#if SDCARD_READAHEAD
+  /* The card is not asked while a background load is active, it would report busy */
+  if (ra_active())
+  {
+    return Stat;
+  }
+#endif
+
+#if SDCARD_WRITEBEHIND
+  /* Nor while a background write is active */
+  if (wb_active())
+  {
+    return Stat;
+  }
+#endif
+
   return SD_CheckStatus(lun);
 }
 
 /* USER CODE BEGIN beforeReadSection */
 /* can be used to modify previous code / undefine following code / add new code */
+
+#if SDCARD_READAHEAD
+
+/*
+ * Read-ahead cache, reads of up to SD_READAHEAD_BLOCKS sectors are served from
+ * SD_READAHEAD_BUFFERS buffers of SD_READAHEAD_BLOCKS sectors each, loaded by multi-block
+ * DMA transfers. When a read hits the second half of a buffer the following sectors are
+ * loaded in the background, sequential reads such as streaming a G-code file then
+ * normally do not wait for the card.
+ * Buffers are replaced on a least recently used basis and dropped when written to.
+ * Only one transfer can be active, a pending load is completed before any other access.
+ */
+
+typedef enum {
+  RA_Empty = 0,
+  RA_Loading,
+  RA_Valid
+} ra_state_t;
+
+typedef struct {
+  ra_state_t state;
+  DWORD sector;
+  uint32_t used;
+  uint8_t *data;
+} ra_buffer_t;
+
+/* In AXI SRAM, 32-Byte aligned for cache maintenance */
+ALIGN_32BYTES(static uint8_t ra_data[SD_READAHEAD_BUFFERS][SD_READAHEAD_BLOCKS * BLOCKSIZE]);
+static ra_buffer_t ra_buf[SD_READAHEAD_BUFFERS];
+static ra_buffer_t *ra_loading = NULL;
+static uint32_t ra_clock = 0;
+static DWORD ra_sectors = 0;
+static volatile bool ra_error = false;
+
+static void ra_reset(void)
+{
+  uint32_t i;
+  BSP_SD_CardInfo CardInfo;
+
+  for (i = 0; i < SD_READAHEAD_BUFFERS; i++)
+  {
+    ra_buf[i].state = RA_Empty;
+    ra_buf[i].data = ra_data[i];
+  }
+
+  BSP_SD_GetCardInfo(&CardInfo);
+  ra_sectors = CardInfo.LogBlockNbr;
+}
+
+/* Completes a pending background load, returns false on failure. */
+static bool ra_wait(void)
+{
+  bool ok = true;
+
+  if (ra_loading)
+  {
+    uint32_t timeout = HAL_GetTick();
+
+    while((ReadStatus == 0) && !ra_error && ((HAL_GetTick() - timeout) < SD_TIMEOUT))
+    {
+    }
+
+    if ((ok = ReadStatus == 1 && SD_CheckStatusWithTimeout(SD_TIMEOUT) == 0))
+    {
+#if (ENABLE_SD_DMA_CACHE_MAINTENANCE == 1)
+      SCB_InvalidateDCache_by_Addr((uint32_t*)ra_loading->data, SD_READAHEAD_BLOCKS * BLOCKSIZE);
+#endif
+      ra_loading->state = RA_Valid;
+    }
+    else
+      ra_loading->state = RA_Empty;
+
+    ReadStatus = 0;
+    ra_loading = NULL;
+  }
+
+  return ok;
+}
+
+/* Returns true while a background load is active. */
+static bool ra_active(void)
+{
+  return ra_loading != NULL;
+}
+
+/* Starts loading a buffer, the load is completed by ra_wait(). */
+static bool ra_start(ra_buffer_t *buf, DWORD sector)
+{
+  if (sector + SD_READAHEAD_BLOCKS > ra_sectors)
+    sector = ra_sectors - SD_READAHEAD_BLOCKS;
+
+  buf->state = RA_Loading;
+  buf->sector = sector;
+  buf->used = ra_clock;
+  ReadStatus = 0;
+  ra_error = false;
+
+  if (SD_CheckStatusWithTimeout(SD_TIMEOUT) == 0 &&
+       BSP_SD_ReadBlocks_DMA((uint32_t*)buf->data, (uint32_t)sector, SD_READAHEAD_BLOCKS) == MSD_OK)
+  {
+    ra_loading = buf;
+    return true;
+  }
+
+  buf->state = RA_Empty;
+
+  return false;
+}
+
+static ra_buffer_t *ra_find(DWORD sector)
+{
+  uint32_t i;
+
+  for (i = 0; i < SD_READAHEAD_BUFFERS; i++)
+  {
+    if (ra_buf[i].state != RA_Empty && sector >= ra_buf[i].sector && sector < ra_buf[i].sector + SD_READAHEAD_BLOCKS)
+      return &ra_buf[i];
+  }
+
+  return NULL;
+}
+
+/* Returns an empty or the least recently used buffer, other than keep. */
+static ra_buffer_t *ra_victim(ra_buffer_t *keep)
+{
+  uint32_t i;
+  ra_buffer_t *buf = NULL;
+
+  for (i = 0; i < SD_READAHEAD_BUFFERS; i++)
+  {
+    if (&ra_buf[i] == keep)
+      continue;
+    if (ra_buf[i].state == RA_Empty)
+      return &ra_buf[i];
+    if (buf == NULL || ra_buf[i].used < buf->used)
+      buf = &ra_buf[i];
+  }
+
+  return buf;
+}
+
+/* Drops buffers overlapping the sectors written. */
+static void ra_invalidate(DWORD sector, UINT count)
+{
+  uint32_t i;
+
+  ra_wait();
+
+  for (i = 0; i < SD_READAHEAD_BUFFERS; i++)
+  {
+    if (ra_buf[i].state == RA_Valid && sector < ra_buf[i].sector + SD_READAHEAD_BLOCKS && sector + count > ra_buf[i].sector)
+      ra_buf[i].state = RA_Empty;
+  }
+}
+
+/* Returns false if the read is not handled, e.g. as it is too large, res is then not set. */
+static bool ra_read(BYTE *buff, DWORD sector, UINT count, DRESULT *res)
+{
+  UINT n;
+  ra_buffer_t *buf = NULL;
+
+  if (count > SD_READAHEAD_BLOCKS || ra_sectors < SD_READAHEAD_BLOCKS ||
+       (uint32_t)ra_data < D1_AXISRAM_BASE || (uint32_t)ra_data >= D2_AHBSRAM_BASE)
+  {
+    ra_wait();
+    return false;
+  }
+
+  *res = RES_OK;
+  ra_clock++;
+
+  while (count)
+  {
+    if ((buf = ra_find(sector)) && buf->state == RA_Loading)
+    {
+      if (!ra_wait())
+        buf = NULL;
+    }
+
+    if (buf == NULL)
+    {
+      ra_wait();
+      buf = ra_victim(NULL);
+      if (!(ra_start(buf, sector) && ra_wait()))
+      {
+        *res = RES_ERROR;
+        return true;
+      }
+    }
+
+    n = buf->sector + SD_READAHEAD_BLOCKS - sector;
+    if (n > count)
+      n = count;
+
+    memcpy(buff, buf->data + (sector - buf->sector) * BLOCKSIZE, n * BLOCKSIZE);
+    buf->used = ra_clock;
+    buff += n * BLOCKSIZE;
+    sector += n;
+    count -= n;
+  }
+
+  /* Read ahead if the second half of a buffer is reached. */
+  if (ra_loading == NULL && sector - buf->sector >= SD_READAHEAD_BLOCKS / 2)
+  {
+    DWORD next = buf->sector + SD_READAHEAD_BLOCKS;
+
+    if (next + SD_READAHEAD_BLOCKS <= ra_sectors && ra_find(next) == NULL)
+      ra_start(ra_victim(buf), next);
+  }
+
+  return true;
+}
+
+#endif /* SDCARD_READAHEAD */
+
 /* USER CODE END beforeReadSection */
 /**
   * @brief  Reads Sector(s)
@@ -192,6 +463,20 @@ DRESULT SD_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
   uint32_t alignedLength = count*BLOCKSIZE + ((uint32_t)buff - alignedAddr);
 #endif
 
+#if SDCARD_WRITEBEHIND
+  if (!wb_read_check(sector, count))
+  {
+    return res;
+  }
+#endif
+
+#if SDCARD_READAHEAD
+  if (ra_read(buff, sector, count, &res))
+  {
+    return res;
+  }
+#endif
+
   /*
   * ensure the SDCard is ready for a new operation
   */
@@ -285,11 +570,12 @@ DRESULT SD_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
   }
     else
     {
-      /* Slow path, fetch each sector a part and memcpy to destination buffer */
-      int i;
+      /* Slow path, fetch up to SD_SCRATCH_BLOCKS sectors at a time and memcpy to destination buffer */
+      UINT i, n;
 
-      for (i = 0; i < count; i++) {
-        ret = BSP_SD_ReadBlocks_DMA((uint32_t*)scratch, (uint32_t)sector++, 1);
+      for (i = 0; i < count; i += n) {
+        n = count - i > SD_SCRATCH_BLOCKS ? SD_SCRATCH_BLOCKS : count - i;
+        ret = BSP_SD_ReadBlocks_DMA((uint32_t*)scratch, (uint32_t)sector, n);
 
         if (ret == MSD_OK) {
           /* wait until the read is successful or a timeout occurs */
@@ -304,16 +590,23 @@ DRESULT SD_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
             break;
           }
           ReadStatus = 0;
+          sector += n;
+
+          if (SD_CheckStatusWithTimeout(SD_TIMEOUT) < 0)
+          {
+            res = RES_ERROR;
+            break;
+          }
 
 #if (ENABLE_SD_DMA_CACHE_MAINTENANCE == 1)
           /*
           *
           * SCratch buffer is always 32 byte aligned, so safe to invalidate without cleaning first
           */
-          SCB_InvalidateDCache_by_Addr((uint32_t*)scratch, BLOCKSIZE);
+          SCB_InvalidateDCache_by_Addr((uint32_t*)scratch, n * BLOCKSIZE);
 #endif
-          memcpy(buff, scratch, BLOCKSIZE);
-          buff += BLOCKSIZE;
+          memcpy(buff, scratch, n * BLOCKSIZE);
+          buff += n * BLOCKSIZE;
         }
         else
         {
@@ -331,6 +624,268 @@ DRESULT SD_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
 
 /* USER CODE BEGIN beforeWriteSection */
 /* can be used to modify previous code / undefine following code / add new code */
+
+#if SDCARD_WRITEBEHIND
+
+/*
+ * Write-behind queue, writes of up to SD_WRITEBEHIND_BLOCKS / 2 sectors are copied to a ring
+ * of SD_WRITEBEHIND_BLOCKS sectors and SD_write() returns without waiting for the card.
+ * The queue is written by SD_WriteBehindPoll(), called from the foreground process, by
+ * multi-block DMA transfers of consecutive sectors ending at SD_WRITEBEHIND_RUN aligned
+ * sector numbers. Writing starts when SD_WRITEBEHIND_RUN sectors are queued or when the
+ * oldest has been queued for SD_WRITEBEHIND_DELAY ms, and is not started while the card is busy.
+ * SD_write() only waits for the card when the queue is full.
+ *
+ * Sectors are written in the order they were queued, so the card sees the writes in the same
+ * order as FatFs issued them, e.g. file data before the FAT and directory entry updates.
+ * CTRL_SYNC, issued by f_sync() and f_close(), waits until the queue is written and the card
+ * is done programming, and returns any error from background writes.
+ * Reads of queued sectors write the queue first, any read waits for an active write.
+ */
+
+typedef enum {
+  WB_Idle = 0,
+  WB_Writing
+} wb_state_t;
+
+/* In AXI SRAM, 32-Byte aligned for cache maintenance */
+ALIGN_32BYTES(static uint8_t wb_data[SD_WRITEBEHIND_BLOCKS][BLOCKSIZE]);
+static DWORD wb_sector[SD_WRITEBEHIND_BLOCKS];
+static uint32_t wb_head = 0, wb_tail = 0, wb_count = 0; /* next free slot, oldest queued and number queued */
+static uint32_t wb_run = 0;                             /* number of sectors in the active transfer */
+static uint32_t wb_queued = 0, wb_started = 0;          /* ms, time of first queued sector and of transfer start */
+static wb_state_t wb_state = WB_Idle;
+static volatile bool wb_error = false;
+static bool wb_failed = false;
+
+static void wb_reset(void)
+{
+  wb_head = wb_tail = wb_count = 0;
+  wb_state = WB_Idle;
+}
+
+/* Drops the queue, the error is returned by the next write or sync. */
+static void wb_fail(void)
+{
+  wb_reset();
+  wb_failed = true;
+}
+
+/* Advances the queue without blocking, completes a finished transfer and starts the next if due. */
+static void wb_step(bool flush)
+{
+  uint32_t n;
+  DWORD sector;
+
+  if (wb_state == WB_Writing)
+  {
+    if (WriteStatus == 0 && !wb_error)
+    {
+      if ((HAL_GetTick() - wb_started) < SD_TIMEOUT)
+      {
+        return;
+      }
+      HAL_SD_Abort(&hsd1);
+    }
+
+    if (WriteStatus == 0 || wb_error)
+    {
+      WriteStatus = 0;
+      wb_fail();
+      return;
+    }
+
+    WriteStatus = 0;
+    wb_state = WB_Idle;
+    wb_tail = (wb_tail + wb_run) % SD_WRITEBEHIND_BLOCKS;
+    wb_count -= wb_run;
+  }
+
+  if (wb_count == 0 ||
+      !(flush || wb_count >= SD_WRITEBEHIND_RUN || (HAL_GetTick() - wb_queued) >= SD_WRITEBEHIND_DELAY) ||
+       HAL_SD_GetState(&hsd1) != HAL_SD_STATE_READY || BSP_SD_GetCardState() != SD_TRANSFER_OK)
+  {
+    return;
+  }
+
+  /* Consecutive sectors, not wrapping around the ring and ending at an aligned sector number */
+  sector = wb_sector[wb_tail];
+  n = 1;
+  while (n < wb_count && wb_tail + n < SD_WRITEBEHIND_BLOCKS &&
+          (sector + n) % SD_WRITEBEHIND_RUN && wb_sector[wb_tail + n] == sector + n)
+  {
+    n++;
+  }
+
+#if SDCARD_READAHEAD
+  /* Sectors loaded ahead after being queued are stale */
+  ra_invalidate(sector, n);
+#endif
+#if (ENABLE_SD_DMA_CACHE_MAINTENANCE == 1)
+  SCB_CleanDCache_by_Addr((uint32_t*)wb_data[wb_tail], n * BLOCKSIZE);
+#endif
+
+  WriteStatus = 0;
+  wb_error = false;
+
+  if (BSP_SD_WriteBlocks_DMA((uint32_t*)wb_data[wb_tail], (uint32_t)sector, n) == MSD_OK)
+  {
+    wb_run = n;
+    wb_started = HAL_GetTick();
+    wb_state = WB_Writing;
+  }
+  else
+  {
+    wb_fail();
+  }
+}
+
+/* Writes queued sectors until no more than count remains, returns false on failure. */
+static bool wb_drain(uint32_t count)
+{
+  uint32_t timeout = HAL_GetTick(), queued = wb_count;
+
+  while (wb_count > count)
+  {
+    wb_step(true);
+
+    if (wb_count != queued)
+    {
+      queued = wb_count;
+      timeout = HAL_GetTick();
+    }
+    else if ((HAL_GetTick() - timeout) >= SD_TIMEOUT)
+    {
+      wb_fail();
+    }
+  }
+
+  return !wb_failed;
+}
+
+/* Returns true while a background transfer is active. */
+static bool wb_active(void)
+{
+  return wb_state == WB_Writing;
+}
+
+/* Completes an active transfer. */
+static void wb_wait(void)
+{
+  while (wb_state == WB_Writing)
+  {
+    wb_step(false);
+  }
+}
+
+/*
+ * Writes the queue before the card is initialized again if it still responds. If not it may
+ * have been replaced, the queue is then dropped and the loss reported by the next sync.
+ */
+static void wb_flush(BYTE lun)
+{
+  wb_wait();
+
+  if (wb_count && !(SD_CheckStatus(lun) & STA_NOINIT))
+  {
+    wb_drain(0);
+  }
+
+  if (wb_count)
+  {
+    wb_fail();
+  }
+}
+
+/* Writes the queue and waits for the card, returns false if any write failed since the last sync. */
+static bool wb_sync(void)
+{
+  bool ok = wb_drain(0) && SD_CheckStatusWithTimeout(SD_TIMEOUT) == 0 && !wb_failed;
+
+  wb_failed = false;
+
+  return ok;
+}
+
+/* Waits for an active transfer and writes the queue if it holds any of the sectors to be read. */
+static bool wb_read_check(DWORD sector, UINT count)
+{
+  uint32_t i;
+
+  wb_wait();
+
+  for (i = 0; i < wb_count; i++)
+  {
+    DWORD queued = wb_sector[(wb_tail + i) % SD_WRITEBEHIND_BLOCKS];
+    if (queued >= sector && queued < sector + count)
+    {
+      return wb_drain(0);
+    }
+  }
+
+  return true;
+}
+
+/* Returns false if the write is not queued as it is too large, res is then not set. */
+static bool wb_write(const BYTE *buff, DWORD sector, UINT count, DRESULT *res)
+{
+  if (count > SD_WRITEBEHIND_BLOCKS / 2 ||
+       (uint32_t)wb_data < D1_AXISRAM_BASE || (uint32_t)wb_data >= D2_AHBSRAM_BASE)
+  {
+    /* Written directly, after the queue to keep the order */
+    *res = RES_ERROR;
+    return !wb_drain(0);
+  }
+
+  if (wb_failed || (wb_count + count > SD_WRITEBEHIND_BLOCKS && !wb_drain(SD_WRITEBEHIND_BLOCKS - count)))
+  {
+    *res = RES_ERROR;
+    return true;
+  }
+
+  if (wb_count == 0)
+  {
+    wb_queued = HAL_GetTick();
+  }
+
+  while (count--)
+  {
+    memcpy(wb_data[wb_head], buff, BLOCKSIZE);
+    wb_sector[wb_head] = sector++;
+    wb_head = (wb_head + 1) % SD_WRITEBEHIND_BLOCKS;
+    wb_count++;
+    buff += BLOCKSIZE;
+  }
+
+  wb_step(false);
+
+  *res = RES_OK;
+
+  return true;
+}
+
+/*
+ * Called from the foreground process, see sdmmc.c. The FatFs grant keeps the file services
+ * serviced from PendSV (ETHERNET_RX_IRQ) out while the queue is advanced, see ffsystem.c.
+ */
+void SD_WriteBehindPoll(void)
+{
+#if FF_FS_REENTRANT
+  ff_req_grant(0);
+#endif
+
+  if (wb_count || wb_active())
+  {
+    wb_step(false);
+  }
+
+#if FF_FS_REENTRANT
+  ff_rel_grant(0);
+#endif
+}
+
+#endif /* SDCARD_WRITEBEHIND */
+
 /* USER CODE END beforeWriteSection */
 /**
   * @brief  Writes Sector(s)
@@ -348,7 +903,18 @@ DRESULT SD_write(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
   uint32_t timeout;
 #if defined(ENABLE_SCRATCH_BUFFER)
   uint8_t ret = MSD_OK;
-  int i;
+  UINT i, n;
+#endif
+
+#if SDCARD_READAHEAD
+  ra_invalidate(sector, count);
+#endif
+
+#if SDCARD_WRITEBEHIND
+  if (wb_write(buff, sector, count, &res))
+  {
+    return res;
+  }
 #endif
 
   WriteStatus = 0;
@@ -416,20 +982,22 @@ DRESULT SD_write(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
   }
     else
     {
-      /* Slow path, fetch each sector a part and memcpy to destination buffer */
+      /* Slow path, memcpy up to SD_SCRATCH_BLOCKS sectors at a time to the scratch buffer and write from there */
 
-      for (i = 0; i < count; i++)
+      for (i = 0; i < count; i += n)
       {
         WriteStatus = 0;
+        n = count - i > SD_SCRATCH_BLOCKS ? SD_SCRATCH_BLOCKS : count - i;
 
-        memcpy((void *)scratch, (void *)buff, BLOCKSIZE);
-        buff += BLOCKSIZE;
+        memcpy((void *)scratch, (void *)buff, n * BLOCKSIZE);
+        buff += n * BLOCKSIZE;
 
 #if (ENABLE_SD_DMA_CACHE_MAINTENANCE == 1)
         /* Clean the scratch buffer before DMA write (will flush any cached data to RAM) */
-        SCB_CleanDCache_by_Addr((uint32_t*)scratch, BLOCKSIZE);
+        SCB_CleanDCache_by_Addr((uint32_t*)scratch, n * BLOCKSIZE);
 #endif
-        ret = BSP_SD_WriteBlocks_DMA((uint32_t*)scratch, (uint32_t)sector++, 1);
+        ret = BSP_SD_WriteBlocks_DMA((uint32_t*)scratch, (uint32_t)sector, n);
+        sector += n;
         if (ret == MSD_OK) {
           /* wait for a message from the queue or a timeout */
           timeout = HAL_GetTick();
@@ -440,6 +1008,12 @@ DRESULT SD_write(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
           {
             break;
           }
+          /* the card is busy programming, wait for it to return to the transfer state before the next write */
+          if (SD_CheckStatusWithTimeout(SD_TIMEOUT) < 0)
+          {
+            ret = MSD_ERROR;
+            break;
+          }
 
         }
         else
@@ -476,7 +1050,11 @@ DRESULT SD_ioctl(BYTE lun, BYTE cmd, void *buff)
   {
   /* Make sure that no pending write process */
   case CTRL_SYNC :
+#if SDCARD_WRITEBEHIND
+    res = wb_sync() ? RES_OK : RES_ERROR;
+#else
     res = RES_OK;
+#endif
     break;
 
   /* Get number of sectors on the disk (DWORD) */
@@ -513,6 +1091,22 @@ DRESULT SD_ioctl(BYTE lun, BYTE cmd, void *buff)
 
 /* USER CODE BEGIN callbackSection */
 /* can be used to modify / following code or add new code */
+
+#if SDCARD_READAHEAD || SDCARD_WRITEBEHIND
+
+/* Flags transfer errors so a pending transfer does not wait for the full timeout. */
+void HAL_SD_ErrorCallback(SD_HandleTypeDef *hsd)
+{
+#if SDCARD_READAHEAD
+  ra_error = true;
+#endif
+#if SDCARD_WRITEBEHIND
+  wb_error = true;
+#endif
+}
+
+#endif
+
 /* USER CODE END callbackSection */
 /**
   * @brief Tx Transfer completed callbacks
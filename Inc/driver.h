@@ -65,6 +65,8 @@
 #define timercr2ois(c, n) TIM_CR2_OIS ## c ## n
 #define timerAF(t, f) timeraf(t, f)
 #define timeraf(t, f) GPIO_AF ## f ## _TIM ## t
+#define timerDMAREQ(t, r) timerdmareq(t, r)
+#define timerdmareq(t, r) DMA_REQUEST_TIM ## t ## _ ## r
 #define usart(t) usartN(t)
 #define usartN(t) USART ## t
 #define usartINT(t) usartint(t)
@@ -73,6 +75,8 @@
 #define usarthandler(t) USART ## t ## _IRQHandler
 #define usartCLKEN(t) usartclken(t)
 #define usartclken(t) __HAL_RCC_USART ## t ## _CLK_ENABLE
+#define usartDMAREQ(t) usartdmareq(t)
+#define usartdmareq(t) DMA_REQUEST_USART ## t ## _RX
 
 #define TIMER_CLOCK_MUL(d) (d == RCC_HCLK_DIV1 ? 1 : 2)
 
@@ -474,6 +478,150 @@
 #define PPI_TIMER_IRQn              timerINT(PPI_TIMER_N)
 #define PPI_TIMER_IRQHandler        timerHANDLER(PPI_TIMER_N)
 
+#if STEP_DMA_ENABLE
+
+// DMA1 streams 0 and 1 are hardwired to DMAMUX1 channels 0 and 1.
+// The step pulse is started by the stepper timer update event, or its CC2 match when
+// a step pulse delay is set, and ended by its CC1 match.
+
+#define STEP_DMA_SET_STREAM         DMA1_Stream0
+#define STEP_DMA_SET_MUX            DMAMUX1_Channel0
+#define STEP_DMA_SET_REQUEST        timerDMAREQ(STEPPER_TIMER_N, UP)
+#define STEP_DMA_SET_DELAYED_REQUEST timerDMAREQ(STEPPER_TIMER_N, CH2)
+#define STEP_DMA_SET_FLAGS          (DMA_LIFCR_CTCIF0|DMA_LIFCR_CHTIF0|DMA_LIFCR_CTEIF0|DMA_LIFCR_CDMEIF0|DMA_LIFCR_CFEIF0)
+#define STEP_DMA_RESET_STREAM       DMA1_Stream1
+#define STEP_DMA_RESET_MUX          DMAMUX1_Channel1
+#define STEP_DMA_RESET_REQUEST      timerDMAREQ(STEPPER_TIMER_N, CH1)
+#define STEP_DMA_RESET_FLAGS        (DMA_LIFCR_CTCIF1|DMA_LIFCR_CHTIF1|DMA_LIFCR_CTEIF1|DMA_LIFCR_CDMEIF1|DMA_LIFCR_CFEIF1)
+
+#if SPINDLE_SYNC_ENABLE
+#error "STEP_DMA_ENABLE cannot be combined with spindle synchronized motion!"
+#endif
+
+// The reset stream clears all step outputs on every CC1 match, injected step pulses would be cut short.
+#if STEP_INJECT_ENABLE
+#error "STEP_DMA_ENABLE cannot be combined with step injection!"
+#endif
+
+#endif // STEP_DMA_ENABLE
+
+#ifndef SERIAL_RX_DMA
+#define SERIAL_RX_DMA 0
+#endif
+
+#ifndef USB_ULPI_ENABLE
+#define USB_ULPI_ENABLE 0
+#endif
+
+#ifndef ETHERNET_RX_IRQ
+#define ETHERNET_RX_IRQ 0
+#endif
+
+#ifndef ETHERNET_TX_ASYNC
+#define ETHERNET_TX_ASYNC 0
+#endif
+
+#ifndef ETHERNET_MEM_PROFILE
+#define ETHERNET_MEM_PROFILE 0
+#endif
+
+#ifndef SDCARD_READAHEAD
+#define SDCARD_READAHEAD 0
+#endif
+
+#ifndef SDCARD_HIGH_SPEED
+#define SDCARD_HIGH_SPEED 0
+#endif
+
+#ifndef SDCARD_INDEX
+#define SDCARD_INDEX 0
+#endif
+
+#ifndef SD_SCRATCH_BLOCKS
+#if SDCARD_HIGH_SPEED
+#define SD_SCRATCH_BLOCKS            8 // Blocks per multi-block transfer for buffers not accessible by the SDMMC IDMA.
+#else
+#define SD_SCRATCH_BLOCKS            1
+#endif
+#endif
+
+#if SDCARD_READAHEAD
+#ifndef SD_READAHEAD_BLOCKS
+#define SD_READAHEAD_BLOCKS         16 // Blocks read per multi-block transfer, 8 KB.
+#endif
+#ifndef SD_READAHEAD_BUFFERS
+#define SD_READAHEAD_BUFFERS        3
+#endif
+#endif
+
+#ifndef SDCARD_WRITEBEHIND
+#define SDCARD_WRITEBEHIND 0
+#endif
+
+#if SDCARD_WRITEBEHIND
+#ifndef SD_WRITEBEHIND_BLOCKS
+#define SD_WRITEBEHIND_BLOCKS       64 // Blocks queued, 32 KB.
+#endif
+#ifndef SD_WRITEBEHIND_RUN
+#define SD_WRITEBEHIND_RUN          16 // Max. blocks written per multi-block transfer, runs are aligned to this.
+#endif
+#ifndef SD_WRITEBEHIND_DELAY
+#define SD_WRITEBEHIND_DELAY        20 // ms, max. time a block is queued before a short run is written.
+#endif
+#endif
+
+#if ETHERNET_RX_IRQ
+#ifndef ETHERNET_RX_BUDGET
+#define ETHERNET_RX_BUDGET          8 // Max. number of frames passed to lwIP per PendSV invocation.
+#endif
+#ifndef ETHERNET_IRQ_PRIORITY
+#define ETHERNET_IRQ_PRIORITY       3 // Below the stepper, pulse and UART interrupts.
+#endif
+#endif
+
+#if USB_ULPI_ENABLE && !defined(STM32H723xx)
+#error "USB_ULPI_ENABLE is only supported for STM32H723 based boards!"
+#endif
+
+#if SERIAL_RX_DMA
+
+// DMA2 streams 0 - 2 are hardwired to DMAMUX1 channels 8 - 10, one per UART stream.
+// The flags mask covers the TC, HT, TE, DME and FE flags of the stream, a transfer error
+// (TEIF) disables the stream and it is restarted by the interrupt handler.
+
+#ifndef SERIAL_RX_DMA_SIZE
+#define SERIAL_RX_DMA_SIZE          256 // Must be a multiple of the 32 byte cache line size.
+#endif
+
+#define SERIAL_RX_DMA_STREAM        DMA2_Stream0
+#define SERIAL_RX_DMA_MUX           DMAMUX1_Channel8
+#define SERIAL_RX_DMA_IRQ           DMA2_Stream0_IRQn
+#define SERIAL_RX_DMA_IRQHandler    DMA2_Stream0_IRQHandler
+#define SERIAL_RX_DMA_ISR           DMA2->LISR
+#define SERIAL_RX_DMA_IFCR          DMA2->LIFCR
+#define SERIAL_RX_DMA_FLAGS         (DMA_LIFCR_CTCIF0|DMA_LIFCR_CHTIF0|DMA_LIFCR_CTEIF0|DMA_LIFCR_CDMEIF0|DMA_LIFCR_CFEIF0)
+#define SERIAL_RX_DMA_TEIF          DMA_LISR_TEIF0
+
+#define SERIAL1_RX_DMA_STREAM       DMA2_Stream1
+#define SERIAL1_RX_DMA_MUX          DMAMUX1_Channel9
+#define SERIAL1_RX_DMA_IRQ          DMA2_Stream1_IRQn
+#define SERIAL1_RX_DMA_IRQHandler   DMA2_Stream1_IRQHandler
+#define SERIAL1_RX_DMA_ISR          DMA2->LISR
+#define SERIAL1_RX_DMA_IFCR         DMA2->LIFCR
+#define SERIAL1_RX_DMA_FLAGS        (DMA_LIFCR_CTCIF1|DMA_LIFCR_CHTIF1|DMA_LIFCR_CTEIF1|DMA_LIFCR_CDMEIF1|DMA_LIFCR_CFEIF1)
+#define SERIAL1_RX_DMA_TEIF         DMA_LISR_TEIF1
+
+#define SERIAL2_RX_DMA_STREAM       DMA2_Stream2
+#define SERIAL2_RX_DMA_MUX          DMAMUX1_Channel10
+#define SERIAL2_RX_DMA_IRQ          DMA2_Stream2_IRQn
+#define SERIAL2_RX_DMA_IRQHandler   DMA2_Stream2_IRQHandler
+#define SERIAL2_RX_DMA_ISR          DMA2->LISR
+#define SERIAL2_RX_DMA_IFCR         DMA2->LIFCR
+#define SERIAL2_RX_DMA_FLAGS        (DMA_LIFCR_CTCIF2|DMA_LIFCR_CHTIF2|DMA_LIFCR_CTEIF2|DMA_LIFCR_CDMEIF2|DMA_LIFCR_CFEIF2)
+#define SERIAL2_RX_DMA_TEIF         DMA_LISR_TEIF2
+
+#endif // SERIAL_RX_DMA
+
 // Adjust STEP_PULSE_LATENCY to get accurate step pulse length when required, e.g if using high step rates.
 // The default value is calibrated for 10 microseconds length.
 // NOTE: step output mode, number of axes and compiler optimization settings may all affect this value.
@@ -26,5 +26,9 @@
 
 bool enet_init (void);
 bool enet_start (void);
+uint32_t enet_get_info_generation (void);
+#if ETHERNET_RX_IRQ
+void enet_pendsv (void);
+#endif
 
 #endif
@@ -42,6 +42,12 @@
 #define Z_STEP_PIN              3
 #define STEP_OUTMODE            GPIO_MAP
 //#define STEP_PINMODE            PINMODE_OD // Uncomment for open drain outputs
+// Uncomment to drive the step pins from the PULSE_TIMER (TIM4) compare channels, requires the step pins
+// to be mapped to TIM4 channel pins (PB6-PB9 or PD12-PD15). Supports max. four motors.
+//#define STEP_PULSE_TIMER_OUTPUT 1
+//#define X_STEP_TIMER_CH         1
+//#define Y_STEP_TIMER_CH         2
+//#define Z_STEP_TIMER_CH         3
 
 // Define step direction output pins.
 #define DIRECTION_PORT          GPIOA
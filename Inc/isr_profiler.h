@@ -0,0 +1,80 @@
+/*
+
+  isr_profiler.h - interrupt load and latency profiler using the DWT cycle counter
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __ISR_PROFILER_H__
+#define __ISR_PROFILER_H__
+
+#include "driver.h"
+
+#if ISR_PROFILER_ENABLE
+
+#define ISR_PROFILER_BUCKETS 8 // Histogram buckets: < 1, 1, 2-3, 4-7 ... >= 64 microseconds
+
+typedef enum {
+    IsrProfile_Stepper = 0,
+    IsrProfile_StepPulse,
+    IsrProfile_StepInject,
+    IsrProfile_Debounce,
+    IsrProfile_EXTI0,       // One per handler as they may nest, records are not atomic
+    IsrProfile_EXTI1,
+    IsrProfile_EXTI2,
+    IsrProfile_EXTI3,
+    IsrProfile_EXTI4,
+    IsrProfile_EXTI9_5,
+    IsrProfile_EXTI15_10,
+    IsrProfile_Serial0,
+    IsrProfile_Serial1,
+    IsrProfile_Serial2,
+    IsrProfile_USB,
+    IsrProfile_SDMMC,
+    IsrProfile_SysTick,
+    IsrProfile_N
+} isr_profile_id_t;
+
+// All times are in CPU cycles. Execution times include time spent in
+// higher priority interrupts preempting the handler.
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t latency_count; // Entry latency, only for sources with a hardware timestamp
+    uint32_t latency_max;
+    uint64_t latency_sum;
+    uint32_t histogram[ISR_PROFILER_BUCKETS];
+} isr_profile_t;
+
+void isr_profiler_init (void);
+void isr_profiler_record (isr_profile_id_t id, uint32_t entry, uint32_t latency);
+
+#define ISR_PROFILE_ENTER() uint32_t isr_entry = DWT->CYCCNT
+#define ISR_PROFILE_EXIT(id) isr_profiler_record(id, isr_entry, 0)
+#define ISR_PROFILE_EXIT_LATENCY(id, latency) isr_profiler_record(id, isr_entry, latency)
+
+#else
+
+#define ISR_PROFILE_ENTER()
+#define ISR_PROFILE_EXIT(id)
+#define ISR_PROFILE_EXIT_LATENCY(id, latency)
+
+#endif // ISR_PROFILER_ENABLE
+
+#endif // __ISR_PROFILER_H__
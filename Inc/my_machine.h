@@ -77,6 +77,26 @@
 //#define EMBROIDERY_ENABLE       1 // Embroidery plugin. To be completed.
 #define PLASMA_ENABLE           1 // Plasma (THC) plugin. To be completed.
 #define STEP_INJECT_ENABLE	1  // [wjr] for plasma??
+//#define STEP_DMA_ENABLE         1 // Output step pulses by DMA triggered by the stepper timer. All step pins must be on the same port.
+                                    // NOTE: cannot be combined with STEP_INJECT_ENABLE.
+//#define ISR_PROFILER_ENABLE     1 // Interrupt execution time and latency statistics, output with the $ISRSTATS command.
+//#define STEP_TRACE_ENABLE       1 // Step and direction output trace capture, see the $STEPTRACE command and tools/steptrace.py.
+//#define SERIAL_RX_DMA           1 // DMA receive with idle line detection for UART streams. Bitmask, 1: SERIAL_PORT, 2: SERIAL1_PORT, 4: SERIAL2_PORT.
+//#define USB_ULPI_ENABLE         1 // H723 only: run the USB_OTG_HS core at high speed via an external ULPI PHY.
+//#define ETHERNET_RX_IRQ         1 // Service lwIP from the lowest priority PendSV interrupt, triggered by Ethernet receive and SysTick.
+                                    // NOTE: network callbacks, incl. those of the FTP and HTTP file services, then run in interrupt context.
+//#define ETHERNET_TX_ASYNC       1 // Queue outgoing frames to the Ethernet DMA without waiting for each to complete.
+//#define ETHERNET_MEM_PROFILE    1 // H743 only: high throughput lwIP configuration with heap and pools in D2 SRAM, see lwipopts.h.
+//#define NETHEALTH_ENABLE        1 // Ethernet and lwIP statistics counters and the $NETHEALTH command.
+//#define NETBENCH_ENABLE         1 // Network benchmark service and $NETSTATS command, see tools/netbench.py.
+//#define UDP_RT_ENABLE           1 // UDP realtime command and status channel on port 5005, see udp_rt.h.
+//#define NETMON_ENABLE           1 // Read-only status monitor sessions for up to 4 observers on TCP port 5006, see netmon.c.
+//#define ETHERNET_IPV6           1 // IPv6 dual stack with link-local and autoconfigured (SLAAC) addresses.
+                                    // NOTE: services only accept IPv6 connections if they create their listeners with the any type address.
+//#define SDCARD_READAHEAD        1 // Read SD card data ahead in the background by multi-block DMA transfers, see sd_diskio.c.
+//#define SDCARD_HIGH_SPEED       1 // Switch SD cards to high speed (50 MHz) mode with hardware flow control, see sdmmc.c.
+//#define SDCARD_INDEX            1 // Fast seek, <file>.gidx line index and job progress for G-code files on SD card, see sdindex.c.
+//#define SDCARD_WRITEBEHIND      1 // Queue SD card writes and write them in the background by multi-block DMA transfers, see sd_diskio.c.
 //#define TRINAMIC_ENABLE      2130 // Trinamic TMC2130 stepper driver support.
 //#define TRINAMIC_ENABLE      5160 // Trinamic TMC5160 stepper driver support.
 //#define TRINAMIC_ENABLE   2209 // Trinamic TMC2209 stepper driver support.
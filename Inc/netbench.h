@@ -0,0 +1,38 @@
+/*
+
+  netbench.h - network throughput and latency benchmark service
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __NETBENCH_H__
+#define __NETBENCH_H__
+
+#include "driver.h"
+
+#if ETHERNET_ENABLE && NETBENCH_ENABLE
+
+#ifndef NETBENCH_PORT
+#define NETBENCH_PORT 5001 // TCP sink and UDP echo, TCP source is on NETBENCH_PORT + 1
+#endif
+
+void netbench_init (void);
+void netbench_record_poll (uint32_t cycles);
+
+#endif
+
+#endif // __NETBENCH_H__
@@ -0,0 +1,46 @@
+/*
+
+  netmon.h - read-only network status monitor sessions
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __NETMON_H__
+#define __NETMON_H__
+
+#include "driver.h"
+
+#if ETHERNET_ENABLE && NETMON_ENABLE
+
+#ifndef NETMON_PORT
+#define NETMON_PORT             5006
+#endif
+#ifndef NETMON_CLIENTS
+#define NETMON_CLIENTS          4       // Max. number of observers
+#endif
+#ifndef NETMON_INTERVAL
+#define NETMON_INTERVAL         100     // ms, status report interval
+#endif
+#define NETMON_FRAME_SIZE       160
+
+void netmon_init (void);
+void netmon_poll (void);
+uint_fast8_t netmon_clients (void);
+
+#endif
+
+#endif // __NETMON_H__
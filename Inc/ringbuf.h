@@ -0,0 +1,101 @@
+/*
+
+  ringbuf.h - lock free single producer/single consumer ring buffer helpers for stream buffers
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+  Works on any buffer struct with volatile head and tail members and a char data array whose size is a power of 2,
+  e.g. stream_rx_buffer_t and stream_tx_buffer_t. Only the producer may update head and only the consumer may update
+  tail, no locking is needed as long as there is one of each - typically foreground code on one side and an ISR on the other.
+*/
+
+#pragma once
+
+#include <string.h>
+
+#include "main.h"
+
+//
+// Copies up to length bytes into the buffer, returns number of bytes copied.
+//
+static inline uint_fast16_t ringbuf_put (char *data, uint_fast16_t size, volatile uint_fast16_t *head, uint_fast16_t tail, const char *src, uint_fast16_t length)
+{
+    uint_fast16_t h = *head, free = (tail - h - 1) & (size - 1);
+
+    if(length > free)
+        length = free;
+
+    if(length) {
+        uint_fast16_t chunk = size - h;
+        if(chunk > length)
+            chunk = length;
+        memcpy(data + h, src, chunk);
+        if(length > chunk)
+            memcpy(data, src + chunk, length - chunk);
+        __DMB();                                // Data must be in place before head is moved
+        *head = (h + length) & (size - 1);
+    }
+
+    return length;
+}
+
+//
+// Copies up to length bytes out of the buffer, returns number of bytes copied.
+//
+static inline uint_fast16_t ringbuf_get (const char *data, uint_fast16_t size, uint_fast16_t head, volatile uint_fast16_t *tail, char *dst, uint_fast16_t length)
+{
+    uint_fast16_t t = *tail, count = (head - t) & (size - 1);
+
+    if(length > count)
+        length = count;
+
+    if(length) {
+        uint_fast16_t chunk = size - t;
+        if(chunk > length)
+            chunk = length;
+        memcpy(dst, data + t, chunk);
+        if(length > chunk)
+            memcpy(dst + chunk, data, length - chunk);
+        __DMB();                                // Data must be read before tail is moved
+        *tail = (t + length) & (size - 1);
+    }
+
+    return length;
+}
+
+//
+// Returns number of contiguous bytes available from tail, ptr is set to the first one.
+// Use ringbuf_skip() to release them when consumed, e.g. after a DMA transfer completes.
+//
+static inline uint_fast16_t ringbuf_peek (char *data, uint_fast16_t size, uint_fast16_t head, uint_fast16_t tail, char **ptr)
+{
+    *ptr = data + tail;
+
+    return head >= tail ? head - tail : size - tail;
+}
+
+#define ringbuf_size(buf)               (sizeof((buf)->data))
+#define ringbuf_count(buf)              (((buf)->head - (buf)->tail) & (ringbuf_size(buf) - 1))
+#define ringbuf_free(buf)               ((ringbuf_size(buf) - 1) - ringbuf_count(buf))
+#define ringbuf_write(buf, src, len)    ringbuf_put((buf)->data, ringbuf_size(buf), &(buf)->head, (buf)->tail, src, len)
+#define ringbuf_read(buf, dst, len)     ringbuf_get((buf)->data, ringbuf_size(buf), (buf)->head, &(buf)->tail, dst, len)
+#define ringbuf_contiguous(buf, ptr)    ringbuf_peek((buf)->data, ringbuf_size(buf), (buf)->head, (buf)->tail, ptr)
+#define ringbuf_skip(buf, len)          do { (buf)->tail = ((buf)->tail + (len)) & (ringbuf_size(buf) - 1); } while(0)
+
+/*EOF*/
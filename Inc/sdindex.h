@@ -0,0 +1,93 @@
+/*
+
+  sdindex.h - fast seek and line index for G-code files on SD card
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __SDINDEX_H__
+#define __SDINDEX_H__
+
+#include "driver.h"
+
+#if SDCARD_ENABLE && SDCARD_INDEX
+
+#include "ff.h"
+
+#ifndef SDINDEX_ENTRIES
+#define SDINDEX_ENTRIES     512     // Max. number of line offsets kept, the interval is doubled when full.
+#endif
+#ifndef SDINDEX_INTERVAL
+#define SDINDEX_INTERVAL    100     // Initial number of lines between line offsets.
+#endif
+#ifndef SDINDEX_MARKS
+#define SDINDEX_MARKS       64      // Max. number of tool changes and program stops recorded.
+#endif
+#ifndef SDINDEX_CLMT_SIZE
+#define SDINDEX_CLMT_SIZE   64      // Cluster link map table size in DWORDs, (SDINDEX_CLMT_SIZE - 2) / 2 fragments max.
+#endif
+#ifndef SDINDEX_FILES
+#define SDINDEX_FILES       2       // Max. number of files open in fast seek mode.
+#endif
+#define SDINDEX_EXT         ".gidx" // Extension added to the file name for the index file.
+#define SDINDEX_MAGIC       0x58444947
+#define SDINDEX_VERSION     2
+
+typedef enum {
+    SdIndexMark_ToolChange = 0,     // M6
+    SdIndexMark_Stop,               // M0
+    SdIndexMark_OptionalStop        // M1
+} sdindex_mark_type_t;
+
+// Index file format, little endian: the header followed by hdr.entries offsets and hdr.marks marks.
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entries;       // number of offsets
+    uint32_t size;          // size of the indexed file,
+    uint16_t fdate;         // its modification date
+    uint16_t ftime;         // and time
+    uint32_t interval;      // number of lines between offsets
+    uint32_t lines;         // number of lines in the file, 0 if the index is incomplete
+    uint16_t marks;         // number of marks
+    uint16_t reserved;
+} sdindex_header_t;
+
+typedef struct {
+    uint32_t line;
+    uint32_t offset;        // file offset of the line
+    uint32_t type;          // sdindex_mark_type_t
+    uint32_t tool;          // last T word seen, for tool changes
+} sdindex_mark_t;
+
+typedef struct {
+    sdindex_header_t hdr;
+    uint32_t offset[SDINDEX_ENTRIES];   // offset[n] is the file offset of line n * interval + 1
+    sdindex_mark_t mark[SDINDEX_MARKS]; // in line order, the first SDINDEX_MARKS only
+} sdindex_t;
+
+bool sdindex_fastseek (FIL *file);
+void sdindex_release (FIL *file);
+FRESULT sdindex_load (sdindex_t *index, const char *path);
+FRESULT sdindex_save (const sdindex_t *index, const char *path);
+FRESULT sdindex_build (sdindex_t *index, const char *path);
+FRESULT sdindex_seek (FIL *file, const sdindex_t *index, uint32_t line);
+void sdindex_init (void);
+
+#endif
+
+#endif // __SDINDEX_H__
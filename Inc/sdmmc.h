@@ -27,7 +27,10 @@
 #include "driver.h"
 #include "fatfs.h"
 
+#include "grbl/hal.h"
+
 void sdmmc_init(void);
+status_code_t sdmmc_write_status (FRESULT res);
 
 #endif
 
@@ -0,0 +1,97 @@
+/*
+
+  step_trace.h - step and direction output trace capture using the DWT cycle counter
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __STEP_TRACE_H__
+#define __STEP_TRACE_H__
+
+#include "driver.h"
+
+#if STEP_TRACE_ENABLE
+
+#ifndef STEP_TRACE_SIZE
+#define STEP_TRACE_SIZE 4096 // Number of entries, must be a power of 2
+#endif
+
+#define STEP_TRACE_MAGIC   0x43525453 // "STRC"
+#define STEP_TRACE_VERSION 1
+
+typedef enum {
+    StepTrace_StepOn = 0,
+    StepTrace_StepOff,
+    StepTrace_Dir
+} step_trace_event_t;
+
+// NOTE: layout is shared with the host side converter, tools/steptrace.py.
+typedef struct {
+    uint32_t cycles;    // DWT->CYCCNT at the time of the output
+    uint8_t event;      // step_trace_event_t
+    uint8_t bits;       // Axis bits for step on and direction events (before inversion)
+    uint16_t reserved;
+} step_trace_entry_t;
+
+typedef struct {
+    volatile bool armed;
+    bool ring;          // Keep capturing, overwriting oldest entries, when buffer is full
+    volatile bool wrapped;
+    volatile uint32_t head;
+    step_trace_entry_t entry[STEP_TRACE_SIZE];
+} step_trace_t;
+
+extern step_trace_t step_trace;
+
+// Called from interrupt context, cycles is the DWT->CYCCNT value at the time of the output.
+inline static __attribute__((always_inline)) void step_trace_add_at (step_trace_event_t event, uint8_t bits, uint32_t cycles)
+{
+    if(step_trace.armed) {
+
+        uint32_t head = step_trace.head;
+
+        step_trace.entry[head].cycles = cycles;
+        step_trace.entry[head].event = (uint8_t)event;
+        step_trace.entry[head].bits = bits;
+
+        if(++head == STEP_TRACE_SIZE) {
+            head = 0;
+            step_trace.wrapped = true;
+            step_trace.armed = step_trace.ring;
+        }
+
+        step_trace.head = head;
+    }
+}
+
+// Called from interrupt context.
+inline static __attribute__((always_inline)) void step_trace_add (step_trace_event_t event, uint8_t bits)
+{
+    step_trace_add_at(event, bits, DWT->CYCCNT);
+}
+
+void step_trace_init (void);
+
+#define STEP_TRACE(event, bits) step_trace_add(event, bits)
+
+#else
+
+#define STEP_TRACE(event, bits)
+
+#endif // STEP_TRACE_ENABLE
+
+#endif // __STEP_TRACE_H__
@@ -220,7 +220,7 @@
 #define  USE_HAL_WWDG_REGISTER_CALLBACKS    0U /* WWDG register callback disabled    */
 
 /* ########################### Ethernet Configuration ######################### */
-#define ETH_TX_DESC_CNT        12  /* number of Ethernet Tx DMA descriptors */
+#define ETH_TX_DESC_CNT        16  /* number of Ethernet Tx DMA descriptors, must be a power of 2 (HAL_ETH_ReleaseTxPacket) */
 #define ETH_RX_DESC_CNT         4  /* number of Ethernet Rx DMA descriptors */
 
 #define ETH_MAC_ADDR0    (0x02UL)
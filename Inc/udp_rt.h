@@ -0,0 +1,80 @@
+/*
+
+  udp_rt.h - UDP realtime command and status channel
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __UDP_RT_H__
+#define __UDP_RT_H__
+
+#include "driver.h"
+
+#if ETHERNET_ENABLE && UDP_RT_ENABLE
+
+#include "grbl/hal.h"
+
+#ifndef UDP_RT_PORT
+#define UDP_RT_PORT             5005
+#endif
+#ifndef UDP_RT_CLIENTS
+#define UDP_RT_CLIENTS          2       // Max. number of status subscribers
+#endif
+#define UDP_RT_MIN_INTERVAL     2       // ms
+#define UDP_RT_TIMEOUT          5000    // ms, subscriptions have to be renewed within this time
+
+// Datagram formats, multi-byte values are little endian.
+//
+// Client to controller:
+//  UdpRt_Realtime:  <type><seq><realtime command characters...>
+//                   Characters that are not realtime commands are ignored. Answered by UdpRt_Ack.
+//  UdpRt_Subscribe: <type><seq><interval ms:uint16>
+//                   Push UdpRt_StatusReport at the given interval, 0 to unsubscribe. Answered by UdpRt_Ack.
+//  UdpRt_Status:    <type><seq>
+//                   Request a single UdpRt_StatusReport.
+//
+// Controller to client:
+//  UdpRt_Ack:          <type><seq><count> - count is the number of realtime commands accepted
+//                                           or 1 if a subscription was accepted.
+//  UdpRt_StatusReport: udp_rt_status_t, seq is the request sequence number or incremented per push.
+
+typedef enum {
+    UdpRt_Realtime = 0x01,
+    UdpRt_Subscribe = 0x02,
+    UdpRt_Status = 0x03,
+    UdpRt_Ack = 0x81,
+    UdpRt_StatusReport = 0x83
+} udp_rt_type_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t type;
+    uint8_t seq;
+    uint8_t n_axis;
+    uint8_t feed_override;      // percent
+    uint16_t state;             // sys_state_t bitmap
+    uint16_t rapid_override;    // percent
+    uint32_t ms;                // controller time
+    float feed_rate;            // current feed rate, mm/min
+    float mpos[N_AXIS];         // machine position, mm
+} udp_rt_status_t;
+
+void udp_rt_init (void);
+void udp_rt_poll (void);
+
+#endif
+
+#endif // __UDP_RT_H__
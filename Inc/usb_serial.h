@@ -45,6 +45,9 @@ typedef struct {
 extern volatile usb_linestate_t usb_linestate;
 
 const io_stream_t *usbInit (void);
-void usbBufferInput (uint8_t *data, uint32_t length);
+bool usbBufferInput (uint8_t *data, uint32_t length);
+void usbBufferReset (void);
+void usbTxComplete (void);
+void usbSOF (void);
 
 /*EOF*/
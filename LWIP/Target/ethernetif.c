@@ -34,6 +34,8 @@
 /* Within 'USER CODE' section, code will be kept by default at each generation */
 /* USER CODE BEGIN 0 */
 
+#include "driver.h"
+
 /* USER CODE END 0 */
 
 /* Private define ------------------------------------------------------------*/
@@ -88,7 +90,9 @@ typedef struct
 } RxBuff_t;
 
 /* Memory Pool Declaration */
+#ifndef ETH_RX_BUFFER_CNT
 #define ETH_RX_BUFFER_CNT             12U
+#endif
 LWIP_MEMPOOL_DECLARE(RX_POOL, ETH_RX_BUFFER_CNT, sizeof(RxBuff_t), "Zero-copy RX PBUF pool");
 
 /* Variable Definitions */
@@ -115,6 +119,8 @@ ETH_DMADescTypeDef DMATxDscrTab[ETH_TX_DESC_CNT] __attribute__((section(".TxDecr
 
 /* USER CODE BEGIN 2 */
 
+static ethernetif_counters_t counters = {0};
+
 /* USER CODE END 2 */
 
 /* Global Ethernet handle */
@@ -144,6 +150,170 @@ void pbuf_free_custom(struct pbuf *p);
 
 /* USER CODE BEGIN 4 */
 
+#if LWIP_IGMP || (LWIP_IPV6 && LWIP_IPV6_MLD)
+
+/* Multicast MAC address filtering for the groups joined via IGMP and MLD.
+   The first three addresses are perfect filtered by the MAC address 1 - 3 registers,
+   the rest by the 64 bin hash table. If the table overflows all multicast frames are passed. */
+
+#ifndef ETH_MCAST_FILTERS
+#define ETH_MCAST_FILTERS 16
+#endif
+
+typedef struct
+{
+  uint8_t addr[6];
+  uint8_t refs;
+} mcast_filter_t;
+
+static mcast_filter_t mcast_filter[ETH_MCAST_FILTERS];
+static uint32_t mcast_overflow = 0; /* number of addresses that did not fit in the table */
+
+/* Hash table index: the upper 6 bits of the bit reversed Ethernet CRC of the address. */
+static uint32_t mcast_hash(const uint8_t *addr)
+{
+  uint32_t i, bit, crc = 0xFFFFFFFF;
+
+  for (i = 0; i < 6; i++)
+  {
+    crc ^= addr[i];
+    for (bit = 0; bit < 8; bit++)
+      crc = (crc >> 1) ^ (crc & 1 ? 0xEDB88320 : 0);
+  }
+
+  return __RBIT(~crc) >> 26;
+}
+
+static void mcast_filter_update(void)
+{
+  uint32_t idx, n = 0, hash[2] = {0};
+  volatile uint32_t *perfect[3][2] = {
+    { &heth.Instance->MACA1HR, &heth.Instance->MACA1LR },
+    { &heth.Instance->MACA2HR, &heth.Instance->MACA2LR },
+    { &heth.Instance->MACA3HR, &heth.Instance->MACA3LR }
+  };
+  ETH_MACFilterConfigTypeDef filters;
+
+  for (idx = 0; idx < ETH_MCAST_FILTERS; idx++)
+  {
+    uint8_t *addr = mcast_filter[idx].addr;
+
+    if (mcast_filter[idx].refs == 0)
+      continue;
+
+    if (n < 3)
+    {
+      *perfect[n][1] = ((uint32_t)addr[3] << 24) | ((uint32_t)addr[2] << 16) | ((uint32_t)addr[1] << 8) | addr[0];
+      *perfect[n][0] = ETH_MACAHR_AE | ((uint32_t)addr[5] << 8) | addr[4];
+    }
+    else
+    {
+      uint32_t bin = mcast_hash(addr);
+      hash[bin >> 5] |= 1UL << (bin & 0x1F);
+    }
+    n++;
+  }
+
+  for (idx = n; idx < 3; idx++)
+    *perfect[idx][0] = 0;
+
+  HAL_ETH_SetHashTable(&heth, hash);
+
+  HAL_ETH_GetMACFilterConfig(&heth, &filters);
+  filters.HachOrPerfectFilter = ENABLE;
+  filters.HashMulticast = n > 3 ? ENABLE : DISABLE;
+  filters.PassAllMulticast = mcast_overflow ? ENABLE : DISABLE;
+  HAL_ETH_SetMACFilterConfig(&heth, &filters);
+}
+
+static err_t mcast_filter_set(const uint8_t *addr, enum netif_mac_filter_action action)
+{
+  uint32_t idx;
+  mcast_filter_t *entry = NULL, *slot = NULL;
+
+  for (idx = 0; idx < ETH_MCAST_FILTERS; idx++)
+  {
+    if (mcast_filter[idx].refs == 0)
+    {
+      if (slot == NULL)
+        slot = &mcast_filter[idx];
+    }
+    else if (memcmp(mcast_filter[idx].addr, addr, 6) == 0)
+      entry = &mcast_filter[idx];
+  }
+
+  if (action == NETIF_ADD_MAC_FILTER)
+  {
+    if (entry)
+      entry->refs++;
+    else if (slot)
+    {
+      memcpy(slot->addr, addr, 6);
+      slot->refs = 1;
+    }
+    else
+      mcast_overflow++;
+  }
+  else if (entry)
+    entry->refs--;
+  else if (mcast_overflow)
+    mcast_overflow--;
+
+  mcast_filter_update();
+
+  return ERR_OK;
+}
+
+#endif
+
+#if LWIP_IGMP
+
+static err_t igmp_mac_filter(struct netif *netif, const ip4_addr_t *group, enum netif_mac_filter_action action)
+{
+  uint32_t ip = lwip_ntohl(ip4_addr_get_u32(group));
+  uint8_t addr[6] = { 0x01, 0x00, 0x5E, (ip >> 16) & 0x7F, (ip >> 8) & 0xFF, ip & 0xFF };
+
+  return mcast_filter_set(addr, action);
+}
+
+#endif
+
+#if LWIP_IPV6 && LWIP_IPV6_MLD
+
+static err_t mld_mac_filter(struct netif *netif, const ip6_addr_t *group, enum netif_mac_filter_action action)
+{
+  uint32_t ip = lwip_ntohl(group->addr[3]);
+  uint8_t addr[6] = { 0x33, 0x33, ip >> 24, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF };
+
+  return mcast_filter_set(addr, action);
+}
+
+#endif
+
+#if !ETHERNET_RX_IRQ
+
+/**
+  * @brief  Counts and clears DMA receive buffer unavailable and fatal bus error
+  *         status, in interrupt mode this is done by HAL_ETH_ErrorCallback()
+  * @param  None
+  * @retval None
+  */
+static void dma_status_check(void)
+{
+  uint32_t status = heth.Instance->DMACSR & (ETH_DMACSR_RBU | ETH_DMACSR_FBE);
+
+  if(status)
+  {
+    __HAL_ETH_DMA_CLEAR_IT(&heth, status);
+    if(status & ETH_DMACSR_RBU)
+      counters.rx_overruns++;
+    if(status & ETH_DMACSR_FBE)
+      counters.dma_errors++;
+  }
+}
+
+#endif
+
 /* USER CODE END 4 */
 
 /*******************************************************************************
@@ -237,6 +407,19 @@ static void low_level_init(struct netif *netif)
 
 /* USER CODE BEGIN LOW_LEVEL_INIT */
 
+#if LWIP_IGMP
+  netif_set_igmp_mac_filter(netif, igmp_mac_filter);
+#endif
+#if LWIP_IPV6 && LWIP_IPV6_MLD
+  ip6_addr_t allnodes;
+
+  netif->flags |= NETIF_FLAG_MLD6;
+  netif_set_mld_mac_filter(netif, mld_mac_filter);
+  /* The all nodes group is not joined via MLD, it carries router advertisements. */
+  ip6_addr_set_allnodes_linklocal(&allnodes);
+  mld_mac_filter(netif, &allnodes, NETIF_ADD_MAC_FILTER);
+#endif
+
 /* USER CODE END LOW_LEVEL_INIT */
 }
 
@@ -261,14 +444,37 @@ static err_t low_level_output(struct netif *netif, struct pbuf *p)
   uint32_t i = 0U;
   struct pbuf *q = NULL;
   err_t errval = ERR_OK;
-  ETH_BufferTypeDef Txbuffer[ETH_TX_DESC_CNT] = {0};
+  ETH_BufferTypeDef Txbuffer[ETH_TX_DESC_CNT];
+
+#if ETHERNET_TX_ASYNC
+
+  /* Free descriptors of frames already sent. */
+  HAL_ETH_ReleaseTxPacket(&heth);
+
+  /* The frame is queued, the pbuf chain must stay valid until HAL_ETH_TxFreeCallback()
+     is called. Take a reference, or a copy if any payload is volatile (PBUF_REF). */
+  for(q = p; q != NULL && !PBUF_NEEDS_COPY(q); q = q->next);
 
-  memset(Txbuffer, 0 , ETH_TX_DESC_CNT*sizeof(ETH_BufferTypeDef));
+  if(q == NULL)
+    pbuf_ref(p);
+  else if((p = pbuf_clone(PBUF_RAW, PBUF_RAM, p)) == NULL)
+    return ERR_MEM;
+
+#endif
 
   for(q = p; q != NULL; q = q->next)
   {
     if(i >= ETH_TX_DESC_CNT)
+    {
+#if ETHERNET_TX_ASYNC
+      pbuf_free(p);
+#endif
       return ERR_IF;
+    }
+
+#if L1_CACHE_ENABLE
+    SCB_CleanDCache_by_Addr((uint32_t *)q->payload, q->len);
+#endif
 
     Txbuffer[i].buffer = q->payload;
     Txbuffer[i].len = q->len;
@@ -290,7 +496,39 @@ static err_t low_level_output(struct netif *netif, struct pbuf *p)
   TxConfig.TxBuffer = Txbuffer;
   TxConfig.pData = p;
 
-  HAL_ETH_Transmit(&heth, &TxConfig, ETH_DMA_TRANSMIT_TIMEOUT);
+#if ETHERNET_TX_ASYNC
+
+  /* Wait for descriptors to become available if the ring is full. */
+  uint32_t tickstart = HAL_GetTick();
+
+  if(HAL_ETH_Transmit_IT(&heth, &TxConfig) != HAL_OK)
+  {
+    counters.tx_ring_full++;
+    do
+    {
+      if(heth.gState != HAL_ETH_STATE_STARTED || HAL_GetTick() - tickstart > ETH_DMA_TRANSMIT_TIMEOUT)
+      {
+        if(heth.gState == HAL_ETH_STATE_STARTED)
+          counters.tx_timeouts++;
+        pbuf_free(p);
+        return ERR_IF;
+      }
+      HAL_ETH_ReleaseTxPacket(&heth);
+    } while(HAL_ETH_Transmit_IT(&heth, &TxConfig) != HAL_OK);
+  }
+
+#else
+
+  if(HAL_ETH_Transmit(&heth, &TxConfig, ETH_DMA_TRANSMIT_TIMEOUT) != HAL_OK)
+  {
+    if(heth.gState == HAL_ETH_STATE_STARTED)
+      counters.tx_timeouts++;
+    return errval;
+  }
+
+#endif
+
+  counters.tx_frames++;
 
   return errval;
 }
@@ -309,7 +547,8 @@ static struct pbuf * low_level_input(struct netif *netif)
 
   if(RxAllocStatus == RX_ALLOC_OK)
   {
-    HAL_ETH_ReadData(&heth, (void **)&p);
+    if(HAL_ETH_ReadData(&heth, (void **)&p) == HAL_OK)
+      counters.rx_frames++;
   }
 
   return p;
@@ -328,6 +567,14 @@ void ethernetif_input(struct netif *netif)
 {
   struct pbuf *p = NULL;
 
+#if ETHERNET_TX_ASYNC
+  HAL_ETH_ReleaseTxPacket(&heth);
+#endif
+
+#if !ETHERNET_RX_IRQ
+  dma_status_check();
+#endif
+
   do
   {
     p = low_level_input( netif );
@@ -341,6 +588,37 @@ void ethernetif_input(struct netif *netif)
   } while(p!=NULL);
 }
 
+#if ETHERNET_RX_IRQ
+
+/**
+ * @brief As ethernetif_input() but passes at most budget frames to lwIP.
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ * @param budget max number of frames to process
+ * @return true if the budget was exhausted, more frames may be pending
+ */
+bool ethernetif_input_budget(struct netif *netif, uint32_t budget)
+{
+  struct pbuf *p = NULL;
+
+#if ETHERNET_TX_ASYNC
+  HAL_ETH_ReleaseTxPacket(&heth);
+#endif
+
+  while(budget && (p = low_level_input(netif)) != NULL)
+  {
+    budget--;
+    if (netif->input( p, netif) != ERR_OK )
+    {
+      pbuf_free(p);
+    }
+  }
+
+  return budget == 0;
+}
+
+#endif
+
 #if !LWIP_ARP
 /**
  * This function has to be completed by user in case of ARP OFF.
@@ -436,6 +714,10 @@ void pbuf_free_custom(struct pbuf *p)
   if (RxAllocStatus == RX_ALLOC_ERROR)
   {
     RxAllocStatus = RX_ALLOC_OK;
+#if ETHERNET_RX_IRQ
+    /* Frames may have been left in the descriptors while the pool was empty. */
+    SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+#endif
   }
 }
 
@@ -518,6 +800,11 @@ void HAL_ETH_MspInit(ETH_HandleTypeDef* ethHandle)
 
   /* USER CODE BEGIN ETH_MspInit 1 */
 
+#if ETHERNET_RX_IRQ
+    HAL_NVIC_SetPriority(ETH_IRQn, ETHERNET_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(ETH_IRQn);
+#endif
+
   /* USER CODE END ETH_MspInit 1 */
   }
 }
@@ -646,7 +933,11 @@ void ethernet_link_check_state(struct netif *netif)
 
   if(netif_is_link_up(netif) && (PHYLinkState <= LAN8742_STATUS_LINK_DOWN))
   {
+#if ETHERNET_RX_IRQ
+    HAL_ETH_Stop_IT(&heth);
+#else
     HAL_ETH_Stop(&heth);
+#endif
     netif_set_down(netif);
     netif_set_link_down(netif);
   }
@@ -685,7 +976,11 @@ void ethernet_link_check_state(struct netif *netif)
       MACConf.DuplexMode = duplex;
       MACConf.Speed = speed;
       HAL_ETH_SetMACConfig(&heth, &MACConf);
+#if ETHERNET_RX_IRQ
+      HAL_ETH_Start_IT(&heth);
+#else
       HAL_ETH_Start(&heth);
+#endif
       netif_set_up(netif);
       netif_set_link_up(netif);
     }
@@ -710,6 +1005,8 @@ void HAL_ETH_RxAllocateCallback(uint8_t **buff)
   }
   else
   {
+    if (RxAllocStatus == RX_ALLOC_OK)
+      counters.rx_alloc_errors++;
     RxAllocStatus = RX_ALLOC_ERROR;
     *buff = NULL;
   }
@@ -769,5 +1066,58 @@ void HAL_ETH_TxFreeCallback(uint32_t * buff)
 
 /* USER CODE BEGIN 8 */
 
+/**
+  * @brief  Returns the interface health counters, the MMC counters are read on demand
+  * @param  None
+  * @retval Pointer to counters
+  */
+const ethernetif_counters_t *ethernetif_get_counters(void)
+{
+  counters.rx_crc_errors = heth.Instance->MMCRCRCEPR;
+  counters.rx_align_errors = heth.Instance->MMCRAEPR;
+
+  return &counters;
+}
+
+#if ETHERNET_RX_IRQ
+
+/* Abnormal DMA interrupts. Receive buffer unavailable is cleared by the HAL and
+   resolved by PendSV replenishing the descriptors, a fatal bus error stops the DMA. */
+
+void HAL_ETH_ErrorCallback(ETH_HandleTypeDef *heth)
+{
+  if(heth->DMAErrorCode & ETH_DMACSR_RBU)
+    counters.rx_overruns++;
+  if(heth->DMAErrorCode & ETH_DMACSR_FBE)
+    counters.dma_errors++;
+
+  SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+}
+
+/* The receive interrupt only pends PendSV, lwIP is serviced from there. */
+
+void HAL_ETH_RxCpltCallback(ETH_HandleTypeDef *heth)
+{
+  SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+}
+
+#if ETHERNET_TX_ASYNC
+
+/* Sent frames are released from PendSV as pbuf_free() must not be called from interrupt context. */
+
+void HAL_ETH_TxCpltCallback(ETH_HandleTypeDef *heth)
+{
+  SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+}
+
+#endif
+
+void ETH_IRQHandler(void)
+{
+  HAL_ETH_IRQHandler(&heth);
+}
+
+#endif
+
 /* USER CODE END 8 */
 
@@ -41,5 +41,22 @@ u32_t sys_now(void);
 
 /* USER CODE BEGIN 1 */
 
+#include <stdbool.h>
+
+typedef struct {
+  uint32_t rx_frames;
+  uint32_t tx_frames;
+  uint32_t rx_alloc_errors; /* Rx pool exhausted */
+  uint32_t rx_overruns;     /* DMA receive buffer unavailable */
+  uint32_t dma_errors;      /* DMA fatal bus errors */
+  uint32_t tx_timeouts;     /* frames dropped as the DMA did not complete or free descriptors in time */
+  uint32_t tx_ring_full;    /* frames that had to wait for a free Tx descriptor */
+  uint32_t rx_crc_errors;   /* MMC counter */
+  uint32_t rx_align_errors; /* MMC counter */
+} ethernetif_counters_t;
+
+bool ethernetif_input_budget(struct netif *netif, uint32_t budget);
+const ethernetif_counters_t *ethernetif_get_counters(void);
+
 /* USER CODE END 1 */
 #endif
@@ -38,6 +38,23 @@ void ff_memfree (
 
 #if FF_FS_REENTRANT	/* Mutal exclusion */
 
+/* Bare metal, no RTOS: FatFs is called from the foreground and, with ETHERNET_RX_IRQ
+/  enabled, from the network file services (FTP, HTTP, WebDAV) running in the lowest
+/  priority PendSV interrupt. Handler mode callers cannot be preempted by the foreground
+/  and are always granted access, thread mode callers mask PendSV via BASEPRI while
+/  they hold the grant. Nothing is ever waited for so FF_FS_TIMEOUT is not used.
+/  SysTick is kept above the masked level, HAL_GetTick() has to advance while a
+/  grant is held for the disk I/O timeouts to expire.
+*/
+
+#include "stm32h7xx.h"
+
+#define FF_GRANT_PRIORITY ((1UL << __NVIC_PRIO_BITS) - 1UL)
+#define FF_GRANT_BASEPRI (FF_GRANT_PRIORITY << (8U - __NVIC_PRIO_BITS))
+
+static volatile uint32_t grant_depth = 0, grant_basepri = 0;
+
+
 /*------------------------------------------------------------------------*/
 /* Create a Synchronization Object                                        */
 /*------------------------------------------------------------------------*/
@@ -46,35 +63,17 @@ void ff_memfree (
 /  When a 0 is returned, the f_mount() function fails with FR_INT_ERR.
 */
 
-//const osMutexDef_t Mutex[FF_VOLUMES];	/* Table of CMSIS-RTOS mutex */
-
-
 int ff_cre_syncobj (	/* 1:Function succeeded, 0:Could not create the sync object */
 	BYTE vol,			/* Corresponding volume (logical drive number) */
 	FF_SYNC_t* sobj		/* Pointer to return the created sync object */
 )
 {
-	/* Win32 */
-	*sobj = CreateMutex(NULL, FALSE, NULL);
-	return (int)(*sobj != INVALID_HANDLE_VALUE);
-
-	/* uITRON */
-//	T_CSEM csem = {TA_TPRI,1,1};
-//	*sobj = acre_sem(&csem);
-//	return (int)(*sobj > 0);
-
-	/* uC/OS-II */
-//	OS_ERR err;
-//	*sobj = OSMutexCreate(0, &err);
-//	return (int)(err == OS_NO_ERR);
-
-	/* FreeRTOS */
-//	*sobj = xSemaphoreCreateMutex();
-//	return (int)(*sobj != NULL);
-
-	/* CMSIS-RTOS */
-//	*sobj = osMutexCreate(&Mutex[vol]);
-//	return (int)(*sobj != NULL);
+	*sobj = (FF_SYNC_t)vol;	/* Access is serialized across all volumes */
+
+	if(NVIC_GetPriority(SysTick_IRQn) >= FF_GRANT_PRIORITY)
+		NVIC_SetPriority(SysTick_IRQn, FF_GRANT_PRIORITY - 1UL);
+
+	return 1;
 }
 
 
@@ -90,23 +89,9 @@ int ff_del_syncobj (	/* 1:Function succeeded, 0:Could not delete due to an error
 	FF_SYNC_t sobj		/* Sync object tied to the logical drive to be deleted */
 )
 {
-	/* Win32 */
-	return (int)CloseHandle(sobj);
-
-	/* uITRON */
-//	return (int)(del_sem(sobj) == E_OK);
-
-	/* uC/OS-II */
-//	OS_ERR err;
-//	OSMutexDel(sobj, OS_DEL_ALWAYS, &err);
-//	return (int)(err == OS_NO_ERR);
+	(void)sobj;
 
-	/* FreeRTOS */
-//  vSemaphoreDelete(sobj);
-//	return 1;
-
-	/* CMSIS-RTOS */
-//	return (int)(osMutexDelete(sobj) == osOK);
+	return 1;
 }
 
 
@@ -121,22 +106,16 @@ int ff_req_grant (	/* 1:Got a grant to access the volume, 0:Could not get a gran
 	FF_SYNC_t sobj	/* Sync object to wait */
 )
 {
-	/* Win32 */
-	return (int)(WaitForSingleObject(sobj, FF_FS_TIMEOUT) == WAIT_OBJECT_0);
-
-	/* uITRON */
-//	return (int)(wai_sem(sobj) == E_OK);
+	(void)sobj;
 
-	/* uC/OS-II */
-//	OS_ERR err;
-//	OSMutexPend(sobj, FF_FS_TIMEOUT, &err));
-//	return (int)(err == OS_NO_ERR);
+	if(__get_IPSR() == 0) {			/* Thread mode: keep PendSV out until released */
+		uint32_t basepri = __get_BASEPRI();
+		__set_BASEPRI_MAX(FF_GRANT_BASEPRI);
+		if(grant_depth++ == 0)
+			grant_basepri = basepri;
+	}
 
-	/* FreeRTOS */
-//	return (int)(xSemaphoreTake(sobj, FF_FS_TIMEOUT) == pdTRUE);
-
-	/* CMSIS-RTOS */
-//	return (int)(osMutexWait(sobj, FF_FS_TIMEOUT) == osOK);
+	return 1;
 }
 
 
@@ -150,20 +129,10 @@ void ff_rel_grant (
 	FF_SYNC_t sobj	/* Sync object to be signaled */
 )
 {
-	/* Win32 */
-	ReleaseMutex(sobj);
-
-	/* uITRON */
-//	sig_sem(sobj);
-
-	/* uC/OS-II */
-//	OSMutexPost(sobj);
-
-	/* FreeRTOS */
-//	xSemaphoreGive(sobj);
+	(void)sobj;
 
-	/* CMSIS-RTOS */
-//	osMutexRelease(sobj);
+	if(__get_IPSR() == 0 && grant_depth && --grant_depth == 0)
+		__set_BASEPRI(grant_basepri);	/* A pended PendSV runs now */
 }
 
 #endif
@@ -46,6 +46,9 @@
 #include "ff.h"
 #include "diskio.h"
 #include "sdmmc.h"
+#if SDCARD_INDEX
+#include "sdindex.h"
+#endif
 #endif
 
 #if USB_SERIAL_CDC
@@ -80,12 +83,24 @@
 #include "openpnp/openpnp.h"
 #endif
 
+#include "isr_profiler.h"
+#include "step_trace.h"
+
 #define DRIVER_IRQMASK (LIMIT_MASK|CONTROL_MASK|DEVICES_IRQ_MASK)
 
 #if DRIVER_IRQMASK != (LIMIT_MASK_SUM+CONTROL_MASK_SUM+DEVICES_IRQ_MASK_SUM)
 #error Interrupt enabled input pins must have unique pin numbers!
 #endif
 
+#if STEP_PULSE_TIMER_OUTPUT
+#if STEP_DMA_ENABLE || STEP_INJECT_ENABLE || SPINDLE_SYNC_ENABLE
+#error "STEP_PULSE_TIMER_OUTPUT cannot be combined with step DMA, step injection or spindle synchronized motion!"
+#endif
+#if defined(B_AXIS) || defined(X2_STEP_PIN) || defined(Y2_STEP_PIN) || defined(Z2_STEP_PIN) || (defined(A_AXIS) && !defined(A_STEP_TIMER_CH))
+#error "STEP_PULSE_TIMER_OUTPUT supports max four motors, each mapped to a PULSE_TIMER channel!"
+#endif
+#endif
+
 #define PROBE_IRQ_BIT 0
 
 #define STEPPER_TIMER_DIV 4
@@ -398,6 +413,42 @@ static uint32_t pulse_length, pulse_delay, aux_irq = 0;
 static bool IOInitDone = false, rtc_started = false;
 static pin_group_pins_t limit_inputs = {0};
 static axes_signals_t next_step_outbits;
+#if STEP_PULSE_TIMER_OUTPUT
+typedef struct {
+    uint32_t ccmr1;
+    uint32_t ccmr2;
+} step_oc_t;
+static step_oc_t step_oc_map[16];
+static uint32_t step_oc_arr, step_oc_arr_delayed;
+#endif
+#if STEP_DMA_ENABLE
+static struct {
+    bool enabled;
+    uint32_t pulse_ticks;
+    uint32_t delay_ticks;
+    uint8_t bits;           // Step bits of the pulse armed for the next tick
+    uint8_t active;         // Step bits of the pulse output in the current tick
+    bool pending;           // Next tick calculated by the core, to be armed at the end of the current pulse
+    bool running;           // Set by wake up, cleared when going idle
+    bool dir_change;
+    axes_signals_t dir_outbits;
+    axes_signals_t step_outbits;
+    GPIO_TypeDef *port;
+    stepper_t *stepper;
+    uint32_t on[N_AXIS];
+#ifdef SQUARING_ENABLED
+    uint32_t on2[N_AXIS];
+#endif
+} step_dma = {0};
+// DMA source words, padded to a cache line so it can be cleaned without touching other data.
+static struct {
+    uint32_t set;   // Written to the step port BSRR on the next step pulse start request
+    uint32_t reset; // Written to the step port BSRR on the stepper timer CC1 match
+} __attribute__((aligned(32))) step_dma_bsrr = {0};
+static void stepDmaArm (uint32_t word);
+static void stepDmaDisarm (void);
+static void stepDmaSetCompare (uint32_t arr);
+#endif
 static delay_t delay = { .ms = 1, .callback = NULL }; // NOTE: initial ms set to 1 for "resetting" systick timer on startup
 static debounce_t debounce;
 #ifdef PROBE_PIN
@@ -521,6 +572,20 @@ static void stepperWakeUp (void)
 {
     stepperEnable((axes_signals_t){AXES_BITMASK});
 
+#if STEP_DMA_ENABLE
+    if(step_dma.enabled) {
+        // Armed with no step bits, consumes the DMA request from the forced update event below.
+        step_dma.bits = 0;
+        stepDmaArm(0);
+        stepDmaSetCompare(hal.f_step_timer / 500);
+        // Restore the update interrupt if disabled when going idle, without the stale update event.
+        STEPPER_TIMER->CR1 &= ~TIM_CR1_OPM;
+        STEPPER_TIMER->SR = ~TIM_SR_UIF;
+        STEPPER_TIMER->DIER |= TIM_DIER_UIE;
+        step_dma.running = true;
+    }
+#endif
+
     STEPPER_TIMER->ARR = hal.f_step_timer / 500; // ~2ms delay to allow drivers time to wake up
     STEPPER_TIMER->EGR = TIM_EGR_UG;
     STEPPER_TIMER->SR = ~TIM_SR_UIF;
@@ -530,6 +595,20 @@ static void stepperWakeUp (void)
 // Disables stepper driver interrupts
 static void stepperGoIdle (bool clear_signals)
 {
+#if STEP_DMA_ENABLE
+    if(step_dma.enabled) {
+        if(step_dma.active) {
+            // The step pulse of this tick, started on the update event or still to be started by the CC2 match,
+            // is ended by the CC1 match. The timer runs to the end of the tick and stops there without an interrupt.
+            step_dma.pending = step_dma.running = false;
+            STEPPER_TIMER->DIER &= ~TIM_DIER_UIE;
+            STEPPER_TIMER->CR1 |= TIM_CR1_OPM;
+            return;
+        }
+        stepDmaDisarm();
+    }
+#endif
+
     STEPPER_TIMER->CR1 &= ~TIM_CR1_CEN;
     STEPPER_TIMER->CNT = 0;
 }
@@ -538,6 +617,9 @@ static void stepperGoIdle (bool clear_signals)
 static void stepperCyclesPerTick (uint32_t cycles_per_tick)
 {
     STEPPER_TIMER->ARR = cycles_per_tick < (1UL << 20) ? cycles_per_tick : 0x000FFFFFUL;
+#if STEP_DMA_ENABLE
+    stepDmaSetCompare(STEPPER_TIMER->ARR);
+#endif
 }
 
 #ifdef SQUARING_ENABLED
@@ -769,13 +851,16 @@ static void stepperPulseStart (stepper_t *stepper)
     }
 #endif
 
-    if(stepper->dir_change)
+    if(stepper->dir_change) {
         stepperSetDirOutputs(stepper->dir_outbits);
+        STEP_TRACE(StepTrace_Dir, stepper->dir_outbits.value);
+    }
 
     if(stepper->step_outbits.value) {
         stepperSetStepOutputs(stepper->step_outbits);
         PULSE_TIMER->EGR = TIM_EGR_UG;
         PULSE_TIMER->CR1 |= TIM_CR1_CEN;
+        STEP_TRACE(StepTrace_StepOn, stepper->step_outbits.value);
     }
 }
 
@@ -795,6 +880,7 @@ static void stepperPulseStartDelayed (stepper_t *stepper)
     if(stepper->dir_change) {
 
         stepperSetDirOutputs(stepper->dir_outbits);
+        STEP_TRACE(StepTrace_Dir, stepper->dir_outbits.value);
 
         if(stepper->step_outbits.value) {
             next_step_outbits = stepper->step_outbits; // Store out_bits
@@ -810,9 +896,347 @@ static void stepperPulseStartDelayed (stepper_t *stepper)
         stepperSetStepOutputs(stepper->step_outbits);
         PULSE_TIMER->EGR = TIM_EGR_UG;
         PULSE_TIMER->CR1 |= TIM_CR1_CEN;
+        STEP_TRACE(StepTrace_StepOn, stepper->step_outbits.value);
+    }
+}
+
+#if STEP_PULSE_TIMER_OUTPUT
+
+// Timer output compare version: each step pin is a PULSE_TIMER channel in one pulse mode,
+// channels for axes that are not to be stepped are forced inactive.
+// The pulse width, and delay after a direction change, is generated by the timer and needs no interrupt.
+static void stepperPulseStartOC (stepper_t *stepper)
+{
+    if(stepper->dir_change) {
+        stepperSetDirOutputs(stepper->dir_outbits);
+        STEP_TRACE(StepTrace_Dir, stepper->dir_outbits.value);
+    }
+
+    if(stepper->step_outbits.value) {
+        PULSE_TIMER->CCMR1 = step_oc_map[stepper->step_outbits.value & 0x0F].ccmr1;
+        PULSE_TIMER->CCMR2 = step_oc_map[stepper->step_outbits.value & 0x0F].ccmr2;
+        PULSE_TIMER->ARR = stepper->dir_change ? step_oc_arr_delayed : step_oc_arr;
+        PULSE_TIMER->EGR = TIM_EGR_UG;
+        PULSE_TIMER->CR1 |= TIM_CR1_CEN;
+        STEP_TRACE(StepTrace_StepOn, stepper->step_outbits.value); // Pulse is ended by the timer, not traced
+    }
+}
+
+// Channel n: OCnM and CCnE/CCnP bit offsets
+#define STEP_OC_CCMR_SHIFT(n) ((((n) - 1) & 1) * 8 + 4)
+#define STEP_OC_CCER_SHIFT(n) (((n) - 1) * 4)
+
+static void stepOCMapChannel (step_oc_t *oc, uint_fast8_t ch, bool invert)
+{
+    // Force inactive (0b100) -> PWM mode 1 (0b110)
+    if(ch <= 2)
+        oc->ccmr1 |= 0b010 << STEP_OC_CCMR_SHIFT(ch);
+    else
+        oc->ccmr2 |= 0b010 << STEP_OC_CCMR_SHIFT(ch);
+
+    PULSE_TIMER->CCER |= (invert ? TIM_CCER_CC1E|TIM_CCER_CC1P : TIM_CCER_CC1E) << STEP_OC_CCER_SHIFT(ch);
+}
+
+static void stepOCConfigure (settings_t *settings)
+{
+    uint_fast8_t idx, axis;
+    step_oc_t axis_oc[4] = {0}, idle = {0};
+    const uint8_t channel[] = {
+        X_STEP_TIMER_CH, Y_STEP_TIMER_CH, Z_STEP_TIMER_CH,
+#ifdef A_AXIS
+        A_STEP_TIMER_CH
+#endif
+    };
+
+    PULSE_TIMER->CCER = 0;
+
+    for(axis = 0; axis < sizeof(channel); axis++) {
+        if(channel[axis] <= 2)
+            idle.ccmr1 |= 0b100 << STEP_OC_CCMR_SHIFT(channel[axis]);
+        else
+            idle.ccmr2 |= 0b100 << STEP_OC_CCMR_SHIFT(channel[axis]);
+        stepOCMapChannel(&axis_oc[axis], channel[axis], !!(settings->steppers.step_invert.mask & (1 << axis)));
+    }
+
+    for(idx = 0; idx < sizeof(step_oc_map) / sizeof(step_oc_t); idx++) {
+        step_oc_map[idx] = idle;
+        for(axis = 0; axis < sizeof(channel); axis++) {
+            if(idx & (1 << axis)) {
+                step_oc_map[idx].ccmr1 |= axis_oc[axis].ccmr1;
+                step_oc_map[idx].ccmr2 |= axis_oc[axis].ccmr2;
+            }
+        }
+    }
+
+    PULSE_TIMER->CCMR1 = idle.ccmr1;
+    PULSE_TIMER->CCMR2 = idle.ccmr2;
+
+    // Downcounting PWM mode 1: output is active from CNT <= CCRx until underflow,
+    // timer runs at 100 ns per tick so pulse width is exact.
+    // ARR must be above CCRx: the one pulse mode timer stops with CNT reloaded to ARR,
+    // the output would stay active if ARR == CCRx. The pulse thus starts one tick after the update event.
+    step_oc_arr = (uint32_t)(10.0f * settings->steppers.pulse_microseconds);
+    step_oc_arr_delayed = step_oc_arr + (uint32_t)(10.0f * settings->steppers.pulse_delay_microseconds);
+    PULSE_TIMER->CCR1 = PULSE_TIMER->CCR2 = PULSE_TIMER->CCR3 = PULSE_TIMER->CCR4 = step_oc_arr - 1;
+    PULSE_TIMER->ARR = step_oc_arr;
+    PULSE_TIMER->DIER &= ~TIM_DIER_UIE;
+}
+
+#endif // STEP_PULSE_TIMER_OUTPUT
+
+#if STEP_DMA_ENABLE
+
+// Returns the step port BSRR word that starts a step pulse for the axes in step_outbits.
+inline static __attribute__((always_inline)) uint32_t stepDmaSetWord (axes_signals_t step_outbits)
+{
+    uint32_t word = 0;
+    uint_fast8_t idx = 0;
+#ifdef SQUARING_ENABLED
+    uint_fast8_t bits = step_outbits.mask & motors_1.mask, bits2 = step_outbits.mask & motors_2.mask;
+
+    while(bits | bits2) {
+        if(bits & 1)
+            word |= step_dma.on[idx];
+        if(bits2 & 1)
+            word |= step_dma.on2[idx];
+        bits >>= 1;
+        bits2 >>= 1;
+        idx++;
+    }
+#else
+    uint_fast8_t bits = step_outbits.mask;
+
+    while(bits) {
+        if(bits & 1)
+            word |= step_dma.on[idx];
+        bits >>= 1;
+        idx++;
+    }
+#endif
+
+    return word;
+}
+
+// Sets the compare values for a tick of arr timer ticks. ARR, CCR1 and CCR2 are preloaded (ARPE, OC1PE and OC2PE set
+// by stepDmaConfigure()) and take effect together at the next update event, or immediately on a forced one (UG).
+// The timer is downcounting: the step pulse starts delay_ticks after the update event, on the update event itself
+// or on the CC2 match, and is ended by the CC1 match pulse_ticks later.
+static void stepDmaSetCompare (uint32_t arr)
+{
+    uint32_t start = arr > step_dma.delay_ticks ? arr - step_dma.delay_ticks : 0;
+
+    STEPPER_TIMER->CCR2 = start;
+    STEPPER_TIMER->CCR1 = start > step_dma.pulse_ticks ? start - step_dma.pulse_ticks : 0;
+}
+
+// Arms the set stream for a single transfer of word to the step port BSRR on the next step pulse start request.
+// The stream is not circular as it fetches the source word as soon as it is enabled, before the request,
+// and has to be rearmed after the word is written. A word of 0 consumes the request without changing any output.
+static void stepDmaArm (uint32_t word)
+{
+    STEP_DMA_SET_STREAM->CR &= ~DMA_SxCR_EN;
+    while(STEP_DMA_SET_STREAM->CR & DMA_SxCR_EN);
+
+    step_dma_bsrr.set = word;
+#if L1_CACHE_ENABLE
+    SCB_CleanDCache_by_Addr((uint32_t *)&step_dma_bsrr, sizeof(step_dma_bsrr));
+#endif
+
+    DMA1->LIFCR = STEP_DMA_SET_FLAGS;
+    STEP_DMA_SET_STREAM->NDTR = 1;
+    STEP_DMA_SET_STREAM->CR |= DMA_SxCR_EN;
+}
+
+// Drops an armed step pulse, it would otherwise be output on the first request after the stepper timer is restarted.
+static void stepDmaDisarm (void)
+{
+    STEP_DMA_SET_STREAM->CR &= ~DMA_SxCR_EN;
+    while(STEP_DMA_SET_STREAM->CR & DMA_SxCR_EN);
+
+    step_dma.bits = step_dma.active = 0;
+    step_dma.pending = step_dma.running = false;
+}
+
+// Called on the stepper timer update event, before the core: the step pulse armed in the previous tick
+// is output in this tick.
+inline static __attribute__((always_inline)) void stepDmaUpdate (void)
+{
+    step_dma.active = step_dma.bits;
+    step_dma.bits = 0;
+
+#if STEP_TRACE_ENABLE
+    if(step_dma.active) {
+        // Cycles since the update event, the pulse starts delay_ticks after it.
+        int32_t elapsed = (int32_t)((STEPPER_TIMER->ARR - STEPPER_TIMER->CNT) - step_dma.delay_ticks) * (int32_t)hal.f_mcu / (int32_t)(hal.f_step_timer / 1000000UL);
+        step_trace_add_at(StepTrace_StepOn, step_dma.active, DWT->CYCCNT - elapsed);
+    }
+#endif
+}
+
+// Called at the end of the stepper interrupt when the core has calculated the step bits for the next tick.
+// They are armed by stepDmaRearm() when the step pulse of the current tick has ended.
+inline static __attribute__((always_inline)) void stepDmaPreload (void)
+{
+    stepper_t *stepper = step_dma.stepper;
+
+    if(stepper && step_dma.running) {
+        step_dma.dir_change = stepper->dir_change;
+        step_dma.dir_outbits = stepper->dir_outbits;
+        step_dma.step_outbits = stepper->step_outbits;
+        step_dma.pending = true;
+    }
+}
+
+// Called on the stepper timer CC1 match that ends the step pulse of the current tick, the start request
+// of the tick has been served so the stream can be rearmed for the next one. A direction change is output
+// here, ahead of the next step pulse by the remainder of the current tick plus the step pulse delay.
+inline static __attribute__((always_inline)) void stepDmaRearm (void)
+{
+    if(step_dma.pending) {
+
+        step_dma.pending = false;
+
+        if(step_dma.dir_change) {
+            stepperSetDirOutputs(step_dma.dir_outbits);
+            STEP_TRACE(StepTrace_Dir, step_dma.dir_outbits.value);
+        }
+
+        step_dma.bits = step_dma.step_outbits.value;
+        stepDmaArm(step_dma.bits ? stepDmaSetWord(step_dma.step_outbits) : 0);
+    }
+}
+
+// DMA version: the step pulse for the current tick has already been started by the stepper timer.
+// The core stepper state is not known before the first call, the pulse is output here for that tick only.
+// The pulse is ended by the CC1 DMA request in both cases.
+static void stepperPulseStartDMA (stepper_t *stepper)
+{
+    if(step_dma.stepper == NULL) {
+
+        step_dma.stepper = stepper;
+
+        if(stepper->dir_change) {
+            stepperSetDirOutputs(stepper->dir_outbits);
+            STEP_TRACE(StepTrace_Dir, stepper->dir_outbits.value);
+        }
+
+        if(stepper->step_outbits.mask) {
+            step_dma.port->BSRR = stepDmaSetWord(stepper->step_outbits);
+            step_dma.active = stepper->step_outbits.value;
+            STEP_TRACE(StepTrace_StepOn, stepper->step_outbits.value);
+        }
+    }
+}
+
+static void stepDmaMapPin (settings_t *settings, GPIO_TypeDef *port, uint32_t bit, uint_fast8_t axis, uint32_t *on)
+{
+    bool invert = !!(settings->steppers.step_invert.mask & (1 << axis));
+
+    if(step_dma.port == NULL)
+        step_dma.port = port;
+    else if(step_dma.port != port)
+        step_dma.enabled = false;
+
+    on[axis] |= invert ? (bit << 16) : bit;
+    step_dma_bsrr.reset |= invert ? bit : (bit << 16);
+}
+
+// The set stream is left disabled, it is armed for each tick by stepDmaArm().
+// The reset stream writes the same word on every CC1 match and is circular.
+static void stepDmaStreamInit (DMA_Stream_TypeDef *stream, DMAMUX_Channel_TypeDef *mux, uint32_t request, volatile uint32_t *src, bool circular)
+{
+    stream->CR &= ~DMA_SxCR_EN;
+    while(stream->CR & DMA_SxCR_EN);
+
+    if(step_dma.enabled) {
+        mux->CCR = request;
+        stream->PAR = (uint32_t)&step_dma.port->BSRR;
+        stream->M0AR = (uint32_t)src;
+        stream->NDTR = 1;
+        stream->FCR = 0; // Direct mode
+        stream->CR = DMA_SxCR_PL|DMA_SxCR_MSIZE_1|DMA_SxCR_PSIZE_1|DMA_SxCR_DIR_0|(circular ? DMA_SxCR_CIRC : 0);
+        DMA1->LIFCR = STEP_DMA_SET_FLAGS|STEP_DMA_RESET_FLAGS;
+        if(circular)
+            stream->CR |= DMA_SxCR_EN;
     }
 }
 
+// Builds the BSRR words for the step outputs and (re)starts the DMA streams.
+// Falls back to interrupt driven step pulses if the step outputs are not on the same port.
+static bool stepDmaConfigure (settings_t *settings)
+{
+#ifdef SQUARING_ENABLED
+    uint32_t *on2 = step_dma.on2;
+#else
+    uint32_t *on2 = step_dma.on;
+#endif
+
+    step_dma.enabled = true;
+    step_dma.port = NULL;
+    step_dma_bsrr.set = step_dma_bsrr.reset = 0;
+    memset(step_dma.on, 0, sizeof(step_dma.on));
+#ifdef SQUARING_ENABLED
+    memset(step_dma.on2, 0, sizeof(step_dma.on2));
+#endif
+
+    stepDmaMapPin(settings, X_STEP_PORT, X_STEP_BIT, X_AXIS, step_dma.on);
+    stepDmaMapPin(settings, Y_STEP_PORT, Y_STEP_BIT, Y_AXIS, step_dma.on);
+    stepDmaMapPin(settings, Z_STEP_PORT, Z_STEP_BIT, Z_AXIS, step_dma.on);
+#ifdef A_AXIS
+    stepDmaMapPin(settings, A_STEP_PORT, A_STEP_BIT, A_AXIS, step_dma.on);
+#endif
+#ifdef B_AXIS
+    stepDmaMapPin(settings, B_STEP_PORT, B_STEP_BIT, B_AXIS, step_dma.on);
+#endif
+#ifdef C_AXIS
+    stepDmaMapPin(settings, C_STEP_PORT, C_STEP_BIT, C_AXIS, step_dma.on);
+#endif
+#ifdef U_AXIS
+    stepDmaMapPin(settings, U_STEP_PORT, U_STEP_BIT, U_AXIS, step_dma.on);
+#endif
+#ifdef V_AXIS
+    stepDmaMapPin(settings, V_STEP_PORT, V_STEP_BIT, V_AXIS, step_dma.on);
+#endif
+#ifdef X2_STEP_PIN
+    stepDmaMapPin(settings, X2_STEP_PORT, X2_STEP_BIT, X_AXIS, on2);
+#endif
+#ifdef Y2_STEP_PIN
+    stepDmaMapPin(settings, Y2_STEP_PORT, Y2_STEP_BIT, Y_AXIS, on2);
+#endif
+#ifdef Z2_STEP_PIN
+    stepDmaMapPin(settings, Z2_STEP_PORT, Z2_STEP_BIT, Z_AXIS, on2);
+#endif
+
+    step_dma.pulse_ticks = (uint32_t)((float)hal.f_step_timer * settings->steppers.pulse_microseconds / 1000000.0f);
+    step_dma.delay_ticks = hal.driver_cap.step_pulse_delay && settings->steppers.pulse_delay_microseconds > 0.0f
+                            ? (uint32_t)((float)hal.f_step_timer * settings->steppers.pulse_delay_microseconds / 1000000.0f)
+                            : 0;
+    step_dma.bits = step_dma.active = 0;
+
+#if L1_CACHE_ENABLE
+    SCB_CleanDCache_by_Addr((uint32_t *)&step_dma_bsrr, sizeof(step_dma_bsrr));
+#endif
+
+    // With a step pulse delay the pulse is started by the CC2 match instead of the update event.
+    stepDmaStreamInit(STEP_DMA_SET_STREAM, STEP_DMA_SET_MUX, step_dma.delay_ticks ? STEP_DMA_SET_DELAYED_REQUEST : STEP_DMA_SET_REQUEST, &step_dma_bsrr.set, false);
+    stepDmaStreamInit(STEP_DMA_RESET_STREAM, STEP_DMA_RESET_MUX, STEP_DMA_RESET_REQUEST, &step_dma_bsrr.reset, true);
+
+    STEPPER_TIMER->DIER &= ~(TIM_DIER_UDE|TIM_DIER_CC1DE|TIM_DIER_CC2DE|TIM_DIER_CC1IE);
+
+    if(step_dma.enabled) {
+        // Channels 1 and 2 frozen, preloaded as ARR. The CC1 match interrupt rearms the set stream.
+        STEPPER_TIMER->CCMR1 = (STEPPER_TIMER->CCMR1 & ~(TIM_CCMR1_OC1M|TIM_CCMR1_CC1S|TIM_CCMR1_OC2M|TIM_CCMR1_CC2S)) | TIM_CCMR1_OC1PE|TIM_CCMR1_OC2PE;
+        STEPPER_TIMER->CR1 |= TIM_CR1_ARPE;
+        STEPPER_TIMER->SR = ~TIM_SR_CC1IF;
+        STEPPER_TIMER->DIER |= (step_dma.delay_ticks ? TIM_DIER_CC2DE : TIM_DIER_UDE)|TIM_DIER_CC1DE|TIM_DIER_CC1IE;
+    } else
+        STEPPER_TIMER->CR1 &= ~TIM_CR1_ARPE;
+
+    return step_dma.enabled;
+}
+
+#endif // STEP_DMA_ENABLE
+
 #if SPINDLE_SYNC_ENABLE
 
 // Spindle sync version: sets stepper direction and pulse pins and starts a step pulse.
@@ -1765,6 +2189,16 @@ void settings_changed (settings_t *settings, settings_changed_flags_t changed)
             hal.stepper.pulse_start = &stepperPulseStart;
         }
 
+#if STEP_DMA_ENABLE
+        if(stepDmaConfigure(settings))
+            hal.stepper.pulse_start = &stepperPulseStartDMA;
+#endif
+
+#if STEP_PULSE_TIMER_OUTPUT
+        stepOCConfigure(settings);
+        hal.stepper.pulse_start = &stepperPulseStartOC;
+#endif
+
         PULSE_TIMER->ARR = pulse_length;
         PULSE_TIMER->EGR = TIM_EGR_UG;
 
@@ -2151,6 +2585,10 @@ static bool driver_setup (settings_t *settings)
     NVIC_SetPriority(STEPPER_TIMER_IRQn, 1);
     NVIC_EnableIRQ(STEPPER_TIMER_IRQn);
 
+#if STEP_DMA_ENABLE
+    __HAL_RCC_DMA1_CLK_ENABLE();
+#endif
+
  // Single-shot 100 ns per tick
 
     PULSE_TIMER_CLKEN();
@@ -2160,9 +2598,27 @@ static bool driver_setup (settings_t *settings)
     PULSE_TIMER->CNT = 0;
     PULSE_TIMER->DIER |= TIM_DIER_UIE;
 
+#if STEP_PULSE_TIMER_OUTPUT
+
+    // Step pins are driven by the PULSE_TIMER compare channels, no interrupt needed
+
+    GPIO_Init.Alternate = timerAF(PULSE_TIMER_N, 2);
+    for(i = 0 ; i < sizeof(outputpin) / sizeof(output_signal_t); i++) {
+        if(outputpin[i].group == PinGroup_StepperStep) {
+            GPIO_Init.Pin = outputpin[i].bit;
+            GPIO_Init.Mode = outputpin[i].mode.open_drain ? GPIO_MODE_AF_OD : GPIO_MODE_AF_PP;
+            HAL_GPIO_Init(outputpin[i].port, &GPIO_Init);
+        }
+    }
+    GPIO_Init.Mode = GPIO_MODE_OUTPUT_PP;
+
+#else
+
     NVIC_SetPriority(PULSE_TIMER_IRQn, 0);
     NVIC_EnableIRQ(PULSE_TIMER_IRQn);
 
+#endif
+
 #if STEP_INJECT_ENABLE
 
     // Single-shot 100 ns per tick
@@ -2190,7 +2646,7 @@ static bool driver_setup (settings_t *settings)
         // Single-shot 0.1 ms per tick
         DEBOUNCE_TIMER_CLKEN();
         DEBOUNCE_TIMER->CR1 |= TIM_CR1_OPM|TIM_CR1_DIR|TIM_CR1_CKD_1|TIM_CR1_ARPE|TIM_CR1_URS;
-        DEBOUNCE_TIMER->PSC = hal.f_step_timer / 10000UL - 1;
+        DEBOUNCE_TIMER->PSC = (hal.f_step_timer * STEPPER_TIMER_DIV) / 10000UL - 1;
         DEBOUNCE_TIMER->SR &= ~TIM_SR_UIF;
         DEBOUNCE_TIMER->ARR = 400; // 40 ms timeout
         DEBOUNCE_TIMER->DIER |= TIM_DIER_UIE;
@@ -2226,6 +2682,9 @@ static bool driver_setup (settings_t *settings)
 
     sdmmc_init();
     sdcard_init();
+#if SDCARD_INDEX
+    sdindex_init();
+#endif
 
 #endif
 
@@ -2451,6 +2910,14 @@ bool driver_init (void)
 
     serialRegisterStreams();
 
+#if ISR_PROFILER_ENABLE
+    isr_profiler_init();
+#endif
+
+#if STEP_TRACE_ENABLE
+    step_trace_init();
+#endif
+
 #if USB_SERIAL_CDC
     stream_connect(usbInit());
 #else
@@ -2672,11 +3139,35 @@ bool driver_init (void)
 // Main stepper driver
 void STEPPER_TIMER_IRQHandler (void)
 {
+    ISR_PROFILE_ENTER();
+#if ISR_PROFILER_ENABLE
+    // Timer is downcounting, ticks elapsed since the update event is the entry latency
+    uint32_t latency = (STEPPER_TIMER->SR & TIM_SR_UIF) ? (STEPPER_TIMER->ARR - STEPPER_TIMER->CNT) * hal.f_mcu / (hal.f_step_timer / 1000000UL) : 0;
+#endif
+
+#if STEP_DMA_ENABLE
+    // End of the step pulse, served first as it belongs to the tick before a pending update event.
+    if(step_dma.enabled && (STEPPER_TIMER->SR & TIM_SR_CC1IF)) {
+        STEPPER_TIMER->SR = ~TIM_SR_CC1IF;
+        stepDmaRearm();
+    }
+#endif
+
     if ((STEPPER_TIMER->SR & TIM_SR_UIF) != 0)                  // check interrupt source
     {
         STEPPER_TIMER->SR = ~TIM_SR_UIF; // clear UIF flag
+#if STEP_DMA_ENABLE
+        if(step_dma.enabled)
+            stepDmaUpdate();
+#endif
         hal.stepper.interrupt_callback();
+#if STEP_DMA_ENABLE
+        if(step_dma.enabled)
+            stepDmaPreload();
+#endif
     }
+
+    ISR_PROFILE_EXIT_LATENCY(IsrProfile_Stepper, latency);
 }
 
 /* The Stepper Port Reset Interrupt: This interrupt handles the falling edge of the step
@@ -2699,6 +3190,8 @@ void STEPPER_TIMER_IRQHandler (void)
 // completing one step cycle.
 void PULSE_TIMER_IRQHandler (void)
 {
+    ISR_PROFILE_ENTER();
+
     PULSE_TIMER->SR &= ~TIM_SR_UIF;                 // Clear UIF flag
 
     if (PULSE_TIMER->ARR == pulse_delay) {          // Delayed step pulse?
@@ -2706,14 +3199,21 @@ void PULSE_TIMER_IRQHandler (void)
         stepperSetStepOutputs(next_step_outbits);   // begin step pulse
         PULSE_TIMER->EGR = TIM_EGR_UG;
         PULSE_TIMER->CR1 |= TIM_CR1_CEN;
-    } else
+        STEP_TRACE(StepTrace_StepOn, next_step_outbits.value);
+    } else {
         stepperSetStepOutputs((axes_signals_t){0}); // end step pulse
+        STEP_TRACE(StepTrace_StepOff, 0);
+    }
+
+    ISR_PROFILE_EXIT(IsrProfile_StepPulse);
 }
 
 #if STEP_INJECT_ENABLE
 
 void PULSE2_TIMER_IRQHandler (void)
 {
+    ISR_PROFILE_ENTER();
+
     PULSE2_TIMER->SR &= ~TIM_SR_UIF;                        // Clear UIF flag
 
     if(PULSE2_TIMER->ARR == pulse_delay) {                  // Delayed step pulse?
@@ -2725,6 +3225,8 @@ void PULSE2_TIMER_IRQHandler (void)
         PULSE2_TIMER->CR1 |= TIM_CR1_CEN;
     } else
         stepperInjectStep(settings.steppers.step_invert);   // end step pulse
+
+    ISR_PROFILE_EXIT(IsrProfile_StepInject);
 }
 
 #endif // STEP_INJECT_ENABLE
@@ -2732,6 +3234,8 @@ void PULSE2_TIMER_IRQHandler (void)
 // Debounce timer interrupt handler
 void DEBOUNCE_TIMER_IRQHandler (void)
 {
+    ISR_PROFILE_ENTER();
+
     DEBOUNCE_TIMER->SR = ~TIM_SR_UIF; // clear UIF flag;
 
     if(debounce.limits) {
@@ -2750,6 +3254,8 @@ void DEBOUNCE_TIMER_IRQHandler (void)
         if(state.safety_door_ajar)
             hal.control.interrupt_callback(state);
     }
+
+    ISR_PROFILE_EXIT(IsrProfile_Debounce);
 }
 
 #if PPI_ENABLE
@@ -2792,6 +3298,8 @@ void RPM_COUNTER_IRQHandler (void)
 
 void EXTI0_IRQHandler(void)
 {
+    ISR_PROFILE_ENTER();
+
     uint32_t ifg = __HAL_GPIO_EXTI_GET_IT(1<<0);
 
     if(ifg) {
@@ -2830,6 +3338,8 @@ void EXTI0_IRQHandler(void)
             qei_select_handler();
 #endif
     }
+
+    ISR_PROFILE_EXIT(IsrProfile_EXTI0);
 }
 
 #endif
@@ -2838,6 +3348,8 @@ void EXTI0_IRQHandler(void)
 
 void EXTI1_IRQHandler(void)
 {
+    ISR_PROFILE_ENTER();
+
     uint32_t ifg = __HAL_GPIO_EXTI_GET_IT(1<<1);
 
     if(ifg) {
@@ -2876,6 +3388,8 @@ void EXTI1_IRQHandler(void)
             qei_select_handler();
 #endif
     }
+
+    ISR_PROFILE_EXIT(IsrProfile_EXTI1);
 }
 
 #endif
@@ -2884,6 +3398,8 @@ void EXTI1_IRQHandler(void)
 
 void EXTI2_IRQHandler(void)
 {
+    ISR_PROFILE_ENTER();
+
     uint32_t ifg = __HAL_GPIO_EXTI_GET_IT(1<<2);
 
     if(ifg) {
@@ -2922,6 +3438,8 @@ void EXTI2_IRQHandler(void)
             qei_select_handler();
 #endif
     }
+
+    ISR_PROFILE_EXIT(IsrProfile_EXTI2);
 }
 
 #endif
@@ -2930,6 +3448,8 @@ void EXTI2_IRQHandler(void)
 
 void EXTI3_IRQHandler(void)
 {
+    ISR_PROFILE_ENTER();
+
     uint32_t ifg = __HAL_GPIO_EXTI_GET_IT(1<<3);
 
     if(ifg) {
@@ -2968,6 +3488,8 @@ void EXTI3_IRQHandler(void)
             qei_select_handler();
 #endif
     }
+
+    ISR_PROFILE_EXIT(IsrProfile_EXTI3);
 }
 
 #endif
@@ -2976,6 +3498,8 @@ void EXTI3_IRQHandler(void)
 
 void EXTI4_IRQHandler(void)
 {
+    ISR_PROFILE_ENTER();
+
     uint32_t ifg = __HAL_GPIO_EXTI_GET_IT(1<<4);
 
     if(ifg) {
@@ -3014,6 +3538,8 @@ void EXTI4_IRQHandler(void)
             qei_select_handler();
 #endif
     }
+
+    ISR_PROFILE_EXIT(IsrProfile_EXTI4);
 }
 
 #endif
@@ -3022,6 +3548,8 @@ void EXTI4_IRQHandler(void)
 
 void EXTI9_5_IRQHandler(void)
 {
+    ISR_PROFILE_ENTER();
+
     uint32_t ifg = __HAL_GPIO_EXTI_GET_IT(0x03E0);
 
     if(ifg) {
@@ -3080,6 +3608,8 @@ void EXTI9_5_IRQHandler(void)
             ioports_event(ifg & aux_irq);
 #endif
     }
+
+    ISR_PROFILE_EXIT(IsrProfile_EXTI9_5);
 }
 
 #endif
@@ -3088,6 +3618,8 @@ void EXTI9_5_IRQHandler(void)
 
 void EXTI15_10_IRQHandler(void)
 {
+    ISR_PROFILE_ENTER();
+
     uint32_t ifg = __HAL_GPIO_EXTI_GET_IT(0xFC00);
 
     if(ifg) {
@@ -3144,6 +3676,8 @@ void EXTI15_10_IRQHandler(void)
             ioports_event(ifg & aux_irq);
 #endif
     }
+
+    ISR_PROFILE_EXIT(IsrProfile_EXTI15_10);
 }
 
 #endif
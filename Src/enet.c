@@ -30,6 +30,8 @@
 #include <lwipopts.h>
 #include <lwip/netif.h>
 #include "lwip/dhcp.h"
+#include "lwip/igmp.h"
+#include "lwip/stats.h"
 #include "lwip.h"
 #include "lwip/init.h"
 #include "ethernetif.h"
@@ -38,6 +40,18 @@
 #include "tcp_echoserver.h"
 #endif
 
+#if NETBENCH_ENABLE
+#include "netbench.h"
+#endif
+
+#if UDP_RT_ENABLE
+#include "udp_rt.h"
+#endif
+
+#if NETMON_ENABLE
+#include "netmon.h"
+#endif
+
 #include "grbl/report.h"
 #include "grbl/nvs_buffer.h"
 
@@ -46,6 +60,11 @@
 #define MDNS_TTL 32
 
 static volatile bool linkUp = false;
+#if NETHEALTH_ENABLE
+static uint32_t link_up_count = 0, link_down_count = 0;
+#endif
+static volatile uint32_t net_info_sequence = 0;
+static network_info_t net_info;
 static char IPAddress[IP4ADDR_STRLEN_MAX];
 static stream_type_t active_stream = StreamType_Null;
 static network_services_t services = {0}, allowed_services;
@@ -97,12 +116,31 @@ static void report_options (bool newopt)
         hal.stream.write(IPAddress);
         hal.stream.write("]" ASCII_EOL);
 
+#if LWIP_IPV6
+        uint_fast8_t idx;
+        char ip6[IP6ADDR_STRLEN_MAX];
+
+        if(netif_default) for(idx = 0; idx < LWIP_IPV6_NUM_ADDRESSES; idx++) {
+            if(ip6_addr_isvalid(netif_ip6_addr_state(netif_default, idx))) {
+                hal.stream.write("[IPV6:");
+                hal.stream.write(ip6addr_ntoa_r(netif_ip6_addr(netif_default, idx), ip6, IP6ADDR_STRLEN_MAX));
+                hal.stream.write("]" ASCII_EOL);
+            }
+        }
+#endif
+
         if(active_stream == StreamType_Telnet || active_stream == StreamType_WebSocket) {
             hal.stream.write("[NETCON:");
             hal.stream.write(active_stream == StreamType_Telnet ? "Telnet" : "Websocket");
             hal.stream.write("]" ASCII_EOL);
         }
 
+#if NETMON_ENABLE
+        hal.stream.write("[NETMON:");
+        hal.stream.write(uitoa(netmon_clients()));
+        hal.stream.write("]" ASCII_EOL);
+#endif
+
 #if MQTT_ENABLE
         char *client_id;
         if(*(client_id = networking_get_info()->mqtt_client_id)) {
@@ -114,41 +152,82 @@ static void report_options (bool newopt)
     }
 }
 
-network_info_t *networking_get_info (void)
+// The network info is rebuilt from the link and netif status callbacks, i.e. from the lwIP
+// context which is PendSV when ETHERNET_RX_IRQ is enabled. It is published under a sequence
+// counter that is odd while net_info is written, networking_get_info() copies it and retries
+// if an update was made meanwhile.
+static void network_info_update (void)
 {
-    static network_info_t info;
+    static network_info_t update;
+
+    network_info_t *info = &update;
 
-    memcpy(&info.status, &network, sizeof(network_settings_t));
+    memcpy(&info->status, &network, sizeof(network_settings_t));
 
-    strcpy(info.status.ip, IPAddress);
+    strcpy(info->status.ip, IPAddress);
 
-    if(info.status.ip_mode == IpMode_DHCP) {
-        *info.status.gateway = '\0';
-        *info.status.mask = '\0';
+    if(info->status.ip_mode == IpMode_DHCP) {
+        *info->status.gateway = '\0';
+        *info->status.mask = '\0';
     }
 
-    info.is_ethernet = true;
-    info.link_up = linkUp;
-    info.mbps = 100;
-    info.status.services = services;
+    info->is_ethernet = true;
+    info->link_up = linkUp;
+    info->mbps = 100;
+    info->status.services = services;
 
     struct netif *netif = netif_default; // netif_get_by_index(0);
 
     if(netif) {
 
         if(linkUp) {
-            ip4addr_ntoa_r(netif_ip_gw4(netif), info.status.gateway, IP4ADDR_STRLEN_MAX);
-            ip4addr_ntoa_r(netif_ip_netmask4(netif), info.status.mask, IP4ADDR_STRLEN_MAX);
+            ip4addr_ntoa_r(netif_ip_gw4(netif), info->status.gateway, IP4ADDR_STRLEN_MAX);
+            ip4addr_ntoa_r(netif_ip_netmask4(netif), info->status.mask, IP4ADDR_STRLEN_MAX);
         }
 
-        sprintf(info.mac, MAC_FORMAT_STRING, netif->hwaddr[0], netif->hwaddr[1], netif->hwaddr[2], netif->hwaddr[3], netif->hwaddr[4], netif->hwaddr[5]);
-    }
+        sprintf(info->mac, MAC_FORMAT_STRING, netif->hwaddr[0], netif->hwaddr[1], netif->hwaddr[2], netif->hwaddr[3], netif->hwaddr[4], netif->hwaddr[5]);
+    } else
+        *info->mac = '\0';
 
 #if MQTT_ENABLE
-    networking_make_mqtt_clientid(info.mac, info.mqtt_client_id);
+    networking_make_mqtt_clientid(info->mac, info->mqtt_client_id);
 #endif
 
-    return &info;
+    net_info_sequence++;
+    __DMB();
+    memcpy(&net_info, info, sizeof(network_info_t));
+    __DMB();
+    net_info_sequence++;
+}
+
+// Returns a copy, one for the foreground and one for interrupt context as the network
+// services may call this from PendSV while the foreground holds its copy.
+network_info_t *networking_get_info (void)
+{
+    static network_info_t copy[2];
+
+    uint32_t sequence;
+    network_info_t *info = &copy[__get_IPSR() != 0];
+
+    // Not built yet, lwIP is not serviced from PendSV before enet_start() has built it.
+    if(net_info_sequence == 0)
+        network_info_update();
+
+    do {
+        sequence = net_info_sequence;
+        __DMB();
+        memcpy(info, &net_info, sizeof(network_info_t));
+        __DMB();
+    } while((sequence & 1) || sequence != net_info_sequence);
+
+    return info;
+}
+
+// Incremented on every change of the information returned by networking_get_info(),
+// callers may cache derived data as long as the value is unchanged.
+uint32_t enet_get_info_generation (void)
+{
+    return net_info_sequence >> 1;
 }
 
 static void link_status_callback (struct netif *netif)
@@ -157,6 +236,13 @@ static void link_status_callback (struct netif *netif)
 
     if(isLinkUp != linkUp) {
         linkUp = isLinkUp;
+#if NETHEALTH_ENABLE
+        if(linkUp)
+            link_up_count++;
+        else
+            link_down_count++;
+#endif
+        network_info_update();
 #if TELNET_ENABLE
         telnetd_notify_link_status(linkUp);
 #endif
@@ -183,17 +269,27 @@ static void mdns_service_info (struct mdns_service *service, void *txt_userdata)
 
 #endif
 
+static bool netif_has_address (struct netif *netif)
+{
+#if LWIP_IPV6
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < LWIP_IPV6_NUM_ADDRESSES; idx++) {
+        if(ip6_addr_isvalid(netif_ip6_addr_state(netif, idx)))
+            return true;
+    }
+#endif
+
+    return !ip4_addr_isany_val(*netif_ip4_addr(netif));
+}
+
 static void netif_status_callback (struct netif *netif)
 {
-#if IP_V6
-    if(netif->ip_addr.u_addr.ip4.addr == 0)
-        return;
-#else
-    if(netif->ip_addr.addr == 0)
+    if(!netif_has_address(netif))
         return;
-#endif
 
-    ip4addr_ntoa_r(netif_ip_addr4(netif), IPAddress, IP4ADDR_STRLEN_MAX);
+    if(!ip4_addr_isany_val(*netif_ip4_addr(netif)))
+        ip4addr_ntoa_r(netif_ip4_addr(netif), IPAddress, IP4ADDR_STRLEN_MAX);
 
 #if TELNET_ENABLE
     if(network.services.telnet && !services.telnet)
@@ -247,8 +343,14 @@ static void netif_status_callback (struct netif *netif)
 //            mdns_resp_announce(netif_default);
         }
     }
+  #if LWIP_IPV6
+    else if(services.mdns) // announce addresses added by autoconfiguration
+        mdns_resp_announce(netif_default);
+  #endif
 #endif
 
+    network_info_update();
+
 #if MQTT_ENABLE
     if(!mqtt_connected)
         mqtt_connect(&network.mqtt, networking_get_info()->mqtt_client_id);
@@ -259,13 +361,20 @@ static void netif_status_callback (struct netif *netif)
 #endif
 }
 
-static void enet_poll (sys_state_t state)
+#if ETHERNET_RX_IRQ
+static volatile bool enet_started = false;
+#endif
+
+// Returns true if the receive budget was exhausted.
+static bool enet_service (void)
 {
     static uint32_t last_ms0, last_link_check;
 
-    on_execute_realtime(state);
-
+    bool rx_pending = false;
     uint32_t ms = hal.get_elapsed_ticks();
+#if NETBENCH_ENABLE
+    uint32_t cycles = DWT->CYCCNT;
+#endif
 
     if(ms - last_link_check >= 100) {
         last_link_check = ms;
@@ -273,7 +382,21 @@ static void enet_poll (sys_state_t state)
     }
 
     sys_check_timeouts();
+#if ETHERNET_RX_IRQ
+    rx_pending = ethernetif_input_budget(netif_default, ETHERNET_RX_BUDGET);
+#else
     ethernetif_input(netif_default);
+#endif
+
+#if UDP_RT_ENABLE
+    if(linkUp)
+        udp_rt_poll();
+#endif
+
+#if NETMON_ENABLE
+    if(linkUp)
+        netmon_poll();
+#endif
 
     if(linkUp && ms - last_ms0 > 3) {
         last_ms0 = ms;
@@ -293,6 +416,35 @@ static void enet_poll (sys_state_t state)
         modbus_tcp_client_poll();
 #endif
     }
+
+#if NETBENCH_ENABLE
+    netbench_record_poll(DWT->CYCCNT - cycles);
+#endif
+
+    return rx_pending;
+}
+
+#if ETHERNET_RX_IRQ
+
+// Called from the lowest priority PendSV interrupt, pended by the Ethernet receive interrupt and SysTick.
+// All lwIP processing takes place here so no locking against the foreground is required.
+// If more frames are pending after the receive budget is spent PendSV is pended again,
+// this allows other interrupts in between passes.
+void enet_pendsv (void)
+{
+    if(enet_started && enet_service())
+        SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+}
+
+#endif
+
+static void enet_poll (sys_state_t state)
+{
+    on_execute_realtime(state);
+
+#if !ETHERNET_RX_IRQ
+    enet_service();
+#endif
 }
 
 bool enet_start (void)
@@ -323,17 +475,36 @@ bool enet_start (void)
         lwip_init();
 
         if(network.ip_mode == IpMode_Static)
-            netif_add(&ethif, (ip_addr_t *)&network.ip, (ip_addr_t *)&network.mask, (ip_addr_t *)&network.gateway, NULL, &ethernetif_init, &ethernet_input);
+            netif_add(&ethif, (ip4_addr_t *)&network.ip, (ip4_addr_t *)&network.mask, (ip4_addr_t *)&network.gateway, NULL, &ethernetif_init, &ethernet_input);
         else
             netif_add(&ethif, NULL, NULL, NULL, NULL, &ethernetif_init, &ethernet_input);
 
         netif_set_default(&ethif);
+
+#if LWIP_IPV6
+        // Link-local address, global addresses are added by stateless autoconfiguration (SLAAC)
+        // from router advertisements. Status callbacks are invoked as addresses become valid.
+        netif_create_ip6_linklocal_address(netif_default, 1);
+        netif_set_ip6_autoconfig_enabled(netif_default, 1);
+#endif
+
+#if LWIP_IGMP
+        // Set before the status callback below may start mDNS.
+        // Multicast MAC filters are set up by ethernetif.c for the groups joined,
+        // starting with the all systems group needed for answering IGMP queries.
+        if(network.services.mdns || network.services.ssdp) {
+            netif_default->flags |= NETIF_FLAG_IGMP;
+            igmp_start(netif_default);
+        }
+#endif
+
         netif_set_link_callback(netif_default, link_status_callback);
         netif_set_status_callback(netif_default, netif_status_callback);
 
         // Invoke the link & interface callback functions once manually, as not necessarily triggered on startup
         link_status_callback(netif_default);
         netif_status_callback(netif_default);
+        network_info_update();
 
     #if LWIP_NETIF_HOSTNAME
         netif_set_hostname(netif_default, network.hostname);
@@ -342,33 +513,106 @@ bool enet_start (void)
             dhcp_start(netif_default);
     }
 
-#if MDNS_ENABLE || SSDP_ENABLE || LWIP_IGMP
+#if TCP_ECHOSERVER_ENABLE
+        // Echos all input on TCP port 7, useful for diagnostics and performance checks
+        tcp_echoserver_init();
+#endif
 
-    if(network.services.mdns || network.services.ssdp) {
+#if NETBENCH_ENABLE
+    if(nvs_address != 0)
+        netbench_init();
+#endif
 
-        ETH_MACFilterConfigTypeDef filters;
+#if UDP_RT_ENABLE
+    if(nvs_address != 0)
+        udp_rt_init();
+#endif
 
-        HAL_ETH_GetMACFilterConfig(&heth, &filters);
+#if NETMON_ENABLE
+    if(nvs_address != 0)
+        netmon_init();
+#endif
 
-        // TODO: add filters for SSDP and mDNS
-        filters.PassAllMulticast = On;
-    //    filters.PromiscuousMode = On;
+#if ETHERNET_RX_IRQ
+    if(nvs_address != 0) {
+        NVIC_SetPriority(PendSV_IRQn, (1UL << __NVIC_PRIO_BITS) - 1UL);
+        // SysTick must preempt PendSV: lwIP and the file services use HAL_GetTick() for timeouts,
+        // and the FatFs grant (ffsystem.c) masks the lowest priority level from the foreground.
+        NVIC_SetPriority(SysTick_IRQn, (1UL << __NVIC_PRIO_BITS) - 2UL);
+        enet_started = true;
+    }
+#endif
 
-        HAL_ETH_SetMACFilterConfig(&heth, &filters);
+    return nvs_address != 0;
+}
+
+#if NETHEALTH_ENABLE
+
+static void report_counter (const char *name, uint32_t value, bool last)
+{
+    hal.stream.write(name);
+    hal.stream.write(":");
+    hal.stream.write(uitoa(value));
+    hal.stream.write(last ? "]" ASCII_EOL : ",");
+}
 
-        netif_default->flags |= NETIF_FLAG_IGMP;
+// $NETHEALTH - outputs the interface and stack health counters, counting starts at boot.
+// [ETH:...] is fed by the driver, [LWIP:...] by the lwIP statistics.
+static status_code_t enet_health_report (sys_state_t state, char *args)
+{
+    const ethernetif_counters_t *eth = ethernetif_get_counters();
+
+    hal.stream.write("[ETH:");
+    hal.stream.write(linkUp ? "up," : "down,");
+    report_counter("linkup", link_up_count, false);
+    report_counter("linkdown", link_down_count, false);
+    report_counter("rx", eth->rx_frames, false);
+    report_counter("tx", eth->tx_frames, false);
+    report_counter("rxnobuf", eth->rx_alloc_errors, false);
+    report_counter("rxoverrun", eth->rx_overruns, false);
+    report_counter("crc", eth->rx_crc_errors, false);
+    report_counter("align", eth->rx_align_errors, false);
+    report_counter("dmaerr", eth->dma_errors, false);
+    report_counter("txfull", eth->tx_ring_full, false);
+    report_counter("txtimeout", eth->tx_timeouts, true);
+
+    uint32_t memp_err = 0;
+  #if MEMP_STATS
+    uint_fast8_t idx;
+    for(idx = 0; idx < MEMP_MAX; idx++) {
+        if(lwip_stats.memp[idx])
+            memp_err += lwip_stats.memp[idx]->err;
     }
+  #endif
 
-#endif
+    hal.stream.write("[LWIP:");
+    report_counter("linkdrop", lwip_stats.link.drop, false);
+    report_counter("ipdrop", lwip_stats.ip.drop, false);
+    report_counter("tcpdrop", lwip_stats.tcp.drop, false);
+    report_counter("udpdrop", lwip_stats.udp.drop, false);
+    report_counter("retrans", lwip_stats.mib2.tcpretranssegs, false);
+    report_counter("memerr", lwip_stats.mem.err, false);
+    report_counter("memperr", memp_err, true);
 
-#if TCP_ECHOSERVER_ENABLE
-        // Echos all input on TCP port 7, useful for diagnostics and performance checks
-        tcp_echoserver_init();
-#endif
+    return Status_OK;
+}
 
-    return nvs_address != 0;
+static const sys_command_t enet_command_list[] = {
+    {"NETHEALTH", enet_health_report, {}, { .str = "output Ethernet and network stack health counters" } }
+};
+
+static sys_commands_t enet_commands = {
+    .n_commands = sizeof(enet_command_list) / sizeof(sys_command_t),
+    .commands = enet_command_list
+};
+
+static sys_commands_t *on_get_commands (void)
+{
+    return &enet_commands;
 }
 
+#endif // NETHEALTH_ENABLE
+
 static inline void set_addr (char *ip, ip4_addr_t *addr)
 {
     memcpy(ip, addr, sizeof(ip4_addr_t));
@@ -458,7 +702,7 @@ static setting_details_t setting_details = {
 
 static status_code_t ethernet_set_ip (setting_id_t setting, char *value)
 {
-    ip_addr_t addr;
+    ip4_addr_t addr;
 
     if(ip4addr_aton(value, &addr) != 1)
         return Status_InvalidStatement;
@@ -500,20 +744,20 @@ static char *ethernet_get_ip (setting_id_t setting)
     switch(setting) {
 
         case Setting_IpAddress:
-            ip4addr_ntoa_r((const ip_addr_t *)&ethernet.ip, ip, IPADDR_STRLEN_MAX);
+            ip4addr_ntoa_r((const ip4_addr_t *)&ethernet.ip, ip, IPADDR_STRLEN_MAX);
             break;
 
         case Setting_Gateway:
-            ip4addr_ntoa_r((const ip_addr_t *)&ethernet.gateway, ip, IPADDR_STRLEN_MAX);
+            ip4addr_ntoa_r((const ip4_addr_t *)&ethernet.gateway, ip, IPADDR_STRLEN_MAX);
             break;
 
         case Setting_NetMask:
-            ip4addr_ntoa_r((const ip_addr_t *)&ethernet.mask, ip, IPADDR_STRLEN_MAX);
+            ip4addr_ntoa_r((const ip4_addr_t *)&ethernet.mask, ip, IPADDR_STRLEN_MAX);
             break;
 
 #if MQTT_ENABLE
         case Setting_MQTTBrokerIpAddress:
-            ip4addr_ntoa_r((const ip_addr_t *)&ethernet.mqtt.ip, ip, IPADDR_STRLEN_MAX);
+            ip4addr_ntoa_r((const ip4_addr_t *)&ethernet.mqtt.ip, ip, IPADDR_STRLEN_MAX);
             break;
 #endif
 
@@ -622,6 +866,11 @@ bool enet_init (network_settings_t *settings)
 
         settings_register(&setting_details);
 
+#if NETHEALTH_ENABLE
+        enet_commands.on_get_commands = grbl.on_get_commands;
+        grbl.on_get_commands = on_get_commands;
+#endif
+
 #if MODBUS_ENABLE & MODBUS_TCP_ENABLED
         modbus_tcp_client_init ();
 #endif
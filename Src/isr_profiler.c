@@ -0,0 +1,196 @@
+/*
+
+  isr_profiler.c - interrupt load and latency profiler using the DWT cycle counter
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "isr_profiler.h"
+
+#if ISR_PROFILER_ENABLE
+
+#include <string.h>
+
+#include "grbl/hal.h"
+#include "grbl/system.h"
+#include "grbl/nuts_bolts.h"
+
+static const char *isr_name[IsrProfile_N] = {
+    "Stepper",
+    "StepPulse",
+    "StepInject",
+    "Debounce",
+    "EXTI0",
+    "EXTI1",
+    "EXTI2",
+    "EXTI3",
+    "EXTI4",
+    "EXTI9_5",
+    "EXTI15_10",
+    "Serial0",
+    "Serial1",
+    "Serial2",
+    "USB",
+    "SDMMC",
+    "SysTick"
+};
+
+static isr_profile_t isr_profile[IsrProfile_N];
+static uint32_t cycles_per_us, start_ms;
+static on_report_options_ptr on_report_options;
+
+// Called from interrupt context at handler exit.
+// Interrupts are masked during the update as handlers sharing an id, e.g. UART and its RX DMA, may nest.
+void isr_profiler_record (isr_profile_id_t id, uint32_t entry, uint32_t latency)
+{
+    uint32_t cycles = DWT->CYCCNT - entry, us = cycles / cycles_per_us, primask = __get_PRIMASK();
+    isr_profile_t *profile = &isr_profile[id];
+
+    __disable_irq();
+
+    profile->count++;
+    profile->sum += cycles;
+    if(cycles < profile->min)
+        profile->min = cycles;
+    if(cycles > profile->max)
+        profile->max = cycles;
+    if(latency) {
+        profile->latency_count++;
+        profile->latency_sum += latency;
+        if(latency > profile->latency_max)
+            profile->latency_max = latency;
+    }
+    profile->histogram[us == 0 ? 0 : min(32 - __CLZ(us), ISR_PROFILER_BUCKETS - 1)]++;
+
+    __set_PRIMASK(primask);
+}
+
+static void isr_profiler_reset (void)
+{
+    uint_fast8_t idx;
+
+    __disable_irq();
+
+    memset(isr_profile, 0, sizeof(isr_profile));
+    for(idx = 0; idx < IsrProfile_N; idx++)
+        isr_profile[idx].min = UINT32_MAX;
+    start_ms = hal.get_elapsed_ticks();
+
+    __enable_irq();
+}
+
+static char *cycles2us (uint64_t cycles)
+{
+    return ftoa((float)cycles / (float)cycles_per_us, 2);
+}
+
+static void report_profile (isr_profile_id_t id, uint64_t elapsed)
+{
+    uint_fast8_t idx;
+    isr_profile_t profile;
+
+    __disable_irq();
+    memcpy(&profile, &isr_profile[id], sizeof(isr_profile_t));
+    __enable_irq();
+
+    hal.stream.write("[ISR:");
+    hal.stream.write(isr_name[id]);
+    hal.stream.write("|");
+    hal.stream.write(uitoa(profile.count));
+    hal.stream.write("|");
+    hal.stream.write(cycles2us(profile.min));
+    hal.stream.write(",");
+    hal.stream.write(cycles2us(profile.sum / profile.count));
+    hal.stream.write(",");
+    hal.stream.write(cycles2us(profile.max));
+    hal.stream.write("|");
+    hal.stream.write(ftoa(elapsed ? (float)profile.sum * 100.0f / (float)elapsed : 0.0f, 2));
+    hal.stream.write("%|");
+    if(profile.latency_count) {
+        hal.stream.write(cycles2us(profile.latency_sum / profile.latency_count));
+        hal.stream.write(",");
+        hal.stream.write(cycles2us(profile.latency_max));
+    }
+    hal.stream.write("|");
+    for(idx = 0; idx < ISR_PROFILER_BUCKETS; idx++) {
+        if(idx)
+            hal.stream.write(",");
+        hal.stream.write(uitoa(profile.histogram[idx]));
+    }
+    hal.stream.write("]" ASCII_EOL);
+}
+
+// $ISRSTATS - outputs statistics for all interrupt sources that has been active since last reset.
+// Format: [ISR:<name>|<count>|<min>,<mean>,<max>|<load>%|<mean latency>,<max latency>|<histogram>]
+// Times are in microseconds, histogram buckets are < 1, 1, 2-3, 4-7 ... >= 64 microseconds.
+// $ISRSTATS=R resets the statistics.
+static status_code_t isr_profiler_command (sys_state_t state, char *args)
+{
+    if(args) {
+        if(!(*args == 'R' || *args == 'r'))
+            return Status_InvalidStatement;
+        isr_profiler_reset();
+    } else {
+
+        uint_fast8_t idx;
+        uint64_t elapsed = (uint64_t)(hal.get_elapsed_ticks() - start_ms) * 1000ULL * cycles_per_us;
+
+        for(idx = 0; idx < IsrProfile_N; idx++) {
+            if(isr_profile[idx].count)
+                report_profile((isr_profile_id_t)idx, elapsed);
+        }
+    }
+
+    return Status_OK;
+}
+
+static const sys_command_t isr_command_list[] = {
+    {"ISRSTATS", isr_profiler_command, {}, { .str = "output interrupt statistics, $ISRSTATS=R to reset" } }
+};
+
+static sys_commands_t isr_commands = {
+    .n_commands = sizeof(isr_command_list) / sizeof(sys_command_t),
+    .commands = isr_command_list
+};
+
+static sys_commands_t *on_get_commands (void)
+{
+    return &isr_commands;
+}
+
+static void report_options (bool newopt)
+{
+    on_report_options(newopt);
+
+    if(!newopt)
+        hal.stream.write("[PLUGIN:ISR profiler v0.01]" ASCII_EOL);
+}
+
+void isr_profiler_init (void)
+{
+    cycles_per_us = hal.f_mcu;
+
+    isr_profiler_reset();
+
+    isr_commands.on_get_commands = grbl.on_get_commands;
+    grbl.on_get_commands = on_get_commands;
+
+    on_report_options = grbl.on_report_options;
+    grbl.on_report_options = report_options;
+}
+
+#endif // ISR_PROFILER_ENABLE
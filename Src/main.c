@@ -24,8 +24,13 @@
 */
 
 #include "main.h"
+#include "driver.h"
 #include "grbl/grbllib.h"
 
+#if ETHERNET_ENABLE
+#include "lwipopts.h"
+#endif
+
 void SystemClock_Config(void);
 void MPU_Config(void);
 
@@ -57,6 +62,19 @@ int main(void)
     grbl_enter();
 }
 
+#if ETHERNET_ENABLE && ETHERNET_MEM_PROFILE == 1
+
+// Returns the MPU region size encoding for a power of 2 sized region.
+static inline uint8_t mpu_region_size (uint32_t size)
+{
+    return (uint8_t)(30 - __CLZ(size));
+}
+
+_Static_assert((LWIP_D2_HEAP_BASE & (LWIP_D2_HEAP_SIZE - 1)) == 0 && (LWIP_D2_HEAP_SIZE & (LWIP_D2_HEAP_SIZE - 1)) == 0, "lwIP heap MPU region misaligned");
+_Static_assert((LWIP_D2_POOL_BASE & (LWIP_D2_POOL_SIZE - 1)) == 0 && (LWIP_D2_POOL_SIZE & (LWIP_D2_POOL_SIZE - 1)) == 0, "lwIP pool MPU region misaligned");
+
+#endif
+
 void MPU_Config(void)
 {
   MPU_Region_InitTypeDef MPU_InitStruct;
@@ -127,6 +145,47 @@ void MPU_Config(void)
 
   HAL_MPU_ConfigRegion(&MPU_InitStruct);
 
+#if ETHERNET_ENABLE && ETHERNET_MEM_PROFILE == 1
+
+  /* D2 SRAM clocks are disabled after reset */
+  __HAL_RCC_D2SRAM1_CLK_ENABLE();
+  __HAL_RCC_D2SRAM2_CLK_ENABLE();
+  __HAL_RCC_D2SRAM3_CLK_ENABLE();
+
+  /* Configure the MPU attributes as Normal Non Cacheable
+     for LwIP heap in D2 SRAM */
+  MPU_InitStruct.Enable = MPU_REGION_ENABLE;
+  MPU_InitStruct.BaseAddress = LWIP_D2_HEAP_BASE;
+  MPU_InitStruct.Size = mpu_region_size(LWIP_D2_HEAP_SIZE);
+  MPU_InitStruct.AccessPermission = MPU_REGION_FULL_ACCESS;
+  MPU_InitStruct.IsBufferable = MPU_ACCESS_NOT_BUFFERABLE;
+  MPU_InitStruct.IsCacheable = MPU_ACCESS_NOT_CACHEABLE;
+  MPU_InitStruct.IsShareable = MPU_ACCESS_SHAREABLE;
+  MPU_InitStruct.Number = MPU_REGION_NUMBER4;
+  MPU_InitStruct.TypeExtField = MPU_TEX_LEVEL1;
+  MPU_InitStruct.SubRegionDisable = 0x00;
+  MPU_InitStruct.DisableExec = MPU_INSTRUCTION_ACCESS_ENABLE;
+
+  HAL_MPU_ConfigRegion(&MPU_InitStruct);
+
+  /* Configure the MPU attributes as Normal Write through
+     for LwIP memory pools in D2 SRAM */
+  MPU_InitStruct.Enable = MPU_REGION_ENABLE;
+  MPU_InitStruct.BaseAddress = LWIP_D2_POOL_BASE;
+  MPU_InitStruct.Size = mpu_region_size(LWIP_D2_POOL_SIZE);
+  MPU_InitStruct.AccessPermission = MPU_REGION_FULL_ACCESS;
+  MPU_InitStruct.IsBufferable = MPU_ACCESS_NOT_BUFFERABLE;
+  MPU_InitStruct.IsCacheable = MPU_ACCESS_CACHEABLE;
+  MPU_InitStruct.IsShareable = MPU_ACCESS_SHAREABLE;
+  MPU_InitStruct.Number = MPU_REGION_NUMBER5;
+  MPU_InitStruct.TypeExtField = MPU_TEX_LEVEL0;
+  MPU_InitStruct.SubRegionDisable = 0x00;
+  MPU_InitStruct.DisableExec = MPU_INSTRUCTION_ACCESS_ENABLE;
+
+  HAL_MPU_ConfigRegion(&MPU_InitStruct);
+
+#endif
+
   /* Enable the MPU */
   HAL_MPU_Enable(MPU_PRIVILEGED_DEFAULT);
 }
@@ -0,0 +1,324 @@
+/*
+
+  netbench.c - network throughput and latency benchmark service
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Services, use tools/netbench.py for driving them:
+//  TCP NETBENCH_PORT     - sink, discards all data received.
+//  TCP NETBENCH_PORT + 1 - source, sends data until the client closes the connection.
+//  UDP NETBENCH_PORT     - echoes datagrams back to the sender. STAT returns the statistics
+//                          in the $NETSTATS format, RESET resets them and returns the result.
+
+#include "netbench.h"
+
+#if ETHERNET_ENABLE && NETBENCH_ENABLE
+
+#include <string.h>
+
+#include "lwip/tcp.h"
+#include "lwip/udp.h"
+#include "lwip/stats.h"
+#include "ethernetif.h"
+
+#include "grbl/hal.h"
+#include "grbl/system.h"
+#include "grbl/nuts_bolts.h"
+
+#define NETBENCH_CHUNK 1024
+
+typedef struct {
+    uint32_t start_ms;
+    uint64_t tcp_rx;            // bytes received by the sink
+    uint64_t tcp_tx;            // bytes sent and acknowledged by the source
+    uint32_t udp_rx;            // datagrams received for echo
+    uint32_t udp_tx;            // datagrams echoed
+    uint32_t polls;             // network poll calls...
+    uint64_t poll_cycles;       // ...their accumulated execution time
+    uint32_t poll_max;          // and max execution time, in CPU cycles
+    uint32_t retransmits;       // lwIP counter at reset
+    uint32_t rx_alloc_errors;   // ethernetif counter at reset
+} netbench_stats_t;
+
+static netbench_stats_t stats;
+static uint32_t cycles_per_us;
+static char pattern[NETBENCH_CHUNK];
+static on_report_options_ptr on_report_options;
+
+// Called from the network poll context, enet_poll() or PendSV.
+void netbench_record_poll (uint32_t cycles)
+{
+    stats.polls++;
+    stats.poll_cycles += cycles;
+    if(cycles > stats.poll_max)
+        stats.poll_max = cycles;
+}
+
+static void netbench_reset (void)
+{
+    __disable_irq();
+
+    memset(&stats, 0, sizeof(netbench_stats_t));
+    stats.start_ms = hal.get_elapsed_ticks();
+    stats.retransmits = lwip_stats.mib2.tcpretranssegs;
+    stats.rx_alloc_errors = ethernetif_get_counters()->rx_alloc_errors;
+
+    __enable_irq();
+}
+
+static char *u64toa (uint64_t n)
+{
+    static char buf[21];
+
+    char *s = &buf[sizeof(buf) - 1];
+
+    *s = '\0';
+    do {
+        *--s = '0' + (char)(n % 10);
+    } while(n /= 10);
+
+    return s;
+}
+
+// Format: [NETBENCH:<elapsed ms>|<TCP rx bytes>,<TCP tx bytes>|<UDP rx>,<UDP tx>|<TCP retransmits>|<RX pool exhausted>|<polls>,<mean us>,<max us>,<load %>]
+static char *netbench_format (char *buf)
+{
+    netbench_stats_t s;
+    uint32_t elapsed, retransmits, rx_alloc_errors;
+
+    __disable_irq();
+    memcpy(&s, &stats, sizeof(netbench_stats_t));
+    retransmits = lwip_stats.mib2.tcpretranssegs - stats.retransmits;
+    rx_alloc_errors = ethernetif_get_counters()->rx_alloc_errors - stats.rx_alloc_errors;
+    __enable_irq();
+
+    elapsed = hal.get_elapsed_ticks() - s.start_ms;
+
+    strcpy(buf, "[NETBENCH:");
+    strcat(buf, uitoa(elapsed));
+    strcat(buf, "|");
+    strcat(buf, u64toa(s.tcp_rx));
+    strcat(buf, ",");
+    strcat(buf, u64toa(s.tcp_tx));
+    strcat(buf, "|");
+    strcat(buf, uitoa(s.udp_rx));
+    strcat(buf, ",");
+    strcat(buf, uitoa(s.udp_tx));
+    strcat(buf, "|");
+    strcat(buf, uitoa(retransmits));
+    strcat(buf, "|");
+    strcat(buf, uitoa(rx_alloc_errors));
+    strcat(buf, "|");
+    strcat(buf, uitoa(s.polls));
+    strcat(buf, ",");
+    strcat(buf, ftoa(s.polls ? (float)s.poll_cycles / (float)s.polls / (float)cycles_per_us : 0.0f, 2));
+    strcat(buf, ",");
+    strcat(buf, ftoa((float)s.poll_max / (float)cycles_per_us, 2));
+    strcat(buf, ",");
+    strcat(buf, ftoa(elapsed ? (float)s.poll_cycles * 0.1f / ((float)elapsed * (float)cycles_per_us) : 0.0f, 2));
+    strcat(buf, "]");
+
+    return buf;
+}
+
+// TCP sink
+
+static err_t sink_recv (void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+    if(p == NULL) {
+        tcp_recv(pcb, NULL);
+        if(tcp_close(pcb) != ERR_OK) {
+            tcp_abort(pcb);
+            return ERR_ABRT;
+        }
+    } else {
+        stats.tcp_rx += p->tot_len;
+        tcp_recved(pcb, p->tot_len);
+        pbuf_free(p);
+    }
+
+    return ERR_OK;
+}
+
+static err_t sink_accept (void *arg, struct tcp_pcb *pcb, err_t err)
+{
+    if(err != ERR_OK || pcb == NULL)
+        return ERR_VAL;
+
+    tcp_setprio(pcb, TCP_PRIO_MIN);
+    tcp_recv(pcb, sink_recv);
+
+    return ERR_OK;
+}
+
+// TCP source
+
+static void source_send (struct tcp_pcb *pcb)
+{
+    u16_t len;
+
+    while((len = tcp_sndbuf(pcb)) > 0 && tcp_sndqueuelen(pcb) < TCP_SND_QUEUELEN) {
+        if(len > sizeof(pattern))
+            len = sizeof(pattern);
+        if(tcp_write(pcb, pattern, len, TCP_WRITE_FLAG_COPY|TCP_WRITE_FLAG_MORE) != ERR_OK)
+            break;
+    }
+
+    tcp_output(pcb);
+}
+
+static err_t source_sent (void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+    stats.tcp_tx += len;
+    source_send(pcb);
+
+    return ERR_OK;
+}
+
+static err_t source_recv (void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+    if(p == NULL) {
+        tcp_recv(pcb, NULL);
+        tcp_sent(pcb, NULL);
+        if(tcp_close(pcb) != ERR_OK) {
+            tcp_abort(pcb);
+            return ERR_ABRT;
+        }
+    } else {
+        tcp_recved(pcb, p->tot_len);
+        pbuf_free(p);
+    }
+
+    return ERR_OK;
+}
+
+static err_t source_accept (void *arg, struct tcp_pcb *pcb, err_t err)
+{
+    if(err != ERR_OK || pcb == NULL)
+        return ERR_VAL;
+
+    tcp_setprio(pcb, TCP_PRIO_MIN);
+    tcp_recv(pcb, source_recv);
+    tcp_sent(pcb, source_sent);
+    source_send(pcb);
+
+    return ERR_OK;
+}
+
+// UDP echo
+
+static void udp_reply (struct udp_pcb *pcb, const char *s, const ip_addr_t *addr, u16_t port)
+{
+    struct pbuf *p;
+    u16_t len = (u16_t)strlen(s);
+
+    if((p = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_RAM))) {
+        memcpy(p->payload, s, len);
+        udp_sendto(pcb, p, addr, port);
+        pbuf_free(p);
+    }
+}
+
+static void echo_recv (void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
+{
+    char buf[160];
+
+    if(p->tot_len == 4 && pbuf_memcmp(p, 0, "STAT", 4) == 0)
+        udp_reply(pcb, netbench_format(buf), addr, port);
+    else if(p->tot_len == 5 && pbuf_memcmp(p, 0, "RESET", 5) == 0) {
+        netbench_reset();
+        udp_reply(pcb, netbench_format(buf), addr, port);
+    } else {
+        stats.udp_rx++;
+        if(udp_sendto(pcb, p, addr, port) == ERR_OK)
+            stats.udp_tx++;
+    }
+
+    pbuf_free(p);
+}
+
+// $NETSTATS - outputs the benchmark statistics, $NETSTATS=R to reset.
+static status_code_t netbench_command (sys_state_t state, char *args)
+{
+    char buf[160];
+
+    if(args) {
+        if(!(*args == 'R' || *args == 'r'))
+            return Status_InvalidStatement;
+        netbench_reset();
+    } else {
+        hal.stream.write(netbench_format(buf));
+        hal.stream.write(ASCII_EOL);
+    }
+
+    return Status_OK;
+}
+
+static const sys_command_t netbench_command_list[] = {
+    {"NETSTATS", netbench_command, {}, { .str = "output network benchmark statistics, $NETSTATS=R to reset" } }
+};
+
+static sys_commands_t netbench_commands = {
+    .n_commands = sizeof(netbench_command_list) / sizeof(sys_command_t),
+    .commands = netbench_command_list
+};
+
+static sys_commands_t *on_get_commands (void)
+{
+    return &netbench_commands;
+}
+
+static void report_options (bool newopt)
+{
+    on_report_options(newopt);
+
+    if(!newopt)
+        hal.stream.write("[PLUGIN:Network benchmark v0.01]" ASCII_EOL);
+}
+
+// Called from enet_start() after lwIP is initialized.
+void netbench_init (void)
+{
+    uint_fast16_t idx;
+    struct tcp_pcb *pcb;
+    struct udp_pcb *udp;
+
+    cycles_per_us = hal.f_mcu;
+
+    for(idx = 0; idx < sizeof(pattern); idx++)
+        pattern[idx] = ' ' + (char)(idx % 95);
+
+    if((pcb = tcp_new_ip_type(IPADDR_TYPE_ANY)) && tcp_bind(pcb, IP_ANY_TYPE, NETBENCH_PORT) == ERR_OK && (pcb = tcp_listen(pcb)))
+        tcp_accept(pcb, sink_accept);
+
+    if((pcb = tcp_new_ip_type(IPADDR_TYPE_ANY)) && tcp_bind(pcb, IP_ANY_TYPE, NETBENCH_PORT + 1) == ERR_OK && (pcb = tcp_listen(pcb)))
+        tcp_accept(pcb, source_accept);
+
+    if((udp = udp_new_ip_type(IPADDR_TYPE_ANY)) && udp_bind(udp, IP_ANY_TYPE, NETBENCH_PORT) == ERR_OK)
+        udp_recv(udp, echo_recv, NULL);
+
+    netbench_reset();
+
+    netbench_commands.on_get_commands = grbl.on_get_commands;
+    grbl.on_get_commands = on_get_commands;
+
+    on_report_options = grbl.on_report_options;
+    grbl.on_report_options = report_options;
+}
+
+#endif // NETBENCH_ENABLE
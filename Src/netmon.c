@@ -0,0 +1,320 @@
+/*
+
+  netmon.c - read-only network status monitor sessions
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// The Telnet and WebSocket servers serve a single controlling client. This service
+// lets up to NETMON_CLIENTS observers connect on NETMON_PORT and receive a status line,
+// <state|MPos:x,y,z...|F:feed rate>, every NETMON_INTERVAL ms. Input from observers is discarded.
+//
+// The status line is formatted once per interval into a reference counted frame which is
+// queued to all observers without copying. An observer still having the previous frame
+// unacknowledged skips the new one, so a slow observer sees stale frames dropped rather
+// than queueing up data or delaying anything else.
+// NOTE: the service runs in the network poll context.
+
+#include "netmon.h"
+
+#if ETHERNET_ENABLE && NETMON_ENABLE
+
+#include <string.h>
+
+#include "lwip/tcp.h"
+
+#include "grbl/hal.h"
+#include "grbl/system.h"
+#include "grbl/nuts_bolts.h"
+#include "grbl/state_machine.h"
+#include "grbl/stepper.h"
+
+typedef struct {
+    uint8_t refs;
+    u16_t len;
+    char data[NETMON_FRAME_SIZE];
+} netmon_frame_t;
+
+typedef struct {
+    struct tcp_pcb *pcb;
+    netmon_frame_t *frame;      // frame in flight, NULL if none
+    u16_t unacked;              // bytes of frame not yet acknowledged
+} netmon_client_t;
+
+// One more frame than clients, as each client holds at most one there is always one free.
+static netmon_frame_t frames[NETMON_CLIENTS + 1];
+static netmon_client_t clients[NETMON_CLIENTS] = {0};
+static on_report_options_ptr on_report_options;
+
+static const char *state_name (sys_state_t state)
+{
+    switch(state) {
+
+        case STATE_CYCLE:
+            return "Run";
+
+        case STATE_HOLD:
+            return "Hold";
+
+        case STATE_JOG:
+            return "Jog";
+
+        case STATE_HOMING:
+            return "Home";
+
+        case STATE_ALARM:
+        case STATE_ESTOP:
+            return "Alarm";
+
+        case STATE_CHECK_MODE:
+            return "Check";
+
+        case STATE_SAFETY_DOOR:
+            return "Door";
+
+        case STATE_SLEEP:
+            return "Sleep";
+
+        case STATE_TOOL_CHANGE:
+            return "Tool";
+
+        default:
+            return "Idle";
+    }
+}
+
+static void frame_add (netmon_frame_t *frame, const char *s)
+{
+    u16_t len = (u16_t)strlen(s);
+
+    if(frame->len + len < NETMON_FRAME_SIZE) {
+        memcpy(&frame->data[frame->len], s, len);
+        frame->len += len;
+    }
+}
+
+static netmon_frame_t *frame_format (void)
+{
+    uint_fast8_t idx;
+    netmon_frame_t *frame = NULL;
+
+    for(idx = 0; idx <= NETMON_CLIENTS; idx++) {
+        if(frames[idx].refs == 0) {
+            frame = &frames[idx];
+            break;
+        }
+    }
+
+    if(frame) {
+
+        int32_t position[N_AXIS];
+        float mpos[N_AXIS];
+
+        idx = N_AXIS;
+        do {
+            idx--;
+            position[idx] = sys.position[idx];
+        } while(idx);
+
+        system_convert_array_steps_to_mpos(mpos, position);
+
+        frame->len = 0;
+        frame_add(frame, "<");
+        frame_add(frame, state_name(state_get()));
+        frame_add(frame, "|MPos:");
+        for(idx = 0; idx < N_AXIS; idx++) {
+            if(idx)
+                frame_add(frame, ",");
+            frame_add(frame, ftoa(mpos[idx], N_DECIMAL_COORDVALUE_MM));
+        }
+        frame_add(frame, "|F:");
+        frame_add(frame, ftoa(st_get_realtime_rate(), 0));
+        frame_add(frame, ">" ASCII_EOL);
+    }
+
+    return frame;
+}
+
+static void client_release_frame (netmon_client_t *client)
+{
+    if(client->frame) {
+        client->frame->refs--;
+        client->frame = NULL;
+    }
+    client->unacked = 0;
+}
+
+// Returns true if the connection was aborted.
+static bool client_close (netmon_client_t *client)
+{
+    bool aborted;
+    struct tcp_pcb *pcb = client->pcb;
+
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, NULL);
+    tcp_sent(pcb, NULL);
+    tcp_err(pcb, NULL);
+
+    // Queued segments reference the frame, abort if any are not acknowledged yet.
+    if((aborted = client->frame != NULL || tcp_close(pcb) != ERR_OK))
+        tcp_abort(pcb);
+
+    client_release_frame(client);
+    client->pcb = NULL;
+
+    return aborted;
+}
+
+static err_t netmon_sent (void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+    netmon_client_t *client = (netmon_client_t *)arg;
+
+    if(client->frame) {
+        if(len >= client->unacked)
+            client_release_frame(client);
+        else
+            client->unacked -= len;
+    }
+
+    return ERR_OK;
+}
+
+static err_t netmon_recv (void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+    netmon_client_t *client = (netmon_client_t *)arg;
+
+    if(p == NULL)
+        return client_close(client) ? ERR_ABRT : ERR_OK;
+
+    tcp_recved(pcb, p->tot_len);
+    pbuf_free(p);
+
+    return ERR_OK;
+}
+
+static void netmon_err (void *arg, err_t err)
+{
+    netmon_client_t *client = (netmon_client_t *)arg;
+
+    if(client) {
+        client_release_frame(client);
+        client->pcb = NULL;
+    }
+}
+
+static err_t netmon_accept (void *arg, struct tcp_pcb *pcb, err_t err)
+{
+    uint_fast8_t idx;
+    netmon_client_t *client = NULL;
+
+    if(err != ERR_OK || pcb == NULL)
+        return ERR_VAL;
+
+    for(idx = 0; idx < NETMON_CLIENTS; idx++) {
+        if(clients[idx].pcb == NULL) {
+            client = &clients[idx];
+            break;
+        }
+    }
+
+    if(client == NULL) {
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+
+    client->pcb = pcb;
+    client->frame = NULL;
+    client->unacked = 0;
+
+    tcp_setprio(pcb, TCP_PRIO_MIN);
+    tcp_nagle_disable(pcb);
+    tcp_arg(pcb, client);
+    tcp_recv(pcb, netmon_recv);
+    tcp_sent(pcb, netmon_sent);
+    tcp_err(pcb, netmon_err);
+
+    return ERR_OK;
+}
+
+uint_fast8_t netmon_clients (void)
+{
+    uint_fast8_t idx, count = 0;
+
+    for(idx = 0; idx < NETMON_CLIENTS; idx++) {
+        if(clients[idx].pcb)
+            count++;
+    }
+
+    return count;
+}
+
+// Called from enet_service() on every network poll.
+void netmon_poll (void)
+{
+    static uint32_t last_ms;
+
+    uint_fast8_t idx;
+    uint32_t ms = hal.get_elapsed_ticks();
+    netmon_frame_t *frame = NULL;
+
+    if(ms - last_ms < NETMON_INTERVAL)
+        return;
+
+    last_ms = ms;
+
+    for(idx = 0; idx < NETMON_CLIENTS; idx++) {
+
+        netmon_client_t *client = &clients[idx];
+
+        if(client->pcb == NULL || client->frame)
+            continue;
+
+        if(frame == NULL && (frame = frame_format()) == NULL)
+            break;
+
+        if(tcp_sndbuf(client->pcb) >= frame->len && tcp_write(client->pcb, frame->data, frame->len, 0) == ERR_OK) {
+            frame->refs++;
+            client->frame = frame;
+            client->unacked = frame->len;
+            tcp_output(client->pcb);
+        }
+    }
+}
+
+static void report_options (bool newopt)
+{
+    on_report_options(newopt);
+
+    if(!newopt)
+        hal.stream.write("[PLUGIN:Network monitor v0.01]" ASCII_EOL);
+}
+
+// Called from enet_start() after lwIP is initialized.
+void netmon_init (void)
+{
+    struct tcp_pcb *pcb;
+
+    if((pcb = tcp_new_ip_type(IPADDR_TYPE_ANY)) && tcp_bind(pcb, IP_ANY_TYPE, NETMON_PORT) == ERR_OK && (pcb = tcp_listen(pcb))) {
+
+        tcp_accept(pcb, netmon_accept);
+
+        on_report_options = grbl.on_report_options;
+        grbl.on_report_options = report_options;
+    }
+}
+
+#endif // NETMON_ENABLE
@@ -0,0 +1,692 @@
+/*
+
+  sdindex.c - fast seek and line index for G-code files on SD card
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Seeking to line N of a large file requires reading everything before it, and seeking to
+// a byte offset walks the FAT cluster chain from the start of the file. This module keeps a
+// sparse line number to file offset index in a <file>.gidx sidecar file and provides fast seek
+// (a cluster link map table) for open files, so a line can be located by a single f_lseek()
+// followed by reading at most interval lines. The index also records the lines with tool
+// changes (M6) and program stops (M0, M1) so senders can offer them as restart points.
+//
+// The index is built while a file is streamed as a job for the first time, the path is taken
+// from the $F=<file> command which is passed on to the SD card plugin. The index is saved when
+// the job has read the complete file and is invalidated if the file size or date changes.
+// Jobs are tracked for progress reporting, the total number of lines is known from the index.
+// While a job runs the real time report has a |SDJ:<line>/<lines>,<percent>,<remaining s> field,
+// system commands are not accepted then.
+//
+// $SDINDEX=<file> builds the index of a file without running it, e.g. after an upload.
+// $SDLINE=<line> locates a line in the file of the current or last job.
+// $SDMARKS[=<file>] lists the tool changes and program stops.
+//
+// NOTE: the job reader is in the SD card plugin, readers wanting to resume from a line should
+//       use sdindex_fastseek() and sdindex_seek() on their file.
+
+#include "sdindex.h"
+
+#if SDCARD_ENABLE && SDCARD_INDEX
+
+#include <string.h>
+
+#include "grbl/hal.h"
+#include "grbl/protocol.h"
+#include "grbl/state_machine.h"
+#include "grbl/nuts_bolts.h"
+
+#define SDINDEX_PATH_SIZE (FF_MAX_LFN + sizeof(SDINDEX_EXT))
+
+typedef struct {
+    sdindex_t *index;
+    uint32_t line;      // current line
+    uint32_t pos;       // current file offset
+    uint32_t line_pos;  // file offset of the current line
+    uint32_t tool;      // last T word
+    uint32_t value;     // integer part of the value of the current word
+    char word;          // letter of the current word if M or T, else 0
+    char comment;       // '(' or ';' when in a comment, else 0
+    bool digits;        // the current word has digits
+    bool fraction;      // the current word has a decimal point
+    uint8_t marks;      // marks found in the current line, bitmap of 1 << sdindex_mark_type_t
+} builder_t;
+
+typedef struct {
+    uint32_t line;      // current line
+    uint32_t pos;       // current file offset
+    uint32_t size;      // size of the file
+    uint32_t started;   // ms
+} job_t;
+
+typedef struct {
+    FIL *file;
+    DWORD clmt[SDINDEX_CLMT_SIZE];
+} linkmap_t;
+
+static bool streaming = false, building = false;
+static char job_path[FF_MAX_LFN + 1] = "";
+static job_t job;
+static builder_t observer;
+static sdindex_t job_index;
+static linkmap_t linkmap[SDINDEX_FILES] = {0};
+static sys_commands_t sdindex_commands;
+ALIGN_32BYTES(static uint32_t read_buf[1024]); // 8 blocks, read directly by multi-block transfers
+static stream_read_ptr stream_read;
+static on_stream_changed_ptr on_stream_changed;
+static on_report_options_ptr on_report_options;
+static on_realtime_report_ptr on_realtime_report;
+
+// Enables fast seek for a file opened for reading, the cluster link map is valid until sdindex_release().
+// Returns false if no map is available or the file is too fragmented, f_lseek() then works as normal.
+bool sdindex_fastseek (FIL *file)
+{
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < SDINDEX_FILES; idx++) {
+        if(linkmap[idx].file == NULL) {
+            linkmap[idx].file = file;
+            linkmap[idx].clmt[0] = SDINDEX_CLMT_SIZE;
+            file->cltbl = linkmap[idx].clmt;
+            if(f_lseek(file, CREATE_LINKMAP) == FR_OK)
+                return true;
+            file->cltbl = NULL;
+            linkmap[idx].file = NULL;
+            break;
+        }
+    }
+
+    return false;
+}
+
+// Must be called before the file object is closed or reused.
+void sdindex_release (FIL *file)
+{
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < SDINDEX_FILES; idx++) {
+        if(linkmap[idx].file == file) {
+            linkmap[idx].file = NULL;
+            file->cltbl = NULL;
+        }
+    }
+}
+
+static char *index_path (char *buf, const char *path)
+{
+    size_t len = strlen(path);
+
+    if(len > FF_MAX_LFN)
+        len = FF_MAX_LFN;
+
+    memcpy(buf, path, len);
+    strcpy(buf + len, SDINDEX_EXT);
+
+    return buf;
+}
+
+static void index_add (sdindex_t *index, uint32_t line, uint32_t offset)
+{
+    if((line - 1) % index->hdr.interval)
+        return;
+
+    if(index->hdr.entries == SDINDEX_ENTRIES) {
+
+        uint_fast16_t idx;
+
+        for(idx = 0; idx < SDINDEX_ENTRIES / 2; idx++)
+            index->offset[idx] = index->offset[idx * 2];
+
+        index->hdr.entries = SDINDEX_ENTRIES / 2;
+        index->hdr.interval *= 2;
+
+        if((line - 1) % index->hdr.interval)
+            return;
+    }
+
+    index->offset[index->hdr.entries++] = offset;
+}
+
+static void builder_start (builder_t *builder, sdindex_t *index, const FILINFO *fno)
+{
+    memset(&index->hdr, 0, sizeof(sdindex_header_t));
+    memset(builder, 0, sizeof(builder_t));
+
+    index->hdr.magic = SDINDEX_MAGIC;
+    index->hdr.version = SDINDEX_VERSION;
+    index->hdr.size = (uint32_t)fno->fsize;
+    index->hdr.fdate = fno->fdate;
+    index->hdr.ftime = fno->ftime;
+    index->hdr.interval = SDINDEX_INTERVAL;
+
+    builder->index = index;
+    builder->line = 1;
+
+    index_add(index, 1, 0);
+}
+
+static void word_end (builder_t *builder)
+{
+    if(builder->word && builder->digits && !builder->fraction) {
+        if(builder->word == 'T')
+            builder->tool = builder->value;
+        else switch(builder->value) {
+
+            case 0:
+                builder->marks |= 1 << SdIndexMark_Stop;
+                break;
+
+            case 1:
+                builder->marks |= 1 << SdIndexMark_OptionalStop;
+                break;
+
+            case 6:
+                builder->marks |= 1 << SdIndexMark_ToolChange;
+                break;
+        }
+    }
+
+    builder->word = 0;
+}
+
+static void line_end (builder_t *builder)
+{
+    sdindex_t *index = builder->index;
+    sdindex_mark_type_t type;
+
+    word_end(builder);
+    builder->comment = 0;
+
+    for(type = SdIndexMark_ToolChange; builder->marks && type <= SdIndexMark_OptionalStop; type++) {
+        if((builder->marks & (1 << type)) && index->hdr.marks < SDINDEX_MARKS) {
+            index->mark[index->hdr.marks].line = builder->line;
+            index->mark[index->hdr.marks].offset = builder->line_pos;
+            index->mark[index->hdr.marks].type = type;
+            index->mark[index->hdr.marks++].tool = builder->tool;
+        }
+    }
+
+    builder->marks = 0;
+}
+
+// Scans for M0, M1, M6 and T words, comments are skipped.
+static inline void parse_char (builder_t *builder, char c)
+{
+    if(builder->comment) {
+        if(c == ')' && builder->comment == '(')
+            builder->comment = 0;
+    } else if(c >= '0' && c <= '9') {
+        if(builder->word && !builder->fraction) {
+            builder->value = builder->value * 10 + (c - '0');
+            builder->digits = true;
+        }
+    } else if(c == '.')
+        builder->fraction = true;
+    else if(c == '(' || c == ';') {
+        word_end(builder);
+        builder->comment = c;
+    } else if((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')) {
+        word_end(builder);
+        c &= ~0x20;
+        if(c == 'M' || c == 'T') {
+            builder->word = c;
+            builder->value = 0;
+            builder->digits = builder->fraction = false;
+        }
+    }
+}
+
+static void builder_feed (builder_t *builder, const char *data, uint32_t len)
+{
+    char c;
+
+    while(len--) {
+        builder->pos++;
+        if((c = *data++) == '\n') {
+            line_end(builder);
+            builder->line_pos = builder->pos;
+            index_add(builder->index, ++builder->line, builder->pos);
+        } else
+            parse_char(builder, c);
+    }
+}
+
+static bool builder_end (builder_t *builder)
+{
+    if(builder->pos == builder->index->hdr.size) {
+        if(builder->line_pos != builder->pos)
+            line_end(builder); // no newline at end of file
+        builder->index->hdr.lines = builder->line;
+    }
+
+    return builder->index->hdr.lines != 0;
+}
+
+FRESULT sdindex_load (sdindex_t *index, const char *path)
+{
+    FIL file;
+    UINT n;
+    FRESULT res;
+    FILINFO fno;
+    char ipath[SDINDEX_PATH_SIZE];
+
+    if((res = f_stat(path, &fno)) != FR_OK)
+        return res;
+
+    if((res = f_open(&file, index_path(ipath, path), FA_READ)) == FR_OK) {
+
+        if((res = f_read(&file, &index->hdr, sizeof(sdindex_header_t), &n)) == FR_OK &&
+            !(n == sizeof(sdindex_header_t) &&
+               index->hdr.magic == SDINDEX_MAGIC &&
+                index->hdr.version == SDINDEX_VERSION &&
+                 index->hdr.entries > 0 && index->hdr.entries <= SDINDEX_ENTRIES && index->hdr.marks <= SDINDEX_MARKS &&
+                  index->hdr.interval > 0 && index->hdr.lines > 0 &&
+                   index->hdr.size == (uint32_t)fno.fsize &&
+                    index->hdr.fdate == fno.fdate && index->hdr.ftime == fno.ftime))
+            res = FR_NO_FILE;
+
+        if(res == FR_OK && (res = f_read(&file, index->offset, index->hdr.entries * sizeof(uint32_t), &n)) == FR_OK &&
+            n != index->hdr.entries * sizeof(uint32_t))
+            res = FR_NO_FILE;
+
+        if(res == FR_OK && (res = f_read(&file, index->mark, index->hdr.marks * sizeof(sdindex_mark_t), &n)) == FR_OK &&
+            n != index->hdr.marks * sizeof(sdindex_mark_t))
+            res = FR_NO_FILE;
+
+        f_close(&file);
+    }
+
+    if(res != FR_OK)
+        index->hdr.lines = 0;
+
+    return res;
+}
+
+FRESULT sdindex_save (const sdindex_t *index, const char *path)
+{
+    FIL file;
+    UINT n;
+    FRESULT res;
+    char ipath[SDINDEX_PATH_SIZE];
+
+    if(index->hdr.lines == 0)
+        return FR_INVALID_PARAMETER;
+
+    if((res = f_open(&file, index_path(ipath, path), FA_CREATE_ALWAYS|FA_WRITE)) == FR_OK) {
+
+        if((res = f_write(&file, &index->hdr, sizeof(sdindex_header_t), &n)) == FR_OK)
+            res = f_write(&file, index->offset, index->hdr.entries * sizeof(uint32_t), &n);
+
+        if(res == FR_OK)
+            res = f_write(&file, index->mark, index->hdr.marks * sizeof(sdindex_mark_t), &n);
+
+        if(f_close(&file) != FR_OK && res == FR_OK)
+            res = FR_DISK_ERR;
+
+        if(res != FR_OK)
+            f_unlink(ipath);
+    }
+
+    return res;
+}
+
+// Builds the index by reading the complete file, blocks the foreground process while doing so.
+FRESULT sdindex_build (sdindex_t *index, const char *path)
+{
+    FIL file;
+    UINT n;
+    FRESULT res;
+    FILINFO fno;
+    builder_t builder;
+    uint32_t blocks = 0;
+
+    if((res = f_stat(path, &fno)) == FR_OK && (res = f_open(&file, path, FA_READ)) == FR_OK) {
+
+        builder_start(&builder, index, &fno);
+
+        do {
+            if((res = f_read(&file, read_buf, sizeof(read_buf), &n)) == FR_OK)
+                builder_feed(&builder, (char *)read_buf, n);
+            // Keep realtime commands and network services alive for large files.
+            if(!(++blocks & 0x0F) && !protocol_execute_realtime())
+                res = FR_INT_ERR;
+        } while(res == FR_OK && n == sizeof(read_buf));
+
+        f_close(&file);
+
+        if(res == FR_OK && !builder_end(&builder))
+            res = FR_INT_ERR;
+    }
+
+    return res;
+}
+
+// Positions the file at the start of the given line, 1 is the first line.
+FRESULT sdindex_seek (FIL *file, const sdindex_t *index, uint32_t line)
+{
+    UINT n, i;
+    FRESULT res;
+    uint32_t entry, current;
+    char buf[128];
+
+    if(line == 0 || index->hdr.entries == 0)
+        return FR_INVALID_PARAMETER;
+
+    if((entry = (line - 1) / index->hdr.interval) >= index->hdr.entries)
+        entry = index->hdr.entries - 1;
+
+    current = entry * index->hdr.interval + 1;
+
+    if((res = f_lseek(file, index->offset[entry])) == FR_OK) while(current < line) {
+
+        FSIZE_t pos = f_tell(file);
+
+        if((res = f_read(file, buf, sizeof(buf), &n)) != FR_OK)
+            break;
+
+        if(n == 0) {
+            res = FR_INVALID_PARAMETER; // past end of file
+            break;
+        }
+
+        for(i = 0; i < n && current < line; i++) {
+            if(buf[i] == '\n')
+                current++;
+        }
+
+        if(current == line)
+            res = f_lseek(file, pos + i);
+    }
+
+    return res;
+}
+
+// Wraps the SD card plugin job reader to track progress, and to build the index
+// while the file is streamed for the first time.
+static int16_t job_read (void)
+{
+    int16_t c = stream_read();
+
+    if(c != SERIAL_NO_DATA && job.pos < job.size) {
+
+        char ch = (char)c;
+
+        job.pos++;
+        if(ch == '\n')
+            job.line++;
+
+        if(building)
+            builder_feed(&observer, &ch, 1);
+    }
+
+    return c;
+}
+
+static void stream_changed (stream_type_t type)
+{
+    FILINFO fno;
+
+    if(streaming) {
+        streaming = false;
+        if(hal.stream.read == job_read)
+            hal.stream.read = stream_read;
+        if(building && builder_end(&observer))
+            sdindex_save(&job_index, job_path);
+        building = false;
+    }
+
+    if(type == StreamType_SDCard && *job_path && f_stat(job_path, &fno) == FR_OK) {
+
+        if((building = sdindex_load(&job_index, job_path) != FR_OK))
+            builder_start(&observer, &job_index, &fno);
+
+        job.line = 1;
+        job.pos = 0;
+        job.size = (uint32_t)fno.fsize;
+        job.started = hal.get_elapsed_ticks();
+
+        stream_read = hal.stream.read;
+        hal.stream.read = job_read;
+        streaming = true;
+    }
+
+    if(on_stream_changed)
+        on_stream_changed(type);
+}
+
+static const sys_command_t *next_command (const char *name)
+{
+    uint_fast16_t idx;
+    sys_commands_t *commands = NULL;
+
+    if(sdindex_commands.on_get_commands)
+        commands = sdindex_commands.on_get_commands();
+
+    while(commands) {
+        for(idx = 0; idx < commands->n_commands; idx++) {
+            if(!strcmp(commands->commands[idx].command, name))
+                return &commands->commands[idx];
+        }
+        commands = commands->on_get_commands ? commands->on_get_commands() : NULL;
+    }
+
+    return NULL;
+}
+
+// $F=<file> - records the path of the job file and passes the command on to the SD card plugin.
+static status_code_t sdindex_file (sys_state_t state, char *args)
+{
+    const sys_command_t *command = next_command("F");
+
+    if(args && !streaming) {
+        strncpy(job_path, args, FF_MAX_LFN);
+        job_path[FF_MAX_LFN] = '\0';
+    }
+
+    return command ? command->execute(state, args) : Status_Unhandled;
+}
+
+// Loads the index of a file into job_index, builds it if there is none and the controller is idle.
+static status_code_t get_index (sys_state_t state, const char *path)
+{
+    FRESULT res;
+
+    if(streaming)
+        return building || strcmp(path, job_path) ? Status_IdleError : Status_OK;
+
+    if((res = sdindex_load(&job_index, path)) != FR_OK) {
+
+        if(state != STATE_IDLE)
+            return Status_IdleError;
+
+        if((res = sdindex_build(&job_index, path)) == FR_OK)
+            res = sdindex_save(&job_index, path);
+    }
+
+    return res == FR_OK ? Status_OK : Status_SDReadError;
+}
+
+// $SDINDEX=<file> - builds the index for a file unless a valid one exists.
+// Format: [SDINDEX:<lines>|<entries>,<interval>|<marks>]
+static status_code_t sdindex_command (sys_state_t state, char *args)
+{
+    status_code_t status;
+
+    if(args == NULL)
+        return Status_InvalidStatement;
+
+    if((status = get_index(state, args)) == Status_OK) {
+        hal.stream.write("[SDINDEX:");
+        hal.stream.write(uitoa(job_index.hdr.lines));
+        hal.stream.write("|");
+        hal.stream.write(uitoa(job_index.hdr.entries));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(job_index.hdr.interval));
+        hal.stream.write("|");
+        hal.stream.write(uitoa(job_index.hdr.marks));
+        hal.stream.write("]" ASCII_EOL);
+    }
+
+    return status;
+}
+
+// $SDLINE=<line> - locates a line in the file of the current or last job, builds the index if required.
+// Format: [SDLINE:<line>|<file offset>|<ms>]
+static status_code_t sdline_command (sys_state_t state, char *args)
+{
+    FIL file;
+    FRESULT res;
+    status_code_t status;
+    uint32_t line, ms = hal.get_elapsed_ticks();
+    uint_fast8_t counter = 0;
+
+    if(args == NULL || *job_path == '\0')
+        return Status_InvalidStatement;
+
+    if(read_uint(args, &counter, &line) != Status_OK || line == 0)
+        return Status_BadNumberFormat;
+
+    if((status = get_index(state, job_path)) != Status_OK)
+        return status;
+
+    if((res = f_open(&file, job_path, FA_READ)) == FR_OK) {
+
+        sdindex_fastseek(&file);
+
+        if((res = sdindex_seek(&file, &job_index, line)) == FR_OK) {
+            hal.stream.write("[SDLINE:");
+            hal.stream.write(uitoa(line));
+            hal.stream.write("|");
+            hal.stream.write(uitoa((uint32_t)f_tell(&file)));
+            hal.stream.write("|");
+            hal.stream.write(uitoa(hal.get_elapsed_ticks() - ms));
+            hal.stream.write("]" ASCII_EOL);
+        }
+
+        sdindex_release(&file);
+        f_close(&file);
+    }
+
+    return res == FR_OK ? Status_OK : (res == FR_INVALID_PARAMETER ? Status_InvalidStatement : Status_SDReadError);
+}
+
+// $SDMARKS[=<file>] - lists the tool changes and program stops in a file, default is the file of the current or last job.
+// Format: [SDMARK:<line>|<file offset>|<M0|M1|M6,T<tool>>]
+static status_code_t sdmarks_command (sys_state_t state, char *args)
+{
+    uint_fast16_t idx;
+    status_code_t status;
+    const char *path = args ? args : job_path;
+
+    if(*path == '\0')
+        return Status_InvalidStatement;
+
+    if((status = get_index(state, path)) == Status_OK) {
+        for(idx = 0; idx < job_index.hdr.marks; idx++) {
+            hal.stream.write("[SDMARK:");
+            hal.stream.write(uitoa(job_index.mark[idx].line));
+            hal.stream.write("|");
+            hal.stream.write(uitoa(job_index.mark[idx].offset));
+            switch((sdindex_mark_type_t)job_index.mark[idx].type) {
+
+                case SdIndexMark_ToolChange:
+                    hal.stream.write("|M6,T");
+                    hal.stream.write(uitoa(job_index.mark[idx].tool));
+                    break;
+
+                case SdIndexMark_Stop:
+                    hal.stream.write("|M0");
+                    break;
+
+                case SdIndexMark_OptionalStop:
+                    hal.stream.write("|M1");
+                    break;
+            }
+            hal.stream.write("]" ASCII_EOL);
+        }
+    }
+
+    return status;
+}
+
+// Adds the progress of the running SD card job to the real time report, the remaining time is estimated
+// from the elapsed time and the share of the file read.
+// Format: |SDJ:<line>/<lines>,<percent>,<remaining s>, lines is 0 while the index is built.
+// NOTE: the position is that of the job reader, it is ahead of the motion by the planner buffer.
+static void realtime_report (stream_write_ptr stream_write, report_tracking_flags_t report)
+{
+    if(streaming) {
+
+        uint32_t elapsed = hal.get_elapsed_ticks() - job.started;
+
+        stream_write("|SDJ:");
+        stream_write(uitoa(job.line));
+        stream_write("/");
+        stream_write(uitoa(building ? 0 : job_index.hdr.lines));
+        stream_write(",");
+        stream_write(ftoa(job.size ? (float)job.pos * 100.0f / (float)job.size : 100.0f, 1));
+        stream_write(",");
+        stream_write(job.pos ? uitoa((uint32_t)((uint64_t)elapsed * (job.size - job.pos) / job.pos / 1000)) : "0");
+    }
+
+    if(on_realtime_report)
+        on_realtime_report(stream_write, report);
+}
+
+static const sys_command_t sdindex_command_list[] = {
+    {"F", sdindex_file, {}, { .str = "run SD card file, $F=<file>" } },
+    {"SDINDEX", sdindex_command, {}, { .str = "build SD card file line index, $SDINDEX=<file>" } },
+    {"SDLINE", sdline_command, {}, { .str = "locate line in SD card job file, $SDLINE=<line>" } },
+    {"SDMARKS", sdmarks_command, {}, { .str = "list tool changes and program stops in SD card file, $SDMARKS[=<file>]" } }
+};
+
+static sys_commands_t sdindex_commands = {
+    .n_commands = sizeof(sdindex_command_list) / sizeof(sys_command_t),
+    .commands = sdindex_command_list
+};
+
+static sys_commands_t *on_get_commands (void)
+{
+    return &sdindex_commands;
+}
+
+static void report_options (bool newopt)
+{
+    on_report_options(newopt);
+
+    if(!newopt)
+        hal.stream.write("[PLUGIN:SD card index v0.03]" ASCII_EOL);
+}
+
+// Called from driver_init() after sdcard_init(), the $F command has to be found before the plugin's.
+void sdindex_init (void)
+{
+    sdindex_commands.on_get_commands = grbl.on_get_commands;
+    grbl.on_get_commands = on_get_commands;
+
+    on_stream_changed = grbl.on_stream_changed;
+    grbl.on_stream_changed = stream_changed;
+
+    on_report_options = grbl.on_report_options;
+    grbl.on_report_options = report_options;
+
+    on_realtime_report = grbl.on_realtime_report;
+    grbl.on_realtime_report = realtime_report;
+}
+
+#endif // SDCARD_INDEX
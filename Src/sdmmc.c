@@ -29,8 +29,212 @@
 
 #include "sdmmc.h"
 
+#include "grbl/hal.h"
+#include "grbl/nuts_bolts.h"
+
+#define SDBENCH_FILE    "/sdbench.tmp"
+#define SDBENCH_SIZE    (1024 * 1024)   // bytes written and read sequentially
+#define SDBENCH_CHUNK   (8 * 1024)      // bytes per f_write()/f_read() call, 16 blocks
+#define SDBENCH_RANDOM  128             // number of 4 KB reads at random offsets
+#define SDBENCH_BLOCK   4096
+
 SD_HandleTypeDef hsd1;
 
+static bool high_speed = false;
+static on_report_options_ptr on_report_options;
+#if SDCARD_WRITEBEHIND
+static on_execute_realtime_ptr on_execute_realtime;
+#endif
+ALIGN_32BYTES(static uint8_t bench_buf[SDBENCH_CHUNK]);
+
+#if SDCARD_HIGH_SPEED
+
+// Returns the smallest divider giving a card clock not above f_max, 0 is bypass.
+static uint32_t sdmmc_clkdiv (uint32_t f_max)
+{
+    uint32_t f_sdmmc = HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_SDMMC);
+
+    return f_sdmmc <= f_max ? 0 : (f_sdmmc + 2 * f_max - 1) / (2 * f_max);
+}
+
+// Replaces the weak implementation in bsp_driver_sd.c.
+// The card is switched to high speed (SDR25, 50 MHz) by CMD6 if it supports it, else it is kept at
+// default speed (25 MHz). UHS-I modes requires 1.8V signalling via a transceiver and are not available.
+// NOTE: HAL_SD_ConfigWideBusOperation() does not limit the clock correctly when the SDMMC kernel clock
+//       is above 25 MHz and the card is in default speed mode, hence the divider is set explicitly.
+uint8_t BSP_SD_Init (void)
+{
+    if(BSP_SD_IsDetected() != SD_PRESENT)
+        return MSD_ERROR_SD_NOT_PRESENT;
+
+    hsd1.Init.ClockDiv = sdmmc_clkdiv(25000000);
+
+    if(HAL_SD_Init(&hsd1) != HAL_OK || HAL_SD_ConfigWideBusOperation(&hsd1, SDMMC_BUS_WIDE_4B) != HAL_OK)
+        return MSD_ERROR;
+
+    if((high_speed = HAL_SD_ConfigSpeedBusOperation(&hsd1, SDMMC_SPEED_MODE_HIGH) == HAL_OK)) {
+        hsd1.Init.ClockDiv = sdmmc_clkdiv(50000000);
+        MODIFY_REG(hsd1.Instance->CLKCR, SDMMC_CLKCR_CLKDIV, hsd1.Init.ClockDiv);
+    } else
+        hsd1.ErrorCode = HAL_SD_ERROR_NONE;
+
+    return MSD_OK;
+}
+
+#endif
+
+static float sdmmc_clock_mhz (void)
+{
+    uint32_t f_sdmmc = HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_SDMMC),
+             div = hsd1.Instance->CLKCR & SDMMC_CLKCR_CLKDIV;
+
+    return (float)(div ? f_sdmmc / (2 * div) : f_sdmmc) / 1000000.0f;
+}
+
+static const char *mb_per_s (uint32_t bytes, uint32_t ms)
+{
+    return ftoa((float)bytes / (float)(ms ? ms : 1) / 1000.0f, 2);
+}
+
+// Maps the result of a failed file write, or of an open for writing, to a status code.
+// There is no status code for write errors, the read error code is used for other failures.
+status_code_t sdmmc_write_status (FRESULT res)
+{
+    switch(res) {
+
+        case FR_OK:
+            return Status_OK;
+
+        case FR_NOT_READY:
+        case FR_NOT_ENABLED:
+        case FR_NO_FILESYSTEM:
+            return Status_SDMountError;
+
+        case FR_WRITE_PROTECTED:
+        case FR_DENIED: // also disk or directory full
+            return Status_AccessDenied;
+
+        default:
+            return Status_SDReadError;
+    }
+}
+
+static status_code_t sdbench_run (uint32_t *ms)
+{
+    FIL file;
+    UINT n;
+    FRESULT res;
+    uint32_t idx, start, seed;
+
+    for(idx = 0; idx < SDBENCH_CHUNK; idx++)
+        bench_buf[idx] = (uint8_t)idx;
+
+    if((res = f_open(&file, SDBENCH_FILE, FA_CREATE_ALWAYS|FA_WRITE|FA_READ)) != FR_OK)
+        return sdmmc_write_status(res);
+
+    // Sequential write
+    start = hal.get_elapsed_ticks();
+    for(idx = 0; res == FR_OK && idx < SDBENCH_SIZE; idx += SDBENCH_CHUNK) {
+        if((res = f_write(&file, bench_buf, SDBENCH_CHUNK, &n)) == FR_OK && n != SDBENCH_CHUNK)
+            res = FR_DENIED; // disk full
+    }
+    if(res == FR_OK)
+        res = f_sync(&file);
+    ms[0] = hal.get_elapsed_ticks() - start;
+
+    if(res != FR_OK) {
+        f_close(&file);
+        f_unlink(SDBENCH_FILE);
+        return sdmmc_write_status(res);
+    }
+
+    // Sequential read
+    if((res = f_lseek(&file, 0)) == FR_OK) {
+        start = hal.get_elapsed_ticks();
+        for(idx = 0; res == FR_OK && idx < SDBENCH_SIZE; idx += SDBENCH_CHUNK)
+            res = f_read(&file, bench_buf, SDBENCH_CHUNK, &n);
+        ms[1] = hal.get_elapsed_ticks() - start;
+    }
+
+    // Random read
+    if(res == FR_OK) {
+        seed = start = hal.get_elapsed_ticks();
+        for(idx = 0; res == FR_OK && idx < SDBENCH_RANDOM; idx++) {
+            seed = seed * 1664525UL + 1013904223UL;
+            if((res = f_lseek(&file, ((seed >> 8) % (SDBENCH_SIZE / SDBENCH_BLOCK)) * SDBENCH_BLOCK)) == FR_OK)
+                res = f_read(&file, bench_buf, SDBENCH_BLOCK, &n);
+        }
+        ms[2] = hal.get_elapsed_ticks() - start;
+    }
+
+    f_close(&file);
+    f_unlink(SDBENCH_FILE);
+
+    return res == FR_OK ? Status_OK : Status_SDReadError;
+}
+
+// $SDBENCH - writes, reads back and randomly reads a 1 MB file in the root directory of the mounted card.
+// Format: [SDBENCH:<clock MHz>,<HS|DS>|<write MB/s>|<read MB/s>|<random read MB/s>,<IOPS>]
+// NOTE: blocks the foreground process for the duration of the test, typically a second or less.
+static status_code_t sdbench_command (sys_state_t state, char *args)
+{
+    uint32_t ms[3];
+    status_code_t status;
+
+    if(state != STATE_IDLE)
+        return Status_IdleError;
+
+    if((status = sdbench_run(ms)) == Status_OK) {
+        hal.stream.write("[SDBENCH:");
+        hal.stream.write(ftoa(sdmmc_clock_mhz(), 1));
+        hal.stream.write(high_speed ? ",HS|" : ",DS|");
+        hal.stream.write(mb_per_s(SDBENCH_SIZE, ms[0]));
+        hal.stream.write("|");
+        hal.stream.write(mb_per_s(SDBENCH_SIZE, ms[1]));
+        hal.stream.write("|");
+        hal.stream.write(mb_per_s(SDBENCH_RANDOM * SDBENCH_BLOCK, ms[2]));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(SDBENCH_RANDOM * 1000 / (ms[2] ? ms[2] : 1)));
+        hal.stream.write("]" ASCII_EOL);
+    }
+
+    return status;
+}
+
+static const sys_command_t sdmmc_command_list[] = {
+    {"SDBENCH", sdbench_command, {}, { .str = "benchmark the mounted SD card" } }
+};
+
+static sys_commands_t sdmmc_commands = {
+    .n_commands = sizeof(sdmmc_command_list) / sizeof(sys_command_t),
+    .commands = sdmmc_command_list
+};
+
+static sys_commands_t *on_get_commands (void)
+{
+    return &sdmmc_commands;
+}
+
+static void report_options (bool newopt)
+{
+    on_report_options(newopt);
+
+    if(!newopt)
+        hal.stream.write("[PLUGIN:SD card benchmark v0.01]" ASCII_EOL);
+}
+
+#if SDCARD_WRITEBEHIND
+
+// Starts queued writes in the background, see sd_diskio.c.
+static void sdmmc_poll (sys_state_t state)
+{
+    SD_WriteBehindPoll();
+
+    on_execute_realtime(state);
+}
+
+#endif
+
 void sdmmc_init()
 {
 	// SDMMC1 init
@@ -41,12 +245,28 @@ void sdmmc_init()
 	hsd1.Init.ClockEdge = SDMMC_CLOCK_EDGE_RISING;
 	hsd1.Init.ClockPowerSave = SDMMC_CLOCK_POWER_SAVE_DISABLE;
 	hsd1.Init.BusWide = SDMMC_BUS_WIDE_4B;
+#if SDCARD_HIGH_SPEED
+	// Flow control stops the card clock instead of failing with a FIFO under/overrun
+	// if the IDMA is stalled by other bus masters at high clock rates.
+	hsd1.Init.HardwareFlowControl = SDMMC_HARDWARE_FLOW_CONTROL_ENABLE;
+#else
 	hsd1.Init.HardwareFlowControl = SDMMC_HARDWARE_FLOW_CONTROL_DISABLE;
+#endif
 	hsd1.Init.ClockDiv = 0;
 
 	// FatFS init
 	MX_FATFS_Init();
 
+	sdmmc_commands.on_get_commands = grbl.on_get_commands;
+	grbl.on_get_commands = on_get_commands;
+
+	on_report_options = grbl.on_report_options;
+	grbl.on_report_options = report_options;
+
+#if SDCARD_WRITEBEHIND
+	on_execute_realtime = grbl.on_execute_realtime;
+	grbl.on_execute_realtime = sdmmc_poll;
+#endif
 }
 
 #endif
@@ -25,15 +25,38 @@
 
 #include "main.h"
 #include "driver.h"
+#include "ringbuf.h"
+#include "isr_profiler.h"
 
 #include "grbl/hal.h"
 #include "grbl/protocol.h"
 
+#ifndef SERIAL_RX_TIMEOUT
+#define SERIAL_RX_TIMEOUT 20 // Receiver timeout in bit times, flushes RX FIFO content below the interrupt threshold
+#endif
+
+typedef struct {
+    USART_TypeDef *uart;
+    uint32_t (*get_clock)(void);
+    stream_rx_buffer_t *rxbuf;
+    stream_tx_buffer_t *txbuf;
+    enqueue_realtime_command_ptr enqueue_realtime_command;
+#if SERIAL_RX_DMA
+    DMA_Stream_TypeDef *dma;                // NULL if DMA receive is not enabled for the port
+    DMAMUX_Channel_TypeDef *dma_mux;
+    uint32_t dma_request;
+    char *dma_buf;                          // Circular DMA buffer, SERIAL_RX_DMA_SIZE bytes
+    uint_fast16_t dma_tail;                 // Index of next character to process in dma_buf
+#endif
+} serial_port_t;
+
 #ifdef SERIAL_PORT
-static stream_rx_buffer_t rxbuf = {0};
-static stream_tx_buffer_t txbuf = {0};
-static enqueue_realtime_command_ptr enqueue_realtime_command = protocol_enqueue_realtime_command;
-static const io_stream_t *serialInit (uint32_t baud_rate);
+static stream_rx_buffer_t rxbuf0 = {0};
+static stream_tx_buffer_t txbuf0 = {0};
+#if SERIAL_RX_DMA & 1
+static char rxdma0[SERIAL_RX_DMA_SIZE] __attribute__((aligned(32)));
+#endif
+static const io_stream_t *serial0Init (uint32_t baud_rate);
 #else
 #define SERIAL_PORT 0
 #endif
@@ -41,8 +64,10 @@ static const io_stream_t *serialInit (uint32_t baud_rate);
 #ifdef SERIAL1_PORT
 static stream_rx_buffer_t rxbuf1 = {0};
 static stream_tx_buffer_t txbuf1 = {0};
-static enqueue_realtime_command_ptr enqueue_realtime_command1 = protocol_enqueue_realtime_command;
-static const io_stream_t *serial1Init(uint32_t baud_rate);
+#if SERIAL_RX_DMA & 2
+static char rxdma1[SERIAL_RX_DMA_SIZE] __attribute__((aligned(32)));
+#endif
+static const io_stream_t *serial1Init (uint32_t baud_rate);
 #else
 #define SERIAL1_PORT 0
 #endif
@@ -50,8 +75,10 @@ static const io_stream_t *serial1Init(uint32_t baud_rate);
 #ifdef SERIAL2_PORT
 static stream_rx_buffer_t rxbuf2 = {0};
 static stream_tx_buffer_t txbuf2 = {0};
-static enqueue_realtime_command_ptr enqueue_realtime_command2 = protocol_enqueue_realtime_command;
-static const io_stream_t *serial2Init(uint32_t baud_rate);
+#if SERIAL_RX_DMA & 4
+static char rxdma2[SERIAL_RX_DMA_SIZE] __attribute__((aligned(32)));
+#endif
+static const io_stream_t *serial2Init (uint32_t baud_rate);
 #else
 #define SERIAL2_PORT 0
 #endif
@@ -67,26 +94,30 @@ static const io_stream_t *serial2Init(uint32_t baud_rate);
 #define UART0_IRQ        usartINT(1)
 #define UART0_IRQHandler usartHANDLER(1)
 #define UART0_CLK_En     usartCLKEN(1)
+#define UART0_DMAREQ     usartDMAREQ(1)
 #elif (SERIAL_PORT >= 20 && SERIAL_PORT < 29)
 #define UART0            usart(2)
 #define UART0_IRQ        usartINT(2)
 #define UART0_IRQHandler usartHANDLER(2)
 #define UART0_CLK_En     usartCLKEN(2)
+#define UART0_DMAREQ     usartDMAREQ(2)
 #elif (SERIAL_PORT >= 30 && SERIAL_PORT < 39)
 #define UART0            usart(3)
 #define UART0_IRQ        usartINT(3)
 #define UART0_IRQHandler usartHANDLER(3)
 #define UART0_CLK_En     usartCLKEN(3)
+#define UART0_DMAREQ     usartDMAREQ(3)
 #else
 #define UART0            usart(SERIAL_PORT)
 #define UART0_IRQ        usartINT(SERIAL_PORT)
 #define UART0_IRQHandler usartHANDLER(SERIAL_PORT)
 #define UART0_CLK_En     usartCLKEN(SERIAL_PORT)
+#define UART0_DMAREQ     usartDMAREQ(SERIAL_PORT)
 #endif
 #if SERIAL_PORT == 1 || (SERIAL_PORT >= 10 && SERIAL_PORT < 19) || SERIAL_PORT == 6
-#define UART0_CLK HAL_RCC_GetPCLK2Freq()
+#define UART0_CLK HAL_RCC_GetPCLK2Freq
 #else
-#define UART0_CLK HAL_RCC_GetPCLK1Freq()
+#define UART0_CLK HAL_RCC_GetPCLK1Freq
 #endif
 
 #if SERIAL_PORT == 1
@@ -128,7 +159,7 @@ static const io_stream_t *serial2Init(uint32_t baud_rate);
 #define UART0_TX_PIN 6
 #define UART0_RX_PIN 7
 #define UART0_PORT GPIOC
-#define UART0_AF GPIO_AF8_USART6
+#define UART0_AF GPIO_AF7_USART6
 #else
 #error Code has to be added to support serial port
 #endif
@@ -146,26 +177,30 @@ static const io_stream_t *serial2Init(uint32_t baud_rate);
 #define UART1_IRQ        usartINT(1)
 #define UART1_IRQHandler usartHANDLER(1)
 #define UART1_CLK_En     usartCLKEN(1)
+#define UART1_DMAREQ     usartDMAREQ(1)
 #elif (SERIAL1_PORT >= 20 && SERIAL1_PORT < 29)
 #define UART1            usart(2)
 #define UART1_IRQ        usartINT(2)
 #define UART1_IRQHandler usartHANDLER(2)
 #define UART1_CLK_En     usartCLKEN(2)
+#define UART1_DMAREQ     usartDMAREQ(2)
 #elif (SERIAL1_PORT >= 30 && SERIAL1_PORT < 39)
 #define UART1            usart(3)
 #define UART1_IRQ        usartINT(3)
 #define UART1_IRQHandler usartHANDLER(3)
 #define UART1_CLK_En     usartCLKEN(3)
+#define UART1_DMAREQ     usartDMAREQ(3)
 #else
 #define UART1            usart(SERIAL1_PORT)
 #define UART1_IRQ        usartINT(SERIAL1_PORT)
 #define UART1_IRQHandler usartHANDLER(SERIAL1_PORT)
 #define UART1_CLK_En     usartCLKEN(SERIAL1_PORT)
+#define UART1_DMAREQ     usartDMAREQ(SERIAL1_PORT)
 #endif
 #if SERIAL1_PORT == 1 || (SERIAL1_PORT >= 10 && SERIAL1_PORT < 19) || SERIAL1_PORT == 6
-#define UART1_CLK HAL_RCC_GetPCLK2Freq()
+#define UART1_CLK HAL_RCC_GetPCLK2Freq
 #else
-#define UART1_CLK HAL_RCC_GetPCLK1Freq()
+#define UART1_CLK HAL_RCC_GetPCLK1Freq
 #endif
 
 #if SERIAL1_PORT == 1
@@ -207,7 +242,7 @@ static const io_stream_t *serial2Init(uint32_t baud_rate);
 #define UART1_TX_PIN 6
 #define UART1_RX_PIN 7
 #define UART1_PORT GPIOC
-#define UART1_AF GPIO_AF8_USART6
+#define UART1_AF GPIO_AF7_USART6
 #else
 #error Code has to be added to support serial port 1
 #endif
@@ -225,26 +260,30 @@ static const io_stream_t *serial2Init(uint32_t baud_rate);
 #define UART2_IRQ        usartINT(1)
 #define UART2_IRQHandler usartHANDLER(1)
 #define UART2_CLK_En     usartCLKEN(1)
+#define UART2_DMAREQ     usartDMAREQ(1)
 #elif (SERIAL2_PORT >= 20 && SERIAL2_PORT < 29)
 #define UART2            usart(2)
 #define UART2_IRQ        usartINT(2)
 #define UART2_IRQHandler usartHANDLER(2)
 #define UART2_CLK_En     usartCLKEN(2)
+#define UART2_DMAREQ     usartDMAREQ(2)
 #elif (SERIAL2_PORT >= 30 && SERIAL2_PORT < 39)
 #define UART2            usart(3)
 #define UART2_IRQ        usartINT(3)
 #define UART2_IRQHandler usartHANDLER(3)
 #define UART2_CLK_En     usartCLKEN(3)
+#define UART2_DMAREQ     usartDMAREQ(3)
 #else
 #define UART2            usart(SERIAL2_PORT)
 #define UART2_IRQ        usartINT(SERIAL2_PORT)
 #define UART2_IRQHandler usartHANDLER(SERIAL2_PORT)
 #define UART2_CLK_En     usartCLKEN(SERIAL2_PORT)
+#define UART2_DMAREQ     usartDMAREQ(SERIAL2_PORT)
 #endif
 #if SERIAL2_PORT == 1 || (SERIAL2_PORT >= 10 && SERIAL2_PORT < 19) || SERIAL2_PORT == 6
-#define UART2_CLK HAL_RCC_GetPCLK2Freq()
+#define UART2_CLK HAL_RCC_GetPCLK2Freq
 #else
-#define UART2_CLK HAL_RCC_GetPCLK1Freq()
+#define UART2_CLK HAL_RCC_GetPCLK1Freq
 #endif
 
 #if SERIAL2_PORT == 1
@@ -286,7 +325,7 @@ static const io_stream_t *serial2Init(uint32_t baud_rate);
 #define UART2_TX_PIN 6
 #define UART2_RX_PIN 7
 #define UART2_PORT GPIOC
-#define UART2_AF GPIO_AF8_USART6
+#define UART2_AF GPIO_AF7_USART6
 #else
 #error Code has to be added to support serial port 2
 #endif
@@ -303,7 +342,7 @@ static io_stream_properties_t serial[] = {
       .flags.connected = On,
       .flags.can_set_baud = On,
       .flags.modbus_ready = On,
-      .claim = serialInit
+      .claim = serial0Init
     },
 #endif
 #if SERIAL1_PORT
@@ -438,693 +477,565 @@ static bool serialClaimPort (uint8_t instance)
 
 #endif
 
-#if SERIAL_PORT
+#if SERIAL_PORT || SERIAL1_PORT || SERIAL2_PORT
 
 //
 // Returns number of free characters in serial input buffer
 //
-static uint16_t serialRxFree (void)
+static inline uint16_t portRxFree (serial_port_t *port)
 {
-    uint16_t tail = rxbuf.tail, head = rxbuf.head;
-
-    return (RX_BUFFER_SIZE - 1) - BUFCOUNT(head, tail, RX_BUFFER_SIZE);
+    return ringbuf_free(port->rxbuf);
 }
 
 //
 // Returns number of characters in serial input buffer
 //
-static uint16_t serialRxCount (void)
+static inline uint16_t portRxCount (serial_port_t *port)
 {
-    uint32_t tail = rxbuf.tail, head = rxbuf.head;
-
-    return BUFCOUNT(head, tail, RX_BUFFER_SIZE);
+    return ringbuf_count(port->rxbuf);
 }
 
 //
 // Flushes the serial input buffer
 //
-static void serialRxFlush (void)
+static inline void portRxFlush (serial_port_t *port)
 {
-    rxbuf.tail = rxbuf.head;
+    port->rxbuf->tail = port->rxbuf->head;
 }
 
 //
 // Flushes and adds a CAN character to the serial input buffer
 //
-static void serialRxCancel (void)
+static void portRxCancel (serial_port_t *port)
 {
-    rxbuf.data[rxbuf.head] = ASCII_CAN;
-    rxbuf.tail = rxbuf.head;
-    rxbuf.head = BUFNEXT(rxbuf.head, rxbuf);
+    stream_rx_buffer_t *rxbuf = port->rxbuf;
+
+    rxbuf->data[rxbuf->head] = ASCII_CAN;
+    rxbuf->tail = rxbuf->head;
+    rxbuf->head = BUFNEXT(rxbuf->head, (*rxbuf));
 }
 
 //
-// Writes a character to the serial output stream
+// Writes a number of characters from a buffer to the serial output stream, blocks if buffer full
 //
-static bool serialPutC (const char c)
+static bool portWrite (serial_port_t *port, const char *s, uint16_t length)
 {
-    uint16_t next_head = BUFNEXT(txbuf.head, txbuf);    // Get pointer to next free slot in buffer
-
-    while(txbuf.tail == next_head) {                    // While TX buffer full
-        if(!hal.stream_blocking_callback())             // check if blocking for space,
-            return false;                               // exit if not (leaves TX buffer in an inconsistent state)
+    uint_fast16_t count;
+
+    while(length) {
+        if((count = ringbuf_write(port->txbuf, s, length))) {
+            s += count;
+            length -= count;
+            port->uart->CR1 |= USART_CR1_TXEIE;     // Enable TX FIFO not full interrupt to (re)start transmission
+        } else if(!hal.stream_blocking_callback())  // Buffer full, check if blocking for space,
+            return false;                           // exit if not
     }
-    txbuf.data[txbuf.head] = c;                         // Add data to buffer,
-    txbuf.head = next_head;                             // update head pointer and
-    UART0->CR1 |= USART_CR1_TXEIE;                      // enable TX interrupts
 
     return true;
 }
 
 //
-// Writes a null terminated string to the serial output stream, blocks if buffer full
-//
-static void serialWriteS (const char *s)
-{
-    char c, *ptr = (char *)s;
-
-    while((c = *ptr++) != '\0')
-        serialPutC(c);
-}
-
-//
-// Writes a number of characters from string to the serial output stream followed by EOL, blocks if buffer full
+// Returns number of characters pending transmission
 //
-static void serialWrite (const char *s, uint16_t length)
+static inline uint16_t portTxCount (serial_port_t *port)
 {
-    char *ptr = (char *)s;
-
-    while(length--)
-        serialPutC(*ptr++);
+    return ringbuf_count(port->txbuf) + (port->uart->ISR & USART_ISR_TC ? 0 : 1);
 }
 
 //
 // Flushes the serial output buffer
 //
-static void serialTxFlush (void)
+static void portTxFlush (serial_port_t *port)
 {
-    UART0->CR1 &= ~USART_CR1_TXEIE;     // Disable TX interrupts
-    txbuf.tail = txbuf.head;
-}
+    // CR3 is also modified by the ISR (TXFTIE), update it with interrupts disabled.
+    __disable_irq();
 
-//
-// Returns number of characters pending transmission
-//
-static uint16_t serialTxCount (void)
-{
-    uint32_t tail = txbuf.tail, head = txbuf.head;
+    port->uart->CR1 &= ~USART_CR1_TXEIE;    // Disable TX interrupts
+    port->uart->CR3 &= ~USART_CR3_TXFTIE;
+    port->txbuf->tail = port->txbuf->head;
 
-    return BUFCOUNT(head, tail, TX_BUFFER_SIZE) + (UART0->ISR & USART_ISR_TC ? 0 : 1);
+    __enable_irq();
 }
 
 //
-// serialGetC - returns -1 if no data available
+// portGetC - returns -1 if no data available
 //
-static int16_t serialGetC (void)
+static int16_t portGetC (serial_port_t *port)
 {
-    uint_fast16_t tail = rxbuf.tail;    // Get buffer pointer
+    stream_rx_buffer_t *rxbuf = port->rxbuf;
+    uint_fast16_t tail = rxbuf->tail;       // Get buffer pointer
 
-    if(tail == rxbuf.head)
+    if(tail == rxbuf->head)
         return -1; // no data available
 
-    char data = rxbuf.data[tail];       // Get next character
-    rxbuf.tail = BUFNEXT(tail, rxbuf);  // and update pointer
+    char data = rxbuf->data[tail];          // Get next character
+    rxbuf->tail = BUFNEXT(tail, (*rxbuf));  // and update pointer
 
     return (int16_t)data;
 }
 
-static bool serialSuspendInput (bool suspend)
+static bool portSetBaudRate (serial_port_t *port, uint32_t baud_rate)
 {
-    return stream_rx_suspend(&rxbuf, suspend);
-}
-
-static bool serialSetBaudRate (uint32_t baud_rate)
-{
-    UART0->CR1 |= (USART_CR1_UE|USART_CR1_RXNEIE);
-    UART0->CR1 = USART_CR1_RE|USART_CR1_TE;
-    UART0->CR3 = USART_CR3_OVRDIS;
-    UART0->BRR = UART_DIV_SAMPLING16(UART0_CLK, baud_rate, UART_PRESCALER_DIV1);
-    UART0->CR1 |= (USART_CR1_UE|USART_CR1_RXNEIE);
+    USART_TypeDef *uart = port->uart;
+
+    uart->CR1 = 0;                          // FIFO and timeout configuration requires the UART to be disabled
+    uart->CR2 = USART_CR2_RTOEN;
+    uart->RTOR = SERIAL_RX_TIMEOUT;
+    uart->BRR = UART_DIV_SAMPLING16(port->get_clock(), baud_rate, UART_PRESCALER_DIV1);
+#if SERIAL_RX_DMA
+    if(port->dma) {
+        uart->CR3 = USART_CR3_OVRDIS|USART_CR3_DMAR|UART_TXFIFO_THRESHOLD_3_4;
+        uart->CR1 = USART_CR1_FIFOEN|USART_CR1_RE|USART_CR1_TE|USART_CR1_IDLEIE|USART_CR1_UE;
+    } else
+#endif
+    {
+        uart->CR3 = USART_CR3_OVRDIS|USART_CR3_RXFTIE|UART_RXFIFO_THRESHOLD_1_2|UART_TXFIFO_THRESHOLD_3_4;
+        uart->CR1 = USART_CR1_FIFOEN|USART_CR1_RE|USART_CR1_TE|USART_CR1_RTOIE|USART_CR1_UE;
+    }
 
-    rxbuf.tail = rxbuf.head;
-    txbuf.tail = txbuf.head;
+    port->rxbuf->tail = port->rxbuf->head;
+    port->txbuf->tail = port->txbuf->head;
 
     return true;
 }
 
-static bool serialDisable (bool disable)
+static bool portDisable (serial_port_t *port, bool disable)
 {
-    if(disable)
-        UART0->CR1 &= ~USART_CR1_RXNEIE;
-    else
-        UART0->CR1 |= USART_CR1_RXNEIE;
+    // CR3 is also modified by the ISR (TXFTIE), update it with interrupts disabled.
+    __disable_irq();
+
+#if SERIAL_RX_DMA
+    if(port->dma) {
+        // Stop the DMA from pulling characters from the FIFO, anything arriving while disabled is lost.
+        if(disable) {
+            port->uart->CR1 &= ~USART_CR1_IDLEIE;
+            port->uart->CR3 &= ~USART_CR3_DMAR;
+        } else {
+            port->dma_tail = SERIAL_RX_DMA_SIZE - port->dma->NDTR;
+            if(port->dma_tail == SERIAL_RX_DMA_SIZE)
+                port->dma_tail = 0;
+            port->uart->CR3 |= USART_CR3_DMAR;
+            port->uart->CR1 |= USART_CR1_IDLEIE;
+        }
+    } else
+#endif
+    if(disable) {
+        port->uart->CR1 &= ~USART_CR1_RTOIE;
+        port->uart->CR3 &= ~USART_CR3_RXFTIE;
+    } else {
+        port->uart->CR3 |= USART_CR3_RXFTIE;
+        port->uart->CR1 |= USART_CR1_RTOIE;
+    }
 
-    return true;
-}
+    __enable_irq();
 
-static bool serialEnqueueRtCommand (char c)
-{
-    return enqueue_realtime_command(c);
+    return true;
 }
 
-static enqueue_realtime_command_ptr serialSetRtHandler (enqueue_realtime_command_ptr handler)
+static enqueue_realtime_command_ptr portSetRtHandler (serial_port_t *port, enqueue_realtime_command_ptr handler)
 {
-    enqueue_realtime_command_ptr prev = enqueue_realtime_command;
+    enqueue_realtime_command_ptr prev = port->enqueue_realtime_command;
 
     if(handler)
-        enqueue_realtime_command = handler;
+        port->enqueue_realtime_command = handler;
 
     return prev;
 }
 
-static const io_stream_t *serialInit (uint32_t baud_rate)
-{
-    static const io_stream_t stream = {
-        .type = StreamType_Serial,
-        .state.connected = On,
-        .read = serialGetC,
-        .write = serialWriteS,
-        .write_n =  serialWrite,
-        .write_char = serialPutC,
-        .enqueue_rt_command = serialEnqueueRtCommand,
-        .get_rx_buffer_free = serialRxFree,
-        .get_rx_buffer_count = serialRxCount,
-        .get_tx_buffer_count = serialTxCount,
-        .reset_write_buffer = serialTxFlush,
-        .reset_read_buffer = serialRxFlush,
-        .cancel_read_buffer = serialRxCancel,
-        .suspend_read = serialSuspendInput,
-        .disable_rx = serialDisable,
-        .set_baud_rate = serialSetBaudRate,
-        .set_enqueue_rt_handler = serialSetRtHandler
-    };
+#if SERIAL_RX_DMA
 
-    if(!serialClaimPort(stream.instance))
-        return NULL;
+//
+// (Re)starts circular reception to the start of the DMA buffer.
+//
+static void portRxDmaStart (serial_port_t *port)
+{
+    port->dma->CR &= ~DMA_SxCR_EN;
+    while(port->dma->CR & DMA_SxCR_EN);
+
+    port->dma_mux->CCR = port->dma_request;
+    port->dma->PAR = (uint32_t)&port->uart->RDR;
+    port->dma->M0AR = (uint32_t)port->dma_buf;
+    port->dma->NDTR = SERIAL_RX_DMA_SIZE;
+    port->dma->FCR = 0;                                         // Direct mode
+    port->dma->CR = DMA_SxCR_MINC|DMA_SxCR_CIRC|DMA_SxCR_HTIE|DMA_SxCR_TCIE|DMA_SxCR_TEIE; // Peripheral to memory, byte size
+    port->dma_tail = 0;
+    port->dma->CR |= DMA_SxCR_EN;
+}
 
-    UART0_CLK_En();
+#endif
 
+static void portInit (serial_port_t *port, uint32_t baud_rate, GPIO_TypeDef *gpio, uint32_t pins, uint32_t af, IRQn_Type irq)
+{
     GPIO_InitTypeDef GPIO_InitStructure = {
         .Mode      = GPIO_MODE_AF_PP,
         .Pull      = GPIO_NOPULL,
         .Speed     = GPIO_SPEED_FREQ_VERY_HIGH,
-        .Pin       = (1 << UART0_RX_PIN)|(1 << UART0_TX_PIN),
-        .Alternate = UART0_AF
+        .Pin       = pins,
+        .Alternate = af
     };
-    HAL_GPIO_Init(UART0_PORT, &GPIO_InitStructure);
-
-    serialSetBaudRate(baud_rate);
+    HAL_GPIO_Init(gpio, &GPIO_InitStructure);
 
-    HAL_NVIC_SetPriority(UART0_IRQ, 0, 0);
-    HAL_NVIC_EnableIRQ(UART0_IRQ);
-
-    return &stream;
-}
-
-void UART0_IRQHandler (void)
-{
-    if(UART0->ISR & USART_ISR_RXNE_RXFNE) {
-        uint32_t data = UART0->RDR;
-        if(!enqueue_realtime_command((char)data)) {             // Check and strip realtime commands...
-            uint16_t next_head = BUFNEXT(rxbuf.head, rxbuf);    // Get and increment buffer pointer
-            if(next_head == rxbuf.tail)                         // If buffer full
-                rxbuf.overflow = 1;                             // flag overflow
-            else {
-                rxbuf.data[rxbuf.head] = (char)data;            // if not add data to buffer
-                rxbuf.head = next_head;                         // and update pointer
-            }
-        }
+#if SERIAL_RX_DMA
+    if(port->dma) {
+        __HAL_RCC_DMA2_CLK_ENABLE();
+        portRxDmaStart(port);
     }
+#endif
 
-    if((UART0->ISR & USART_ISR_TXE_TXFNF) && (UART0->CR1 & USART_CR1_TXEIE)) {
-        uint_fast16_t tail = txbuf.tail;            // Get buffer pointer
-        UART0->TDR = txbuf.data[tail];              // Send next character
-        txbuf.tail = tail = BUFNEXT(tail, txbuf);   // and increment pointer
-        if(tail == txbuf.head)                      // If buffer empty then
-            UART0->CR1 &= ~USART_CR1_TXEIE;         // disable UART TX interrupt
-   }
-}
+    portSetBaudRate(port, baud_rate);
 
-#endif // SERIAL_PORT
+    HAL_NVIC_SetPriority(irq, 0, 0);
+    HAL_NVIC_EnableIRQ(irq);
+}
 
-#if SERIAL1_PORT
+#if SERIAL_RX_DMA
 
 //
-// Returns number of free characters in serial input buffer
+// Copies a span of received characters to the input buffer, flags overflow if it does not fit.
 //
-static uint16_t serial1RxFree (void)
+static inline void portRxStore (serial_port_t *port, const char *data, uint_fast16_t length)
 {
-    uint32_t tail = rxbuf1.tail, head = rxbuf1.head;
-
-    return (RX_BUFFER_SIZE - 1) - BUFCOUNT(head, tail, RX_BUFFER_SIZE);
+    if(length && ringbuf_write(port->rxbuf, data, length) != length)
+        port->rxbuf->overflow = On;
 }
 
 //
-// Returns number of characters in serial input buffer
+// Strips realtime commands from a span of received characters,
+// the runs of characters in between are copied in bulk to the input buffer.
 //
-static uint16_t serial1RxCount (void)
+static void portRxSpan (serial_port_t *port, const char *data, uint_fast16_t length)
 {
-    uint32_t tail = rxbuf1.tail, head = rxbuf1.head;
+    const char *run = data;
 
-    return BUFCOUNT(head, tail, RX_BUFFER_SIZE);
-}
+    while(length--) {
+        if(port->enqueue_realtime_command(*data)) {     // Realtime command, store preceding run and skip it
+            portRxStore(port, run, data - run);
+            run = data + 1;
+        }
+        data++;
+    }
 
-//
-// Flushes the serial input buffer
-//
-static void serial1RxFlush (void)
-{
-    rxbuf1.tail = rxbuf1.head;
+    portRxStore(port, run, data - run);
 }
 
 //
-// Flushes and adds a CAN character to the serial input buffer
+// Processes characters written by DMA since the last call.
+// Called from the UART ISR on idle line and from the DMA ISR on half and full transfer.
 //
-static void serial1RxCancel (void)
+static void portRxDmaPoll (serial_port_t *port)
 {
-    rxbuf1.data[rxbuf1.head] = ASCII_CAN;
-    rxbuf1.tail = rxbuf1.head;
-    rxbuf1.head = BUFNEXT(rxbuf1.head, rxbuf1);
-}
+    uint_fast16_t head = SERIAL_RX_DMA_SIZE - port->dma->NDTR, tail = port->dma_tail;
 
-//
-// Writes a character to the serial output stream
-//
-static bool serial1PutC (const char c)
-{
-    uint32_t next_head = BUFNEXT(txbuf1.head, txbuf1);   // Set and update head pointer
+    if(head == SERIAL_RX_DMA_SIZE)
+        head = 0;
 
-    while(txbuf1.tail == next_head) {           // While TX buffer full
-        if(!hal.stream_blocking_callback())     // check if blocking for space,
-            return false;                       // exit if not (leaves TX buffer in an inconsistent state)
-        UART1->CR1 |= USART_CR1_TXEIE;          // Enable TX interrupts???
-    }
+    if(head == tail)
+        return;
 
-    txbuf1.data[txbuf1.head] = c;               // Add data to buffer
-    txbuf1.head = next_head;                    // and update head pointer
+#if L1_CACHE_ENABLE
+    SCB_InvalidateDCache_by_Addr((uint32_t *)port->dma_buf, SERIAL_RX_DMA_SIZE);
+#endif
 
-    UART1->CR1 |= USART_CR1_TXEIE;              // Enable TX interrupts
+    if(head > tail)
+        portRxSpan(port, port->dma_buf + tail, head - tail);
+    else {
+        portRxSpan(port, port->dma_buf + tail, SERIAL_RX_DMA_SIZE - tail);
+        portRxSpan(port, port->dma_buf, head);
+    }
 
-    return true;
+    port->dma_tail = head;
 }
 
 //
-// Writes a null terminated string to the serial output stream, blocks if buffer full
+// A transfer error disables the stream, characters received up to the error are
+// processed before reception is restarted.
 //
-static void serial1WriteS (const char *s)
+static void portRxDmaIRQHandler (serial_port_t *port, volatile uint32_t *isr, volatile uint32_t *ifcr, uint32_t flags, uint32_t te)
 {
-    char c, *ptr = (char *)s;
+    bool error = !!(*isr & te);
 
-    while((c = *ptr++) != '\0')
-        serial1PutC(c);
-}
+    *ifcr = flags;
 
-// Writes a number of characters from a buffer to the serial output stream, blocks if buffer full
-//
-static void serial1Write (const char *s, uint16_t length)
-{
-    char *ptr = (char *)s;
+    portRxDmaPoll(port);
 
-    while(length--)
-        serial1PutC(*ptr++);
+    if(error)
+        portRxDmaStart(port);
 }
 
-//
-// Flushes the serial output buffer
-//
-static void serial1TxFlush (void)
-{
-    UART1->CR1 &= ~USART_CR1_TXEIE;     // Disable TX interrupts
-    txbuf1.tail = txbuf1.head;
-}
-
-//
-// Returns number of characters pending transmission
-//
-static uint16_t serial1TxCount (void)
-{
-    uint32_t tail = txbuf1.tail, head = txbuf1.head;
-
-    return BUFCOUNT(head, tail, TX_BUFFER_SIZE) + (UART1->ISR & USART_ISR_TC ? 0 : 1);
-}
+#endif // SERIAL_RX_DMA
 
 //
-// serialGetC - returns -1 if no data available
+// Drains the RX FIFO into the input buffer and refills the TX FIFO from the output buffer.
+// RX interrupts are raised when the FIFO is half full or on receiver timeout, TX interrupts
+// when the FIFO is down to a quarter of its depth. Up to 16 characters are moved per interrupt.
 //
-static int16_t serial1GetC (void)
+static void portIRQHandler (serial_port_t *port)
 {
-    uint_fast16_t tail = rxbuf1.tail;       // Get buffer pointer
-
-    if(tail == rxbuf1.head)
-        return -1; // no data available
-
-    char data = rxbuf1.data[tail];          // Get next character
-    rxbuf1.tail = BUFNEXT(tail, rxbuf1);    // and update pointer
+    USART_TypeDef *uart = port->uart;
 
-    return (int16_t)data;
-}
+    if(uart->ISR & USART_ISR_RTOF)
+        uart->ICR = USART_ICR_RTOCF;
 
-static bool serial1SuspendInput (bool suspend)
-{
-    return stream_rx_suspend(&rxbuf1, suspend);
-}
+#if SERIAL_RX_DMA
+    if(port->dma) {
+        if(uart->ISR & USART_ISR_IDLE)
+            uart->ICR = USART_ICR_IDLECF;
+        portRxDmaPoll(port);
+    } else
+#endif
+    if(uart->ISR & USART_ISR_RXNE_RXFNE) {
+
+        stream_rx_buffer_t *rxbuf = port->rxbuf;
+
+        do {
+            char c = (char)uart->RDR;
+            if(!port->enqueue_realtime_command(c)) {                // Check and strip realtime commands...
+                uint_fast16_t next_head = BUFNEXT(rxbuf->head, (*rxbuf)); // Get and increment buffer pointer
+                if(next_head == rxbuf->tail)                        // If buffer full
+                    rxbuf->overflow = 1;                            // flag overflow
+                else {
+                    rxbuf->data[rxbuf->head] = c;                   // if not add data to buffer
+                    rxbuf->head = next_head;                        // and update pointer
+                }
+            }
+        } while(uart->ISR & USART_ISR_RXNE_RXFNE);
+    }
 
-static bool serial1SetBaudRate (uint32_t baud_rate)
-{
-    UART1->CR1 = USART_CR1_RE|USART_CR1_TE;
-    UART1->CR3 = USART_CR3_OVRDIS;
-    UART1->BRR = UART_DIV_SAMPLING16(UART1_CLK, baud_rate, UART_PRESCALER_DIV1);
-    UART1->CR1 |= (USART_CR1_UE|USART_CR1_RXNEIE);
+    if((uart->CR1 & USART_CR1_TXEIE) || (uart->CR3 & USART_CR3_TXFTIE)) {
 
-    rxbuf1.tail = rxbuf1.head;
-    txbuf1.tail = txbuf1.head;
+        stream_tx_buffer_t *txbuf = port->txbuf;
+        uint_fast16_t tail = txbuf->tail;                           // Get buffer pointer
 
-    return true;
+        while(tail != txbuf->head && (uart->ISR & USART_ISR_TXE_TXFNF)) {
+            uart->TDR = txbuf->data[tail];                          // Send next character
+            tail = BUFNEXT(tail, (*txbuf));                         // and increment pointer
+        }
+        txbuf->tail = tail;
+
+        // The not full interrupt is only used to kick off transmission, keep
+        // going on the threshold interrupt until the buffer is empty.
+        uart->CR1 &= ~USART_CR1_TXEIE;
+        if(tail == txbuf->head)
+            uart->CR3 &= ~USART_CR3_TXFTIE;
+        else
+            uart->CR3 |= USART_CR3_TXFTIE;
+    }
 }
 
-static bool serial1Disable (bool disable)
-{
-    if(disable)
-        UART1->CR1 &= ~USART_CR1_RXNEIE;
-    else
-        UART1->CR1 |= USART_CR1_RXNEIE;
-
-    return true;
-}
+// The io_stream_t API does not pass a context, generate per port entry points.
+
+#define SERIAL_PORT_STREAM(n, p, instance_) \
+static uint16_t serial##n##RxFree (void) { return portRxFree(&p); } \
+static uint16_t serial##n##RxCount (void) { return portRxCount(&p); } \
+static void serial##n##RxFlush (void) { portRxFlush(&p); } \
+static void serial##n##RxCancel (void) { portRxCancel(&p); } \
+static bool serial##n##PutC (const char c) { return portWrite(&p, &c, 1); } \
+static void serial##n##WriteS (const char *s) { portWrite(&p, s, (uint16_t)strlen(s)); } \
+static void serial##n##Write (const char *s, uint16_t length) { portWrite(&p, s, length); } \
+static void serial##n##TxFlush (void) { portTxFlush(&p); } \
+static uint16_t serial##n##TxCount (void) { return portTxCount(&p); } \
+static int16_t serial##n##GetC (void) { return portGetC(&p); } \
+static bool serial##n##SuspendInput (bool suspend) { return stream_rx_suspend(p.rxbuf, suspend); } \
+static bool serial##n##SetBaudRate (uint32_t baud_rate) { return portSetBaudRate(&p, baud_rate); } \
+static bool serial##n##Disable (bool disable) { return portDisable(&p, disable); } \
+static bool serial##n##EnqueueRtCommand (char c) { return p.enqueue_realtime_command(c); } \
+static enqueue_realtime_command_ptr serial##n##SetRtHandler (enqueue_realtime_command_ptr handler) { return portSetRtHandler(&p, handler); } \
+static const io_stream_t serial##n##stream = { \
+    .type = StreamType_Serial, \
+    .instance = instance_, \
+    .state.connected = On, \
+    .read = serial##n##GetC, \
+    .write = serial##n##WriteS, \
+    .write_n = serial##n##Write, \
+    .write_char = serial##n##PutC, \
+    .enqueue_rt_command = serial##n##EnqueueRtCommand, \
+    .get_rx_buffer_free = serial##n##RxFree, \
+    .get_rx_buffer_count = serial##n##RxCount, \
+    .get_tx_buffer_count = serial##n##TxCount, \
+    .reset_write_buffer = serial##n##TxFlush, \
+    .reset_read_buffer = serial##n##RxFlush, \
+    .cancel_read_buffer = serial##n##RxCancel, \
+    .suspend_read = serial##n##SuspendInput, \
+    .disable_rx = serial##n##Disable, \
+    .set_baud_rate = serial##n##SetBaudRate, \
+    .set_enqueue_rt_handler = serial##n##SetRtHandler \
+};
 
-static bool serial1EnqueueRtCommand (char c)
-{
-    return enqueue_realtime_command1(c);
-}
+#endif
 
-static enqueue_realtime_command_ptr serial1SetRtHandler (enqueue_realtime_command_ptr handler)
-{
-    enqueue_realtime_command_ptr prev = enqueue_realtime_command1;
+#if SERIAL_PORT
 
-    if(handler)
-        enqueue_realtime_command1 = handler;
+static serial_port_t port0 = {
+    .uart = UART0,
+    .get_clock = UART0_CLK,
+    .rxbuf = &rxbuf0,
+    .txbuf = &txbuf0,
+    .enqueue_realtime_command = protocol_enqueue_realtime_command,
+#if SERIAL_RX_DMA & 1
+    .dma = SERIAL_RX_DMA_STREAM,
+    .dma_mux = SERIAL_RX_DMA_MUX,
+    .dma_request = UART0_DMAREQ,
+    .dma_buf = rxdma0
+#endif
+};
 
-    return prev;
-}
+SERIAL_PORT_STREAM(0, port0, 0)
 
-static const io_stream_t *serial1Init (uint32_t baud_rate)
+static const io_stream_t *serial0Init (uint32_t baud_rate)
 {
-    static const io_stream_t stream = {
-        .type = StreamType_Serial,
-        .instance = 1,
-        .state.connected = On,
-        .read = serial1GetC,
-        .write = serial1WriteS,
-        .write_n =  serial1Write,
-        .write_char = serial1PutC,
-        .enqueue_rt_command = serial1EnqueueRtCommand,
-        .get_rx_buffer_free = serial1RxFree,
-        .get_rx_buffer_count = serial1RxCount,
-        .get_tx_buffer_count = serial1TxCount,
-        .reset_write_buffer = serial1TxFlush,
-        .reset_read_buffer = serial1RxFlush,
-        .cancel_read_buffer = serial1RxCancel,
-        .suspend_read = serial1SuspendInput,
-        .disable_rx = serial1Disable,
-        .set_baud_rate = serial1SetBaudRate,
-        .set_enqueue_rt_handler = serial1SetRtHandler
-    };
-
-    if(!serialClaimPort(stream.instance))
+    if(!serialClaimPort(serial0stream.instance))
         return NULL;
 
-    UART1_CLK_En();
-
-    GPIO_InitTypeDef GPIO_InitStructure = {
-        .Mode      = GPIO_MODE_AF_PP,
-        .Pull      = GPIO_NOPULL,
-        .Speed     = GPIO_SPEED_FREQ_VERY_HIGH,
-        .Pin       = (1 << UART1_RX_PIN)|(1 << UART1_TX_PIN),
-        .Alternate = UART1_AF
-    };
-    HAL_GPIO_Init(UART1_PORT, &GPIO_InitStructure);
-
-    serial1SetBaudRate(baud_rate);
+    UART0_CLK_En();
 
-    HAL_NVIC_SetPriority(UART1_IRQ, 0, 0);
-    HAL_NVIC_EnableIRQ(UART1_IRQ);
+    portInit(&port0, baud_rate, UART0_PORT, (1 << UART0_RX_PIN)|(1 << UART0_TX_PIN), UART0_AF, UART0_IRQ);
 
-    return &stream;
-}
-
-void UART1_IRQHandler (void)
-{
-    if(UART1->ISR & USART_ISR_RXNE_RXFNE) {
-        uint32_t data = UART1->RDR;
-        if(!enqueue_realtime_command1((char)data)) {            // Check and strip realtime commands...
-            uint16_t next_head = BUFNEXT(rxbuf1.head, rxbuf1);  // Get and increment buffer pointer
-            if(next_head == rxbuf1.tail)                        // If buffer full
-                rxbuf1.overflow = 1;                            // flag overflow
-            else {
-                rxbuf1.data[rxbuf1.head] = (char)data;          // if not add data to buffer
-                rxbuf1.head = next_head;                        // and update pointer
-            }
-        }
-    }
+#if SERIAL_RX_DMA & 1
+    HAL_NVIC_SetPriority(SERIAL_RX_DMA_IRQ, 0, 0);
+    HAL_NVIC_EnableIRQ(SERIAL_RX_DMA_IRQ);
+#endif
 
-    if((UART1->ISR & USART_ISR_TXE_TXFNF) && (UART1->CR1 & USART_CR1_TXEIE)) {
-        uint_fast16_t tail = txbuf1.tail;           // Get buffer pointer
-        UART1->TDR = txbuf1.data[tail];             // Send next character
-        txbuf1.tail = tail = BUFNEXT(tail, txbuf1); // and increment pointer
-        if(tail == txbuf1.head)                     // If buffer empty then
-            UART1->CR1 &= ~USART_CR1_TXEIE;         // disable UART TX interrupt
-   }
+    return &serial0stream;
 }
 
-#endif // SERIAL1_PORT
-
-#if SERIAL2_PORT
-
-//
-// Returns number of free characters in serial input buffer
-//
-static uint16_t serial2RxFree (void)
+void UART0_IRQHandler (void)
 {
-    uint32_t tail = rxbuf2.tail, head = rxbuf2.head;
+    ISR_PROFILE_ENTER();
 
-    return (RX_BUFFER_SIZE - 1) - BUFCOUNT(head, tail, RX_BUFFER_SIZE);
-}
-
-//
-// Returns number of characters in serial input buffer
-//
-static uint16_t serial2RxCount (void)
-{
-    uint32_t tail = rxbuf2.tail, head = rxbuf2.head;
+    portIRQHandler(&port0);
 
-    return BUFCOUNT(head, tail, RX_BUFFER_SIZE);
+    ISR_PROFILE_EXIT(IsrProfile_Serial0);
 }
 
-//
-// Flushes the serial input buffer
-//
-static void serial2RxFlush (void)
-{
-    rxbuf2.tail = rxbuf2.head;
-}
+#if SERIAL_RX_DMA & 1
 
-//
-// Flushes and adds a CAN character to the serial input buffer
-//
-static void serial2RxCancel (void)
+void SERIAL_RX_DMA_IRQHandler (void)
 {
-    rxbuf2.data[rxbuf2.head] = ASCII_CAN;
-    rxbuf2.tail = rxbuf2.head;
-    rxbuf2.head = BUFNEXT(rxbuf2.head, rxbuf2);
-}
+    ISR_PROFILE_ENTER();
 
-//
-// Writes a character to the serial output stream
-//
-static bool serial2PutC (const char c)
-{
-    uint32_t next_head = BUFNEXT(txbuf2.head, txbuf2);   // Set and update head pointer
+    portRxDmaIRQHandler(&port0, &SERIAL_RX_DMA_ISR, &SERIAL_RX_DMA_IFCR, SERIAL_RX_DMA_FLAGS, SERIAL_RX_DMA_TEIF);
 
-    while(txbuf2.tail == next_head) {           // While TX buffer full
-        if(!hal.stream_blocking_callback())     // check if blocking for space,
-            return false;                       // exit if not (leaves TX buffer in an inconsistent state)
-        UART2->CR1 |= USART_CR1_TXEIE;          // Enable TX interrupts???
-    }
+    ISR_PROFILE_EXIT(IsrProfile_Serial0);
+}
 
-    txbuf2.data[txbuf2.head] = c;               // Add data to buffer
-    txbuf2.head = next_head;                    // and update head pointer
+#endif
 
-    UART2->CR1 |= USART_CR1_TXEIE;              // Enable TX interrupts
+#endif // SERIAL_PORT
 
-    return true;
-}
+#if SERIAL1_PORT
 
-//
-// Writes a null terminated string to the serial output stream, blocks if buffer full
-//
-static void serial2WriteS (const char *s)
-{
-    char c, *ptr = (char *)s;
+static serial_port_t port1 = {
+    .uart = UART1,
+    .get_clock = UART1_CLK,
+    .rxbuf = &rxbuf1,
+    .txbuf = &txbuf1,
+    .enqueue_realtime_command = protocol_enqueue_realtime_command,
+#if SERIAL_RX_DMA & 2
+    .dma = SERIAL1_RX_DMA_STREAM,
+    .dma_mux = SERIAL1_RX_DMA_MUX,
+    .dma_request = UART1_DMAREQ,
+    .dma_buf = rxdma1
+#endif
+};
 
-    while((c = *ptr++) != '\0')
-        serial2PutC(c);
-}
+SERIAL_PORT_STREAM(1, port1, 1)
 
-// Writes a number of characters from a buffer to the serial output stream, blocks if buffer full
-//
-static void serial2Write (const char *s, uint16_t length)
+static const io_stream_t *serial1Init (uint32_t baud_rate)
 {
-    char *ptr = (char *)s;
+    if(!serialClaimPort(serial1stream.instance))
+        return NULL;
 
-    while(length--)
-        serial2PutC(*ptr++);
-}
+    UART1_CLK_En();
 
-//
-// Flushes the serial output buffer
-//
-static void serial2TxFlush (void)
-{
-    UART2->CR1 &= ~USART_CR1_TXEIE;     // Disable TX interrupts
-    txbuf2.tail = txbuf2.head;
-}
+    portInit(&port1, baud_rate, UART1_PORT, (1 << UART1_RX_PIN)|(1 << UART1_TX_PIN), UART1_AF, UART1_IRQ);
 
-//
-// Returns number of characters pending transmission
-//
-static uint16_t serial2TxCount (void)
-{
-    uint32_t tail = txbuf2.tail, head = txbuf2.head;
+#if SERIAL_RX_DMA & 2
+    HAL_NVIC_SetPriority(SERIAL1_RX_DMA_IRQ, 0, 0);
+    HAL_NVIC_EnableIRQ(SERIAL1_RX_DMA_IRQ);
+#endif
 
-    return BUFCOUNT(head, tail, TX_BUFFER_SIZE) + (UART2->ISR & USART_ISR_TC ? 0 : 1);
+    return &serial1stream;
 }
 
-//
-// serialGetC - returns -1 if no data available
-//
-static int16_t serial2GetC (void)
+void UART1_IRQHandler (void)
 {
-    uint_fast16_t tail = rxbuf2.tail;       // Get buffer pointer
-
-    if(tail == rxbuf2.head)
-        return -1; // no data available
+    ISR_PROFILE_ENTER();
 
-    char data = rxbuf2.data[tail];          // Get next character
-    rxbuf2.tail = BUFNEXT(tail, rxbuf2);    // and update pointer
+    portIRQHandler(&port1);
 
-    return (int16_t)data;
+    ISR_PROFILE_EXIT(IsrProfile_Serial1);
 }
 
-static bool serial2SuspendInput (bool suspend)
-{
-    return stream_rx_suspend(&rxbuf2, suspend);
-}
+#if SERIAL_RX_DMA & 2
 
-static bool serial2SetBaudRate (uint32_t baud_rate)
+void SERIAL1_RX_DMA_IRQHandler (void)
 {
-    UART2->CR1 = USART_CR1_RE|USART_CR1_TE;
-    UART2->CR3 = USART_CR3_OVRDIS;
-    UART2->BRR = UART_DIV_SAMPLING16(UART2_CLK, baud_rate, UART_PRESCALER_DIV1);
-    UART2->CR1 |= (USART_CR1_UE|USART_CR1_RXNEIE);
+    ISR_PROFILE_ENTER();
 
-    rxbuf2.tail = rxbuf2.head;
-    txbuf2.tail = txbuf2.head;
+    portRxDmaIRQHandler(&port1, &SERIAL1_RX_DMA_ISR, &SERIAL1_RX_DMA_IFCR, SERIAL1_RX_DMA_FLAGS, SERIAL1_RX_DMA_TEIF);
 
-    return true;
+    ISR_PROFILE_EXIT(IsrProfile_Serial1);
 }
 
-static bool serial2Disable (bool disable)
-{
-    if(disable)
-        UART2->CR1 &= ~USART_CR1_RXNEIE;
-    else
-        UART2->CR1 |= USART_CR1_RXNEIE;
-
-    return true;
-}
+#endif
 
-static bool serial2EnqueueRtCommand (char c)
-{
-    return enqueue_realtime_command2(c);
-}
+#endif // SERIAL1_PORT
 
-static enqueue_realtime_command_ptr serial2SetRtHandler (enqueue_realtime_command_ptr handler)
-{
-    enqueue_realtime_command_ptr prev = enqueue_realtime_command2;
+#if SERIAL2_PORT
 
-    if(handler)
-        enqueue_realtime_command2 = handler;
+static serial_port_t port2 = {
+    .uart = UART2,
+    .get_clock = UART2_CLK,
+    .rxbuf = &rxbuf2,
+    .txbuf = &txbuf2,
+    .enqueue_realtime_command = protocol_enqueue_realtime_command,
+#if SERIAL_RX_DMA & 4
+    .dma = SERIAL2_RX_DMA_STREAM,
+    .dma_mux = SERIAL2_RX_DMA_MUX,
+    .dma_request = UART2_DMAREQ,
+    .dma_buf = rxdma2
+#endif
+};
 
-    return prev;
-}
+SERIAL_PORT_STREAM(2, port2, 2)
 
 static const io_stream_t *serial2Init (uint32_t baud_rate)
 {
-    static const io_stream_t stream = {
-        .type = StreamType_Serial,
-        .instance = 2,
-        .state.connected = On,
-        .read = serial2GetC,
-        .write = serial2WriteS,
-        .write_n =  serial2Write,
-        .write_char = serial2PutC,
-        .enqueue_rt_command = serial2EnqueueRtCommand,
-        .get_rx_buffer_free = serial2RxFree,
-        .get_rx_buffer_count = serial2RxCount,
-        .get_tx_buffer_count = serial2TxCount,
-        .reset_write_buffer = serial2TxFlush,
-        .reset_read_buffer = serial2RxFlush,
-        .cancel_read_buffer = serial2RxCancel,
-        .suspend_read = serial2SuspendInput,
-        .disable_rx = serial2Disable,
-        .set_baud_rate = serial2SetBaudRate,
-        .set_enqueue_rt_handler = serial2SetRtHandler
-    };
-
-    if(!serialClaimPort(stream.instance))
+    if(!serialClaimPort(serial2stream.instance))
         return NULL;
 
     UART2_CLK_En();
 
-    GPIO_InitTypeDef GPIO_InitStructure = {
-        .Mode      = GPIO_MODE_AF_PP,
-        .Pull      = GPIO_NOPULL,
-        .Speed     = GPIO_SPEED_FREQ_VERY_HIGH,
-        .Pin       = (1 << UART2_RX_PIN)|(1 << UART2_TX_PIN),
-        .Alternate = UART2_AF
-    };
-    HAL_GPIO_Init(UART2_PORT, &GPIO_InitStructure);
-
-    serial2SetBaudRate(baud_rate);
+    portInit(&port2, baud_rate, UART2_PORT, (1 << UART2_RX_PIN)|(1 << UART2_TX_PIN), UART2_AF, UART2_IRQ);
 
-    HAL_NVIC_SetPriority(UART2_IRQ, 0, 0);
-    HAL_NVIC_EnableIRQ(UART2_IRQ);
+#if SERIAL_RX_DMA & 4
+    HAL_NVIC_SetPriority(SERIAL2_RX_DMA_IRQ, 0, 0);
+    HAL_NVIC_EnableIRQ(SERIAL2_RX_DMA_IRQ);
+#endif
 
-    return &stream;
+    return &serial2stream;
 }
 
 void UART2_IRQHandler (void)
 {
-    if(UART2->ISR & USART_ISR_RXNE_RXFNE) {
-        uint32_t data = UART2->RDR;
-        if(!enqueue_realtime_command2((char)data)) {            // Check and strip realtime commands...
-            uint16_t next_head = BUFNEXT(rxbuf2.head, rxbuf2);  // Get and increment buffer pointer
-            if(next_head == rxbuf2.tail)                        // If buffer full
-                rxbuf2.overflow = 1;                            // flag overflow
-            else {
-                rxbuf2.data[rxbuf2.head] = (char)data;          // if not add data to buffer
-                rxbuf2.head = next_head;                        // and update pointer
-            }
-        }
-    }
+    ISR_PROFILE_ENTER();
 
-    if((UART2->ISR & USART_ISR_TXE_TXFNF) && (UART2->CR1 & USART_CR1_TXEIE)) {
-        uint_fast16_t tail = txbuf2.tail;           // Get buffer pointer
-        UART2->TDR = txbuf2.data[tail];             // Send next character
-        txbuf2.tail = tail = BUFNEXT(tail, txbuf2); // and increment pointer
-        if(tail == txbuf2.head)                     // If buffer empty then
-            UART2->CR1 &= ~USART_CR1_TXEIE;         // disable UART TX interrupt
-   }
+    portIRQHandler(&port2);
+
+    ISR_PROFILE_EXIT(IsrProfile_Serial2);
 }
 
+#if SERIAL_RX_DMA & 4
+
+void SERIAL2_RX_DMA_IRQHandler (void)
+{
+    ISR_PROFILE_ENTER();
+
+    portRxDmaIRQHandler(&port2, &SERIAL2_RX_DMA_ISR, &SERIAL2_RX_DMA_IFCR, SERIAL2_RX_DMA_FLAGS, SERIAL2_RX_DMA_TEIF);
+
+    ISR_PROFILE_EXIT(IsrProfile_Serial2);
+}
+
+#endif
+
 #endif // SERIAL2_PORT
@@ -0,0 +1,237 @@
+/*
+
+  step_trace.c - step and direction output trace capture using the DWT cycle counter
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "step_trace.h"
+
+#if STEP_TRACE_ENABLE
+
+#include <string.h>
+
+#include "grbl/hal.h"
+#include "grbl/system.h"
+#include "grbl/nuts_bolts.h"
+
+#if SDCARD_ENABLE
+#include "sdmmc.h"
+#endif
+
+#define STEP_TRACE_FILENAME "/steptrace.bin"
+#define STEP_TRACE_LINE_ENTRIES 8
+
+// NOTE: layout is shared with the host side converter, tools/steptrace.py.
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entry_size;
+    uint32_t f_cpu;     // DWT->CYCCNT frequency, Hz
+    uint32_t count;     // Number of entries following the header
+    uint32_t step_invert;
+    uint32_t dir_invert;
+} step_trace_header_t;
+
+step_trace_t step_trace = {0};
+
+static on_report_options_ptr on_report_options;
+
+static void step_trace_arm (bool ring)
+{
+    step_trace.armed = false;
+    step_trace.head = 0;
+    step_trace.wrapped = false;
+    step_trace.ring = ring;
+    step_trace.armed = true;
+}
+
+static uint32_t step_trace_count (void)
+{
+    return step_trace.wrapped ? STEP_TRACE_SIZE : step_trace.head;
+}
+
+static void step_trace_get_header (step_trace_header_t *hdr)
+{
+    hdr->magic = STEP_TRACE_MAGIC;
+    hdr->version = STEP_TRACE_VERSION;
+    hdr->entry_size = sizeof(step_trace_entry_t);
+    hdr->f_cpu = hal.f_mcu * 1000000UL;
+    hdr->count = step_trace_count();
+    hdr->step_invert = settings.steppers.step_invert.mask;
+    hdr->dir_invert = settings.steppers.dir_invert.mask;
+}
+
+static char *hex (uint32_t value, uint_fast8_t digits, char *s)
+{
+    static const char hexdigit[] = "0123456789ABCDEF";
+
+    while(digits--) {
+        *s++ = hexdigit[(value >> (digits << 2)) & 0x0F];
+    }
+
+    return s;
+}
+
+// Outputs the trace as hex encoded entries, oldest first:
+// [STEPTRACE:<f_cpu>|<count>|<step_invert>|<dir_invert>]
+// [STEPTRACED:<cycles(8)><event(2)><bits(2)>...]
+static void step_trace_dump (void)
+{
+    char buf[STEP_TRACE_LINE_ENTRIES * 12 + 1], *s = buf;
+    step_trace_header_t hdr;
+    uint32_t idx, n = 0;
+
+    step_trace_get_header(&hdr);
+
+    hal.stream.write("[STEPTRACE:");
+    hal.stream.write(uitoa(hdr.f_cpu));
+    hal.stream.write("|");
+    hal.stream.write(uitoa(hdr.count));
+    hal.stream.write("|");
+    hal.stream.write(uitoa(hdr.step_invert));
+    hal.stream.write("|");
+    hal.stream.write(uitoa(hdr.dir_invert));
+    hal.stream.write("]" ASCII_EOL);
+
+    idx = step_trace.wrapped ? step_trace.head : 0;
+
+    while(n < hdr.count) {
+        s = hex(step_trace.entry[idx].cycles, 8, s);
+        s = hex(step_trace.entry[idx].event, 2, s);
+        s = hex(step_trace.entry[idx].bits, 2, s);
+        idx = (idx + 1) & (STEP_TRACE_SIZE - 1);
+        if(++n % STEP_TRACE_LINE_ENTRIES == 0 || n == hdr.count) {
+            *s = '\0';
+            hal.stream.write("[STEPTRACED:");
+            hal.stream.write(buf);
+            hal.stream.write("]" ASCII_EOL);
+            s = buf;
+        }
+    }
+}
+
+#if SDCARD_ENABLE
+
+// A short write means the card is full.
+static FRESULT step_trace_write (FIL *file, const void *data, UINT size)
+{
+    UINT bw;
+    FRESULT res = f_write(file, data, size, &bw);
+
+    return res == FR_OK && bw != size ? FR_DENIED : res;
+}
+
+// Writes header followed by the entries, oldest first, to STEP_TRACE_FILENAME.
+static status_code_t step_trace_save (void)
+{
+    FIL file;
+    FRESULT res;
+    step_trace_header_t hdr;
+    uint32_t start = step_trace.wrapped ? step_trace.head : 0;
+
+    step_trace_get_header(&hdr);
+
+    if((res = f_open(&file, STEP_TRACE_FILENAME, FA_WRITE|FA_CREATE_ALWAYS)) != FR_OK)
+        return sdmmc_write_status(res);
+
+    if((res = step_trace_write(&file, &hdr, sizeof(hdr))) == FR_OK && start)
+        res = step_trace_write(&file, &step_trace.entry[start], (STEP_TRACE_SIZE - start) * sizeof(step_trace_entry_t));
+
+    if(res == FR_OK)
+        res = step_trace_write(&file, &step_trace.entry[0], (hdr.count - (start ? STEP_TRACE_SIZE - start : 0)) * sizeof(step_trace_entry_t));
+
+    if(res == FR_OK)
+        res = f_close(&file);
+    else
+        f_close(&file);
+
+    return sdmmc_write_status(res);
+}
+
+#endif // SDCARD_ENABLE
+
+// $STEPTRACE - outputs capture status.
+// $STEPTRACE=ARM   - starts a capture, stops when the buffer is full.
+// $STEPTRACE=RING  - starts a continuous capture, keeps the latest STEP_TRACE_SIZE entries.
+// $STEPTRACE=STOP  - stops capture.
+// $STEPTRACE=DUMP  - stops capture and outputs the trace over the active stream.
+// $STEPTRACE=SAVE  - stops capture and writes the trace to the SD card.
+static status_code_t step_trace_command (sys_state_t state, char *args)
+{
+    status_code_t status = Status_OK;
+
+    if(args == NULL) {
+        hal.stream.write("[STEPTRACE:");
+        hal.stream.write(step_trace.armed ? (step_trace.ring ? "ring" : "armed") : "stopped");
+        hal.stream.write("|");
+        hal.stream.write(uitoa(step_trace_count()));
+        hal.stream.write("|");
+        hal.stream.write(uitoa(STEP_TRACE_SIZE));
+        hal.stream.write("]" ASCII_EOL);
+    } else if(!strcmp(args, "ARM") || !strcmp(args, "RING"))
+        step_trace_arm(*args == 'R');
+    else if(!strcmp(args, "STOP"))
+        step_trace.armed = false;
+    else if(!strcmp(args, "DUMP")) {
+        step_trace.armed = false;
+        step_trace_dump();
+    }
+#if SDCARD_ENABLE
+    else if(!strcmp(args, "SAVE")) {
+        step_trace.armed = false;
+        status = step_trace_save();
+    }
+#endif
+    else
+        status = Status_InvalidStatement;
+
+    return status;
+}
+
+static const sys_command_t step_trace_command_list[] = {
+    {"STEPTRACE", step_trace_command, {}, { .str = "step trace capture, args: ARM, RING, STOP, DUMP or SAVE" } }
+};
+
+static sys_commands_t step_trace_commands = {
+    .n_commands = sizeof(step_trace_command_list) / sizeof(sys_command_t),
+    .commands = step_trace_command_list
+};
+
+static sys_commands_t *on_get_commands (void)
+{
+    return &step_trace_commands;
+}
+
+static void report_options (bool newopt)
+{
+    on_report_options(newopt);
+
+    if(!newopt)
+        hal.stream.write("[PLUGIN:Step trace v0.01]" ASCII_EOL);
+}
+
+void step_trace_init (void)
+{
+    step_trace_commands.on_get_commands = grbl.on_get_commands;
+    grbl.on_get_commands = on_get_commands;
+
+    on_report_options = grbl.on_report_options;
+    grbl.on_report_options = report_options;
+}
+
+#endif // STEP_TRACE_ENABLE
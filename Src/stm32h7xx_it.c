@@ -24,6 +24,10 @@
 #include "stm32h7xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "isr_profiler.h"
+#if ETHERNET_ENABLE
+#include "enet.h"
+#endif
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -174,7 +178,9 @@ void DebugMon_Handler(void)
 void PendSV_Handler(void)
 {
   /* USER CODE BEGIN PendSV_IRQn 0 */
-
+#if ETHERNET_ENABLE && ETHERNET_RX_IRQ
+  enet_pendsv();
+#endif
   /* USER CODE END PendSV_IRQn 0 */
   /* USER CODE BEGIN PendSV_IRQn 1 */
 
@@ -187,11 +193,16 @@ void PendSV_Handler(void)
 void SysTick_Handler(void)
 {
   /* USER CODE BEGIN SysTick_IRQn 0 */
+  ISR_PROFILE_ENTER();
   cycle_count = DWT->CYCCNT;
   /* USER CODE END SysTick_IRQn 0 */
   HAL_IncTick();
   /* USER CODE BEGIN SysTick_IRQn 1 */
   Driver_IncTick();
+#if ETHERNET_ENABLE && ETHERNET_RX_IRQ
+  SCB->ICSR = SCB_ICSR_PENDSVSET_Msk; // run lwIP timeouts and service polls
+#endif
+  ISR_PROFILE_EXIT(IsrProfile_SysTick);
   /* USER CODE END SysTick_IRQn 1 */
 }
 
@@ -211,11 +222,11 @@ void SysTick_Handler(void)
 void OTG_HS_IRQHandler(void)
 {
   /* USER CODE BEGIN OTG_HS_IRQn 0 */
-
+  ISR_PROFILE_ENTER();
   /* USER CODE END OTG_HS_IRQn 0 */
   HAL_PCD_IRQHandler(&hpcd_USB_OTG_HS);
   /* USER CODE BEGIN OTG_HS_IRQn 1 */
-
+  ISR_PROFILE_EXIT(IsrProfile_USB);
   /* USER CODE END OTG_HS_IRQn 1 */
 }
 #else
@@ -225,11 +236,11 @@ void OTG_HS_IRQHandler(void)
 void OTG_FS_IRQHandler(void)
 {
   /* USER CODE BEGIN OTG_FS_IRQn 0 */
-
+  ISR_PROFILE_ENTER();
   /* USER CODE END OTG_FS_IRQn 0 */
   HAL_PCD_IRQHandler(&hpcd_USB_OTG_FS);
   /* USER CODE BEGIN OTG_FS_IRQn 1 */
-
+  ISR_PROFILE_EXIT(IsrProfile_USB);
   /* USER CODE END OTG_FS_IRQn 1 */
 }
 #endif // STM32H723xx / STM32H743xx
@@ -243,11 +254,11 @@ void OTG_FS_IRQHandler(void)
 void SDMMC1_IRQHandler(void)
 {
   /* USER CODE BEGIN SDMMC1_IRQn 0 */
-
+  ISR_PROFILE_ENTER();
   /* USER CODE END SDMMC1_IRQn 0 */
   HAL_SD_IRQHandler(&hsd1);
   /* USER CODE BEGIN SDMMC1_IRQn 1 */
-
+  ISR_PROFILE_EXIT(IsrProfile_SDMMC);
   /* USER CODE END SDMMC1_IRQn 1 */
 }
 #endif
@@ -0,0 +1,203 @@
+/*
+
+  udp_rt.c - UDP realtime command and status channel
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Realtime commands (feed hold, cycle start, jog cancel, overrides...) sent over TCP may be
+// delayed by Nagle, delayed ACKs and retransmits. This channel accepts them as UDP datagrams
+// and pushes status datagrams to subscribers, see udp_rt.h for the protocol.
+// NOTE: the service runs in the network poll context and is not tied to a stream.
+
+#include "udp_rt.h"
+
+#if ETHERNET_ENABLE && UDP_RT_ENABLE
+
+#include <string.h>
+
+#include "lwip/udp.h"
+
+#include "grbl/system.h"
+#include "grbl/nuts_bolts.h"
+#include "grbl/state_machine.h"
+#include "grbl/stepper.h"
+
+typedef struct {
+    ip_addr_t addr;
+    u16_t port;
+    uint8_t seq;
+    uint16_t interval;
+    uint32_t last_push;
+    uint32_t last_seen;
+} udp_rt_client_t;
+
+static struct udp_pcb *pcb = NULL;
+static udp_rt_client_t clients[UDP_RT_CLIENTS] = {0};
+static on_report_options_ptr on_report_options;
+
+static void send_status (const ip_addr_t *addr, u16_t port, uint8_t seq)
+{
+    struct pbuf *p;
+
+    if((p = pbuf_alloc(PBUF_TRANSPORT, sizeof(udp_rt_status_t), PBUF_RAM))) {
+
+        uint_fast8_t idx = N_AXIS;
+        int32_t position[N_AXIS];
+        float mpos[N_AXIS];
+        udp_rt_status_t *status = (udp_rt_status_t *)p->payload;
+
+        do {
+            idx--;
+            position[idx] = sys.position[idx];
+        } while(idx);
+
+        system_convert_array_steps_to_mpos(mpos, position);
+
+        status->type = UdpRt_StatusReport;
+        status->seq = seq;
+        status->n_axis = N_AXIS;
+        status->state = (uint16_t)state_get();
+        status->feed_override = (uint8_t)sys.override.feed_rate;
+        status->rapid_override = (uint16_t)sys.override.rapid_rate;
+        status->ms = hal.get_elapsed_ticks();
+        status->feed_rate = st_get_realtime_rate();
+        memcpy(status->mpos, mpos, sizeof(mpos));
+
+        udp_sendto(pcb, p, addr, port);
+        pbuf_free(p);
+    }
+}
+
+static void send_ack (const ip_addr_t *addr, u16_t port, uint8_t seq, uint8_t count)
+{
+    struct pbuf *p;
+
+    if((p = pbuf_alloc(PBUF_TRANSPORT, 3, PBUF_RAM))) {
+        ((uint8_t *)p->payload)[0] = UdpRt_Ack;
+        ((uint8_t *)p->payload)[1] = seq;
+        ((uint8_t *)p->payload)[2] = count;
+        udp_sendto(pcb, p, addr, port);
+        pbuf_free(p);
+    }
+}
+
+static udp_rt_client_t *get_client (const ip_addr_t *addr, u16_t port, bool add)
+{
+    uint_fast8_t idx;
+    udp_rt_client_t *client = NULL;
+
+    for(idx = 0; idx < UDP_RT_CLIENTS; idx++) {
+        if(clients[idx].interval && clients[idx].port == port && ip_addr_cmp(&clients[idx].addr, addr))
+            return &clients[idx];
+        if(client == NULL && clients[idx].interval == 0)
+            client = &clients[idx];
+    }
+
+    if(add && client) {
+        ip_addr_copy(client->addr, *addr);
+        client->port = port;
+        client->seq = 0;
+        client->last_push = hal.get_elapsed_ticks();
+    } else
+        client = NULL;
+
+    return client;
+}
+
+static void udp_rt_recv (void *arg, struct udp_pcb *upcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
+{
+    uint8_t hdr[4];
+    u16_t len = pbuf_copy_partial(p, hdr, sizeof(hdr), 0);
+
+    if(len >= 2) switch(hdr[0]) {
+
+        case UdpRt_Realtime:
+            {
+                char c;
+                uint8_t count = 0;
+                u16_t offset = 2;
+
+                while(offset < p->tot_len) {
+                    c = (char)pbuf_get_at(p, offset++);
+                    if(grbl.enqueue_realtime_command(c))
+                        count++;
+                }
+                send_ack(addr, port, hdr[1], count);
+            }
+            break;
+
+        case UdpRt_Subscribe:
+            if(len >= 4) {
+                uint16_t interval = hdr[2] | (hdr[3] << 8);
+                udp_rt_client_t *client = get_client(addr, port, interval != 0);
+                if(client) {
+                    client->interval = interval == 0 ? 0 : max(interval, UDP_RT_MIN_INTERVAL);
+                    client->last_seen = hal.get_elapsed_ticks();
+                }
+                send_ack(addr, port, hdr[1], client != NULL);
+            }
+            break;
+
+        case UdpRt_Status:
+            send_status(addr, port, hdr[1]);
+            break;
+    }
+
+    pbuf_free(p);
+}
+
+// Called from enet_service() on every network poll.
+void udp_rt_poll (void)
+{
+    uint_fast8_t idx;
+    uint32_t ms = hal.get_elapsed_ticks();
+
+    for(idx = 0; idx < UDP_RT_CLIENTS; idx++) {
+        udp_rt_client_t *client = &clients[idx];
+        if(client->interval) {
+            if(ms - client->last_seen > UDP_RT_TIMEOUT)
+                client->interval = 0;
+            else if(ms - client->last_push >= client->interval) {
+                client->last_push = ms;
+                send_status(&client->addr, client->port, ++client->seq);
+            }
+        }
+    }
+}
+
+static void report_options (bool newopt)
+{
+    on_report_options(newopt);
+
+    if(!newopt)
+        hal.stream.write("[PLUGIN:UDP realtime v0.01]" ASCII_EOL);
+}
+
+// Called from enet_start() after lwIP is initialized.
+void udp_rt_init (void)
+{
+    if((pcb = udp_new_ip_type(IPADDR_TYPE_ANY)) && udp_bind(pcb, IP_ANY_TYPE, UDP_RT_PORT) == ERR_OK) {
+
+        udp_recv(pcb, udp_rt_recv, NULL);
+
+        on_report_options = grbl.on_report_options;
+        grbl.on_report_options = report_options;
+    }
+}
+
+#endif // UDP_RT_ENABLE
@@ -30,12 +30,51 @@
 #include "usb_device.h"
 
 #include "usb_serial.h"
+#include "ringbuf.h"
 #include "../grbl/grbl.h"
 #include "../grbl/protocol.h"
 
+// Reception is held back when there is no room for a full packet in the input buffer,
+// for H723 the high speed packet size is used since the core may run with an ULPI PHY.
+#ifdef STM32H723xx
+#define USB_MAX_PACKET_SIZE CDC_DATA_HS_MAX_PACKET_SIZE
+#define USB_IRQn OTG_HS_IRQn
+#define USB_CORE USB_OTG_HS
+#define usbResumeReceive CDC_ResumeReceive_HS
+#define usbTransmit CDC_Transmit_HS
+#else
+#define USB_MAX_PACKET_SIZE CDC_DATA_FS_MAX_PACKET_SIZE
+#define USB_IRQn OTG_FS_IRQn
+#define USB_CORE USB_OTG_FS
+#define usbResumeReceive CDC_ResumeReceive_FS
+#define usbTransmit CDC_Transmit_FS
+#endif
+
+#ifndef USB_TX_BUFFER_SIZE
+#define USB_TX_BUFFER_SIZE 4096 // Must be a power of 2
+#endif
+
+// Max length of a single IN transfer, output queued behind it is sent on completion.
+#define USB_TX_CHUNK_SIZE (USB_TX_BUFFER_SIZE / 4)
+
+// Number of (micro)frames a partial line written by usbPutC() is held back before being sent.
+#ifndef USB_TX_FLUSH_SOF
+#define USB_TX_FLUSH_SOF 2
+#endif
+
+// Transmit queue, transfers are made directly from the buffer.
+typedef struct {
+    volatile uint_fast16_t head;
+    volatile uint_fast16_t tail;
+    volatile uint32_t length;   // Length of transfer in progress, 0 if idle
+    char data[USB_TX_BUFFER_SIZE];
+} usb_tx_buffer_t;
+
 static stream_rx_buffer_t rxbuf = {0};
-static stream_block_tx_buffer2_t txbuf = {0};
+static usb_tx_buffer_t txbuf = {0};
 static enqueue_realtime_command_ptr enqueue_realtime_command = protocol_enqueue_realtime_command;
+static volatile bool rx_paused = false;
+static volatile uint_fast8_t tx_sof = 0;    // SOF countdown for delayed flush, 0 if not armed
 
 volatile usb_linestate_t usb_linestate = {0};
 
@@ -53,12 +92,24 @@ static uint16_t usbRxFree (void)
     return RX_BUFFER_SIZE - BUFCOUNT(head, tail, RX_BUFFER_SIZE);
 }
 
+//
+// Rearms the OUT endpoint if reception is held back and there is room for a full packet
+//
+static inline void usbRxResume (void)
+{
+    if(rx_paused && ringbuf_free(&rxbuf) >= USB_MAX_PACKET_SIZE) {
+        rx_paused = false;
+        usbResumeReceive();
+    }
+}
+
 //
 // Flushes the input buffer
 //
 static void usbRxFlush (void)
 {
-    rxbuf.head = rxbuf.tail = 0;
+    rxbuf.tail = rxbuf.head;
+    usbRxResume();
 }
 
 //
@@ -69,61 +120,85 @@ static void usbRxCancel (void)
     rxbuf.data[rxbuf.head] = ASCII_CAN;
     rxbuf.tail = rxbuf.head;
     rxbuf.head =  BUFNEXT(rxbuf.head, rxbuf);;
+    usbRxResume();
 }
 
 //
-// Writes current buffer to the USB output stream, swaps buffers
+// Starts transmission of the next chunk of queued output if idle.
+// The transfer length is taken from the contiguous part of the buffer so no copying is needed,
+// the USB device class appends a ZLP when a transfer is a multiple of the max packet size.
 //
-static inline bool usb_write (void)
+static void usbTxStart (void)
 {
-    static uint8_t dummy = 0;
+    char *data;
+    uint32_t length;
 
-    txbuf.s = txbuf.use_tx2data ? txbuf.data2 : txbuf.data;
+    if(txbuf.length == 0 && (length = ringbuf_contiguous(&txbuf, &data))) {
+        txbuf.length = length > USB_TX_CHUNK_SIZE ? USB_TX_CHUNK_SIZE : length;
+        if(usbTransmit((uint8_t *)data, txbuf.length) != USBD_OK)
+            txbuf.length = 0;
+    }
+}
 
-#ifdef STM32H723xx
-    while(CDC_Transmit_HS((uint8_t *)txbuf.s, txbuf.length) == USBD_BUSY) {
-#else
-    while(CDC_Transmit_FS((uint8_t *)txbuf.s, txbuf.length) == USBD_BUSY) {
-#endif
-        if(!hal.stream_blocking_callback())
-            return false;
+//
+// Starts transmission from the foreground, the USB interrupt is masked to avoid racing the completion callback
+//
+static void usbTxFlush (void)
+{
+    if(txbuf.length == 0) {
+        HAL_NVIC_DisableIRQ(USB_IRQn);
+        usbTxStart();
+        HAL_NVIC_EnableIRQ(USB_IRQn);
     }
+}
 
-    if(txbuf.length % 64 == 0) {
-#ifdef STM32H723xx
-        while(CDC_Transmit_HS(&dummy, 0) == USBD_BUSY) {
-#else
-        while(CDC_Transmit_FS(&dummy, 0) == USBD_BUSY) {
-#endif
+//
+// Adds characters to the transmit queue, blocks if full
+//
+static bool usbTxQueue (const char *s, uint_fast16_t length)
+{
+    uint_fast16_t count;
+
+    while(length) {
+        if((count = ringbuf_write(&txbuf, s, length))) {
+            s += count;
+            length -= count;
+        } else {
+            usbTxFlush();
             if(!hal.stream_blocking_callback())
                 return false;
         }
     }
 
-    txbuf.use_tx2data = !txbuf.use_tx2data;
-    txbuf.s = txbuf.use_tx2data ? txbuf.data2 : txbuf.data;
-    txbuf.length = 0;
-
     return true;
 }
 
+//
+// Arms a flush on SOF if idle, the SOF interrupt is only enabled while a flush is pending
+//
+static void usbTxFlushDelayed (void)
+{
+    if(txbuf.length == 0 && tx_sof == 0) {
+        HAL_NVIC_DisableIRQ(USB_IRQn);
+        tx_sof = USB_TX_FLUSH_SOF;
+        USB_CORE->GINTMSK |= USB_OTG_GINTMSK_SOFM;
+        HAL_NVIC_EnableIRQ(USB_IRQn);
+    }
+}
+
 //
 // Writes a single character to the USB output stream, blocks if buffer full
+// Buffers characters up to EOL (LF) or a full packet before transmitting, a partial line is sent after a couple of frames
 //
 static bool usbPutC (const char c)
 {
-    static uint8_t buf[1];
-
-    *buf = c;
+    if(!usbTxQueue(&c, 1))
+        return false;
 
-#ifdef STM32H723xx
-    while(CDC_Transmit_HS(buf, 1) == USBD_BUSY) {
-#else
-    while(CDC_Transmit_FS(buf, 1) == USBD_BUSY) {
-#endif
-        if(!hal.stream_blocking_callback())
-            return false;
-    }
+    if(c == ASCII_LF || ringbuf_count(&txbuf) >= USB_MAX_PACKET_SIZE)
+        usbTxFlush();
+    else
+        usbTxFlushDelayed();
 
     return true;
 }
@@ -136,29 +211,11 @@ static void usbWriteS (const char *s)
 {
     size_t length = strlen(s);
 
-    if(length == 0)
-        return;
-
-    if(txbuf.length && (txbuf.length + length) > txbuf.max_length) {
-        if(!usb_write())
-            return;
-    }
-
-    while(length > txbuf.max_length) {
-        txbuf.length = txbuf.max_length;
-        memcpy(txbuf.s, s, txbuf.length);
-        if(!usb_write())
-            return;
-        length -= txbuf.max_length;
-        s += txbuf.max_length;
-    }
-
-    if(length) {
-        memcpy(txbuf.s, s, length);
-        txbuf.length += length;
-        txbuf.s += length;
-        if(s[length - 1] == ASCII_LF)
-            usb_write();
+    if(length && usbTxQueue(s, length)) {
+        if(s[length - 1] == ASCII_LF || ringbuf_count(&txbuf) >= USB_MAX_PACKET_SIZE)
+            usbTxFlush();
+        else
+            usbTxFlushDelayed();
     }
 }
 
@@ -167,30 +224,18 @@ static void usbWriteS (const char *s)
 //
 static void usbWrite (const char *s, uint16_t length)
 {
-    if(length == 0)
-        return;
-
-    if(txbuf.length && (txbuf.length + length) > txbuf.max_length) {
-        if(!usb_write())
-            return;
-    }
-
-    while(length > txbuf.max_length) {
-        txbuf.length = txbuf.max_length;
-        memcpy(txbuf.s, s, txbuf.length);
-        if(!usb_write())
-            return;
-        length -= txbuf.max_length;
-        s += txbuf.max_length;
-    }
+    if(length && usbTxQueue(s, length))
+        usbTxFlush();
+}
 
-    if(length) {
-        memcpy(txbuf.s, s, length);
-        txbuf.length += length;
-        txbuf.s += length;
-        usb_write();
-    }
+//
+// Returns number of characters pending transmission
+//
+static uint16_t usbTxCount (void)
+{
+    return ringbuf_count(&txbuf);
 }
+
 //
 // usbGetC - returns -1 if no data available
 //
@@ -204,6 +249,8 @@ static int16_t usbGetC (void)
     char data = rxbuf.data[tail];       // Get next character, increment tmp pointer
     rxbuf.tail = BUFNEXT(tail, rxbuf);  // and update pointer
 
+    usbRxResume();
+
     return (int16_t)data;
 }
 
@@ -241,6 +288,7 @@ const io_stream_t *usbInit (void)
         .write_n = usbWrite,
         .enqueue_rt_command = usbEnqueueRtCommand,
         .get_rx_buffer_free = usbRxFree,
+        .get_tx_buffer_count = usbTxCount,
         .reset_read_buffer = usbRxFlush,
         .cancel_read_buffer = usbRxCancel,
         .suspend_read = usbSuspendInput,
@@ -249,15 +297,14 @@ const io_stream_t *usbInit (void)
 
     MX_USB_DEVICE_Init();
 
-    txbuf.s = txbuf.data;
-    txbuf.max_length = BLOCK_TX_BUFFER_SIZE;
-
     return &stream;
 }
 
 // NOTE: A call to this function should be added as the first line of CDC_Receive_FS() & CDC_Receive_HS().
 //       These are found in the usbd_cdc_if.c support files for H743 and H723 parts.
-void usbBufferInput (uint8_t *data, uint32_t length)
+//       Returns false if the OUT endpoint should not be rearmed since there is no room for another packet,
+//       it is then rearmed from the foreground when enough data has been consumed.
+bool usbBufferInput (uint8_t *data, uint32_t length)
 {
     while(length--) {
         if(!enqueue_realtime_command(*data)) {                  // Check and strip realtime commands,
@@ -271,6 +318,38 @@ void usbBufferInput (uint8_t *data, uint32_t length)
         }
         data++;                                                 // next...
     }
+
+    return !(rx_paused = ringbuf_free(&rxbuf) < USB_MAX_PACKET_SIZE);
+}
+
+// NOTE: A call to this function should be added to CDC_TransmitCplt_FS() & CDC_TransmitCplt_HS().
+//       Releases the transferred chunk and starts the next one, if any.
+void usbTxComplete (void)
+{
+    ringbuf_skip(&txbuf, txbuf.length);
+    txbuf.length = 0;
+    usbTxStart();
+}
+
+// NOTE: A call to this function should be added to HAL_PCD_SOFCallback() in usbd_conf.c.
+//       Sends output held back by usbPutC() when the countdown expires.
+void usbSOF (void)
+{
+    if(tx_sof && --tx_sof == 0) {
+        USB_CORE->GINTMSK &= ~USB_OTG_GINTMSK_SOFM;
+        usbTxStart();
+    }
+}
+
+// NOTE: A call to this function should be added to CDC_Init_FS() & CDC_Init_HS(),
+//       the class driver arms the OUT endpoint on (re)initialization.
+//       A transfer in progress when the device was reset will never complete, pending output is discarded.
+void usbBufferReset (void)
+{
+    rx_paused = false;
+    tx_sof = 0;
+    txbuf.length = 0;
+    txbuf.tail = txbuf.head;
 }
 
 #endif
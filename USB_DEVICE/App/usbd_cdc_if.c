@@ -157,6 +157,9 @@ static int8_t CDC_Init_FS(void)
   /* Set Application Buffers */
   USBD_CDC_SetTxBuffer(&hUsbDeviceFS, UserTxBufferFS, 0);
   USBD_CDC_SetRxBuffer(&hUsbDeviceFS, UserRxBufferFS);
+#if USB_SERIAL_CDC
+  usbBufferReset();
+#endif
   return (USBD_OK);
   /* USER CODE END 3 */
 }
@@ -265,7 +268,8 @@ static int8_t CDC_Receive_FS(uint8_t* Buf, uint32_t *Len)
 {
   /* USER CODE BEGIN 6 */
 #if USB_SERIAL_CDC
-  usbBufferInput(Buf, *Len);
+  if(!usbBufferInput(Buf, *Len))
+    return (USBD_OK); // Input buffer is full, the OUT endpoint is rearmed by CDC_ResumeReceive_FS() when there is room
 #endif
   USBD_CDC_SetRxBuffer(&hUsbDeviceFS, &Buf[0]);
   USBD_CDC_ReceivePacket(&hUsbDeviceFS);
@@ -317,12 +321,28 @@ static int8_t CDC_TransmitCplt_FS(uint8_t *Buf, uint32_t *Len, uint8_t epnum)
   UNUSED(Buf);
   UNUSED(Len);
   UNUSED(epnum);
+#if USB_SERIAL_CDC
+  usbTxComplete();
+#endif
   /* USER CODE END 13 */
   return result;
 }
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_IMPLEMENTATION */
 
+/**
+  * @brief  CDC_ResumeReceive_FS
+  *         Rearms the OUT endpoint after reception has been held back by CDC_Receive_FS.
+  *         Called from the foreground, the USB interrupt is masked while the endpoint is prepared.
+  */
+void CDC_ResumeReceive_FS(void)
+{
+  HAL_NVIC_DisableIRQ(OTG_FS_IRQn);
+  USBD_CDC_SetRxBuffer(&hUsbDeviceFS, UserRxBufferFS);
+  USBD_CDC_ReceivePacket(&hUsbDeviceFS);
+  HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
+}
+
 /* USER CODE END PRIVATE_FUNCTIONS_IMPLEMENTATION */
 
 /**
@@ -158,6 +158,9 @@ static int8_t CDC_Init_HS(void)
   /* Set Application Buffers */
   USBD_CDC_SetTxBuffer(&hUsbDeviceHS, UserTxBufferHS, 0);
   USBD_CDC_SetRxBuffer(&hUsbDeviceHS, UserRxBufferHS);
+#if USB_SERIAL_CDC
+  usbBufferReset();
+#endif
   return (USBD_OK);
   /* USER CODE END 8 */
 }
@@ -267,7 +270,8 @@ static int8_t CDC_Receive_HS(uint8_t* Buf, uint32_t *Len)
 {
   /* USER CODE BEGIN 11 */
 #if USB_SERIAL_CDC
-  usbBufferInput(Buf, *Len);
+  if(!usbBufferInput(Buf, *Len))
+    return (USBD_OK); // Input buffer is full, the OUT endpoint is rearmed by CDC_ResumeReceive_HS() when there is room
 #endif
   USBD_CDC_SetRxBuffer(&hUsbDeviceHS, &Buf[0]);
   USBD_CDC_ReceivePacket(&hUsbDeviceHS);
@@ -315,12 +319,28 @@ static int8_t CDC_TransmitCplt_HS(uint8_t *Buf, uint32_t *Len, uint8_t epnum)
   UNUSED(Buf);
   UNUSED(Len);
   UNUSED(epnum);
+#if USB_SERIAL_CDC
+  usbTxComplete();
+#endif
   /* USER CODE END 14 */
   return result;
 }
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_IMPLEMENTATION */
 
+/**
+  * @brief  CDC_ResumeReceive_HS
+  *         Rearms the OUT endpoint after reception has been held back by CDC_Receive_HS.
+  *         Called from the foreground, the USB interrupt is masked while the endpoint is prepared.
+  */
+void CDC_ResumeReceive_HS(void)
+{
+  HAL_NVIC_DisableIRQ(OTG_HS_IRQn);
+  USBD_CDC_SetRxBuffer(&hUsbDeviceHS, UserRxBufferHS);
+  USBD_CDC_ReceivePacket(&hUsbDeviceHS);
+  HAL_NVIC_EnableIRQ(OTG_HS_IRQn);
+}
+
 /* USER CODE END PRIVATE_FUNCTIONS_IMPLEMENTATION */
 
 /**
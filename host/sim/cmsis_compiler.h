@@ -0,0 +1,158 @@
+/*
+
+  cmsis_compiler.h - host replacement of the CMSIS compiler header
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// The CMSIS core header is copied next to this file so that its include of
+// cmsis_compiler.h resolves here. Core registers are kept by the simulator in
+// mcu_sim.c, instructions that change the interrupt masks let it dispatch
+// interrupts that become unmasked.
+
+#ifndef __CMSIS_COMPILER_H
+#define __CMSIS_COMPILER_H
+
+#include <stdint.h>
+
+#define __ASM                   __asm
+#define __INLINE                inline
+#define __STATIC_INLINE         static inline
+#define __STATIC_FORCEINLINE    __attribute__((always_inline)) static inline
+#define __NO_RETURN             __attribute__((__noreturn__))
+#define __USED                  __attribute__((used))
+#define __WEAK                  __attribute__((weak))
+#define __PACKED                __attribute__((packed, aligned(1)))
+#define __PACKED_STRUCT         struct __attribute__((packed, aligned(1)))
+#define __PACKED_UNION          union __attribute__((packed, aligned(1)))
+#define __ALIGNED(x)            __attribute__((aligned(x)))
+#define __RESTRICT              __restrict
+#define __COMPILER_BARRIER()    __ASM volatile("":::"memory")
+
+#define __UNALIGNED_UINT32_READ(addr)       (*((const __PACKED uint32_t *)(addr)))
+#define __UNALIGNED_UINT32_WRITE(addr, val) ((*((__PACKED uint32_t *)(addr))) = (val))
+
+#define __NOP()                 __COMPILER_BARRIER()
+#define __WFI()                 sim_idle()
+#define __WFE()                 sim_idle()
+#define __SEV()                 __COMPILER_BARRIER()
+#define __DSB()                 __sync_synchronize()
+#define __ISB()                 __sync_synchronize()
+#define __DMB()                 __sync_synchronize()
+#define __BKPT(value)           __builtin_trap()
+
+#define __CLZ(x)                ((x) ? (uint8_t)__builtin_clz(x) : 32U)
+#define __REV(x)                __builtin_bswap32(x)
+#define __RBIT(x)               sim_rbit(x)
+
+extern volatile uint32_t sim_primask, sim_basepri, sim_ipsr, sim_exceptions;
+
+void sim_idle (void);
+void sim_mask_changed (void);
+
+__STATIC_INLINE uint32_t sim_rbit (uint32_t value)
+{
+    uint32_t result = 0, bit;
+
+    for(bit = 0; bit < 32; bit++) {
+        result = (result << 1) | (value & 1U);
+        value >>= 1;
+    }
+
+    return result;
+}
+
+__STATIC_INLINE void __enable_irq (void)
+{
+    __COMPILER_BARRIER();
+    sim_primask = 0;
+    sim_mask_changed();
+}
+
+__STATIC_INLINE void __disable_irq (void)
+{
+    sim_primask = 1;
+    __COMPILER_BARRIER();
+}
+
+__STATIC_INLINE uint32_t __get_PRIMASK (void)
+{
+    return sim_primask;
+}
+
+__STATIC_INLINE void __set_PRIMASK (uint32_t primask)
+{
+    __COMPILER_BARRIER();
+    sim_primask = primask & 1U;
+    sim_mask_changed();
+}
+
+__STATIC_INLINE uint32_t __get_IPSR (void)
+{
+    return sim_ipsr;
+}
+
+__STATIC_INLINE uint32_t __get_BASEPRI (void)
+{
+    return sim_basepri;
+}
+
+__STATIC_INLINE void __set_BASEPRI (uint32_t basepri)
+{
+    __COMPILER_BARRIER();
+    sim_basepri = basepri & 0xFFU;
+    sim_mask_changed();
+}
+
+__STATIC_INLINE void __set_BASEPRI_MAX (uint32_t basepri)
+{
+    basepri &= 0xFFU;
+    if(basepri && (sim_basepri == 0 || basepri < sim_basepri))
+        sim_basepri = basepri;
+    __COMPILER_BARRIER();
+}
+
+// Exception entry and return clear the local exclusive monitor, the simulator counts
+// exceptions taken so a store fails when an interrupt was serviced after the load.
+
+extern volatile uint32_t sim_exclusive;
+
+__STATIC_INLINE uint32_t __LDREXW (volatile uint32_t *addr)
+{
+    sim_exclusive = sim_exceptions;
+    __COMPILER_BARRIER();
+
+    return *addr;
+}
+
+__STATIC_INLINE uint32_t __STREXW (uint32_t value, volatile uint32_t *addr)
+{
+    __COMPILER_BARRIER();
+    if(sim_exclusive != sim_exceptions)
+        return 1;
+
+    *addr = value;
+
+    return 0;
+}
+
+__STATIC_INLINE void __CLREX (void)
+{
+    sim_exclusive = ~sim_exceptions;
+}
+
+#endif // __CMSIS_COMPILER_H
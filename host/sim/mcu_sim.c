@@ -0,0 +1,1416 @@
+/*
+
+  mcu_sim.c - register level simulation of the STM32H743 peripherals used by the driver
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#define _GNU_SOURCE
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "mcu_sim.h"
+
+#define PERIPH_REGION_BASE  0x40000000UL
+#define PERIPH_REGION_SIZE  0x20000000UL
+#define PPB_REGION_BASE     0xE0000000UL
+#define PPB_REGION_SIZE     0x00100000UL
+
+#define PAGE_SIZE           4096UL
+#define TIMER_CLOCK_DIV     2   // CPU cycles per timer kernel clock, the timer clock is 2 x PCLK
+#define USART_CLOCK_DIV     4   // CPU cycles per USART kernel clock (PCLK)
+#define USART_FIFO_SIZE     16
+#define USART_BUFFER_SIZE   65536
+#define N_IRQS              150
+#define N_GPIO              11
+#define N_DMA_STREAMS       16
+#define MAX_NESTING         32
+
+#define EXC_PENDSV          14
+#define EXC_SYSTICK         15
+
+typedef void (*vector_t)(void);
+
+typedef struct {
+    TIM_TypeDef *tim;
+    IRQn_Type irq;
+    uint32_t max;
+    uint8_t dma_up;
+    uint8_t dma_cc[4];
+    bool running;
+    uint64_t t_ref;     // Time of the counter tick that loaded cnt_ref
+    uint32_t cnt_ref;
+    uint32_t psc;       // Active (shadow) registers
+    uint32_t arr;
+    uint32_t ccr[4];
+} sim_tim_t;
+
+typedef struct {
+    USART_TypeDef *uart;
+    IRQn_Type irq;
+    uint8_t dma_rx;
+    uint8_t tx[USART_FIFO_SIZE];
+    uint32_t tx_n, tx_head;
+    bool shifting;
+    uint8_t shift_data;
+    uint64_t shift_done;
+    uint8_t rx[USART_FIFO_SIZE];
+    uint32_t rx_n, rx_head;
+    uint32_t flags;     // Latched status flags: TC, RTOF and IDLE
+    char in[USART_BUFFER_SIZE];
+    uint32_t in_n, in_head;
+    uint64_t in_next;   // End of stop bit of the next incoming character
+    uint64_t rto_at, idle_at;
+    char out[USART_BUFFER_SIZE];
+    uint32_t out_n;
+    uint64_t out_last;
+} sim_uart_t;
+
+typedef struct {
+    uint16_t drive;     // Pins driven from outside and their level
+    uint16_t level;
+    uint16_t idr;
+} sim_gpio_t;
+
+typedef struct {
+    bool enabled;
+    uint32_t ndtr;      // Number of data items programmed when enabled
+    uint32_t item;
+    uint32_t fifo;      // Memory to peripheral data fetched ahead of the request
+} sim_dma_stream_t;
+
+typedef struct {
+    uintptr_t addr, page;
+    bool write;
+    uint32_t old;
+} sim_access_t;
+
+#define TIMER(t, n, top, up, cc1, cc2, cc3, cc4) { .tim = t, .irq = n, .max = top, .dma_up = up, .dma_cc = { cc1, cc2, cc3, cc4 } }
+
+static sim_tim_t timers[] = {
+    TIMER(TIM2, TIM2_IRQn, 0xFFFFFFFF, DMA_REQUEST_TIM2_UP, DMA_REQUEST_TIM2_CH1, DMA_REQUEST_TIM2_CH2, DMA_REQUEST_TIM2_CH3, DMA_REQUEST_TIM2_CH4),
+    TIMER(TIM3, TIM3_IRQn, 0xFFFF, DMA_REQUEST_TIM3_UP, DMA_REQUEST_TIM3_CH1, DMA_REQUEST_TIM3_CH2, DMA_REQUEST_TIM3_CH3, DMA_REQUEST_TIM3_CH4),
+    TIMER(TIM4, TIM4_IRQn, 0xFFFF, DMA_REQUEST_TIM4_UP, DMA_REQUEST_TIM4_CH1, DMA_REQUEST_TIM4_CH2, DMA_REQUEST_TIM4_CH3, 0),
+    TIMER(TIM5, TIM5_IRQn, 0xFFFFFFFF, DMA_REQUEST_TIM5_UP, DMA_REQUEST_TIM5_CH1, DMA_REQUEST_TIM5_CH2, DMA_REQUEST_TIM5_CH3, DMA_REQUEST_TIM5_CH4),
+    TIMER(TIM6, TIM6_DAC_IRQn, 0xFFFF, DMA_REQUEST_TIM6_UP, 0, 0, 0, 0),
+    TIMER(TIM7, TIM7_IRQn, 0xFFFF, DMA_REQUEST_TIM7_UP, 0, 0, 0, 0),
+    TIMER(TIM12, TIM8_BRK_TIM12_IRQn, 0xFFFF, 0, 0, 0, 0, 0),
+    TIMER(TIM13, TIM8_UP_TIM13_IRQn, 0xFFFF, 0, 0, 0, 0, 0),
+    TIMER(TIM14, TIM8_TRG_COM_TIM14_IRQn, 0xFFFF, 0, 0, 0, 0, 0)
+};
+
+static sim_uart_t uarts[] = {
+    { .uart = USART1, .irq = USART1_IRQn, .dma_rx = DMA_REQUEST_USART1_RX },
+    { .uart = USART2, .irq = USART2_IRQn, .dma_rx = DMA_REQUEST_USART2_RX },
+    { .uart = USART3, .irq = USART3_IRQn, .dma_rx = DMA_REQUEST_USART3_RX },
+    { .uart = USART6, .irq = USART6_IRQn, .dma_rx = DMA_REQUEST_USART6_RX }
+};
+
+#define N_TIMERS (sizeof(timers) / sizeof(sim_tim_t))
+#define N_UARTS (sizeof(uarts) / sizeof(sim_uart_t))
+
+static const IRQn_Type dma_irq[N_DMA_STREAMS] = {
+    DMA1_Stream0_IRQn, DMA1_Stream1_IRQn, DMA1_Stream2_IRQn, DMA1_Stream3_IRQn,
+    DMA1_Stream4_IRQn, DMA1_Stream5_IRQn, DMA1_Stream6_IRQn, DMA1_Stream7_IRQn,
+    DMA2_Stream0_IRQn, DMA2_Stream1_IRQn, DMA2_Stream2_IRQn, DMA2_Stream3_IRQn,
+    DMA2_Stream4_IRQn, DMA2_Stream5_IRQn, DMA2_Stream6_IRQn, DMA2_Stream7_IRQn
+};
+
+static const uint8_t dma_flag_shift[4] = { 0, 6, 16, 22 };
+
+// Interrupt handlers, weak so that the test only links what the configuration under test provides.
+
+#define HANDLERS(f) \
+    f(EXTI0) f(EXTI1) f(EXTI2) f(EXTI3) f(EXTI4) f(EXTI9_5) f(EXTI15_10) \
+    f(DMA1_Stream0) f(DMA1_Stream1) f(DMA1_Stream2) f(DMA1_Stream3) f(DMA1_Stream4) f(DMA1_Stream5) f(DMA1_Stream6) f(DMA1_Stream7) \
+    f(DMA2_Stream0) f(DMA2_Stream1) f(DMA2_Stream2) f(DMA2_Stream3) f(DMA2_Stream4) f(DMA2_Stream5) f(DMA2_Stream6) f(DMA2_Stream7) \
+    f(TIM2) f(TIM3) f(TIM4) f(TIM5) f(TIM6_DAC) f(TIM7) f(TIM8_BRK_TIM12) f(TIM8_UP_TIM13) f(TIM8_TRG_COM_TIM14) \
+    f(USART1) f(USART2) f(USART3) f(USART6)
+
+#define DECLARE_HANDLER(name) extern void name##_IRQHandler (void) __attribute__((weak));
+#define VECTOR(name) [name##_IRQn] = name##_IRQHandler,
+
+HANDLERS(DECLARE_HANDLER)
+
+extern void SysTick_Handler (void) __attribute__((weak));
+extern void PendSV_Handler (void) __attribute__((weak));
+
+static vector_t vectors[N_IRQS] = {
+    HANDLERS(VECTOR)
+};
+
+volatile uint64_t sim_cycles = 0;
+volatile uint32_t sim_primask = 0, sim_basepri = 0, sim_ipsr = 0, sim_exceptions = 0, sim_exclusive = 0;
+sim_gpio_output_ptr sim_on_gpio_output = NULL;
+
+static uint8_t *alias;
+static sim_gpio_t gpio[N_GPIO];
+static sim_dma_stream_t dma[N_DMA_STREAMS];
+static sim_access_t traps[2];
+static uint32_t n_access = 0;
+static uint32_t nvic_enabled[5], nvic_pending[5], nvic_active[5];
+static bool systick_enabled = false, systick_pending = false, pendsv_pending = false;
+static uint64_t systick_next;
+static uint32_t prigroup = 0, dwt_offset = 0;
+static uint32_t active_prio[MAX_NESTING], active_exc[MAX_NESTING], depth = 0;
+static uint32_t irq_counts[N_IRQS];
+
+static void sim_advance (uint64_t target);
+static void sim_dispatch (void);
+static void dma_request (uint8_t request);
+
+// Register access by the simulator goes through a second, accessible mapping of the registers.
+
+static inline volatile uint32_t *reg_ptr (uintptr_t addr)
+{
+    return (volatile uint32_t *)(alias + (addr >= PPB_REGION_BASE ? addr - PPB_REGION_BASE + PERIPH_REGION_SIZE : addr - PERIPH_REGION_BASE));
+}
+
+#define REG(r) (*reg_ptr((uintptr_t)&(r)))
+#define REG8(r) (*(volatile uint8_t *)reg_ptr((uintptr_t)&(r)))
+
+static inline bool in_region (uintptr_t addr)
+{
+    return (addr >= PERIPH_REGION_BASE && addr < PERIPH_REGION_BASE + PERIPH_REGION_SIZE) ||
+            (addr >= PPB_REGION_BASE && addr < PPB_REGION_BASE + PPB_REGION_SIZE);
+}
+
+static inline bool in_block (uintptr_t addr, const volatile void *base, uint32_t size, uint32_t *offset)
+{
+    *offset = (uint32_t)(addr - (uintptr_t)base);
+
+    return addr >= (uintptr_t)base && addr < (uintptr_t)base + size;
+}
+
+// GPIO and EXTI
+
+static uint16_t gpio_idr (uint32_t port)
+{
+    GPIO_TypeDef *regs = (GPIO_TypeDef *)(GPIOA_BASE + port * 0x400UL);
+    uint32_t pin, mode, pull, moder = REG(regs->MODER), pupdr = REG(regs->PUPDR), odr = REG(regs->ODR);
+    uint16_t idr = 0, bit;
+
+    for(pin = 0; pin < 16; pin++) {
+        bit = 1 << pin;
+        mode = (moder >> (pin * 2)) & 0x3;
+        pull = (pupdr >> (pin * 2)) & 0x3;
+        if(mode == 1 || (mode == 2 && !(gpio[port].drive & bit)))
+            idr |= odr & bit;
+        else if(gpio[port].drive & bit)
+            idr |= gpio[port].level & bit;
+        else if(pull == 1)
+            idr |= bit;
+    }
+
+    return idr;
+}
+
+static void gpio_update (uint32_t port)
+{
+    uint16_t idr = gpio_idr(port), changed = idr ^ gpio[port].idr;
+    uint32_t pin, line, exti_port;
+
+    gpio[port].idr = idr;
+
+    for(pin = 0; changed && pin < 16; pin++) {
+        line = 1 << pin;
+        if(changed & line) {
+            exti_port = (REG(SYSCFG->EXTICR[pin >> 2]) >> ((pin & 0x3) * 4)) & 0xF;
+            if(exti_port == port && (REG(EXTI->IMR1) & line) && ((idr & line ? REG(EXTI->RTSR1) : REG(EXTI->FTSR1)) & line))
+                REG(EXTI->PR1) |= line;
+        }
+    }
+}
+
+static void gpio_output (uint32_t port, uint32_t old_odr)
+{
+    GPIO_TypeDef *regs = (GPIO_TypeDef *)(GPIOA_BASE + port * 0x400UL);
+    uint16_t odr = (uint16_t)REG(regs->ODR), changed = odr ^ (uint16_t)old_odr;
+
+    if(changed && sim_on_gpio_output)
+        sim_on_gpio_output(regs, changed, odr, sim_cycles);
+
+    gpio_update(port);
+}
+
+static void gpio_write (uint32_t port, uint32_t offset, uint32_t old, uint32_t value)
+{
+    GPIO_TypeDef *regs = (GPIO_TypeDef *)(GPIOA_BASE + port * 0x400UL);
+    uint32_t odr = REG(regs->ODR);
+
+    switch(offset) {
+
+        case offsetof(GPIO_TypeDef, BSRR):
+            REG(regs->BSRR) = 0;
+            REG(regs->ODR) = ((odr & ~(value >> 16)) | value) & 0xFFFF;
+            gpio_output(port, odr);
+            break;
+
+        case offsetof(GPIO_TypeDef, ODR):
+            REG(regs->ODR) = value & 0xFFFF;
+            gpio_output(port, old);
+            break;
+
+        case offsetof(GPIO_TypeDef, IDR):
+            REG(regs->IDR) = old;
+            break;
+
+        default:
+            gpio_update(port);
+            break;
+    }
+}
+
+// Timers, the counter is evaluated from the time of its last reload or update.
+
+static inline bool tim_down (sim_tim_t *t)
+{
+    return !!(REG(t->tim->CR1) & TIM_CR1_DIR);
+}
+
+static inline uint64_t tim_period (sim_tim_t *t)
+{
+    return (uint64_t)TIMER_CLOCK_DIV * (t->psc + 1);
+}
+
+static uint32_t tim_count (sim_tim_t *t)
+{
+    uint64_t ticks;
+
+    if(!t->running)
+        return t->cnt_ref;
+
+    ticks = (sim_cycles - t->t_ref) / tim_period(t);
+
+    return (tim_down(t) ? t->cnt_ref - (uint32_t)ticks : t->cnt_ref + (uint32_t)ticks) & t->max;
+}
+
+// Ticks from t_ref to the next update event and to the next compare match.
+static uint64_t tim_next (sim_tim_t *t, bool *update)
+{
+    uint32_t ch;
+    uint64_t ticks, match = UINT64_MAX;
+
+    if(tim_down(t)) {
+        ticks = (uint64_t)t->cnt_ref + 1;
+        for(ch = 0; ch < 4; ch++) {
+            if(t->ccr[ch] < t->cnt_ref && t->cnt_ref - t->ccr[ch] < match)
+                match = t->cnt_ref - t->ccr[ch];
+        }
+    } else {
+        ticks = t->cnt_ref <= t->arr ? (uint64_t)(t->arr - t->cnt_ref) + 1 : (uint64_t)(t->max - t->cnt_ref) + 1;
+        for(ch = 0; ch < 4; ch++) {
+            if(t->ccr[ch] > t->cnt_ref && t->ccr[ch] <= t->arr && t->ccr[ch] - t->cnt_ref < match)
+                match = t->ccr[ch] - t->cnt_ref;
+        }
+    }
+
+    *update = ticks <= match;
+
+    return *update ? ticks : match;
+}
+
+static void tim_match (sim_tim_t *t)
+{
+    uint32_t ch, dier = REG(t->tim->DIER);
+
+    for(ch = 0; ch < 4; ch++) {
+        if(t->ccr[ch] == t->cnt_ref && t->ccr[ch] <= t->arr) {
+            REG(t->tim->SR) |= TIM_SR_CC1IF << ch;
+            if(dier & (TIM_DIER_CC1DE << ch))
+                dma_request(t->dma_cc[ch]);
+        }
+    }
+}
+
+// Update event, from counter overflow/underflow or from setting UG.
+static void tim_update (sim_tim_t *t, uint64_t when, bool overflow)
+{
+    uint32_t cr1 = REG(t->tim->CR1);
+
+    t->psc = REG(t->tim->PSC) & 0xFFFF;
+    t->arr = REG(t->tim->ARR) & t->max;
+    t->ccr[0] = REG(t->tim->CCR1) & t->max;
+    t->ccr[1] = REG(t->tim->CCR2) & t->max;
+    t->ccr[2] = REG(t->tim->CCR3) & t->max;
+    t->ccr[3] = REG(t->tim->CCR4) & t->max;
+    t->cnt_ref = tim_down(t) ? t->arr : 0;
+    t->t_ref = when;
+
+    if(!(cr1 & TIM_CR1_UDIS) && (overflow || !(cr1 & TIM_CR1_URS))) {
+        REG(t->tim->SR) |= TIM_SR_UIF;
+        if(REG(t->tim->DIER) & TIM_DIER_UDE)
+            dma_request(t->dma_up);
+    }
+
+    if(overflow && (cr1 & TIM_CR1_OPM)) {
+        REG(t->tim->CR1) &= ~TIM_CR1_CEN;
+        t->running = false;
+    } else if(overflow)
+        tim_match(t);
+}
+
+static uint64_t tim_event (sim_tim_t *t)
+{
+    bool update;
+
+    return t->running ? t->t_ref + tim_next(t, &update) * tim_period(t) : UINT64_MAX;
+}
+
+static void tim_process (sim_tim_t *t)
+{
+    bool update;
+    uint64_t ticks, when;
+
+    while(t->running) {
+
+        ticks = tim_next(t, &update);
+        when = t->t_ref + ticks * tim_period(t);
+
+        if(when > sim_cycles)
+            break;
+
+        if(update) {
+            if(!tim_down(t) && t->cnt_ref > t->arr) {
+                t->cnt_ref = 0; // Wrap without update when ARR was set below the counter
+                t->t_ref = when;
+            } else
+                tim_update(t, when, true);
+        } else {
+            t->cnt_ref = tim_down(t) ? t->cnt_ref - (uint32_t)ticks : t->cnt_ref + (uint32_t)ticks;
+            t->t_ref = when;
+            tim_match(t);
+        }
+    }
+}
+
+static void tim_write (sim_tim_t *t, uint32_t offset, uint32_t old, uint32_t value)
+{
+    uint32_t ch;
+
+    switch(offset) {
+
+        case offsetof(TIM_TypeDef, CR1):
+            if((old ^ value) & (TIM_CR1_CEN|TIM_CR1_DIR)) {
+                REG(t->tim->CR1) = old;
+                t->cnt_ref = tim_count(t);
+                t->t_ref = sim_cycles;
+                REG(t->tim->CR1) = value;
+                t->running = !!(value & TIM_CR1_CEN);
+            }
+            break;
+
+        case offsetof(TIM_TypeDef, SR):
+            REG(t->tim->SR) = old & value;
+            break;
+
+        case offsetof(TIM_TypeDef, EGR):
+            REG(t->tim->EGR) = 0;
+            if(value & TIM_EGR_UG)
+                tim_update(t, sim_cycles, false);
+            break;
+
+        case offsetof(TIM_TypeDef, CNT):
+            t->cnt_ref = value & t->max;
+            t->t_ref = sim_cycles;
+            break;
+
+        case offsetof(TIM_TypeDef, ARR):
+            if(!(REG(t->tim->CR1) & TIM_CR1_ARPE))
+                t->arr = value & t->max;
+            break;
+
+        case offsetof(TIM_TypeDef, CCR1):
+        case offsetof(TIM_TypeDef, CCR2):
+        case offsetof(TIM_TypeDef, CCR3):
+        case offsetof(TIM_TypeDef, CCR4):
+            ch = (offset - offsetof(TIM_TypeDef, CCR1)) / 4;
+            if(!((ch < 2 ? REG(t->tim->CCMR1) : REG(t->tim->CCMR2)) & (ch & 1 ? TIM_CCMR1_OC2PE : TIM_CCMR1_OC1PE)))
+                t->ccr[ch] = value & t->max;
+            break;
+    }
+}
+
+// USART with FIFO mode, 8 bit characters with one stop bit.
+
+static inline uint32_t uart_depth (sim_uart_t *u)
+{
+    return REG(u->uart->CR1) & USART_CR1_FIFOEN ? USART_FIFO_SIZE : 1;
+}
+
+static inline uint64_t uart_bit_time (sim_uart_t *u)
+{
+    uint32_t brr = REG(u->uart->BRR) & 0xFFFF;
+
+    return (uint64_t)(brr ? brr : 0x10000) * USART_CLOCK_DIV;
+}
+
+static inline uint32_t uart_threshold (uint32_t cfg)
+{
+    static const uint8_t eighths[8] = { 1, 2, 4, 6, 7, 8, 8, 8 };
+
+    return USART_FIFO_SIZE * eighths[cfg & 0x7] / 8;
+}
+
+static uint32_t uart_isr (sim_uart_t *u)
+{
+    uint32_t isr = u->flags, cr1 = REG(u->uart->CR1), cr3 = REG(u->uart->CR3), depth = uart_depth(u);
+
+    if(u->tx_n < depth)
+        isr |= USART_ISR_TXE_TXFNF;
+    if((cr1 & USART_CR1_FIFOEN) && depth - u->tx_n >= uart_threshold(cr3 >> USART_CR3_TXFTCFG_Pos))
+        isr |= USART_ISR_TXFT;
+    if(u->rx_n)
+        isr |= USART_ISR_RXNE_RXFNE;
+    if((cr1 & USART_CR1_FIFOEN) && u->rx_n >= uart_threshold(cr3 >> USART_CR3_RXFTCFG_Pos))
+        isr |= USART_ISR_RXFT;
+    if(cr1 & USART_CR1_TE)
+        isr |= USART_ISR_TEACK;
+    if(cr1 & USART_CR1_RE)
+        isr |= USART_ISR_REACK;
+
+    return isr;
+}
+
+static bool uart_irq (sim_uart_t *u)
+{
+    uint32_t isr = uart_isr(u), cr1 = REG(u->uart->CR1), cr3 = REG(u->uart->CR3);
+
+    return ((cr1 & USART_CR1_TXEIE_TXFNFIE) && (isr & USART_ISR_TXE_TXFNF)) ||
+           ((cr3 & USART_CR3_TXFTIE) && (isr & USART_ISR_TXFT)) ||
+           ((cr1 & USART_CR1_TCIE) && (isr & USART_ISR_TC)) ||
+           ((cr1 & USART_CR1_RXNEIE_RXFNEIE) && (isr & USART_ISR_RXNE_RXFNE)) ||
+           ((cr3 & USART_CR3_RXFTIE) && (isr & USART_ISR_RXFT)) ||
+           ((cr1 & USART_CR1_RTOIE) && (isr & USART_ISR_RTOF)) ||
+           ((cr1 & USART_CR1_IDLEIE) && (isr & USART_ISR_IDLE));
+}
+
+static void uart_start_tx (sim_uart_t *u, uint64_t when)
+{
+    uint32_t cr1 = REG(u->uart->CR1);
+
+    if(!u->shifting && u->tx_n && (cr1 & USART_CR1_UE) && (cr1 & USART_CR1_TE)) {
+        u->shift_data = u->tx[u->tx_head];
+        u->tx_head = (u->tx_head + 1) % USART_FIFO_SIZE;
+        u->tx_n--;
+        u->shifting = true;
+        u->shift_done = when + 10 * uart_bit_time(u);
+    }
+}
+
+static void uart_receive (sim_uart_t *u, uint64_t when)
+{
+    uint32_t cr1 = REG(u->uart->CR1);
+    char c = u->in[u->in_head];
+
+    u->in_head = (u->in_head + 1) % USART_BUFFER_SIZE;
+    u->in_n--;
+
+    if((cr1 & USART_CR1_UE) && (cr1 & USART_CR1_RE)) {
+
+        if(u->rx_n < uart_depth(u)) { // Overrun data is lost, the driver disables overrun detection
+            u->rx[(u->rx_head + u->rx_n) % USART_FIFO_SIZE] = (uint8_t)c;
+            u->rx_n++;
+        }
+
+        u->rto_at = REG(u->uart->CR2) & USART_CR2_RTOEN ? when + (REG(u->uart->RTOR) & 0xFFFFFF) * uart_bit_time(u) : 0;
+        u->idle_at = u->in_n ? 0 : when + 10 * uart_bit_time(u);
+
+        if(REG(u->uart->CR3) & USART_CR3_DMAR) {
+            uint32_t rx_n;
+            do {
+                rx_n = u->rx_n;
+                dma_request(u->dma_rx);
+            } while(u->rx_n && u->rx_n != rx_n);
+        }
+    }
+
+    if(u->in_n)
+        u->in_next = when + 10 * uart_bit_time(u);
+}
+
+static uint64_t uart_event (sim_uart_t *u)
+{
+    uint64_t next = UINT64_MAX;
+
+    if(u->shifting)
+        next = u->shift_done;
+    if(u->in_n && u->in_next < next)
+        next = u->in_next;
+    if(u->rto_at && u->rto_at < next)
+        next = u->rto_at;
+    if(u->idle_at && u->idle_at < next)
+        next = u->idle_at;
+
+    return next;
+}
+
+static void uart_process (sim_uart_t *u)
+{
+    uint64_t when;
+
+    while((when = uart_event(u)) <= sim_cycles) {
+
+        if(u->shifting && u->shift_done == when) {
+            u->shifting = false;
+            if(u->out_n < USART_BUFFER_SIZE)
+                u->out[u->out_n++] = (char)u->shift_data;
+            u->out_last = when;
+            uart_start_tx(u, when);
+            if(!u->shifting)
+                u->flags |= USART_ISR_TC;
+        } else if(u->in_n && u->in_next == when)
+            uart_receive(u, when);
+        else if(u->rto_at == when) {
+            u->rto_at = 0;
+            u->flags |= USART_ISR_RTOF;
+        } else if(u->idle_at == when) {
+            u->idle_at = 0;
+            u->flags |= USART_ISR_IDLE;
+        }
+    }
+}
+
+static void uart_write (sim_uart_t *u, uint32_t offset, uint32_t old, uint32_t value)
+{
+    switch(offset) {
+
+        case offsetof(USART_TypeDef, CR1):
+            if((old & USART_CR1_UE) && !(value & USART_CR1_UE)) {
+                u->tx_n = u->rx_n = 0;
+                u->shifting = false;
+                u->rto_at = u->idle_at = 0;
+                u->flags = USART_ISR_TC;
+            }
+            uart_start_tx(u, sim_cycles);
+            break;
+
+        case offsetof(USART_TypeDef, TDR):
+            if((REG(u->uart->CR1) & (USART_CR1_UE|USART_CR1_TE)) == (USART_CR1_UE|USART_CR1_TE) && u->tx_n < uart_depth(u)) {
+                u->tx[(u->tx_head + u->tx_n) % USART_FIFO_SIZE] = (uint8_t)value;
+                u->tx_n++;
+                u->flags &= ~USART_ISR_TC;
+                uart_start_tx(u, sim_cycles);
+            }
+            break;
+
+        case offsetof(USART_TypeDef, ICR):
+            REG(u->uart->ICR) = 0;
+            u->flags &= ~(value & (USART_ICR_TCCF|USART_ICR_RTOCF|USART_ICR_IDLECF));
+            break;
+
+        case offsetof(USART_TypeDef, RQR):
+            REG(u->uart->RQR) = 0;
+            if(value & USART_RQR_RXFRQ)
+                u->rx_n = 0;
+            if(value & USART_RQR_TXFRQ)
+                u->tx_n = 0;
+            break;
+
+        case offsetof(USART_TypeDef, ISR):
+            REG(u->uart->ISR) = old;
+            break;
+    }
+}
+
+static void uart_read (sim_uart_t *u, uint32_t offset, bool access)
+{
+    switch(offset) {
+
+        case offsetof(USART_TypeDef, ISR):
+            REG(u->uart->ISR) = uart_isr(u);
+            break;
+
+        case offsetof(USART_TypeDef, RDR):
+            if(access && u->rx_n) {
+                REG(u->uart->RDR) = u->rx[u->rx_head];
+                u->rx_head = (u->rx_head + 1) % USART_FIFO_SIZE;
+                u->rx_n--;
+            }
+            break;
+    }
+}
+
+// DMA streams, requests are routed by the DMAMUX channel of the stream.
+
+static inline DMA_Stream_TypeDef *dma_stream_regs (uint32_t stream)
+{
+    return (DMA_Stream_TypeDef *)((stream < 8 ? DMA1_Stream0_BASE : DMA2_Stream0_BASE) + (stream & 0x7) * 0x18UL);
+}
+
+static inline volatile uint32_t *dma_isr (uint32_t stream)
+{
+    DMA_TypeDef *regs = stream < 8 ? DMA1 : DMA2;
+
+    return (stream & 0x7) < 4 ? reg_ptr((uintptr_t)&regs->LISR) : reg_ptr((uintptr_t)&regs->HISR);
+}
+
+static inline uint32_t dma_flags (uint32_t stream)
+{
+    return (*dma_isr(stream) >> dma_flag_shift[stream & 0x3]) & 0x3D;
+}
+
+static uint32_t bus_read (uintptr_t addr, uint32_t size);
+static void bus_write (uintptr_t addr, uint32_t value, uint32_t size);
+
+static inline uint32_t memory_read (uintptr_t addr, uint32_t size)
+{
+    return size == 1 ? *(uint8_t *)addr : (size == 2 ? *(uint16_t *)addr : *(uint32_t *)addr);
+}
+
+static inline void memory_write (uintptr_t addr, uint32_t value, uint32_t size)
+{
+    if(size == 1)
+        *(uint8_t *)addr = (uint8_t)value;
+    else if(size == 2)
+        *(uint16_t *)addr = (uint16_t)value;
+    else
+        *(uint32_t *)addr = value;
+}
+
+static void dma_fetch (uint32_t stream)
+{
+    DMA_Stream_TypeDef *regs = dma_stream_regs(stream);
+    uint32_t cr = REG(regs->CR), msize = 1 << ((cr & DMA_SxCR_MSIZE) >> DMA_SxCR_MSIZE_Pos);
+
+    dma[stream].fifo = memory_read(REG(regs->M0AR) + (cr & DMA_SxCR_MINC ? dma[stream].item * msize : 0), msize);
+}
+
+static void dma_transfer (uint32_t stream)
+{
+    DMA_Stream_TypeDef *regs = dma_stream_regs(stream);
+    uint32_t cr = REG(regs->CR), ndtr = REG(regs->NDTR), flags = 0,
+             msize = 1 << ((cr & DMA_SxCR_MSIZE) >> DMA_SxCR_MSIZE_Pos),
+             psize = 1 << ((cr & DMA_SxCR_PSIZE) >> DMA_SxCR_PSIZE_Pos);
+
+    if((cr & DMA_SxCR_DIR) == DMA_SxCR_DIR_0) {
+        bus_write(REG(regs->PAR), dma[stream].fifo, psize);
+    } else
+        memory_write(REG(regs->M0AR) + (cr & DMA_SxCR_MINC ? dma[stream].item * msize : 0), bus_read(REG(regs->PAR), psize), msize);
+
+    dma[stream].item++;
+    REG(regs->NDTR) = --ndtr;
+
+    if(ndtr == dma[stream].ndtr / 2)
+        flags |= DMA_LISR_HTIF0;
+
+    if(ndtr == 0) {
+        flags |= DMA_LISR_TCIF0;
+        if(cr & DMA_SxCR_CIRC) {
+            dma[stream].item = 0;
+            REG(regs->NDTR) = dma[stream].ndtr;
+        } else {
+            dma[stream].enabled = false;
+            REG(regs->CR) &= ~DMA_SxCR_EN;
+        }
+    }
+
+    *dma_isr(stream) |= flags << dma_flag_shift[stream & 0x3];
+
+    if(dma[stream].enabled && (cr & DMA_SxCR_DIR) == DMA_SxCR_DIR_0)
+        dma_fetch(stream);
+}
+
+static void dma_request (uint8_t request)
+{
+    uint32_t stream;
+
+    if(request == 0)
+        return;
+
+    for(stream = 0; stream < N_DMA_STREAMS; stream++) {
+        if(dma[stream].enabled && (REG(DMAMUX1_Channel0[stream].CCR) & DMAMUX_CxCR_DMAREQ_ID) == request)
+            dma_transfer(stream);
+    }
+}
+
+static bool dma_irq_line (uint32_t stream)
+{
+    uint32_t cr = REG(dma_stream_regs(stream)->CR), flags = dma_flags(stream);
+
+    return ((flags & DMA_LISR_TCIF0) && (cr & DMA_SxCR_TCIE)) ||
+           ((flags & DMA_LISR_HTIF0) && (cr & DMA_SxCR_HTIE)) ||
+           ((flags & DMA_LISR_TEIF0) && (cr & DMA_SxCR_TEIE));
+}
+
+static void dma_write (DMA_TypeDef *regs, uint32_t offset, uint32_t old, uint32_t value)
+{
+    uint32_t stream;
+
+    switch(offset) {
+
+        case offsetof(DMA_TypeDef, LIFCR):
+            REG(regs->LIFCR) = 0;
+            REG(regs->LISR) &= ~value;
+            break;
+
+        case offsetof(DMA_TypeDef, HIFCR):
+            REG(regs->HIFCR) = 0;
+            REG(regs->HISR) &= ~value;
+            break;
+
+        case offsetof(DMA_TypeDef, LISR):
+        case offsetof(DMA_TypeDef, HISR):
+            *reg_ptr((uintptr_t)regs + offset) = old;
+            break;
+
+        default:
+            if(offset >= 0x10 && offset < 0x10 + 8 * 0x18 && (offset - 0x10) % 0x18 == offsetof(DMA_Stream_TypeDef, CR)) {
+                stream = (offset - 0x10) / 0x18 + (regs == DMA2 ? 8 : 0);
+                if(!(old & DMA_SxCR_EN) && (value & DMA_SxCR_EN)) {
+                    dma[stream].enabled = true;
+                    dma[stream].ndtr = REG(dma_stream_regs(stream)->NDTR);
+                    dma[stream].item = 0;
+                    if((value & DMA_SxCR_DIR) == DMA_SxCR_DIR_0)
+                        dma_fetch(stream);
+                } else if(!(value & DMA_SxCR_EN))
+                    dma[stream].enabled = false;
+            }
+            break;
+    }
+}
+
+// SysTick and the core peripherals
+
+static uint64_t systick_event (void)
+{
+    return systick_enabled ? systick_next : UINT64_MAX;
+}
+
+static void systick_process (void)
+{
+    while(systick_enabled && systick_next <= sim_cycles) {
+        REG(SysTick->CTRL) |= SysTick_CTRL_COUNTFLAG_Msk;
+        if(REG(SysTick->CTRL) & SysTick_CTRL_TICKINT_Msk)
+            systick_pending = true;
+        systick_next += (REG(SysTick->LOAD) & 0xFFFFFF) + 1;
+    }
+}
+
+static void core_write (uintptr_t addr, uint32_t old, uint32_t value)
+{
+    uint32_t offset, idx;
+
+    if(in_block(addr, &SysTick->CTRL, 4, &offset)) {
+        systick_enabled = !!(value & SysTick_CTRL_ENABLE_Msk);
+        if(systick_enabled && !(old & SysTick_CTRL_ENABLE_Msk))
+            systick_next = sim_cycles + (REG(SysTick->LOAD) & 0xFFFFFF) + 1;
+    } else if(in_block(addr, &SysTick->VAL, 4, &offset)) {
+        REG(SysTick->VAL) = 0;
+        systick_next = sim_cycles + (REG(SysTick->LOAD) & 0xFFFFFF) + 1;
+    } else if(in_block(addr, &SCB->ICSR, 4, &offset)) {
+        REG(SCB->ICSR) = 0;
+        if(value & SCB_ICSR_PENDSVSET_Msk)
+            pendsv_pending = true;
+        if(value & SCB_ICSR_PENDSVCLR_Msk)
+            pendsv_pending = false;
+        if(value & SCB_ICSR_PENDSTSET_Msk)
+            systick_pending = true;
+        if(value & SCB_ICSR_PENDSTCLR_Msk)
+            systick_pending = false;
+    } else if(in_block(addr, &SCB->AIRCR, 4, &offset)) {
+        prigroup = (value & SCB_AIRCR_PRIGROUP_Msk) >> SCB_AIRCR_PRIGROUP_Pos;
+        REG(SCB->AIRCR) = (0xFA05UL << SCB_AIRCR_VECTKEY_Pos) | (value & SCB_AIRCR_PRIGROUP_Msk);
+    } else if(in_block(addr, &DWT->CYCCNT, 4, &offset)) {
+        dwt_offset = value - (uint32_t)sim_cycles;
+    } else if(in_block(addr, NVIC->ISER, sizeof(NVIC->ISER), &offset)) {
+        idx = offset / 4;
+        if(idx < 5) {
+            nvic_enabled[idx] |= value;
+            REG(NVIC->ISER[idx]) = REG(NVIC->ICER[idx]) = nvic_enabled[idx];
+        }
+    } else if(in_block(addr, NVIC->ICER, sizeof(NVIC->ICER), &offset)) {
+        idx = offset / 4;
+        if(idx < 5) {
+            nvic_enabled[idx] &= ~value;
+            REG(NVIC->ISER[idx]) = REG(NVIC->ICER[idx]) = nvic_enabled[idx];
+        }
+    } else if(in_block(addr, NVIC->ISPR, sizeof(NVIC->ISPR), &offset)) {
+        if((idx = offset / 4) < 5)
+            nvic_pending[idx] |= value;
+    } else if(in_block(addr, NVIC->ICPR, sizeof(NVIC->ICPR), &offset)) {
+        if((idx = offset / 4) < 5)
+            nvic_pending[idx] &= ~value;
+    }
+}
+
+static void core_read (uintptr_t addr)
+{
+    uint32_t offset, idx;
+
+    if(in_block(addr, &SysTick->VAL, 4, &offset)) {
+        uint32_t load = REG(SysTick->LOAD) & 0xFFFFFF;
+        REG(SysTick->VAL) = systick_enabled ? (uint32_t)((systick_next - sim_cycles - 1) % (load + 1)) : 0;
+    } else if(in_block(addr, &DWT->CYCCNT, 4, &offset))
+        REG(DWT->CYCCNT) = (uint32_t)sim_cycles + dwt_offset;
+    else if(in_block(addr, &SCB->ICSR, 4, &offset))
+        REG(SCB->ICSR) = (pendsv_pending ? SCB_ICSR_PENDSVSET_Msk : 0) | (systick_pending ? SCB_ICSR_PENDSTSET_Msk : 0) | (sim_ipsr & SCB_ICSR_VECTACTIVE_Msk);
+    else if(in_block(addr, NVIC->ISPR, sizeof(NVIC->ISPR), &offset) || in_block(addr, NVIC->ICPR, sizeof(NVIC->ICPR), &offset)) {
+        if((idx = offset / 4) < 5)
+            REG(NVIC->ISPR[idx]) = REG(NVIC->ICPR[idx]) = nvic_pending[idx];
+    } else if(in_block(addr, NVIC->IABR, sizeof(NVIC->IABR), &offset)) {
+        if((idx = offset / 4) < 5)
+            REG(NVIC->IABR[idx]) = nvic_active[idx];
+    }
+}
+
+// Register semantics, the read hook runs before the access and may have side effects when
+// access is set, the write hook runs after the register was written.
+
+static void on_read (uintptr_t addr, bool access)
+{
+    uint32_t idx, offset;
+
+    addr &= ~0x3UL;
+
+    if(addr >= PPB_REGION_BASE) {
+        core_read(addr);
+        return;
+    }
+
+    for(idx = 0; idx < N_GPIO; idx++) {
+        if(in_block(addr, (void *)(GPIOA_BASE + idx * 0x400UL), 0x400, &offset)) {
+            if(offset == offsetof(GPIO_TypeDef, IDR))
+                REG(((GPIO_TypeDef *)(GPIOA_BASE + idx * 0x400UL))->IDR) = gpio_idr(idx);
+            return;
+        }
+    }
+
+    for(idx = 0; idx < N_TIMERS; idx++) {
+        if(in_block(addr, timers[idx].tim, 0x400, &offset)) {
+            if(offset == offsetof(TIM_TypeDef, CNT))
+                REG(timers[idx].tim->CNT) = tim_count(&timers[idx]);
+            return;
+        }
+    }
+
+    for(idx = 0; idx < N_UARTS; idx++) {
+        if(in_block(addr, uarts[idx].uart, 0x400, &offset)) {
+            uart_read(&uarts[idx], offset, access);
+            return;
+        }
+    }
+}
+
+static void on_write (uintptr_t addr, uint32_t old, uint32_t value)
+{
+    uint32_t idx, offset;
+
+    addr &= ~0x3UL;
+
+    if(addr >= PPB_REGION_BASE) {
+        core_write(addr, old, value);
+        return;
+    }
+
+    for(idx = 0; idx < N_GPIO; idx++) {
+        if(in_block(addr, (void *)(GPIOA_BASE + idx * 0x400UL), 0x400, &offset)) {
+            gpio_write(idx, offset, old, value);
+            return;
+        }
+    }
+
+    for(idx = 0; idx < N_TIMERS; idx++) {
+        if(in_block(addr, timers[idx].tim, 0x400, &offset)) {
+            tim_write(&timers[idx], offset, old, value);
+            return;
+        }
+    }
+
+    for(idx = 0; idx < N_UARTS; idx++) {
+        if(in_block(addr, uarts[idx].uart, 0x400, &offset)) {
+            uart_write(&uarts[idx], offset, old, value);
+            return;
+        }
+    }
+
+    if(in_block(addr, DMA1, 0x400, &offset))
+        dma_write(DMA1, offset, old, value);
+    else if(in_block(addr, DMA2, 0x400, &offset))
+        dma_write(DMA2, offset, old, value);
+    else if(in_block(addr, &EXTI->PR1, 4, &offset))
+        REG(EXTI->PR1) = old & ~value;
+    else if(in_block(addr, SYSCFG, 0x400, &offset) || in_block(addr, EXTI, 0x400, &offset)) {
+        for(idx = 0; idx < N_GPIO; idx++)
+            gpio[idx].idr = gpio_idr(idx);
+    }
+}
+
+// Bus accesses by the DMA controller, of the given size at the given address.
+
+static uint32_t bus_read (uintptr_t addr, uint32_t size)
+{
+    uint32_t shift = (addr & 0x3) * 8;
+
+    on_read(addr, true);
+
+    return (*reg_ptr(addr & ~0x3UL) >> shift) & (size == 4 ? 0xFFFFFFFF : (1UL << (size * 8)) - 1);
+}
+
+static void bus_write (uintptr_t addr, uint32_t value, uint32_t size)
+{
+    uint32_t old = *reg_ptr(addr & ~0x3UL), shift = (addr & 0x3) * 8,
+             mask = (size == 4 ? 0xFFFFFFFF : (1UL << (size * 8)) - 1) << shift;
+
+    on_read(addr, false);
+    *reg_ptr(addr & ~0x3UL) = (old & ~mask) | ((value << shift) & mask);
+    on_write(addr, old, *reg_ptr(addr & ~0x3UL));
+}
+
+// Interrupts, level sensitive sources latch the pending state when not active.
+
+static void irq_lines (uint32_t *lines)
+{
+    uint32_t idx, pending;
+
+    memset(lines, 0, sizeof(uint32_t) * 5);
+
+    for(idx = 0; idx < N_TIMERS; idx++) {
+        if(REG(timers[idx].tim->SR) & REG(timers[idx].tim->DIER) & 0x7F)
+            lines[timers[idx].irq >> 5] |= 1UL << (timers[idx].irq & 0x1F);
+    }
+
+    for(idx = 0; idx < N_UARTS; idx++) {
+        if(uart_irq(&uarts[idx]))
+            lines[uarts[idx].irq >> 5] |= 1UL << (uarts[idx].irq & 0x1F);
+    }
+
+    for(idx = 0; idx < N_DMA_STREAMS; idx++) {
+        if(dma_irq_line(idx))
+            lines[dma_irq[idx] >> 5] |= 1UL << (dma_irq[idx] & 0x1F);
+    }
+
+    if((pending = REG(EXTI->PR1) & REG(EXTI->IMR1) & 0xFFFF)) {
+        for(idx = 0; idx < 5; idx++) {
+            if(pending & (1 << idx))
+                lines[0] |= 1UL << (EXTI0_IRQn + idx);
+        }
+        if(pending & 0x03E0)
+            lines[0] |= 1UL << EXTI9_5_IRQn;
+        if(pending & 0xFC00)
+            lines[1] |= 1UL << (EXTI15_10_IRQn - 32);
+    }
+}
+
+static inline uint32_t group_priority (uint32_t priority)
+{
+    return priority & (0xFFUL << (prigroup + 1)) & 0xFF;
+}
+
+static uint32_t execution_priority (void)
+{
+    uint32_t priority = depth ? active_prio[depth - 1] : 256;
+
+    if(sim_basepri && group_priority(sim_basepri) < priority)
+        priority = group_priority(sim_basepri);
+
+    return sim_primask ? 0 : priority;
+}
+
+static void take_exception (uint32_t exception, uint32_t priority)
+{
+    uint32_t ipsr = sim_ipsr;
+    vector_t handler;
+
+    if(exception == EXC_SYSTICK) {
+        systick_pending = false;
+        handler = SysTick_Handler;
+    } else if(exception == EXC_PENDSV) {
+        pendsv_pending = false;
+        handler = PendSV_Handler;
+    } else {
+        uint32_t irq = exception - 16;
+        nvic_pending[irq >> 5] &= ~(1UL << (irq & 0x1F));
+        nvic_active[irq >> 5] |= 1UL << (irq & 0x1F);
+        irq_counts[irq]++;
+        handler = vectors[irq];
+    }
+
+    if(handler == NULL || depth == MAX_NESTING) {
+        fprintf(stderr, "sim: no handler for exception %u\n", exception);
+        abort();
+    }
+
+    active_exc[depth] = exception;
+    active_prio[depth++] = priority;
+    sim_ipsr = exception;
+    sim_exceptions++;
+
+    sim_advance(sim_cycles + SIM_ENTRY_CYCLES);
+    handler();
+    sim_advance(sim_cycles + SIM_EXIT_CYCLES);
+
+    depth--;
+    sim_ipsr = ipsr;
+    sim_exceptions++;
+
+    if(exception > EXC_SYSTICK) {
+        uint32_t irq = exception - 16;
+        nvic_active[irq >> 5] &= ~(1UL << (irq & 0x1F));
+    }
+}
+
+static void sim_dispatch (void)
+{
+    uint32_t lines[5], idx, irq, priority, best, best_priority;
+
+    for(;;) {
+
+        irq_lines(lines);
+        for(idx = 0; idx < 5; idx++)
+            nvic_pending[idx] |= lines[idx] & ~nvic_active[idx];
+
+        best = 0;
+        best_priority = 256;
+
+        if(pendsv_pending && (priority = group_priority(REG8(SCB->SHPR[10]))) < best_priority) {
+            best = EXC_PENDSV;
+            best_priority = priority;
+        }
+
+        if(systick_pending && (priority = group_priority(REG8(SCB->SHPR[11]))) < best_priority) {
+            best = EXC_SYSTICK;
+            best_priority = priority;
+        }
+
+        for(irq = 0; irq < N_IRQS; irq++) {
+            if((nvic_pending[irq >> 5] & nvic_enabled[irq >> 5] & ~nvic_active[irq >> 5]) & (1UL << (irq & 0x1F))) {
+                if((priority = group_priority(REG8(NVIC->IP[irq]))) < best_priority) {
+                    best = irq + 16;
+                    best_priority = priority;
+                }
+            }
+        }
+
+        if(best == 0 || best_priority >= execution_priority())
+            break;
+
+        take_exception(best, best_priority);
+    }
+}
+
+void sim_mask_changed (void)
+{
+    if(alias)
+        sim_dispatch();
+}
+
+// Virtual clock
+
+static uint64_t next_event (void)
+{
+    uint32_t idx;
+    uint64_t next = systick_event(), when;
+
+    for(idx = 0; idx < N_TIMERS; idx++) {
+        if((when = tim_event(&timers[idx])) < next)
+            next = when;
+    }
+
+    for(idx = 0; idx < N_UARTS; idx++) {
+        if((when = uart_event(&uarts[idx])) < next)
+            next = when;
+    }
+
+    return next;
+}
+
+static void sim_advance (uint64_t target)
+{
+    uint32_t idx;
+    uint64_t next;
+
+    while((next = next_event()) <= target) {
+
+        if(next > sim_cycles)
+            sim_cycles = next;
+
+        systick_process();
+        for(idx = 0; idx < N_TIMERS; idx++)
+            tim_process(&timers[idx]);
+        for(idx = 0; idx < N_UARTS; idx++)
+            uart_process(&uarts[idx]);
+
+        sim_dispatch();
+    }
+
+    if(sim_cycles < target)
+        sim_cycles = target;
+
+    sim_dispatch();
+}
+
+void sim_run (uint64_t cycles)
+{
+    sim_advance(sim_cycles + cycles);
+}
+
+void sim_run_us (uint32_t us)
+{
+    sim_advance(sim_cycles + (uint64_t)us * SIM_CYCLES_PER_US);
+}
+
+void sim_idle (void)
+{
+    uint64_t next = next_event();
+
+    sim_advance(next == UINT64_MAX || next <= sim_cycles ? sim_cycles + SIM_CYCLES_PER_US : next);
+}
+
+bool sim_run_until (bool (*done)(void), uint32_t timeout_us)
+{
+    uint64_t next, timeout = sim_cycles + (uint64_t)timeout_us * SIM_CYCLES_PER_US;
+
+    while(!done()) {
+        if(sim_cycles >= timeout)
+            return false;
+        next = next_event();
+        sim_advance(next > timeout || next <= sim_cycles ? (next <= sim_cycles ? sim_cycles + 1 : timeout) : next);
+    }
+
+    return true;
+}
+
+uint32_t sim_irq_count (IRQn_Type irq)
+{
+    return irq_counts[irq];
+}
+
+// External stimuli
+
+static inline uint32_t gpio_index (GPIO_TypeDef *port)
+{
+    return ((uintptr_t)port - GPIOA_BASE) / 0x400UL;
+}
+
+void sim_pin_drive (GPIO_TypeDef *port, uint16_t pin, bool level)
+{
+    uint32_t idx = gpio_index(port);
+
+    gpio[idx].drive |= pin;
+    gpio[idx].level = level ? gpio[idx].level | pin : gpio[idx].level & ~pin;
+    gpio_update(idx);
+    sim_dispatch();
+}
+
+void sim_pin_release (GPIO_TypeDef *port, uint16_t pin)
+{
+    uint32_t idx = gpio_index(port);
+
+    gpio[idx].drive &= ~pin;
+    gpio_update(idx);
+    sim_dispatch();
+}
+
+bool sim_pin_level (GPIO_TypeDef *port, uint16_t pin)
+{
+    return !!(gpio_idr(gpio_index(port)) & pin);
+}
+
+static sim_uart_t *uart_get (USART_TypeDef *uart)
+{
+    uint32_t idx;
+
+    for(idx = 0; idx < N_UARTS; idx++) {
+        if(uarts[idx].uart == uart)
+            return &uarts[idx];
+    }
+
+    abort();
+}
+
+// Characters are received back to back, the first one completes one character time from now.
+void sim_uart_receive (USART_TypeDef *uart, const char *data, uint32_t length)
+{
+    sim_uart_t *u = uart_get(uart);
+
+    if(u->in_n == 0)
+        u->in_next = sim_cycles + 10 * uart_bit_time(u);
+
+    while(length-- && u->in_n < USART_BUFFER_SIZE)
+        u->in[(u->in_head + u->in_n++) % USART_BUFFER_SIZE] = *data++;
+}
+
+// Returns the characters transmitted since the last call and the time the last one completed.
+uint32_t sim_uart_transmitted (USART_TypeDef *uart, char *data, uint32_t size, uint64_t *last)
+{
+    sim_uart_t *u = uart_get(uart);
+    uint32_t n = u->out_n < size ? u->out_n : size;
+
+    memcpy(data, u->out, n);
+    memmove(u->out, u->out + n, u->out_n - n);
+    u->out_n -= n;
+
+    if(last)
+        *last = u->out_last;
+
+    return n;
+}
+
+// Trap handling, a faulting access gets the page unprotected for a single instruction.
+
+static void on_fault (int sig, siginfo_t *info, void *context)
+{
+    ucontext_t *uc = (ucontext_t *)context;
+    uintptr_t addr = (uintptr_t)info->si_addr;
+    sim_access_t *a;
+
+    if(!in_region(addr) || n_access == 2) {
+        signal(SIGSEGV, SIG_DFL);
+        return;
+    }
+
+    a = &traps[n_access++];
+    a->addr = addr;
+    a->page = addr & ~(PAGE_SIZE - 1);
+    a->write = !!(uc->uc_mcontext.gregs[REG_ERR] & 0x2);
+
+    on_read(addr, !a->write);
+    a->old = *reg_ptr(addr & ~0x3UL);
+
+    mprotect((void *)a->page, PAGE_SIZE, PROT_READ|PROT_WRITE);
+    uc->uc_mcontext.gregs[REG_EFL] |= 0x100; // Trap after the instruction
+}
+
+static void on_step (int sig, siginfo_t *info, void *context)
+{
+    ucontext_t *uc = (ucontext_t *)context;
+    sim_access_t done[2];
+    uint32_t idx, n = n_access;
+
+    uc->uc_mcontext.gregs[REG_EFL] &= ~0x100;
+
+    memcpy(done, traps, sizeof(done));
+    n_access = 0;
+
+    for(idx = 0; idx < n; idx++)
+        mprotect((void *)done[idx].page, PAGE_SIZE, PROT_NONE);
+
+    for(idx = 0; idx < n; idx++) {
+        if(done[idx].write)
+            on_write(done[idx].addr, done[idx].old, *reg_ptr(done[idx].addr & ~0x3UL));
+    }
+
+    if(n)
+        sim_advance(sim_cycles + SIM_ACCESS_CYCLES);
+}
+
+void sim_init (void)
+{
+    int fd;
+    uint32_t idx;
+    struct sigaction sa = {0};
+
+    if((fd = memfd_create("mcu_sim", 0)) < 0 || ftruncate(fd, PERIPH_REGION_SIZE + PPB_REGION_SIZE) ||
+        mmap((void *)PERIPH_REGION_BASE, PERIPH_REGION_SIZE, PROT_NONE, MAP_SHARED|MAP_FIXED_NOREPLACE, fd, 0) != (void *)PERIPH_REGION_BASE ||
+         mmap((void *)PPB_REGION_BASE, PPB_REGION_SIZE, PROT_NONE, MAP_SHARED|MAP_FIXED_NOREPLACE, fd, PERIPH_REGION_SIZE) != (void *)PPB_REGION_BASE ||
+          (alias = mmap(NULL, PERIPH_REGION_SIZE + PPB_REGION_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        perror("sim: mapping registers failed");
+        exit(1);
+    }
+
+    sa.sa_flags = SA_SIGINFO|SA_NODEFER;
+    sa.sa_sigaction = on_fault;
+    sigaction(SIGSEGV, &sa, NULL);
+    sa.sa_sigaction = on_step;
+    sigaction(SIGTRAP, &sa, NULL);
+
+    // Reset values
+    for(idx = 0; idx < N_GPIO; idx++)
+        REG(((GPIO_TypeDef *)(GPIOA_BASE + idx * 0x400UL))->MODER) = 0xFFFFFFFF;
+    REG(SCB->AIRCR) = 0xFA05UL << SCB_AIRCR_VECTKEY_Pos;
+    for(idx = 0; idx < N_UARTS; idx++)
+        uarts[idx].flags = USART_ISR_TC;
+    for(idx = 0; idx < N_TIMERS; idx++)
+        timers[idx].arr = REG(timers[idx].tim->ARR) = timers[idx].max;
+
+    // What HAL_Init() and SystemClock_Config() leave behind.
+    HAL_NVIC_SetPriorityGrouping(NVIC_PRIORITYGROUP_4);
+    SysTick_Config(SystemCoreClock / (1000UL / uwTickFreq));
+    HAL_NVIC_SetPriority(SysTick_IRQn, TICK_INT_PRIORITY, 0);
+    uwTickPrio = TICK_INT_PRIORITY;
+}
+
+// HAL parts that are not compiled for the host, with the clock tree as configured by main.c.
+
+uint32_t SystemCoreClock = SIM_CPU_CLOCK;
+uint32_t SystemD2Clock = SIM_CPU_CLOCK / 2;
+
+const uint16_t UARTPrescTable[12] = { 1, 2, 4, 6, 8, 10, 12, 16, 32, 64, 128, 256 };
+
+__IO uint32_t uwTick;
+uint32_t uwTickPrio = (1UL << __NVIC_PRIO_BITS);
+HAL_TickFreqTypeDef uwTickFreq = HAL_TICK_FREQ_DEFAULT;
+
+void HAL_IncTick (void)
+{
+    uwTick += (uint32_t)uwTickFreq;
+}
+
+uint32_t HAL_GetTick (void)
+{
+    return uwTick;
+}
+
+void HAL_Delay (uint32_t delay)
+{
+    uint32_t start = HAL_GetTick();
+
+    while(HAL_GetTick() - start < delay + (uint32_t)uwTickFreq)
+        sim_idle();
+}
+
+void HAL_RCC_GetClockConfig (RCC_ClkInitTypeDef *clock, uint32_t *latency)
+{
+    clock->ClockType = RCC_CLOCKTYPE_SYSCLK|RCC_CLOCKTYPE_HCLK|RCC_CLOCKTYPE_D1PCLK1|RCC_CLOCKTYPE_PCLK1|RCC_CLOCKTYPE_PCLK2|RCC_CLOCKTYPE_D3PCLK1;
+    clock->SYSCLKSource = RCC_SYSCLKSOURCE_PLLCLK;
+    clock->SYSCLKDivider = RCC_SYSCLK_DIV1;
+    clock->AHBCLKDivider = RCC_HCLK_DIV2;
+    clock->APB3CLKDivider = RCC_APB3_DIV2;
+    clock->APB1CLKDivider = RCC_APB1_DIV2;
+    clock->APB2CLKDivider = RCC_APB2_DIV2;
+    clock->APB4CLKDivider = RCC_APB4_DIV2;
+    *latency = FLASH_LATENCY_4;
+}
+
+uint32_t HAL_RCC_GetSysClockFreq (void)
+{
+    return SIM_CPU_CLOCK;
+}
+
+uint32_t HAL_RCC_GetHCLKFreq (void)
+{
+    return SIM_CPU_CLOCK / 2;
+}
+
+uint32_t HAL_RCC_GetPCLK1Freq (void)
+{
+    return SIM_CPU_CLOCK / 4;
+}
+
+uint32_t HAL_RCC_GetPCLK2Freq (void)
+{
+    return SIM_CPU_CLOCK / 4;
+}
+
+/*EOF*/
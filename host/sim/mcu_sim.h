@@ -0,0 +1,62 @@
+/*
+
+  mcu_sim.h - register level simulation of the STM32H743 peripherals used by the driver
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// The peripheral address ranges are mapped inaccessible at their device addresses,
+// every register access by the code under test traps to the simulator which applies
+// the register semantics, advances the virtual clock and services interrupts that
+// became pending. Modelled are GPIO with EXTI, the general purpose timers, USART with
+// FIFOs, DMA streams with the DMAMUX, NVIC, SysTick and the DWT cycle counter.
+//
+// The virtual clock counts CPU cycles, time only passes by register accesses,
+// interrupt entry and exit and when the test or an idle loop runs the simulation.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "main.h"
+
+#define SIM_CPU_CLOCK       480000000UL // SYSCLK, HCLK is SYSCLK / 2 and all APB clocks are HCLK / 2.
+#define SIM_CYCLES_PER_US   (SIM_CPU_CLOCK / 1000000UL)
+#define SIM_ACCESS_CYCLES   12          // Cost of a peripheral register access
+#define SIM_ENTRY_CYCLES    12          // Interrupt entry latency
+#define SIM_EXIT_CYCLES     10          // Interrupt exit
+
+// Called on every change of the output data register, with the changed bits and the new level.
+typedef void (*sim_gpio_output_ptr)(GPIO_TypeDef *port, uint16_t changed, uint16_t odr, uint64_t cycles);
+
+extern volatile uint64_t sim_cycles;
+extern sim_gpio_output_ptr sim_on_gpio_output;
+
+void sim_init (void);
+void sim_run (uint64_t cycles);
+void sim_run_us (uint32_t us);
+bool sim_run_until (bool (*done)(void), uint32_t timeout_us);
+void sim_idle (void);
+uint32_t sim_irq_count (IRQn_Type irq);
+void sim_pin_drive (GPIO_TypeDef *port, uint16_t pin, bool level);
+void sim_pin_release (GPIO_TypeDef *port, uint16_t pin);
+bool sim_pin_level (GPIO_TypeDef *port, uint16_t pin);
+void sim_uart_receive (USART_TypeDef *uart, const char *data, uint32_t length);
+uint32_t sim_uart_transmitted (USART_TypeDef *uart, char *data, uint32_t size, uint64_t *last);
+
+/*EOF*/
@@ -0,0 +1,38 @@
+/*
+
+  driver.h - host stub with the driver options under test
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include "main.h"
+
+#define STEP_TRACE_ENABLE   1
+#define STEP_TRACE_SIZE     16
+
+#define SDCARD_READAHEAD        1
+#define SD_READAHEAD_BLOCKS     16
+#define SD_READAHEAD_BUFFERS    3
+#define SD_SCRATCH_BLOCKS       8
+#define SDCARD_WRITEBEHIND      1
+#define SD_WRITEBEHIND_BLOCKS   64
+#define SD_WRITEBEHIND_RUN      16
+#define SD_WRITEBEHIND_DELAY    20
+
+/*EOF*/
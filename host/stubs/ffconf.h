@@ -0,0 +1,30 @@
+/*
+
+  ffconf.h - host stub enabling the FatFs functions used by the tests
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include_next "ffconf.h"
+
+// f_mkfs() formats the simulated card, f_gets() streams a file line by line as a G-code job does.
+#undef FF_USE_MKFS
+#define FF_USE_MKFS     1
+#undef FF_USE_STRFUNC
+#define FF_USE_STRFUNC  1
+
+/*EOF*/
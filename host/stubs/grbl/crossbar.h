@@ -0,0 +1,265 @@
+/*
+
+  crossbar.h - host stub of the grblHAL core header, pin functions, groups and properties
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include "nuts_bolts.h"
+
+typedef enum {
+    Input_Probe = 0,
+    Input_Reset,
+    Input_FeedHold,
+    Input_CycleStart,
+    Input_SafetyDoor,
+    Input_LimitsOverride,
+    Input_EStop,
+    Input_ProbeDisconnect,
+    Input_MotorFault,
+    Input_MotorWarning,
+    Input_LimitX,
+    Input_LimitX_2,
+    Input_LimitX_Max,
+    Input_LimitY,
+    Input_LimitY_2,
+    Input_LimitY_Max,
+    Input_LimitZ,
+    Input_LimitZ_2,
+    Input_LimitZ_Max,
+    Input_LimitA,
+    Input_LimitA_Max,
+    Input_LimitB,
+    Input_LimitB_Max,
+    Input_LimitC,
+    Input_LimitC_Max,
+    Input_LimitU,
+    Input_LimitU_Max,
+    Input_LimitV,
+    Input_LimitV_Max,
+    Input_SpindleIndex,
+    Input_MPGSelect,
+    Input_KeypadStrobe,
+    Input_RX,
+    Input_Aux0,
+    Input_Aux1,
+    Input_Aux2,
+    Input_Aux3,
+    Input_Aux4,
+    Input_Aux5,
+    Input_Aux6,
+    Input_Aux7,
+    Input_Analog_Aux0,
+    Input_Analog_Aux1,
+    Input_Analog_Aux2,
+    Input_Analog_Aux3,
+    Output_StepX,
+    Output_StepX_2,
+    Output_StepY,
+    Output_StepY_2,
+    Output_StepZ,
+    Output_StepZ_2,
+    Output_StepA,
+    Output_StepB,
+    Output_StepC,
+    Output_StepU,
+    Output_StepV,
+    Output_DirX,
+    Output_DirX_2,
+    Output_DirY,
+    Output_DirY_2,
+    Output_DirZ,
+    Output_DirZ_2,
+    Output_DirA,
+    Output_DirB,
+    Output_DirC,
+    Output_DirU,
+    Output_DirV,
+    Output_MotorChipSelect,
+    Output_MotorChipSelectX,
+    Output_MotorChipSelectY,
+    Output_MotorChipSelectZ,
+    Output_MotorChipSelectM3,
+    Output_MotorChipSelectM4,
+    Output_MotorChipSelectM5,
+    Output_StepperPower,
+    Output_StepperEnable,
+    Output_StepperEnableX,
+    Output_StepperEnableY,
+    Output_StepperEnableZ,
+    Output_StepperEnableA,
+    Output_StepperEnableB,
+    Output_StepperEnableC,
+    Output_StepperEnableU,
+    Output_StepperEnableV,
+    Output_SpindleOn,
+    Output_SpindleDir,
+    Output_SpindlePWM,
+    Output_CoolantMist,
+    Output_CoolantFlood,
+    Output_SdCardCS,
+    Output_SPICS,
+    Output_TX,
+    Output_Aux0,
+    Output_Aux1,
+    Output_Aux2,
+    Output_Aux3,
+    Output_Aux4,
+    Output_Aux5,
+    Output_Aux6,
+    Output_Aux7,
+    Output_Analog_Aux0,
+    Output_Analog_Aux1,
+    Output_Analog_Aux2,
+    Output_Analog_Aux3,
+    Bidirectional_MotorUARTX,
+    Bidirectional_MotorUARTY,
+    Bidirectional_MotorUARTZ,
+    Bidirectional_MotorUARTM3,
+    Bidirectional_MotorUARTM4,
+    Bidirectional_MotorUARTM5
+} pin_function_t;
+
+// Input groups are bits, the driver tests for membership of several at once.
+typedef enum {
+    PinGroup_Control = (1 << 0),
+    PinGroup_Limit = (1 << 1),
+    PinGroup_LimitMax = (1 << 2),
+    PinGroup_SafetyDoor = (1 << 3),
+    PinGroup_AuxInput = (1 << 4),
+    PinGroup_SpindleIndex = (1 << 5),
+    PinGroup_MPG = (1 << 6),
+    PinGroup_Keypad = (1 << 7),
+    PinGroup_Probe = (1 << 8),
+    PinGroup_Motor_Fault = (1 << 9),
+    PinGroup_Motor_Warning = (1 << 10),
+    PinGroup_AuxInputAnalog = (1 << 11),
+// Output groups
+    PinGroup_StepperPower = (1 << 12),
+    PinGroup_StepperStep,
+    PinGroup_StepperDir,
+    PinGroup_StepperEnable,
+    PinGroup_MotorChipSelect,
+    PinGroup_MotorUART,
+    PinGroup_SpindleControl,
+    PinGroup_SpindlePWM,
+    PinGroup_Coolant,
+    PinGroup_SdCard,
+    PinGroup_AuxOutput,
+    PinGroup_AuxOutputAnalog,
+    PinGroup_UART1,
+    PinGroup_UART2,
+    PinGroup_UART3
+} pin_group_t;
+
+typedef enum {
+    IRQ_Mode_None = 0b00000,
+    IRQ_Mode_Rising = 0b00001,
+    IRQ_Mode_Falling = 0b00010,
+    IRQ_Mode_RisingFalling = 0b00011,
+    IRQ_Mode_Change = 0b00100,
+    IRQ_Mode_Edges = 0b00111,
+    IRQ_Mode_Low = 0b01000,
+    IRQ_Mode_High = 0b10000,
+    IRQ_Mode_All = 0b11111
+} pin_irq_mode_t;
+
+typedef enum {
+    PullMode_None = 0b00,
+    PullMode_Up = 0b01,
+    PullMode_Down = 0b10,
+    PullMode_UpDown = 0b11
+} pull_mode_t;
+
+#define PINMODE_NONE        (0)
+#define PINMODE_OUTPUT      (1<<1)
+#define PINMODE_OD          (1<<2)
+
+typedef union {
+    uint16_t mask;
+    struct {
+        uint16_t input      :1,
+                 output     :1,
+                 open_drain :1,
+                 pull_mode  :2,
+                 irq_mode   :5,
+                 invert     :1,
+                 analog     :1,
+                 pwm        :1,
+                 servo_pwm  :1,
+                 claimable  :1,
+                 external   :1;
+    };
+} pin_cap_t;
+
+typedef union {
+    uint16_t mask;
+    struct {
+        uint16_t input      :1,
+                 output     :1,
+                 open_drain :1,
+                 pull_mode  :2,
+                 irq_mode   :5,
+                 inverted   :1,
+                 analog     :1,
+                 pwm        :1,
+                 servo_pwm  :1,
+                 claimed    :1,
+                 unused     :1;
+    };
+} pin_mode_t;
+
+#define XBAR_SET_CAP(cap, mode) { cap.mask = mode.mask; cap.claimable = !mode.claimed; }
+
+struct xbar;
+
+typedef float (*xbar_get_value_ptr)(struct xbar *pin);
+
+typedef struct xbar {
+    pin_function_t function;
+    pin_group_t group;
+    pin_cap_t cap;
+    pin_mode_t mode;
+    uint8_t pin;
+    uint32_t bit;
+    void *port;
+    const char *description;
+    xbar_get_value_ptr get_value;
+} xbar_t;
+
+typedef struct {
+    pin_function_t function;
+    pin_group_t group;
+    void *port;
+    uint8_t pin;
+    pin_mode_t mode;
+    const char *description;
+} periph_pin_t;
+
+typedef struct periph_signal {
+    periph_pin_t pin;
+    struct periph_signal *next;
+} periph_signal_t;
+
+typedef void (*pin_info_ptr)(xbar_t *pin, void *data);
+
+axes_signals_t xbar_fn_to_axismask (pin_function_t id);
+const char *xbar_fn_to_pinname (pin_function_t id);
+
+/*EOF*/
@@ -0,0 +1,141 @@
+/*
+
+  driver_opts.h - host stub of the grblHAL core header, defaults for the driver options
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+// Everything that needs a plugin or core code not present in the host build defaults to off,
+// options given on the command line take precedence.
+
+#include "hal.h"
+
+#ifndef N_AXIS
+#define N_AXIS 3
+#endif
+#ifndef N_ABC_MOTORS
+#define N_ABC_MOTORS 0
+#endif
+#ifndef N_GANGED
+#define N_GANGED 0
+#endif
+#ifndef N_AUTO_SQUARED
+#define N_AUTO_SQUARED 0
+#endif
+#ifndef SERIAL_STREAM
+#define SERIAL_STREAM 0
+#endif
+#ifndef BAUD_RATE
+#define BAUD_RATE 115200
+#endif
+#ifndef DRIVER_SPINDLE_ENABLE
+#define DRIVER_SPINDLE_ENABLE 0
+#endif
+#ifndef DRIVER_SPINDLE_DIR_ENABLE
+#define DRIVER_SPINDLE_DIR_ENABLE 0
+#endif
+#ifndef DRIVER_SPINDLE_PWM_ENABLE
+#define DRIVER_SPINDLE_PWM_ENABLE 0
+#endif
+#ifndef SPINDLE_ENCODER_ENABLE
+#define SPINDLE_ENCODER_ENABLE 0
+#endif
+#ifndef SPINDLE_SYNC_ENABLE
+#define SPINDLE_SYNC_ENABLE 0
+#endif
+#ifndef ESTOP_ENABLE
+#define ESTOP_ENABLE 0
+#endif
+#ifndef SAFETY_DOOR_ENABLE
+#define SAFETY_DOOR_ENABLE 0
+#endif
+#ifndef MOTOR_FAULT_ENABLE
+#define MOTOR_FAULT_ENABLE 0
+#endif
+#ifndef MOTOR_WARNING_ENABLE
+#define MOTOR_WARNING_ENABLE 0
+#endif
+#ifndef AUX_CONTROLS_ENABLED
+#define AUX_CONTROLS_ENABLED 0
+#endif
+#ifndef STEP_INJECT_ENABLE
+#define STEP_INJECT_ENABLE 0
+#endif
+#ifndef STEP_DMA_ENABLE
+#define STEP_DMA_ENABLE 0
+#endif
+#ifndef STEP_PULSE_TIMER_OUTPUT
+#define STEP_PULSE_TIMER_OUTPUT 0
+#endif
+#ifndef USB_SERIAL_CDC
+#define USB_SERIAL_CDC 0
+#endif
+#ifndef I2C_ENABLE
+#define I2C_ENABLE 0
+#endif
+#ifndef I2C_STROBE_ENABLE
+#define I2C_STROBE_ENABLE 0
+#endif
+#ifndef SDCARD_ENABLE
+#define SDCARD_ENABLE 0
+#endif
+#ifndef EEPROM_ENABLE
+#define EEPROM_ENABLE 0
+#endif
+#ifndef ETHERNET_ENABLE
+#define ETHERNET_ENABLE 0
+#endif
+#ifndef ODOMETER_ENABLE
+#define ODOMETER_ENABLE 0
+#endif
+#ifndef PPI_ENABLE
+#define PPI_ENABLE 0
+#endif
+#ifndef KEYPAD_ENABLE
+#define KEYPAD_ENABLE 0
+#endif
+#ifndef MPG_ENABLE
+#define MPG_ENABLE 0
+#endif
+#ifndef MODBUS_ENABLE
+#define MODBUS_ENABLE 0
+#endif
+#ifndef BLUETOOTH_ENABLE
+#define BLUETOOTH_ENABLE 0
+#endif
+#ifndef OPENPNP_ENABLE
+#define OPENPNP_ENABLE 0
+#endif
+#ifndef TRINAMIC_ENABLE
+#define TRINAMIC_ENABLE 0
+#endif
+#ifndef RTC_ENABLE
+#define RTC_ENABLE 0
+#endif
+#ifndef QEI_ENABLE
+#define QEI_ENABLE 0
+#endif
+#ifndef ISR_PROFILER_ENABLE
+#define ISR_PROFILER_ENABLE 0
+#endif
+#ifndef STEP_TRACE_ENABLE
+#define STEP_TRACE_ENABLE 0
+#endif
+
+/*EOF*/
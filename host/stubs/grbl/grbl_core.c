@@ -0,0 +1,301 @@
+/*
+
+  grbl_core.c - host stub of the grblHAL core functions called by the driver
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver_opts.h"
+#include "protocol.h"
+#include "state_machine.h"
+#include "machine_limits.h"
+
+#include "mcu_sim.h"
+
+static bool stream_blocking (void);
+static void execute_delay (sys_state_t state);
+static void register_periph_pin (const periph_pin_t *pin);
+static void set_periph_pin_description (const pin_function_t function, const pin_group_t group, const char *description);
+
+grbl_hal_t hal = {
+    .version = HAL_VERSION,
+    .stream_blocking_callback = stream_blocking,
+    .periph_port.register_pin = register_periph_pin,
+    .periph_port.set_pin_description = set_periph_pin_description
+};
+
+grbl_t grbl = {
+    .on_execute_delay = execute_delay
+};
+
+settings_t settings = {
+    .version = SETTINGS_VERSION,
+    .steppers.pulse_microseconds = 10.0f
+};
+
+system_t sys;
+
+static io_stream_details_t *streams = NULL;
+static driver_settings_load_ptr on_settings_loaded = NULL;
+static setting_changed_ptr on_setting_changed = NULL;
+
+// The foreground process is idle while waiting, let the simulation run.
+
+static bool stream_blocking (void)
+{
+    sim_idle();
+
+    return true;
+}
+
+static void execute_delay (sys_state_t state)
+{
+    sim_idle();
+}
+
+static void register_periph_pin (const periph_pin_t *pin)
+{
+}
+
+static void set_periph_pin_description (const pin_function_t function, const pin_group_t group, const char *description)
+{
+}
+
+sys_state_t state_get (void)
+{
+    return STATE_IDLE;
+}
+
+// Streams
+
+void stream_register_streams (io_stream_details_t *details)
+{
+    details->next = streams;
+    streams = details;
+}
+
+bool stream_connect_instance (uint8_t instance, uint32_t baud_rate)
+{
+    uint_fast8_t idx;
+    const io_stream_t *stream = NULL;
+    io_stream_details_t *details = streams;
+
+    while(details && stream == NULL) {
+        for(idx = 0; idx < details->n_streams; idx++) {
+            if(details->streams[idx].type == StreamType_Serial && details->streams[idx].instance == instance) {
+                if((stream = details->streams[idx].claim(baud_rate)))
+                    break;
+            }
+        }
+        details = details->next;
+    }
+
+    if(stream)
+        memcpy(&hal.stream, stream, sizeof(io_stream_t));
+
+    return stream != NULL;
+}
+
+bool stream_rx_suspend (stream_rx_buffer_t *rxbuffer, bool suspend)
+{
+    return false; // Tool change input buffering is not supported
+}
+
+// Realtime commands are stripped from the input, tests may install their own handler.
+
+bool protocol_enqueue_realtime_command (char c)
+{
+    return c == CMD_RESET || c == CMD_STATUS_REPORT || c == CMD_CYCLE_START || c == CMD_FEED_HOLD || (c & 0x80);
+}
+
+bool protocol_execute_realtime (void)
+{
+    return !sys.abort;
+}
+
+bool protocol_enqueue_foreground_task (foreground_task_ptr fn, void *data)
+{
+    fn(data);
+
+    return true;
+}
+
+// Auxiliary I/O ports, port names are "P0", "P1"... as laid out by iports_get_pnum().
+
+bool ioports_add (io_ports_data_t *ports, io_port_type_t type, uint8_t n_in, uint8_t n_out)
+{
+    uint_fast8_t idx, n_ports = max(n_in, n_out);
+    char *pnum;
+
+    if(type != Port_Digital)
+        return false;
+
+    ports->in.n_ports = ports->in.idx_last = n_in;
+    ports->out.n_ports = ports->out.idx_last = n_out;
+    ports->in.map = n_in ? malloc(n_in) : NULL;
+    ports->out.map = n_out ? malloc(n_out) : NULL;
+
+    if((pnum = ports->pnum = malloc(n_ports * 4 + 1)) == NULL)
+        return false;
+
+    for(idx = 0; idx < n_ports; idx++) {
+        if(idx < n_in)
+            ports->in.map[idx] = idx;
+        if(idx < n_out)
+            ports->out.map[idx] = idx;
+        pnum += sprintf(pnum, "P%u", (unsigned int)idx) + 1;
+    }
+
+    hal.port.num_digital_in = n_in;
+    hal.port.num_digital_out = n_out;
+
+    return true;
+}
+
+uint8_t ioports_map_reverse (io_ports_detail_t *type, uint8_t port)
+{
+    uint_fast8_t idx;
+
+    if(type->map) for(idx = 0; idx < type->n_ports; idx++) {
+        if(type->map[idx] == port)
+            return idx;
+    }
+
+    return port;
+}
+
+void ioports_add_settings (driver_settings_load_ptr settings_loaded, setting_changed_ptr setting_changed)
+{
+    on_settings_loaded = settings_loaded;
+    on_setting_changed = setting_changed;
+}
+
+bool ioport_claim (io_port_type_t type, io_port_direction_t dir, uint8_t *port, const char *description)
+{
+    return hal.port.claim && hal.port.claim(type, dir, port, description);
+}
+
+// Settings are not persisted
+
+void settings_write_global (void)
+{
+}
+
+void settings_loaded (void)
+{
+    if(on_settings_loaded)
+        on_settings_loaded();
+}
+
+void setting_changed (setting_id_t id)
+{
+    if(on_setting_changed)
+        on_setting_changed(id);
+}
+
+// Crossbar and limit switch helpers
+
+axes_signals_t xbar_fn_to_axismask (pin_function_t id)
+{
+    axes_signals_t mask = {0};
+
+    switch(id) {
+
+        case Input_LimitX:
+        case Input_LimitX_2:
+        case Input_LimitX_Max:
+            mask.x = On;
+            break;
+
+        case Input_LimitY:
+        case Input_LimitY_2:
+        case Input_LimitY_Max:
+            mask.y = On;
+            break;
+
+        case Input_LimitZ:
+        case Input_LimitZ_2:
+        case Input_LimitZ_Max:
+            mask.z = On;
+            break;
+
+        default:
+            break;
+    }
+
+    return mask;
+}
+
+const char *xbar_fn_to_pinname (pin_function_t id)
+{
+    return "N/A";
+}
+
+limit_signals_t get_limits_cap (void)
+{
+    limit_signals_t cap = {0};
+
+    cap.min.mask = AXES_BITMASK;
+
+    return cap;
+}
+
+home_signals_t get_home_cap (void)
+{
+    home_signals_t cap = {0};
+
+    return cap;
+}
+
+axes_signals_t limit_signals_merge (limit_signals_t signals)
+{
+    axes_signals_t state;
+
+    state.mask = signals.min.mask | signals.min2.mask | signals.max.mask | signals.max2.mask;
+
+    return state;
+}
+
+limit_signals_t xbar_get_homing_source_from_cycle (axes_signals_t homing_cycle)
+{
+    limit_signals_t source = {0};
+
+    source.min.mask = homing_cycle.mask;
+
+    return source;
+}
+
+// Driver parts that are not built for the host, flash.c and the symbols from the linker script.
+
+bool memcpy_from_flash (uint8_t *dest)
+{
+    return false;
+}
+
+bool memcpy_to_flash (uint8_t *source)
+{
+    return true;
+}
+
+uint8_t _estack;
+uint32_t _Min_Stack_Size;
+
+/*EOF*/
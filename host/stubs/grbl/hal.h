@@ -0,0 +1,174 @@
+/*
+
+  hal.h - host stub of the grblHAL core header, the HAL structure filled in by the driver
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Only the members used by this driver are declared, with the signatures of HAL version 10.
+
+#pragma once
+
+#include "nuts_bolts.h"
+#include "crossbar.h"
+#include "system.h"
+#include "settings.h"
+#include "stream.h"
+#include "ioports.h"
+#include "stepper.h"
+
+#define HAL_VERSION 10
+
+typedef uint_fast16_t sys_state_t;
+
+typedef void (*delay_callback_ptr)(void);
+
+typedef struct {
+    volatile uint32_t ms;
+    delay_callback_ptr callback;
+} delay_t;
+
+typedef enum {
+    NVS_None = 0,
+    NVS_EEPROM,
+    NVS_FRAM,
+    NVS_Flash,
+    NVS_Emulated
+} nvs_type;
+
+typedef struct {
+    nvs_type type;
+    bool (*memcpy_from_flash)(uint8_t *dest);
+    bool (*memcpy_to_flash)(uint8_t *source);
+} nvs_io_t;
+
+typedef union {
+    uint32_t value;
+    struct {
+        uint32_t mist_control       :1,
+                 software_debounce  :1,
+                 step_pulse_delay   :1,
+                 limits_pull_up     :1,
+                 control_pull_up    :1,
+                 probe_pull_up      :1,
+                 amass_level        :2,
+                 spindle_encoder    :1,
+                 spindle_sync       :1,
+                 mpg_mode           :1,
+                 unassigned         :21;
+    };
+} driver_cap_t;
+
+typedef struct {
+    void (*wake_up)(void);
+    void (*go_idle)(bool clear_signals);
+    void (*enable)(axes_signals_t enable);
+    void (*disable_motors)(axes_signals_t axes, squaring_mode_t mode);
+    void (*cycles_per_tick)(uint32_t cycles_per_tick);
+    void (*pulse_start)(stepper_t *stepper);
+    void (*output_step)(axes_signals_t step_outbits, axes_signals_t dir_outbits);
+    axes_signals_t (*get_ganged)(bool auto_squared);
+    void (*motor_iterator)(void (*callback)(uint_fast8_t motor, uint_fast8_t axis));
+    void (*interrupt_callback)(void);
+} stepper_ptrs_t;
+
+typedef struct {
+    void (*enable)(bool on, axes_signals_t homing_cycle);
+    limit_signals_t (*get_state)(void);
+    void (*interrupt_callback)(limit_signals_t state);
+} limits_ptrs_t;
+
+typedef struct {
+    control_signals_t (*get_state)(void);
+    void (*interrupt_callback)(control_signals_t signals);
+} control_signals_ptrs_t;
+
+typedef struct {
+    void (*set_state)(coolant_state_t mode);
+    coolant_state_t (*get_state)(void);
+} coolant_ptrs_t;
+
+typedef struct {
+    probe_state_t (*get_state)(void);
+    void (*configure)(bool is_probe_away, bool probing);
+} probe_ptrs_t;
+
+typedef struct {
+    uint8_t num_digital_in;
+    uint8_t num_digital_out;
+    uint8_t num_analog_in;
+    uint8_t num_analog_out;
+    void (*digital_out)(uint8_t port, bool on);
+    bool (*analog_out)(uint8_t port, float value);
+    int32_t (*wait_on_input)(io_port_type_t type, uint8_t port, wait_mode_t wait_mode, float timeout);
+    bool (*register_interrupt_handler)(uint8_t port, pin_irq_mode_t irq_mode, ioport_interrupt_callback_ptr interrupt_callback);
+    xbar_t *(*get_pin_info)(io_port_type_t type, io_port_direction_t dir, uint8_t port);
+    void (*set_pin_description)(io_port_type_t type, io_port_direction_t dir, uint8_t port, const char *description);
+    bool (*claim)(io_port_type_t type, io_port_direction_t dir, uint8_t *port, const char *description);
+    bool (*swap_pins)(io_port_type_t type, io_port_direction_t dir, uint8_t port_a, uint8_t port_b);
+} io_port_t;
+
+typedef struct {
+    void (*register_pin)(const periph_pin_t *pin);
+    void (*set_pin_description)(const pin_function_t function, const pin_group_t group, const char *description);
+} periph_port_t;
+
+typedef struct {
+    uint32_t version;
+    const char *info;
+    const char *driver_version;
+    const char *driver_url;
+    const char *board;
+    uint32_t f_mcu;
+    uint32_t f_step_timer;
+    uint32_t rx_buffer_size;
+    driver_cap_t driver_cap;
+    control_signals_t signals_cap;
+    limit_signals_t limits_cap;
+    home_signals_t home_cap;
+    nvs_io_t nvs;
+    io_stream_t stream;
+    stepper_ptrs_t stepper;
+    limits_ptrs_t limits;
+    control_signals_ptrs_t control;
+    coolant_ptrs_t coolant;
+    probe_ptrs_t probe;
+    io_port_t port;
+    periph_port_t periph_port;
+    bool (*driver_setup)(settings_t *settings);
+    void (*settings_changed)(settings_t *settings, settings_changed_flags_t changed);
+    void (*delay_ms)(uint32_t ms, delay_callback_ptr callback);
+    uint32_t (*get_free_mem)(void);
+    void (*irq_enable)(void);
+    void (*irq_disable)(void);
+    void (*set_bits_atomic)(volatile uint_fast16_t *value, uint_fast16_t bits);
+    uint_fast16_t (*clear_bits_atomic)(volatile uint_fast16_t *value, uint_fast16_t bits);
+    uint_fast16_t (*set_value_atomic)(volatile uint_fast16_t *value, uint_fast16_t bits);
+    uint64_t (*get_micros)(void);
+    uint32_t (*get_elapsed_ticks)(void);
+    void (*enumerate_pins)(bool low_level, pin_info_ptr pin_info, void *data);
+    bool (*stream_blocking_callback)(void);
+} grbl_hal_t;
+
+typedef struct {
+    void (*on_execute_delay)(sys_state_t state);
+} grbl_t;
+
+extern grbl_hal_t hal;
+extern grbl_t grbl;
+
+/*EOF*/
@@ -0,0 +1,79 @@
+/*
+
+  ioports.h - host stub of the grblHAL core header, auxiliary I/O port API
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include "crossbar.h"
+#include "settings.h"
+#include "system.h"
+
+typedef enum {
+    Port_Analog = 0,
+    Port_Digital = 1
+} io_port_type_t;
+
+typedef enum {
+    Port_Input = 0,
+    Port_Output = 1
+} io_port_direction_t;
+
+typedef enum {
+    WaitMode_Immediate = 0,
+    WaitMode_Rise,
+    WaitMode_Fall,
+    WaitMode_High,
+    WaitMode_Low
+} wait_mode_t;
+
+typedef void (*ioport_interrupt_callback_ptr)(uint8_t port, bool state);
+
+// Claimed ports are moved to the end of the map, port numbers seen by the user are indices into it.
+typedef struct {
+    uint8_t n_start;
+    uint8_t n_ports;
+    uint8_t idx_last;
+    uint8_t *map;
+} io_ports_detail_t;
+
+typedef struct {
+    io_ports_detail_t in;
+    io_ports_detail_t out;
+    char *pnum;         // Port names, "P0", "P1"... as consecutive null terminated strings
+} io_ports_data_t;
+
+typedef struct {
+    bool enabled;
+    bool debouncing;
+    uint8_t port;
+    pin_irq_mode_t irq_mode;
+    control_signals_t cap;
+    pin_function_t function;
+} aux_ctrl_t;
+
+#define ioports_map(type, port) ( type.map ? type.map[port] : port )
+#define iports_get_pnum(type, port) type.pnum + (port * 3) + (port > 9 ? port - 10 : 0)
+
+uint8_t ioports_map_reverse (io_ports_detail_t *type, uint8_t port);
+bool ioports_add (io_ports_data_t *ports, io_port_type_t type, uint8_t n_in, uint8_t n_out);
+void ioports_add_settings (driver_settings_load_ptr settings_loaded, setting_changed_ptr setting_changed);
+bool ioport_claim (io_port_type_t type, io_port_direction_t dir, uint8_t *port, const char *description);
+
+/*EOF*/
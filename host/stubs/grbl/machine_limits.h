@@ -0,0 +1,31 @@
+/*
+
+  machine_limits.h - host stub of the grblHAL core header, limit switch helpers
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include "hal.h"
+
+limit_signals_t get_limits_cap (void);
+home_signals_t get_home_cap (void);
+axes_signals_t limit_signals_merge (limit_signals_t signals);
+limit_signals_t xbar_get_homing_source_from_cycle (axes_signals_t homing_cycle);
+
+/*EOF*/
@@ -0,0 +1,40 @@
+/*
+
+  motor_pins.h - host stub of the grblHAL core header, motor to axis mapping for three axes without ganged motors
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#if N_ABC_MOTORS || N_GANGED
+#error "The host build only supports three axes without ganged motors!"
+#endif
+
+typedef void (*motor_iterator_callback_ptr)(uint_fast8_t motor, uint_fast8_t axis);
+
+static void motor_iterator (motor_iterator_callback_ptr callback)
+{
+    uint_fast8_t idx = N_AXIS;
+
+    do {
+        idx--;
+        callback(idx, idx);
+    } while(idx);
+}
+
+/*EOF*/
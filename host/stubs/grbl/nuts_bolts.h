@@ -0,0 +1,93 @@
+/*
+
+  nuts_bolts.h - host stub of the grblHAL core header, common types and helpers used by the driver
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define bit(n) (1UL << (n))
+
+#define On  1
+#define Off 0
+
+#define X_AXIS 0
+#define Y_AXIS 1
+#define Z_AXIS 2
+
+#define X_AXIS_BIT (1 << X_AXIS)
+#define Y_AXIS_BIT (1 << Y_AXIS)
+#define Z_AXIS_BIT (1 << Z_AXIS)
+
+#define AXES_BITMASK ((1 << N_AXIS) - 1)
+
+#define ASCII_CAN 0x18
+
+#define CMD_RESET           0x18 // ctrl-x
+#define CMD_STATUS_REPORT   '?'
+#define CMD_CYCLE_START     '~'
+#define CMD_FEED_HOLD       '!'
+
+#ifndef max
+#define max(a,b) (((a) > (b)) ? (a) : (b))
+#endif
+#ifndef min
+#define min(a,b) (((a) < (b)) ? (a) : (b))
+#endif
+
+typedef union {
+    uint8_t mask;
+    uint8_t value;
+    struct {
+        uint8_t x :1,
+                y :1,
+                z :1,
+                a :1,
+                b :1,
+                c :1,
+                u :1,
+                v :1;
+    };
+} axes_signals_t;
+
+typedef struct {
+    axes_signals_t min;
+    axes_signals_t max;
+    axes_signals_t min2;
+    axes_signals_t max2;
+} limit_signals_t;
+
+typedef struct {
+    axes_signals_t a;
+    axes_signals_t b;
+} home_signals_t;
+
+typedef union {
+    uint8_t value;
+    uint8_t mask;
+    struct {
+        uint8_t flood  :1,
+                mist   :1,
+                unused :6;
+    };
+} coolant_state_t;
+
+/*EOF*/
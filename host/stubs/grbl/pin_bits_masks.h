@@ -0,0 +1,93 @@
+/*
+
+  pin_bits_masks.h - host stub of the grblHAL core header, pin bits and masks derived from the board map
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+// Covers the signals of the generic board map, X, Y and Z motors on shared step and direction ports.
+
+#define X_STEP_PORT         STEP_PORT
+#define Y_STEP_PORT         STEP_PORT
+#define Z_STEP_PORT         STEP_PORT
+#define X_DIRECTION_PORT    DIRECTION_PORT
+#define Y_DIRECTION_PORT    DIRECTION_PORT
+#define Z_DIRECTION_PORT    DIRECTION_PORT
+#define X_LIMIT_PORT        LIMIT_PORT
+#define Y_LIMIT_PORT        LIMIT_PORT
+#define Z_LIMIT_PORT        LIMIT_PORT
+#define RESET_PORT          CONTROL_PORT
+#define FEED_HOLD_PORT      CONTROL_PORT
+#define CYCLE_START_PORT    CONTROL_PORT
+
+#define X_STEP_BIT          (1 << X_STEP_PIN)
+#define Y_STEP_BIT          (1 << Y_STEP_PIN)
+#define Z_STEP_BIT          (1 << Z_STEP_PIN)
+#define STEP_MASK           (X_STEP_BIT|Y_STEP_BIT|Z_STEP_BIT)
+
+#define X_DIRECTION_BIT     (1 << X_DIRECTION_PIN)
+#define Y_DIRECTION_BIT     (1 << Y_DIRECTION_PIN)
+#define Z_DIRECTION_BIT     (1 << Z_DIRECTION_PIN)
+#define DIRECTION_MASK      (X_DIRECTION_BIT|Y_DIRECTION_BIT|Z_DIRECTION_BIT)
+
+#define X_LIMIT_BIT         (1 << X_LIMIT_PIN)
+#define Y_LIMIT_BIT         (1 << Y_LIMIT_PIN)
+#define Z_LIMIT_BIT         (1 << Z_LIMIT_PIN)
+#define LIMIT_MASK          (X_LIMIT_BIT|Y_LIMIT_BIT|Z_LIMIT_BIT)
+#define LIMIT_MASK_SUM      (X_LIMIT_BIT+Y_LIMIT_BIT+Z_LIMIT_BIT)
+
+#define RESET_BIT           (1 << RESET_PIN)
+#define FEED_HOLD_BIT       (1 << FEED_HOLD_PIN)
+#define CYCLE_START_BIT     (1 << CYCLE_START_PIN)
+#define CONTROL_MASK        (RESET_BIT|FEED_HOLD_BIT|CYCLE_START_BIT)
+#define CONTROL_MASK_SUM    (RESET_BIT+FEED_HOLD_BIT+CYCLE_START_BIT)
+
+#define SAFETY_DOOR_BIT     0
+#define MOTOR_FAULT_BIT     0
+#define MOTOR_WARNING_BIT   0
+#define SPINDLE_INDEX_BIT   0
+#define I2C_STROBE_BIT      0
+#define SPI_IRQ_BIT         0
+#define MPG_MODE_BIT        0
+#define DEVICES_IRQ_MASK    0
+#define DEVICES_IRQ_MASK_SUM 0
+
+#define STEPPERS_ENABLE_BIT (1 << STEPPERS_ENABLE_PIN)
+#define COOLANT_FLOOD_BIT   (1 << COOLANT_FLOOD_PIN)
+#define COOLANT_MIST_BIT    (1 << COOLANT_MIST_PIN)
+#define PROBE_BIT           (1 << PROBE_PIN)
+
+#ifdef AUXINPUT0_PIN
+#define AUXINPUT0_BIT       (1 << AUXINPUT0_PIN)
+#else
+#define AUXINPUT0_BIT       0
+#endif
+#define AUXINPUT_MASK       AUXINPUT0_BIT
+
+#ifdef AUXOUTPUT0_PIN
+#define AUXOUTPUT0_BIT      (1 << AUXOUTPUT0_PIN)
+#endif
+#ifdef AUXOUTPUT1_PIN
+#define AUXOUTPUT1_BIT      (1 << AUXOUTPUT1_PIN)
+#endif
+#ifdef AUXOUTPUT2_PIN
+#define AUXOUTPUT2_BIT      (1 << AUXOUTPUT2_PIN)
+#endif
+
+/*EOF*/
@@ -0,0 +1,32 @@
+/*
+
+  protocol.h - host stub of the grblHAL core header, realtime command and foreground task queues
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include "hal.h"
+
+typedef void (*foreground_task_ptr)(void *data);
+
+bool protocol_enqueue_realtime_command (char c);
+bool protocol_execute_realtime (void);
+bool protocol_enqueue_foreground_task (foreground_task_ptr fn, void *data);
+
+/*EOF*/
@@ -0,0 +1,127 @@
+/*
+
+  settings.h - host stub of the grblHAL core header, the settings read by the driver
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include "nuts_bolts.h"
+#include "system.h"
+
+#define SETTINGS_VERSION 22
+
+typedef enum {
+    Setting_PulseMicroseconds = 0,
+    Setting_StepInvertMask = 2,
+    Setting_DirInvertMask = 3,
+    Setting_InvertStepperEnable = 4,
+    Setting_LimitPinsInvertMask = 5,
+    Setting_InvertProbePin = 6,
+    Setting_ControlInvertMask = 14,
+    Setting_CoolantInvertMask = 15,
+    Settings_IoPort_InvertIn = 370,
+    Settings_IoPort_InvertOut = 372
+} setting_id_t;
+
+typedef union {
+    uint32_t mask;
+    struct {
+        uint32_t bit0 :1,
+                 bit1 :1,
+                 bit2 :1,
+                 bit3 :1,
+                 bit4 :1,
+                 bit5 :1,
+                 bit6 :1,
+                 bit7 :1;
+    };
+} ioport_bus_t;
+
+typedef struct {
+    ioport_bus_t invert_in;
+    ioport_bus_t pullup_disable_in;
+    ioport_bus_t invert_out;
+    ioport_bus_t od_enable_out;
+} ioport_settings_t;
+
+typedef struct {
+    float pulse_microseconds;
+    float pulse_delay_microseconds;
+    axes_signals_t step_invert;
+    axes_signals_t dir_invert;
+    axes_signals_t ganged_dir_invert;
+    axes_signals_t enable_invert;
+    axes_signals_t deenergize;
+} stepper_settings_t;
+
+typedef union {
+    uint16_t value;
+    struct {
+        uint16_t hard_enabled       :1,
+                 soft_enabled       :1,
+                 check_at_init      :1,
+                 jog_soft_limited   :1,
+                 two_switches       :1,
+                 unassigned         :11;
+    };
+} limit_settings_flags_t;
+
+typedef struct {
+    limit_settings_flags_t flags;
+    axes_signals_t invert;
+    axes_signals_t disable_pullup;
+} limit_settings_t;
+
+typedef struct {
+    bool invert_probe_pin;
+    bool disable_probe_pullup;
+} probe_settings_t;
+
+typedef struct {
+    uint32_t version;
+    stepper_settings_t steppers;
+    limit_settings_t limits;
+    control_signals_t control_invert;
+    control_signals_t control_disable_pullup;
+    coolant_state_t coolant_invert;
+    probe_settings_t probe;
+    ioport_settings_t ioport;
+} settings_t;
+
+typedef union {
+    uint8_t value;
+    struct {
+        uint8_t spindle :1,
+                unused  :7;
+    };
+} settings_changed_flags_t;
+
+typedef void (*driver_settings_load_ptr)(void);
+typedef void (*setting_changed_ptr)(setting_id_t id);
+
+extern settings_t settings;
+
+void settings_write_global (void);
+
+// Host build only, run the settings hooks registered by the driver as settings_init()
+// and changing a setting with a $-command would.
+void settings_loaded (void);
+void setting_changed (setting_id_t id);
+
+/*EOF*/
@@ -0,0 +1,60 @@
+/*
+
+  stepdir_map.h - host stub of the grblHAL core header, lookup tables for mapped step and direction outputs
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+// Port bits for every combination of axis bits, with the invert settings applied.
+
+#if STEP_OUTMODE == GPIO_MAP || DIRECTION_OUTMODE == GPIO_MAP
+
+#define USE_STEPDIR_MAP 1
+
+#if STEP_OUTMODE == GPIO_MAP
+static uint32_t step_outmap[1 << N_AXIS];
+#endif
+#if DIRECTION_OUTMODE == GPIO_MAP
+static uint32_t dir_outmap[1 << N_AXIS];
+#endif
+
+static void stepdirmap_init (settings_t *settings)
+{
+    uint_fast8_t idx;
+    axes_signals_t step, dir;
+
+    for(idx = 0; idx < (1 << N_AXIS); idx++) {
+
+        step.mask = idx ^ settings->steppers.step_invert.mask;
+        dir.mask = idx ^ settings->steppers.dir_invert.mask;
+
+#if STEP_OUTMODE == GPIO_MAP
+        step_outmap[idx] = (step.x ? X_STEP_BIT : 0) | (step.y ? Y_STEP_BIT : 0) | (step.z ? Z_STEP_BIT : 0);
+#endif
+#if DIRECTION_OUTMODE == GPIO_MAP
+        dir_outmap[idx] = (dir.x ? X_DIRECTION_BIT : 0) | (dir.y ? Y_DIRECTION_BIT : 0) | (dir.z ? Z_DIRECTION_BIT : 0);
+#endif
+    }
+}
+
+#else
+#define USE_STEPDIR_MAP 0
+#endif
+
+/*EOF*/
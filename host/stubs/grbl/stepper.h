@@ -0,0 +1,41 @@
+/*
+
+  stepper.h - host stub of the grblHAL core header, the stepper state passed to the driver
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include "nuts_bolts.h"
+
+typedef struct {
+    uint32_t step_count;
+    bool new_block;
+    bool dir_change;
+    axes_signals_t step_outbits;
+    axes_signals_t dir_outbits;
+    uint_fast8_t amass_level;
+} stepper_t;
+
+typedef enum {
+    SquaringMode_Both = 0,
+    SquaringMode_A,
+    SquaringMode_B
+} squaring_mode_t;
+
+/*EOF*/
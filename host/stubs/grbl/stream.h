@@ -0,0 +1,130 @@
+/*
+
+  stream.h - host stub of the grblHAL core header, stream API used by the serial driver
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include "nuts_bolts.h"
+
+#ifndef RX_BUFFER_SIZE
+#define RX_BUFFER_SIZE 1024 // must be a power of 2
+#endif
+
+#ifndef TX_BUFFER_SIZE
+#define TX_BUFFER_SIZE 512  // must be a power of 2
+#endif
+
+#define SERIAL_NO_DATA -1
+
+#define BUFNEXT(ptr, buffer) ((ptr + 1) & (sizeof(buffer.data) - 1))
+#define BUFCOUNT(head, tail, size) ((head >= tail) ? (head - tail) : (size - tail + head))
+
+typedef enum {
+    StreamType_Serial = 0,
+    StreamType_MPG,
+    StreamType_Bluetooth,
+    StreamType_Telnet,
+    StreamType_WebSocket,
+    StreamType_SDCard,
+    StreamType_Redirected,
+    StreamType_Null
+} stream_type_t;
+
+typedef bool (*enqueue_realtime_command_ptr)(char c);
+
+typedef struct {
+    volatile uint_fast16_t head;
+    volatile uint_fast16_t tail;
+    bool rts_state;
+    bool overflow;
+    bool backup;
+    char data[RX_BUFFER_SIZE];
+} stream_rx_buffer_t;
+
+typedef struct {
+    volatile uint_fast16_t head;
+    volatile uint_fast16_t tail;
+    char data[TX_BUFFER_SIZE];
+} stream_tx_buffer_t;
+
+typedef union {
+    uint8_t value;
+    struct {
+        uint8_t connected       :1,
+                claimed         :1,
+                can_set_baud    :1,
+                rts_handshake   :1,
+                unused          :4;
+    };
+} io_stream_state_t;
+
+typedef struct io_stream {
+    stream_type_t type;
+    uint8_t instance;
+    io_stream_state_t state;
+    int16_t (*read)(void);
+    void (*write)(const char *s);
+    void (*write_n)(const char *s, uint16_t length);
+    bool (*write_char)(const char c);
+    bool (*enqueue_rt_command)(char c);
+    uint16_t (*get_rx_buffer_free)(void);
+    uint16_t (*get_rx_buffer_count)(void);
+    uint16_t (*get_tx_buffer_count)(void);
+    void (*reset_write_buffer)(void);
+    void (*reset_read_buffer)(void);
+    void (*cancel_read_buffer)(void);
+    bool (*suspend_read)(bool suspend);
+    bool (*disable_rx)(bool disable);
+    bool (*set_baud_rate)(uint32_t baud_rate);
+    enqueue_realtime_command_ptr (*set_enqueue_rt_handler)(enqueue_realtime_command_ptr handler);
+} io_stream_t;
+
+typedef const io_stream_t *(*stream_claim_ptr)(uint32_t baud_rate);
+
+typedef union {
+    uint8_t value;
+    struct {
+        uint8_t claimable       :1,
+                claimed         :1,
+                connected       :1,
+                can_set_baud    :1,
+                modbus_ready    :1,
+                unused          :3;
+    };
+} io_stream_flags_t;
+
+typedef struct {
+    stream_type_t type;
+    uint8_t instance;
+    io_stream_flags_t flags;
+    stream_claim_ptr claim;
+} io_stream_properties_t;
+
+typedef struct io_stream_details {
+    uint8_t n_streams;
+    io_stream_properties_t *streams;
+    struct io_stream_details *next;
+} io_stream_details_t;
+
+void stream_register_streams (io_stream_details_t *details);
+bool stream_connect_instance (uint8_t instance, uint32_t baud_rate);
+bool stream_rx_suspend (stream_rx_buffer_t *rxbuffer, bool suspend);
+
+/*EOF*/
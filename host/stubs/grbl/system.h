@@ -0,0 +1,64 @@
+/*
+
+  system.h - host stub of the grblHAL core header, control signals and system state
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include "nuts_bolts.h"
+
+typedef union {
+    uint16_t value;
+    uint16_t mask;
+    struct {
+        uint16_t reset              :1,
+                 feed_hold          :1,
+                 cycle_start        :1,
+                 safety_door_ajar   :1,
+                 block_delete       :1,
+                 stop_disable       :1,
+                 e_stop             :1,
+                 probe_disconnected :1,
+                 motor_fault        :1,
+                 motor_warning      :1,
+                 limits_override    :1,
+                 single_block       :1,
+                 unassigned         :1,
+                 probe_overtravel   :1,
+                 probe_triggered    :1,
+                 deasserted         :1;
+    };
+} control_signals_t;
+
+typedef struct {
+    uint8_t triggered   :1,
+            connected   :1,
+            inverted    :1,
+            is_probing  :1,
+            unused      :4;
+} probe_state_t;
+
+typedef struct {
+    volatile bool abort;
+    bool mpg_mode;
+} system_t;
+
+extern system_t sys;
+
+/*EOF*/
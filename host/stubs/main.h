@@ -0,0 +1,41 @@
+/*
+
+  main.h - host stub for the CMSIS core definitions used by driver headers
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define __DMB() __sync_synchronize()
+#define __CLZ(x) ((x) ? (uint32_t)__builtin_clz(x) : 32U)
+
+// Simulated DWT, CYCCNT is the virtual clock and only advances when the test does so.
+typedef struct {
+    volatile uint32_t CYCCNT;
+} DWT_Type;
+
+extern DWT_Type sim_dwt;
+
+#define DWT (&sim_dwt)
+
+void sim_clock_advance (uint32_t cycles);
+
+/*EOF*/
@@ -0,0 +1,32 @@
+/*
+
+  sim.c - host simulation of the peripherals used by the code under test
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "stm32h7xx.h"
+
+DWT_Type sim_dwt = {0};
+
+uint32_t sim_ipsr = 0, sim_basepri = 0;
+uint32_t sim_systick_priority = (1UL << __NVIC_PRIO_BITS) - 1UL;
+
+void sim_clock_advance (uint32_t cycles)
+{
+    sim_dwt.CYCCNT += cycles;
+}
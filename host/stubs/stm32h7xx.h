@@ -0,0 +1,74 @@
+/*
+
+  stm32h7xx.h - host stub for the CMSIS core register and NVIC access used by ffsystem.c
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include "main.h"
+
+#define __NVIC_PRIO_BITS 4
+
+// Simulated exception number and BASEPRI, the test sets sim_ipsr to run code as an interrupt handler.
+extern uint32_t sim_ipsr, sim_basepri;
+
+// Simulated SysTick priority, the HAL sets it to TICK_INT_PRIORITY (the lowest) in HAL_Init().
+// HAL_GetTick() in the test only advances while it is not masked by BASEPRI.
+typedef enum {
+    SysTick_IRQn = -1
+} IRQn_Type;
+
+extern uint32_t sim_systick_priority;
+
+static inline uint32_t NVIC_GetPriority (IRQn_Type irqn)
+{
+    (void)irqn;
+
+    return sim_systick_priority;
+}
+
+static inline void NVIC_SetPriority (IRQn_Type irqn, uint32_t priority)
+{
+    (void)irqn;
+
+    sim_systick_priority = priority & ((1UL << __NVIC_PRIO_BITS) - 1UL);
+}
+
+static inline uint32_t __get_IPSR (void)
+{
+    return sim_ipsr;
+}
+
+static inline uint32_t __get_BASEPRI (void)
+{
+    return sim_basepri;
+}
+
+static inline void __set_BASEPRI (uint32_t basepri)
+{
+    sim_basepri = basepri;
+}
+
+static inline void __set_BASEPRI_MAX (uint32_t basepri)
+{
+    if(basepri && (sim_basepri == 0 || basepri < sim_basepri))
+        sim_basepri = basepri;
+}
+
+/*EOF*/
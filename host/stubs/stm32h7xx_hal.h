@@ -0,0 +1,89 @@
+/*
+
+  stm32h7xx_hal.h - host stub for the HAL SD card definitions used by sd_diskio.c
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include "stm32h7xx.h"
+
+#define ALIGN_32BYTES(buf) buf __attribute__ ((aligned (32)))
+
+// The SDMMC IDMA region covers the host address space so no buffer takes the scratch buffer path.
+#define D1_AXISRAM_BASE 0x00000000UL
+#define D2_AHBSRAM_BASE 0xFFFFFFFFUL
+
+#define BLOCKSIZE       512U
+
+#define GPIO_PIN_4      0x0010U
+#define GPIO_PIN_8      0x0100U
+
+typedef enum {
+    HAL_OK = 0,
+    HAL_ERROR,
+    HAL_BUSY,
+    HAL_TIMEOUT
+} HAL_StatusTypeDef;
+
+typedef enum {
+    HAL_SD_STATE_RESET = 0,
+    HAL_SD_STATE_READY = 1,
+    HAL_SD_STATE_TIMEOUT = 2,
+    HAL_SD_STATE_BUSY = 3,
+    HAL_SD_STATE_PROGRAMMING = 4,
+    HAL_SD_STATE_RECEIVING = 5,
+    HAL_SD_STATE_TRANSFER = 6,
+    HAL_SD_STATE_ERROR = 0xF
+} HAL_SD_StateTypeDef;
+
+typedef uint32_t HAL_SD_CardStateTypeDef;
+
+#define HAL_SD_CARD_READY           0x00000001U
+#define HAL_SD_CARD_IDENTIFICATION  0x00000002U
+#define HAL_SD_CARD_STANDBY         0x00000003U
+#define HAL_SD_CARD_TRANSFER        0x00000004U
+#define HAL_SD_CARD_SENDING         0x00000005U
+#define HAL_SD_CARD_RECEIVING       0x00000006U
+#define HAL_SD_CARD_PROGRAMMING     0x00000007U
+#define HAL_SD_CARD_DISCONNECTED    0x00000008U
+#define HAL_SD_CARD_ERROR           0x000000FFU
+
+typedef struct {
+    uint32_t CardType;
+    uint32_t CardVersion;
+    uint32_t Class;
+    uint32_t RelCardAdd;
+    uint32_t BlockNbr;
+    uint32_t BlockSize;
+    uint32_t LogBlockNbr;
+    uint32_t LogBlockSize;
+    uint32_t CardSpeed;
+} HAL_SD_CardInfoTypeDef;
+
+typedef struct {
+    volatile uint32_t ErrorCode;
+} SD_HandleTypeDef;
+
+uint32_t HAL_GetTick (void);
+HAL_SD_StateTypeDef HAL_SD_GetState (SD_HandleTypeDef *hsd);
+HAL_SD_CardStateTypeDef HAL_SD_GetCardState (SD_HandleTypeDef *hsd);
+HAL_StatusTypeDef HAL_SD_Abort (SD_HandleTypeDef *hsd);
+void HAL_SD_ErrorCallback (SD_HandleTypeDef *hsd);
+
+/*EOF*/
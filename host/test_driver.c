@@ -0,0 +1,442 @@
+/*
+
+  test_driver.c - step timing and pin logic tests of driver.c against the simulated peripherals
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "driver.h"
+#include "mcu_sim.h"
+
+#include "grbl/pin_bits_masks.h"
+
+#define CHECK(c) if(!(c)) { printf("%s:%d: %s failed\n", __FILE__, __LINE__, #c); return 1; }
+
+#define N_EDGES 64
+#define US(cycles) ((float)(cycles) / (float)SIM_CYCLES_PER_US)
+
+typedef struct {
+    uint64_t cycles;
+    bool level;
+} edge_t;
+
+static struct {
+    uint32_t n;
+    edge_t edge[N_EDGES];
+} x_step, x_dir;
+
+static stepper_t st;
+static uint32_t tick, n_steps, cycles_per_tick;
+static bool idle;
+static limit_signals_t limits;
+static uint32_t limits_calls;
+static control_signals_t control;
+static uint32_t control_calls;
+static uint32_t aux_calls;
+static bool aux_state;
+
+static void record (GPIO_TypeDef *port, uint16_t changed, uint16_t odr, uint64_t cycles)
+{
+    if(port == STEP_PORT && (changed & X_STEP_BIT) && x_step.n < N_EDGES)
+        x_step.edge[x_step.n++] = (edge_t){ .cycles = cycles, .level = !!(odr & X_STEP_BIT) };
+    if(port == DIRECTION_PORT && (changed & X_DIRECTION_BIT) && x_dir.n < N_EDGES)
+        x_dir.edge[x_dir.n++] = (edge_t){ .cycles = cycles, .level = !!(odr & X_DIRECTION_BIT) };
+}
+
+// Stands in for the core stepper interrupt: the step pulse calculated in the previous tick is output first,
+// then the bits for the next tick are calculated. The first tick after wake up only calculates, the tick
+// that outputs the last step goes idle.
+static void stepper_interrupt (void)
+{
+    if(tick) {
+        hal.stepper.pulse_start(&st);
+        st.dir_change = false;
+    } else {
+        hal.stepper.cycles_per_tick(cycles_per_tick);
+        st.dir_change = true;
+        st.dir_outbits.x = On;
+    }
+
+    if(tick++ == n_steps) {
+        hal.stepper.go_idle(false);
+        idle = true;
+    } else
+        st.step_outbits.x = On;
+}
+
+static bool is_idle (void)
+{
+    return idle;
+}
+
+static void limits_interrupt (limit_signals_t state)
+{
+    limits = state;
+    limits_calls++;
+}
+
+static void control_interrupt (control_signals_t signals)
+{
+    control = signals;
+    control_calls++;
+}
+
+static void aux_interrupt (uint8_t port, bool state)
+{
+    aux_state = state;
+    aux_calls++;
+}
+
+static void apply_settings (void)
+{
+    hal.settings_changed(&settings, (settings_changed_flags_t){0});
+}
+
+// Outputs steps X axis step pulses, ticks_per_step stepper timer ticks apart.
+static bool run_steps (uint32_t steps, uint32_t ticks_per_step)
+{
+    bool ok;
+
+    memset(&st, 0, sizeof(stepper_t));
+    memset(&x_step, 0, sizeof(x_step));
+    memset(&x_dir, 0, sizeof(x_dir));
+    tick = 0;
+    idle = false;
+    n_steps = steps;
+    cycles_per_tick = ticks_per_step - 1;
+
+    // The first tick is 2 ms after wake up
+    hal.stepper.wake_up();
+    ok = sim_run_until(is_idle, 2000 + (steps + 1) * (ticks_per_step / (hal.f_step_timer / 1000000UL)));
+    sim_run_us(100); // Let the last pulse end
+
+    return ok;
+}
+
+// The step rate is set by the stepper timer, the pulse length by the pulse timer or by the CC1 match
+// with step DMA. The direction output changes ahead of the first step pulse.
+static int test_step_timing (void)
+{
+    uint32_t idx;
+
+    CHECK(run_steps(10, hal.f_step_timer / 1000));  // 1 kHz step rate
+
+    CHECK(x_dir.n == 1 && x_dir.edge[0].level);
+    CHECK(x_step.n == 2 * 10);
+    CHECK(x_dir.edge[0].cycles < x_step.edge[0].cycles);
+
+    for(idx = 0; idx < x_step.n; idx += 2) {
+        float width = US(x_step.edge[idx + 1].cycles - x_step.edge[idx].cycles);
+        CHECK(x_step.edge[idx].level && !x_step.edge[idx + 1].level);
+#if STEP_DMA_ENABLE
+        // The first pulse is started by the stepper interrupt, the following ones by the update event.
+        CHECK(width > (idx ? 9.9f : 9.0f) && width < 10.1f);
+#else
+        CHECK(width > 9.0f && width < 10.5f);
+#endif
+        if(idx) {
+            float interval = US(x_step.edge[idx].cycles - x_step.edge[idx - 2].cycles);
+#if STEP_DMA_ENABLE
+            CHECK(interval > (idx > 2 ? 999.9f : 998.0f) && interval < 1000.1f);
+#else
+            CHECK(interval > 998.0f && interval < 1002.0f);
+#endif
+        }
+    }
+
+    CHECK(!sim_pin_level(STEP_PORT, X_STEP_BIT));
+
+    // With step DMA the timer stops at the end of the last tick
+    sim_run_us(1000);
+    CHECK(!(STEPPER_TIMER->CR1 & TIM_CR1_CEN));
+    CHECK(tick == 11);
+
+    return 0;
+}
+
+// Inverted step outputs idle high and output low going pulses.
+static int test_step_invert (void)
+{
+    settings.steppers.step_invert.x = On;
+    apply_settings();
+
+    CHECK(sim_pin_level(STEP_PORT, X_STEP_BIT));
+
+    CHECK(run_steps(2, hal.f_step_timer / 2000));
+
+    CHECK(x_step.n == 4);
+    CHECK(!x_step.edge[0].level && x_step.edge[1].level);
+    CHECK(sim_pin_level(STEP_PORT, X_STEP_BIT));
+
+    settings.steppers.step_invert.x = Off;
+    apply_settings();
+
+    CHECK(!sim_pin_level(STEP_PORT, X_STEP_BIT));
+
+    return 0;
+}
+
+// With a step pulse delay the first step pulse after a direction change starts the delay later.
+static int test_step_delay (void)
+{
+    settings.steppers.pulse_delay_microseconds = 5.0f;
+    apply_settings();
+
+    CHECK(run_steps(2, hal.f_step_timer / 2000));
+
+    CHECK(x_dir.n == 1 && x_step.n == 4);
+    CHECK(US(x_step.edge[0].cycles - x_dir.edge[0].cycles) >= 4.0f);
+    CHECK(US(x_step.edge[1].cycles - x_step.edge[0].cycles) > 9.0f);
+
+    settings.steppers.pulse_delay_microseconds = 0.0f;
+    apply_settings();
+
+    return 0;
+}
+
+static int test_stepper_enable (void)
+{
+    hal.stepper.enable((axes_signals_t){AXES_BITMASK});
+    CHECK(sim_pin_level(STEPPERS_ENABLE_PORT, STEPPERS_ENABLE_BIT));
+
+    hal.stepper.enable((axes_signals_t){0});
+    CHECK(!sim_pin_level(STEPPERS_ENABLE_PORT, STEPPERS_ENABLE_BIT));
+
+    settings.steppers.enable_invert.mask = AXES_BITMASK;
+    hal.stepper.enable((axes_signals_t){AXES_BITMASK});
+    CHECK(!sim_pin_level(STEPPERS_ENABLE_PORT, STEPPERS_ENABLE_BIT));
+    settings.steppers.enable_invert.mask = 0;
+
+    return 0;
+}
+
+// Limit switches are normally closed to ground, a triggered switch releases the input
+// which is pulled up. The interrupt is debounced.
+static int test_limits (void)
+{
+    uint32_t calls;
+
+    sim_pin_drive(LIMIT_PORT, Y_LIMIT_BIT, false);
+    sim_pin_drive(LIMIT_PORT, X_LIMIT_BIT, false);
+    sim_pin_drive(LIMIT_PORT, Z_LIMIT_BIT, false);
+
+    settings.limits.flags.hard_enabled = On;
+    settings.limits.invert.mask = 0;
+    apply_settings();
+
+    CHECK(hal.limits.get_state().min.mask == 0);
+
+    calls = limits_calls;
+    sim_pin_release(LIMIT_PORT, Y_LIMIT_BIT);
+    CHECK(limits_calls == calls);   // Debouncing
+    sim_run_us(39000);
+    CHECK(limits_calls == calls);
+    sim_run_us(2000);
+    CHECK(limits_calls == calls + 1 && limits.min.mask == Y_AXIS_BIT);
+    CHECK(hal.limits.get_state().min.mask == Y_AXIS_BIT);
+
+    // A switch bouncing back within the debounce time does not trigger
+    sim_pin_drive(LIMIT_PORT, Y_LIMIT_BIT, false);
+    calls = limits_calls;
+    sim_pin_release(LIMIT_PORT, X_LIMIT_BIT);
+    sim_run_us(1000);
+    sim_pin_drive(LIMIT_PORT, X_LIMIT_BIT, false);
+    sim_run_us(50000);
+    CHECK(limits_calls == calls);
+
+    // No interrupts when hard limits are disabled
+    hal.limits.enable(false, (axes_signals_t){0});
+    sim_pin_release(LIMIT_PORT, Z_LIMIT_BIT);
+    sim_run_us(50000);
+    CHECK(limits_calls == calls);
+    CHECK(hal.limits.get_state().min.mask == Z_AXIS_BIT);
+
+    sim_pin_drive(LIMIT_PORT, Z_LIMIT_BIT, false);
+    settings.limits.flags.hard_enabled = Off;
+    apply_settings();
+
+    return 0;
+}
+
+// Control inputs are pulled up and active low when inverted, a change calls the core immediately.
+static int test_control (void)
+{
+    uint32_t calls;
+
+    settings.control_invert.mask = 0;
+    settings.control_invert.reset = settings.control_invert.feed_hold = settings.control_invert.cycle_start = On;
+    apply_settings();
+
+    CHECK((hal.control.get_state().mask & 0x07) == 0);
+
+    calls = control_calls;
+    sim_pin_drive(CONTROL_PORT, FEED_HOLD_BIT, false);
+    CHECK(control_calls == calls + 1 && control.feed_hold && !control.reset && !control.cycle_start);
+    sim_pin_release(CONTROL_PORT, FEED_HOLD_BIT);
+    CHECK(control_calls == calls + 1);  // Falling edge only
+
+    sim_pin_drive(CONTROL_PORT, CYCLE_START_BIT, false);
+    CHECK(control_calls == calls + 2 && control.cycle_start && !control.feed_hold);
+    sim_pin_release(CONTROL_PORT, CYCLE_START_BIT);
+
+    // Not inverted the input is active high, the pull-up asserts it
+    settings.control_invert.reset = Off;
+    apply_settings();
+    CHECK(hal.control.get_state().reset);
+
+    settings.control_invert.reset = On;
+    apply_settings();
+    CHECK(!hal.control.get_state().reset);
+
+    return 0;
+}
+
+static int test_coolant (void)
+{
+    hal.coolant.set_state((coolant_state_t){ .flood = On });
+    CHECK(sim_pin_level(COOLANT_FLOOD_PORT, COOLANT_FLOOD_BIT) && !sim_pin_level(COOLANT_MIST_PORT, COOLANT_MIST_BIT));
+    CHECK(hal.coolant.get_state().flood && !hal.coolant.get_state().mist);
+
+    settings.coolant_invert.mask = 0;
+    settings.coolant_invert.mist = On;
+    hal.coolant.set_state((coolant_state_t){ .flood = On });
+    CHECK(sim_pin_level(COOLANT_FLOOD_PORT, COOLANT_FLOOD_BIT) && sim_pin_level(COOLANT_MIST_PORT, COOLANT_MIST_BIT));
+    CHECK(hal.coolant.get_state().flood && !hal.coolant.get_state().mist);
+
+    hal.coolant.set_state((coolant_state_t){0});
+    CHECK(!sim_pin_level(COOLANT_FLOOD_PORT, COOLANT_FLOOD_BIT) && sim_pin_level(COOLANT_MIST_PORT, COOLANT_MIST_BIT));
+    CHECK(hal.coolant.get_state().value == 0);
+    settings.coolant_invert.mask = 0;
+
+    return 0;
+}
+
+static int test_probe (void)
+{
+    hal.probe.configure(false, false);
+
+    sim_pin_drive(PROBE_PORT, PROBE_BIT, true);
+    CHECK(hal.probe.get_state().triggered);
+    sim_pin_drive(PROBE_PORT, PROBE_BIT, false);
+    CHECK(!hal.probe.get_state().triggered);
+
+    // Probing away from the workpiece inverts the trigger level
+    hal.probe.configure(true, true);
+    CHECK(hal.probe.get_state().triggered);
+
+    settings.probe.invert_probe_pin = On;
+    hal.probe.configure(false, true);
+    CHECK(hal.probe.get_state().triggered);
+
+    settings.probe.invert_probe_pin = Off;
+    hal.probe.configure(false, false);
+    sim_pin_release(PROBE_PORT, PROBE_BIT);
+
+    return 0;
+}
+
+// Aux outputs, the invert setting is applied to the output and when it is changed.
+static int test_aux_out (void)
+{
+    CHECK(hal.port.num_digital_out == 3);
+
+    hal.port.digital_out(0, true);
+    hal.port.digital_out(2, true);
+    CHECK(sim_pin_level(AUXOUTPUT0_PORT, AUXOUTPUT0_BIT));
+    CHECK(!sim_pin_level(AUXOUTPUT1_PORT, AUXOUTPUT1_BIT));
+    CHECK(sim_pin_level(AUXOUTPUT2_PORT, AUXOUTPUT2_BIT));
+
+    settings.ioport.invert_out.mask = 0b010;
+    setting_changed(Settings_IoPort_InvertOut);
+    CHECK(sim_pin_level(AUXOUTPUT1_PORT, AUXOUTPUT1_BIT));
+
+    hal.port.digital_out(1, true);
+    CHECK(!sim_pin_level(AUXOUTPUT1_PORT, AUXOUTPUT1_BIT));
+
+    hal.port.digital_out(0, false);
+    hal.port.digital_out(2, false);
+    CHECK(!sim_pin_level(AUXOUTPUT0_PORT, AUXOUTPUT0_BIT));
+    CHECK(!sim_pin_level(AUXOUTPUT2_PORT, AUXOUTPUT2_BIT));
+
+    settings.ioport.invert_out.mask = 0;
+    setting_changed(Settings_IoPort_InvertOut);
+    CHECK(sim_pin_level(AUXOUTPUT1_PORT, AUXOUTPUT1_BIT));
+    hal.port.digital_out(1, false);
+
+    return 0;
+}
+
+// Aux input, read immediately and by interrupt.
+static int test_aux_in (void)
+{
+    CHECK(hal.port.num_digital_in == 1);
+
+    CHECK(hal.port.wait_on_input(Port_Digital, 0, WaitMode_Immediate, 0.0f) == 1);  // Pulled up
+    sim_pin_drive(AUXINPUT0_PORT, AUXINPUT0_BIT, false);
+    CHECK(hal.port.wait_on_input(Port_Digital, 0, WaitMode_Immediate, 0.0f) == 0);
+
+    aux_calls = 0;
+    CHECK(hal.port.register_interrupt_handler(0, IRQ_Mode_Rising, aux_interrupt));
+    sim_pin_drive(AUXINPUT0_PORT, AUXINPUT0_BIT, true);
+    CHECK(aux_calls == 1 && aux_state);
+    sim_pin_drive(AUXINPUT0_PORT, AUXINPUT0_BIT, false);
+    CHECK(aux_calls == 1);
+
+    CHECK(!hal.port.register_interrupt_handler(0, IRQ_Mode_None, NULL));
+    sim_pin_drive(AUXINPUT0_PORT, AUXINPUT0_BIT, true);
+    CHECK(aux_calls == 1);
+
+    sim_pin_release(AUXINPUT0_PORT, AUXINPUT0_BIT);
+
+    return 0;
+}
+
+int main (void)
+{
+    sim_init();
+
+    if(!driver_init()) {
+        printf("driver_init() failed\n");
+        return 1;
+    }
+
+    sim_on_gpio_output = record;
+    hal.stepper.interrupt_callback = stepper_interrupt;
+    hal.limits.interrupt_callback = limits_interrupt;
+    hal.control.interrupt_callback = control_interrupt;
+
+    settings_loaded();
+
+    if(!hal.driver_setup(&settings)) {
+        printf("driver_setup() failed\n");
+        return 1;
+    }
+
+    return test_step_timing() ||
+            test_step_invert() ||
+             test_step_delay() ||
+              test_stepper_enable() ||
+               test_limits() ||
+                test_control() ||
+                 test_coolant() ||
+                  test_probe() ||
+                   test_aux_out() ||
+                    test_aux_in();
+}
@@ -0,0 +1,134 @@
+/*
+
+  test_ringbuf.c - ring buffer helper tests and throughput benchmark
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <time.h>
+
+#include "ringbuf.h"
+
+#define CHECK(c) if(!(c)) { printf("%s:%d: %s failed\n", __FILE__, __LINE__, #c); return 1; }
+
+typedef struct {
+    volatile uint_fast16_t head;
+    volatile uint_fast16_t tail;
+    char data[16];
+} test_buffer_t;
+
+static int test_put_get (void)
+{
+    char out[16];
+    test_buffer_t buf = {0};
+
+    CHECK(ringbuf_count(&buf) == 0);
+    CHECK(ringbuf_free(&buf) == 15);
+
+    CHECK(ringbuf_write(&buf, "0123456789abcdefXYZ", 19) == 15);   // One slot is always kept free
+    CHECK(ringbuf_count(&buf) == 15 && ringbuf_free(&buf) == 0);
+    CHECK(ringbuf_write(&buf, "X", 1) == 0);
+
+    CHECK(ringbuf_read(&buf, out, 10) == 10);
+    CHECK(memcmp(out, "0123456789", 10) == 0);
+
+    // Wraps around the end of the data array
+    CHECK(ringbuf_write(&buf, "ghijklmn", 8) == 8);
+    CHECK(buf.head == 7);
+    CHECK(ringbuf_read(&buf, out, sizeof(out)) == 13);
+    CHECK(memcmp(out, "abcdeghijklmn", 13) == 0);
+    CHECK(ringbuf_count(&buf) == 0);
+
+    return 0;
+}
+
+static int test_peek_skip (void)
+{
+    char *ptr;
+    test_buffer_t buf = {0};
+
+    buf.head = buf.tail = 12;
+    CHECK(ringbuf_write(&buf, "abcdefgh", 8) == 8);
+
+    // Contiguous part up to the end of the data array first, then the rest
+    CHECK(ringbuf_contiguous(&buf, &ptr) == 4);
+    CHECK(memcmp(ptr, "abcd", 4) == 0);
+    ringbuf_skip(&buf, 4);
+    CHECK(ringbuf_contiguous(&buf, &ptr) == 4);
+    CHECK(memcmp(ptr, "efgh", 4) == 0);
+    // Must be usable as a single statement
+    if(ringbuf_count(&buf) == 4)
+        ringbuf_skip(&buf, 4);
+    else
+        return 1;
+    CHECK(ringbuf_count(&buf) == 0);
+
+    return 0;
+}
+
+// Interleaved writes and reads of varying lengths, data must come out in order.
+static int test_sequence (void)
+{
+    char in[7], out[5];
+    uint32_t idx, n, i, w = 0, r = 0;
+    test_buffer_t buf = {0};
+
+    for(idx = 0; idx < 10000; idx++) {
+        for(n = 0; n < 1 + idx % 7; n++)
+            in[n] = (char)(w + n);
+        w += ringbuf_write(&buf, in, 1 + idx % 7);
+        n = ringbuf_read(&buf, out, 1 + idx % 5);
+        for(i = 0; i < n; i++)
+            CHECK(out[i] == (char)r++);
+        CHECK(ringbuf_count(&buf) == w - r);
+    }
+
+    return 0;
+}
+
+static void benchmark (void)
+{
+    static struct {
+        volatile uint_fast16_t head;
+        volatile uint_fast16_t tail;
+        char data[1024];
+    } buf;
+
+    char chunk[64];
+    uint32_t total = 0;
+    clock_t start = clock();
+
+    memset(chunk, 'G', sizeof(chunk));
+
+    while(total < 256 * 1024 * 1024) {
+        total += ringbuf_write(&buf, chunk, sizeof(chunk));
+        ringbuf_read(&buf, chunk, sizeof(chunk));
+    }
+
+    printf("ringbuf: %.0f MB/s\n", (double)total / 1048576.0 / ((double)(clock() - start) / CLOCKS_PER_SEC));
+}
+
+int main (void)
+{
+    if(test_put_get() || test_peek_skip() || test_sequence())
+        return 1;
+
+    benchmark();
+
+    return 0;
+}
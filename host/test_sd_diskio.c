@@ -0,0 +1,296 @@
+/*
+
+  test_sd_diskio.c - SD card disk I/O tests, FatFs on a simulated card with asynchronous DMA transfers
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver.h"
+#include "ff_gen_drv.h"
+#include "sd_diskio.h"
+
+#define CHECK(c) if(!(c)) { printf("%s:%d: %s failed\n", __FILE__, __LINE__, #c); return 1; }
+
+#define CARD_BLOCKS (16 * 2048)
+#define JOB_LINES   20000
+
+// Simulated card, a transfer completes a few ms after it is started and the card is
+// busy programming for a while after a write. The card state is not to be read while
+// a transfer is active, doing so is counted as a violation.
+
+SD_HandleTypeDef hsd1;
+
+static uint8_t card[CARD_BLOCKS * 512];
+static uint32_t ticks, programming;
+static uint32_t violations;
+
+static struct {
+    bool active, read;
+    uint32_t *data, block, count, done;
+} xfer;
+
+static void xfer_complete (void)
+{
+    if(xfer.active && ticks >= xfer.done) {
+        xfer.active = false;
+        if(xfer.read) {
+            memcpy(xfer.data, card + xfer.block * 512, xfer.count * 512);
+            BSP_SD_ReadCpltCallback();
+        } else {
+            memcpy(card + xfer.block * 512, xfer.data, xfer.count * 512);
+            programming = ticks + 3;
+            BSP_SD_WriteCpltCallback();
+        }
+    }
+}
+
+static uint8_t xfer_start (uint32_t *data, uint32_t block, uint32_t count, bool read)
+{
+    // Disk access from thread mode must hold the FatFs grant, i.e. have PendSV masked.
+    if(xfer.active || ticks < programming || block + count > CARD_BLOCKS || (sim_ipsr == 0 && sim_basepri == 0))
+        violations++;
+
+    xfer.active = true;
+    xfer.read = read;
+    xfer.data = data;
+    xfer.block = block;
+    xfer.count = count;
+    xfer.done = ticks + 1 + rand() % 8;
+
+    return MSD_OK;
+}
+
+// SysTick only advances when it is not masked by BASEPRI, a disk I/O timeout loop spinning
+// on a frozen tick would never end and fails the test instead.
+uint32_t HAL_GetTick (void)
+{
+    static uint32_t frozen = 0;
+
+    if(sim_ipsr == 0 && sim_basepri && (sim_systick_priority << (8U - __NVIC_PRIO_BITS)) >= sim_basepri) {
+        if(++frozen == 1000000) {
+            printf("%s:%d: SysTick masked while waiting on the card\n", __FILE__, __LINE__);
+            exit(1);
+        }
+    } else {
+        frozen = 0;
+        ticks++;
+        xfer_complete();
+    }
+
+    return ticks;
+}
+
+HAL_SD_StateTypeDef HAL_SD_GetState (SD_HandleTypeDef *hsd)
+{
+    return xfer.active ? HAL_SD_STATE_BUSY : HAL_SD_STATE_READY;
+}
+
+HAL_SD_CardStateTypeDef HAL_SD_GetCardState (SD_HandleTypeDef *hsd)
+{
+    if(xfer.active) {
+        violations++;
+        return xfer.read ? HAL_SD_CARD_SENDING : HAL_SD_CARD_RECEIVING;
+    }
+
+    return ticks < programming ? HAL_SD_CARD_PROGRAMMING : HAL_SD_CARD_TRANSFER;
+}
+
+HAL_StatusTypeDef HAL_SD_Abort (SD_HandleTypeDef *hsd)
+{
+    xfer.active = false;
+
+    return HAL_OK;
+}
+
+uint8_t BSP_SD_Init (void)
+{
+    return MSD_OK;
+}
+
+uint8_t BSP_SD_GetCardState (void)
+{
+    return HAL_SD_GetCardState(&hsd1) == HAL_SD_CARD_TRANSFER ? SD_TRANSFER_OK : SD_TRANSFER_BUSY;
+}
+
+void BSP_SD_GetCardInfo (BSP_SD_CardInfo *info)
+{
+    memset(info, 0, sizeof(BSP_SD_CardInfo));
+    info->BlockNbr = info->LogBlockNbr = CARD_BLOCKS;
+    info->BlockSize = info->LogBlockSize = 512;
+}
+
+uint8_t BSP_SD_ReadBlocks_DMA (uint32_t *data, uint32_t block, uint32_t count)
+{
+    return xfer_start(data, block, count, true);
+}
+
+uint8_t BSP_SD_WriteBlocks_DMA (uint32_t *data, uint32_t block, uint32_t count)
+{
+    return xfer_start(data, block, count, false);
+}
+
+DWORD get_fattime (void)
+{
+    return 0;
+}
+
+#if !SDCARD_WRITEBEHIND
+void SD_WriteBehindPoll (void)
+{
+}
+#endif
+
+static char path[4];
+static FATFS fs;
+
+static void job_line (char *line, uint32_t n)
+{
+    sprintf(line, "N%u G1 X%u Y%u\n", n, n * 7 % 1000, n * 13 % 1000);
+}
+
+static int test_mount (void)
+{
+    static BYTE work[4096];
+    MKFS_PARM opt = { FM_ANY, 0, 0, 0, 0 };
+
+    CHECK(FATFS_LinkDriver(&SD_Driver, path) == 0);
+    // Mounting creates the grant and raises SysTick above the level it masks.
+    CHECK(f_mount(&fs, path, 1) == FR_NO_FILESYSTEM);
+    CHECK(sim_systick_priority < (1UL << __NVIC_PRIO_BITS) - 1UL);
+
+    sim_basepri = 0xF0; // f_mkfs() does not lock the volume
+    CHECK(f_mkfs(path, &opt, work, sizeof(work)) == FR_OK);
+    sim_basepri = 0;
+    CHECK(f_mount(&fs, path, 1) == FR_OK);
+
+    return 0;
+}
+
+static int test_write_job (void)
+{
+    FIL file;
+    UINT n, len;
+    uint32_t idx;
+    char line[64];
+
+    CHECK(f_open(&file, "job.nc", FA_CREATE_ALWAYS|FA_WRITE) == FR_OK);
+    for(idx = 0; idx < JOB_LINES; idx++) {
+        job_line(line, idx);
+        len = strlen(line);
+        CHECK(f_write(&file, line, len, &n) == FR_OK && n == len);
+        if(rand() % 4 == 0)
+            SD_WriteBehindPoll();
+    }
+    CHECK(f_close(&file) == FR_OK);
+
+    return 0;
+}
+
+// Streams the job line by line with f_gets() while another file is written, as a job
+// that logs to the card does, and checks every line.
+static int test_stream_job (void)
+{
+    FIL job, log;
+    UINT n;
+    uint32_t idx;
+    char line[64], expected[64];
+
+    CHECK(f_open(&job, "job.nc", FA_READ) == FR_OK);
+    CHECK(f_open(&log, "log.txt", FA_CREATE_ALWAYS|FA_WRITE) == FR_OK);
+
+    for(idx = 0; f_gets(line, sizeof(line), &job); idx++) {
+        job_line(expected, idx);
+        CHECK(strcmp(line, expected) == 0);
+        if(idx % 20 == 0)
+            CHECK(f_write(&log, line, strlen(line), &n) == FR_OK);
+        if(idx % 400 == 0)
+            CHECK(f_sync(&log) == FR_OK);
+        SD_WriteBehindPoll();
+    }
+
+    CHECK(idx == JOB_LINES && !f_error(&job));
+    CHECK(f_close(&job) == FR_OK);
+    CHECK(f_close(&log) == FR_OK);
+
+    return 0;
+}
+
+static bool on_card (const char *sector)
+{
+    uint32_t block;
+
+    for(block = 0; block < CARD_BLOCKS; block++) {
+        if(memcmp(card + block * 512, sector, 512) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+// Initializing the card again writes queued sectors first as long as the card responds.
+static int test_reinit (void)
+{
+    FIL file;
+    UINT n;
+    char sector[512];
+
+    memset(sector, ' ', sizeof(sector));
+    memcpy(sector, "(queued sector)", 15);
+
+    CHECK(f_open(&file, "queued.nc", FA_CREATE_ALWAYS|FA_WRITE) == FR_OK);
+    CHECK(f_write(&file, sector, sizeof(sector), &n) == FR_OK && n == sizeof(sector));
+    CHECK(!on_card(sector));
+
+    sim_basepri = 0xF0;
+    CHECK(SD_Driver.disk_initialize(0) == 0);
+    sim_basepri = 0;
+
+    CHECK(on_card(sector));
+    CHECK(f_close(&file) == FR_OK);
+
+    return 0;
+}
+
+// File functions called from an interrupt handler, e.g. the PendSV serviced file services,
+// are granted access without masking, foreground calls restore BASEPRI when done.
+static int test_grant (void)
+{
+    FILINFO info;
+
+    sim_ipsr = 14; // PendSV
+    CHECK(f_stat("job.nc", &info) == FR_OK && sim_basepri == 0);
+    sim_ipsr = 0;
+    CHECK(f_stat("job.nc", &info) == FR_OK && sim_basepri == 0);
+
+    return 0;
+}
+
+int main (void)
+{
+    srand(1);
+
+    if(test_mount() || test_write_job() || test_stream_job() || test_reinit() || test_grant())
+        return 1;
+
+    CHECK(violations == 0);
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+/*
+
+  test_serial.c - serial stream tests of serial.c against the simulated USART
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "driver.h"
+#include "mcu_sim.h"
+
+#define CHECK(c) if(!(c)) { printf("%s:%d: %s failed\n", __FILE__, __LINE__, #c); return 1; }
+
+#define CHAR_US (10.0f * 1000000.0f / (float)BAUD_RATE) // 8N1
+
+static char rt_commands[16];
+static uint32_t n_rt_commands;
+
+static bool enqueue_rt_command (char c)
+{
+    bool rt = c == CMD_STATUS_REPORT || c == CMD_FEED_HOLD;
+
+    if(rt && n_rt_commands < sizeof(rt_commands))
+        rt_commands[n_rt_commands++] = c;
+
+    return rt;
+}
+
+static bool tx_done (void)
+{
+    return hal.stream.get_tx_buffer_count() == 0 && (USART3->ISR & USART_ISR_TC);
+}
+
+// Characters are output back to back at the baud rate.
+static int test_write (void)
+{
+    static const char msg[] = "ok\r\n[MSG:Hello]\r\n";
+    char out[64];
+    uint64_t start = sim_cycles, last;
+    uint32_t n;
+
+    hal.stream.write(msg);
+    CHECK(sim_run_until(tx_done, 10000));
+
+    n = sim_uart_transmitted(USART3, out, sizeof(out), &last);
+    CHECK(n == strlen(msg) && !memcmp(out, msg, n));
+    CHECK((float)(last - start) / (float)SIM_CYCLES_PER_US < (n + 1) * CHAR_US);
+    CHECK((float)(last - start) / (float)SIM_CYCLES_PER_US > n * CHAR_US);
+
+    return 0;
+}
+
+// Output exceeding the buffer size blocks until there is space, nothing is lost.
+static int test_write_blocking (void)
+{
+    static char msg[TX_BUFFER_SIZE * 2 + 1], out[TX_BUFFER_SIZE * 2];
+    uint32_t idx, n = 0;
+
+    for(idx = 0; idx < TX_BUFFER_SIZE * 2; idx++)
+        msg[idx] = 'A' + idx % 26;
+
+    hal.stream.write(msg);
+    CHECK(sim_run_until(tx_done, (uint32_t)(TX_BUFFER_SIZE * 2 * CHAR_US) + 1000));
+
+    while(n < sizeof(out) && (idx = sim_uart_transmitted(USART3, out + n, sizeof(out) - n, NULL)))
+        n += idx;
+    CHECK(n == TX_BUFFER_SIZE * 2 && !memcmp(out, msg, n));
+
+    return 0;
+}
+
+// Realtime commands are stripped from the input and passed on immediately.
+static int test_read (void)
+{
+    static const char in[] = "G0 X1?\nG1!Y2\n";
+    char line[16];
+    uint32_t n = 0;
+    int16_t c;
+
+    n_rt_commands = 0;
+    sim_uart_receive(USART3, in, strlen(in));
+    sim_run_us((uint32_t)(strlen(in) * CHAR_US) + 500);
+
+    CHECK(n_rt_commands == 2 && rt_commands[0] == CMD_STATUS_REPORT && rt_commands[1] == CMD_FEED_HOLD);
+    CHECK(hal.stream.get_rx_buffer_count() == strlen(in) - 2);
+
+    while((c = hal.stream.read()) != SERIAL_NO_DATA && n < sizeof(line) - 1)
+        line[n++] = (char)c;
+    line[n] = '\0';
+
+    CHECK(!strcmp(line, "G0 X1\nG1Y2\n"));
+    CHECK(hal.stream.get_rx_buffer_count() == 0);
+
+    return 0;
+}
+
+// Input below the FIFO threshold is delivered when the line goes idle.
+static int test_read_idle (void)
+{
+    sim_uart_receive(USART3, "$$\n", 3);
+
+    sim_run_us((uint32_t)(3.0f * CHAR_US) + 10);
+    CHECK(hal.stream.get_rx_buffer_count() == 0);
+
+    sim_run_us((uint32_t)(3.0f * CHAR_US));   // Receiver timeout is 20 bit times
+    CHECK(hal.stream.get_rx_buffer_count() == 3);
+    CHECK(hal.stream.read() == '$' && hal.stream.read() == '$' && hal.stream.read() == '\n');
+
+    return 0;
+}
+
+// Input is discarded by cancelling the read buffer, it is replaced by a CAN character.
+static int test_cancel (void)
+{
+    sim_uart_receive(USART3, "G0 X10\n", 7);
+    sim_run_us((uint32_t)(7.0f * CHAR_US) + 500);
+    CHECK(hal.stream.get_rx_buffer_count() == 7);
+
+    hal.stream.cancel_read_buffer();
+    CHECK(hal.stream.read() == ASCII_CAN && hal.stream.read() == SERIAL_NO_DATA);
+
+    return 0;
+}
+
+int main (void)
+{
+    sim_init();
+
+    if(!driver_init()) {
+        printf("driver_init() failed\n");
+        return 1;
+    }
+
+    hal.stream.set_enqueue_rt_handler(enqueue_rt_command);
+
+    return test_write() ||
+            test_write_blocking() ||
+             test_read() ||
+              test_read_idle() ||
+               test_cancel();
+}
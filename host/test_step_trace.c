@@ -0,0 +1,84 @@
+/*
+
+  test_step_trace.c - step trace capture tests against the simulated cycle counter
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "step_trace.h"
+
+#define CHECK(c) if(!(c)) { printf("%s:%d: %s failed\n", __FILE__, __LINE__, #c); return 1; }
+
+step_trace_t step_trace;
+
+static void arm (bool ring)
+{
+    memset(&step_trace, 0, sizeof(step_trace));
+    step_trace.ring = ring;
+    step_trace.armed = true;
+}
+
+static int test_timestamps (void)
+{
+    arm(false);
+
+    sim_dwt.CYCCNT = 1000;
+    STEP_TRACE(StepTrace_Dir, 0x02);
+    sim_clock_advance(480);
+    STEP_TRACE(StepTrace_StepOn, 0x03);
+    step_trace_add_at(StepTrace_StepOff, 0, sim_dwt.CYCCNT + 960);
+
+    CHECK(step_trace.head == 3 && !step_trace.wrapped);
+    CHECK(step_trace.entry[0].cycles == 1000 && step_trace.entry[0].event == StepTrace_Dir && step_trace.entry[0].bits == 0x02);
+    CHECK(step_trace.entry[1].cycles == 1480 && step_trace.entry[1].event == StepTrace_StepOn && step_trace.entry[1].bits == 0x03);
+    CHECK(step_trace.entry[2].cycles == 2440 && step_trace.entry[2].event == StepTrace_StepOff);
+
+    return 0;
+}
+
+// A single shot capture stops when full, a ring capture keeps overwriting the oldest entries.
+static int test_full (void)
+{
+    uint32_t idx;
+
+    arm(false);
+    for(idx = 0; idx < STEP_TRACE_SIZE + 5; idx++) {
+        sim_clock_advance(10);
+        STEP_TRACE(StepTrace_StepOn, idx);
+    }
+    CHECK(!step_trace.armed && step_trace.wrapped && step_trace.head == 0);
+    CHECK(step_trace.entry[STEP_TRACE_SIZE - 1].bits == STEP_TRACE_SIZE - 1);
+
+    arm(true);
+    for(idx = 0; idx < STEP_TRACE_SIZE + 5; idx++) {
+        sim_clock_advance(10);
+        STEP_TRACE(StepTrace_StepOn, idx);
+    }
+    CHECK(step_trace.armed && step_trace.wrapped && step_trace.head == 5);
+    CHECK(step_trace.entry[4].bits == STEP_TRACE_SIZE + 4);
+    CHECK(step_trace.entry[5].bits == 5);   // Oldest entry
+
+    return 0;
+}
+
+int main (void)
+{
+    return test_timestamps() || test_full();
+}
@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+#
+# netbench.py - host side driver for the network benchmark service (NETBENCH_ENABLE)
+#
+# Part of grblHAL
+#
+# Usage: netbench.py [--port N] [--time S] <host> <test> [test...]
+#
+# Tests:
+#   sink    TCP upload to the controller, data is discarded
+#   source  TCP download from the controller
+#   udp     UDP echo packet rate, see --size and --rate
+#   rtt     UDP round trip time, one packet in flight
+#   stats   output the controller statistics only
+#
+# Controller statistics are reset before and read back after each test.
+# Poll times are for the network poll handler (enet_poll or PendSV), load is
+# the share of CPU time used by it.
+#
+
+import argparse
+import select
+import socket
+import sys
+import time
+
+FIELDS = ('elapsed_ms', 'tcp', 'udp', 'retransmits', 'rx_pool_exhausted', 'poll')
+
+
+def command(args, cmd):
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as s:
+        s.settimeout(1.0)
+        for _ in range(3):
+            s.sendto(cmd, (args.host, args.port))
+            try:
+                data = s.recv(512).decode('ascii', 'replace').strip()
+            except socket.timeout:
+                continue
+            if data.startswith('[NETBENCH:'):
+                return dict(zip(FIELDS, data[10:-1].split('|')))
+    raise RuntimeError('no response from %s:%d' % (args.host, args.port))
+
+
+def report(name, result, stats):
+    tcp_rx, tcp_tx = stats['tcp'].split(',')
+    udp_rx, udp_tx = stats['udp'].split(',')
+    polls, mean, peak, load = stats['poll'].split(',')
+    print('%s: %s' % (name, result))
+    print('  controller: tcp rx %s tx %s bytes, udp rx %s tx %s, retransmits %s, rx pool exhausted %s'
+          % (tcp_rx, tcp_tx, udp_rx, udp_tx, stats['retransmits'], stats['rx_pool_exhausted']))
+    print('  poll: %s calls, mean %s us, max %s us, load %s%%' % (polls, mean, peak, load))
+
+
+def rate(nbytes, seconds):
+    return '%d bytes in %.2f s, %.2f Mbit/s' % (nbytes, seconds, nbytes * 8 / seconds / 1e6)
+
+
+def test_sink(args):
+    data = bytes(range(256)) * 256
+    total = 0
+    with socket.create_connection((args.host, args.port), timeout=5.0) as s:
+        start = time.monotonic()
+        while time.monotonic() - start < args.time:
+            s.sendall(data)
+            total += len(data)
+        s.shutdown(socket.SHUT_WR)
+        s.recv(1)
+        elapsed = time.monotonic() - start
+    return rate(total, elapsed)
+
+
+def test_source(args):
+    total = 0
+    with socket.create_connection((args.host, args.port + 1), timeout=5.0) as s:
+        start = time.monotonic()
+        while time.monotonic() - start < args.time:
+            data = s.recv(65536)
+            if not data:
+                break
+            total += len(data)
+        elapsed = time.monotonic() - start
+    return rate(total, elapsed)
+
+
+def test_udp(args):
+    payload = b'\0' * args.size
+    interval = 1.0 / args.rate if args.rate else 0.0
+    sent = received = 0
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as s:
+        s.setblocking(False)
+        s.connect((args.host, args.port))
+        start = next_tx = time.monotonic()
+        while time.monotonic() - start < args.time:
+            if time.monotonic() >= next_tx:
+                try:
+                    s.send(payload)
+                    sent += 1
+                except BlockingIOError:
+                    pass
+                next_tx += interval
+            while select.select([s], [], [], 0)[0]:
+                s.recv(2048)
+                received += 1
+        elapsed = time.monotonic() - start
+        deadline = time.monotonic() + 0.5
+        while time.monotonic() < deadline:
+            if select.select([s], [], [], 0.05)[0]:
+                s.recv(2048)
+                received += 1
+    return '%d sent, %d echoed (%.1f%% loss), %.0f packets/s' % (
+        sent, received, 100.0 * (sent - received) / sent if sent else 0.0, received / elapsed)
+
+
+def test_rtt(args):
+    times = []
+    lost = 0
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as s:
+        s.settimeout(0.5)
+        s.connect((args.host, args.port))
+        start = time.monotonic()
+        seq = 0
+        while time.monotonic() - start < args.time:
+            payload = seq.to_bytes(4, 'little') + b'\0' * max(0, args.size - 4)
+            t0 = time.perf_counter()
+            s.send(payload)
+            try:
+                while s.recv(2048)[:4] != payload[:4]:
+                    pass
+                times.append((time.perf_counter() - t0) * 1e6)
+            except socket.timeout:
+                lost += 1
+            seq += 1
+    if not times:
+        return 'no replies, %d lost' % lost
+    times.sort()
+    return '%d samples, %d lost, min %.0f us, mean %.0f us, p99 %.0f us, max %.0f us' % (
+        len(times), lost, times[0], sum(times) / len(times), times[int(len(times) * 0.99)], times[-1])
+
+
+TESTS = {
+    'sink': test_sink,
+    'source': test_source,
+    'udp': test_udp,
+    'rtt': test_rtt,
+}
+
+
+def main():
+    parser = argparse.ArgumentParser(description='grblHAL network benchmark')
+    parser.add_argument('host')
+    parser.add_argument('tests', nargs='+', choices=list(TESTS) + ['stats'])
+    parser.add_argument('--port', type=int, default=5001, help='NETBENCH_PORT, default 5001')
+    parser.add_argument('--time', type=float, default=10.0, help='test duration in seconds, default 10')
+    parser.add_argument('--size', type=int, default=64, help='UDP payload size, default 64')
+    parser.add_argument('--rate', type=float, default=1000.0, help='UDP packets/s, 0 for flat out, default 1000')
+    args = parser.parse_args()
+
+    try:
+        for name in args.tests:
+            if name == 'stats':
+                report(name, 'current', command(args, b'STAT'))
+                continue
+            command(args, b'RESET')
+            result = TESTS[name](args)
+            report(name, result, command(args, b'STAT'))
+    except (OSError, RuntimeError) as e:
+        print('error: %s' % e, file=sys.stderr)
+        return 1
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+#
+# steptrace.py - converts step traces captured with the $STEPTRACE command to VCD or CSV
+#
+# Part of grblHAL
+#
+# Input is either the binary file written by $STEPTRACE=SAVE or a text log of
+# the $STEPTRACE=DUMP output (other lines in the log are ignored).
+#
+# Usage: steptrace.py [--csv] <input> [output]
+#
+# Timestamps are 32-bit DWT cycle counts, wraparounds are unwrapped under the
+# assumption that consecutive events are less than 2^32 cycles apart.
+#
+
+import struct
+import sys
+
+MAGIC = 0x43525453
+HEADER = struct.Struct('<IHHIIII')
+ENTRY = struct.Struct('<IBBH')
+AXES = 'XYZABCUV'
+EVENTS = ('step_on', 'step_off', 'dir')
+
+
+def read_bin(data):
+    magic, version, entry_size, f_cpu, count, step_inv, dir_inv = HEADER.unpack_from(data, 0)
+    if magic != MAGIC or version != 1 or entry_size != ENTRY.size:
+        raise ValueError('not a step trace file')
+    entries = [ENTRY.unpack_from(data, HEADER.size + i * ENTRY.size)[:3] for i in range(count)]
+    return f_cpu, step_inv, dir_inv, entries
+
+
+def read_dump(text):
+    f_cpu = step_inv = dir_inv = None
+    entries = []
+    for line in text.splitlines():
+        line = line.strip()
+        if line.startswith('[STEPTRACE:') and f_cpu is None:
+            fields = line[11:-1].split('|')
+            f_cpu, step_inv, dir_inv = int(fields[0]), int(fields[2]), int(fields[3])
+        elif line.startswith('[STEPTRACED:'):
+            hexdata = line[12:-1]
+            for i in range(0, len(hexdata), 12):
+                entries.append((int(hexdata[i:i + 8], 16), int(hexdata[i + 8:i + 10], 16), int(hexdata[i + 10:i + 12], 16)))
+    if f_cpu is None:
+        raise ValueError('no $STEPTRACE=DUMP output found')
+    return f_cpu, step_inv, dir_inv, entries
+
+
+def unwrap(entries):
+    result, base, last = [], 0, None
+    for cycles, event, bits in entries:
+        if last is not None and cycles < last:
+            base += 1 << 32
+        last = cycles
+        result.append((base + cycles, event, bits))
+    if result:
+        t0 = result[0][0]
+        result = [(t - t0, e, b) for t, e, b in result]
+    return result
+
+
+def write_csv(out, f_cpu, entries):
+    out.write('time_us,delta_us,event,bits\n')
+    prev = 0
+    for t, event, bits in entries:
+        out.write('%.3f,%.3f,%s,0x%02X\n' % (t * 1e6 / f_cpu, (t - prev) * 1e6 / f_cpu, EVENTS[event], bits))
+        prev = t
+
+
+def write_vcd(out, f_cpu, step_inv, dir_inv, entries):
+    # Signal levels are logical (before inversion), inversion masks are recorded in the header comment
+    used = 0
+    for _, event, bits in entries:
+        used |= bits
+    axes = [i for i in range(len(AXES)) if used & (1 << i)] or [0, 1, 2]
+    out.write('$comment step_invert=0x%02X dir_invert=0x%02X f_cpu=%d $end\n' % (step_inv, dir_inv, f_cpu))
+    out.write('$timescale 1ns $end\n$scope module steppers $end\n')
+    for i in axes:
+        out.write('$var wire 1 s%d step_%s $end\n' % (i, AXES[i]))
+        out.write('$var wire 1 d%d dir_%s $end\n' % (i, AXES[i]))
+    out.write('$upscope $end\n$enddefinitions $end\n#0\n$dumpvars\n')
+    for i in axes:
+        out.write('0s%d\n0d%d\n' % (i, i))
+    out.write('$end\n')
+    for t, event, bits in entries:
+        out.write('#%d\n' % (t * 1000000000 // f_cpu))
+        for i in axes:
+            if event == 0 and bits & (1 << i):
+                out.write('1s%d\n' % i)
+            elif event == 1:
+                out.write('0s%d\n' % i)
+            elif event == 2:
+                out.write('%dd%d\n' % (1 if bits & (1 << i) else 0, i))
+
+
+def main(argv):
+    csv = '--csv' in argv
+    args = [a for a in argv[1:] if a != '--csv']
+    if not args:
+        sys.stderr.write('usage: steptrace.py [--csv] <input> [output]\n')
+        return 1
+    with open(args[0], 'rb') as f:
+        data = f.read()
+    if len(data) >= 4 and struct.unpack_from('<I', data, 0)[0] == MAGIC:
+        f_cpu, step_inv, dir_inv, entries = read_bin(data)
+    else:
+        f_cpu, step_inv, dir_inv, entries = read_dump(data.decode('ascii', 'replace'))
+    entries = unwrap(entries)
+    out = open(args[1], 'w') if len(args) > 1 else sys.stdout
+    if csv:
+        write_csv(out, f_cpu, entries)
+    else:
+        write_vcd(out, f_cpu, step_inv, dir_inv, entries)
+    if out is not sys.stdout:
+        out.close()
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))